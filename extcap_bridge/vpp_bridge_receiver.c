@@ -0,0 +1,686 @@
+/*
+ * vpp_bridge_receiver.c - native UDP receiver of the VPP extcap bridge
+ *
+ * Receives the datagrams of a VPP Wireshark bridge session and writes them
+ * to the Wireshark FIFO as pcap, in place of the Python receive and write
+ * threads of vpp_extcap_bridge.py, which launches it when it is found next
+ * to the script. Datagrams are taken in batches with recvmmsg into a large
+ * socket receive buffer, the pcap record headers of a whole batch are built
+ * into one array and written together with the packet bytes, still in the
+ * receive buffers, by as few writev calls as the iovec limit allows.
+ *
+ * Build (Linux), the second one with LZ4 support for compressing sessions:
+ *   cc -O2 -o vpp_bridge_receiver vpp_bridge_receiver.c
+ *   cc -O2 -DVPP_BRIDGE_RECEIVER_LZ4 -o vpp_bridge_receiver vpp_bridge_receiver.c -llz4
+ *
+ * Usage: vpp_bridge_receiver --fifo <path> --interface <sw_if_index>
+ *                            [--port <port>] [--rcvbuf <bytes>] [--pcapng] [--lz4]
+ *                            [--sequence]
+ *
+ * The bound port is printed on stdout as "port <n>" once the socket is
+ * ready, so --port 0 (the default) lets the kernel choose. Counters,
+ * including datagrams the kernel dropped for a full receive buffer, are
+ * printed on stderr on exit. With --sequence, for sessions enabled with
+ * "sequence", the sequence header of every datagram is checked and
+ * stripped, and lost packets are reported on stderr, at most once a
+ * second, split by where they were lost.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef VPP_BRIDGE_RECEIVER_LZ4
+#include <lz4.h>
+#endif
+
+#define RECEIVER_MAX_DATAGRAM_SIZE 65507      // Maximum UDP datagram size
+#define RECEIVER_BATCH_DATAGRAMS 64           // Datagrams taken by one recvmmsg call
+#define RECEIVER_DEFAULT_RCVBUF (64 << 20)    // Socket receive buffer, bytes
+#define RECEIVER_POLL_TIMEOUT_MS 100          // Checks for termination in between
+#define RECEIVER_WRITE_IOVS 1024              // iovecs written by one writev call
+
+/* Per-packet header sent by the VPP plugin, all fields big-endian */
+#define PACKET_HEADER_SIZE 21   // sw_if_index, timestamp, length, original length, direction
+#define DIRECTION_DROP 2        // Records of dropped packets carry the drop reason
+#define DROP_REASON_SIZE 4      // vlib error, between the header and the packet data
+
+/* Compression header of the datagrams of a compressing session */
+#define COMPRESSION_HEADER_SIZE 12  // magic, flags, reserved, uncompressed length, payload length
+#define COMPRESSION_MAGIC 0x575a
+#define COMPRESSION_FLAG_LZ4 1
+
+/* Sequence header of the datagrams of a sequenced session, inside the compression header */
+#define SEQUENCE_HEADER_SIZE 32  // magic, sender, reserved, sequence, records, socket drops,
+                                 // records before, ring drops
+#define SEQUENCE_MAGIC 0x5753
+#define SEQUENCE_MAX_SENDERS 256
+
+/* pcap file header, nanosecond timestamps, Ethernet */
+#define PCAP_MAGIC 0xa1b23c4d
+#define PCAP_SNAPLEN 65535
+#define PCAP_NETWORK 1
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t network;
+} pcap_file_header_t;
+
+typedef struct {
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t caplen;
+  uint32_t len;
+} pcap_record_header_t;
+
+typedef struct {
+  int fd;
+  struct iovec iovs[RECEIVER_WRITE_IOVS];
+  pcap_record_header_t headers[RECEIVER_WRITE_IOVS / 2];
+  int n_iovs;
+  int n_headers;
+} writer_t;
+
+/* Last datagram seen of one sender thread of a sequenced session */
+typedef struct {
+  uint8_t seen;
+  uint32_t next_sequence;
+  uint64_t next_record;
+  uint32_t socket_drops;
+  uint64_t ring_drops;
+} sequence_sender_t;
+
+typedef struct {
+  uint64_t datagrams;
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t filtered;
+  uint64_t malformed;
+  uint32_t kernel_drops;        // Cumulative SO_RXQ_OVFL count
+
+  /* Losses of a sequenced session */
+  sequence_sender_t senders[SEQUENCE_MAX_SENDERS];
+  uint64_t lost_datagrams;
+  uint64_t lost_records;
+  uint64_t socket_drops;        // Of the lost datagrams, dropped on the VPP socket
+  uint64_t ring_drops;          // Packets dropped in the VPP worker rings
+  uint64_t late;                // Reordered datagrams, counted as lost at first
+  time_t reported;
+} receiver_stats_t;
+
+static volatile sig_atomic_t receiver_stop;
+
+static void
+receiver_signal (int sig)
+{
+  (void) sig;
+  receiver_stop = 1;
+}
+
+static uint32_t
+get_be32 (const uint8_t *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint64_t
+get_be64 (const uint8_t *p)
+{
+  return ((uint64_t) get_be32 (p) << 32) | get_be32 (p + 4);
+}
+
+/**
+ * @brief Write all queued iovecs, resuming after partial writes
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+static int
+writer_flush (writer_t *w)
+{
+  struct iovec *iov = w->iovs;
+  int n = w->n_iovs;
+
+  while (n > 0)
+    {
+      ssize_t written = writev (w->fd, iov, n > IOV_MAX ? IOV_MAX : n);
+
+      if (written < 0)
+        {
+          if (errno == EINTR && !receiver_stop)
+            continue;
+          return -1;
+        }
+
+      while (n > 0 && (size_t) written >= iov->iov_len)
+        {
+          written -= iov->iov_len;
+          iov++;
+          n--;
+        }
+      if (n > 0)
+        {
+          iov->iov_base = (uint8_t *) iov->iov_base + written;
+          iov->iov_len -= written;
+        }
+    }
+
+  w->n_iovs = 0;
+  w->n_headers = 0;
+  return 0;
+}
+
+static int
+writer_add (writer_t *w, const void *data, size_t length)
+{
+  if (w->n_iovs == RECEIVER_WRITE_IOVS && writer_flush (w) < 0)
+    return -1;
+
+  w->iovs[w->n_iovs].iov_base = (void *) data;
+  w->iovs[w->n_iovs].iov_len = length;
+  w->n_iovs++;
+  return 0;
+}
+
+/**
+ * @brief Queue the pcap record of one packet, its bytes are not copied
+ */
+static int
+writer_add_packet (writer_t *w, uint64_t timestamp_ns, const uint8_t *data, uint32_t length,
+                   uint32_t original_length)
+{
+  pcap_record_header_t *h;
+
+  /* Header and data go out together, the header slot is tied to the iovec */
+  if ((w->n_iovs > RECEIVER_WRITE_IOVS - 2 || w->n_headers == RECEIVER_WRITE_IOVS / 2) &&
+      writer_flush (w) < 0)
+    return -1;
+
+  h = &w->headers[w->n_headers++];
+  h->ts_sec = timestamp_ns / 1000000000;
+  h->ts_nsec = timestamp_ns % 1000000000;
+  h->caplen = length;
+  h->len = original_length > length ? original_length : length;
+
+  if (writer_add (w, h, sizeof (*h)) < 0)
+    return -1;
+  return length ? writer_add (w, data, length) : 0;
+}
+
+/**
+ * @brief Queue the packets of the interface out of one datagram
+ *
+ * Records never span datagrams, a truncated record ends the datagram.
+ */
+static int
+receiver_add_datagram (writer_t *w, receiver_stats_t *st, const uint8_t *data, size_t size,
+                       uint32_t sw_if_index)
+{
+  size_t offset = 0;
+
+  while (size - offset >= PACKET_HEADER_SIZE)
+    {
+      const uint8_t *p = data + offset;
+      uint32_t length = get_be32 (p + 12);
+      size_t header_size = PACKET_HEADER_SIZE + (p[20] == DIRECTION_DROP ? DROP_REASON_SIZE : 0);
+
+      if (header_size > size - offset || length > size - offset - header_size)
+        break;
+
+      offset += header_size + length;
+
+      if (get_be32 (p) != sw_if_index)
+        {
+          st->filtered++;
+          continue;
+        }
+
+      if (writer_add_packet (w, get_be64 (p + 4), p + header_size, length, get_be32 (p + 16)) < 0)
+        return -1;
+
+      st->packets++;
+      st->bytes += length;
+    }
+
+  if (offset != size)
+    st->malformed++;
+
+  return 0;
+}
+
+/**
+ * @brief Restore a datagram of a compressing session
+ *
+ * A compressed payload is decompressed into @c dst, one that was stored as
+ * is is left where it is.
+ *
+ * @return the length of the datagram at @c *out, -1 if it is malformed
+ */
+static long
+receiver_decompress (const uint8_t *data, size_t size, uint8_t *dst, const uint8_t **out)
+{
+  const uint8_t *payload = data + COMPRESSION_HEADER_SIZE;
+  uint32_t length, payload_length;
+
+  if (size < COMPRESSION_HEADER_SIZE || ((data[0] << 8) | data[1]) != COMPRESSION_MAGIC)
+    return -1;
+
+  length = get_be32 (data + 4);
+  payload_length = get_be32 (data + 8);
+  if (payload_length != size - COMPRESSION_HEADER_SIZE || length > RECEIVER_MAX_DATAGRAM_SIZE)
+    return -1;
+
+  if (!(data[2] & COMPRESSION_FLAG_LZ4))
+    {
+      *out = payload;
+      return payload_length == length ? (long) length : -1;
+    }
+
+#ifdef VPP_BRIDGE_RECEIVER_LZ4
+  if (LZ4_decompress_safe ((const char *) payload, (char *) dst, payload_length,
+                           RECEIVER_MAX_DATAGRAM_SIZE) != (int) length)
+    return -1;
+  *out = dst;
+  return length;
+#else
+  (void) dst;
+  return -1;
+#endif
+}
+
+static void
+receiver_report_losses (receiver_stats_t *st, const char *prefix)
+{
+  uint64_t socket_drops = st->socket_drops < st->lost_datagrams ? st->socket_drops :
+                          st->lost_datagrams;
+  uint64_t kernel_drops = st->lost_datagrams - socket_drops;
+
+  if (st->kernel_drops < kernel_drops)
+    kernel_drops = st->kernel_drops;
+
+  fprintf (stderr, "%s%llu datagrams (%llu packets) lost after VPP: %llu on the VPP socket, "
+           "%llu in the receive buffer, %llu on the network; %llu packets dropped in the VPP "
+           "worker rings\n", prefix, (unsigned long long) st->lost_datagrams,
+           (unsigned long long) st->lost_records, (unsigned long long) socket_drops,
+           (unsigned long long) kernel_drops,
+           (unsigned long long) (st->lost_datagrams - socket_drops - kernel_drops),
+           (unsigned long long) st->ring_drops);
+}
+
+/**
+ * @brief Account for the sequence header of a datagram and strip it
+ *
+ * Counting starts with the first datagram seen of each sender thread. A
+ * datagram from before the expected one was reordered on the way and had
+ * been counted as lost.
+ *
+ * @return the length of the datagram past the header, -1 if it is malformed
+ */
+static long
+receiver_check_sequence (receiver_stats_t *st, const uint8_t **data, size_t size)
+{
+  const uint8_t *h = *data;
+  sequence_sender_t *s;
+  uint32_t sequence, records, socket_drops, gap;
+  uint64_t records_before, ring_drops;
+  time_t now;
+
+  if (size < SEQUENCE_HEADER_SIZE || ((h[0] << 8) | h[1]) != SEQUENCE_MAGIC)
+    return -1;
+
+  s = &st->senders[h[2]];
+  sequence = get_be32 (h + 4);
+  records = get_be32 (h + 8);
+  socket_drops = get_be32 (h + 12);
+  records_before = get_be64 (h + 16);
+  ring_drops = get_be64 (h + 24);
+  *data = h + SEQUENCE_HEADER_SIZE;
+
+  gap = sequence - s->next_sequence;
+  if (s->seen && gap >= 1U << 31)
+    {
+      st->late++;
+      st->lost_datagrams -= st->lost_datagrams ? 1 : 0;
+      st->lost_records -= st->lost_records > records ? records : st->lost_records;
+      return size - SEQUENCE_HEADER_SIZE;
+    }
+
+  if (s->seen)
+    {
+      st->lost_datagrams += gap;
+      st->lost_records += records_before > s->next_record ? records_before - s->next_record : 0;
+      st->socket_drops += socket_drops - s->socket_drops;
+      st->ring_drops += ring_drops > s->ring_drops ? ring_drops - s->ring_drops : 0;
+
+      now = time (NULL);
+      if ((gap || ring_drops > s->ring_drops) && now != st->reported)
+        {
+          st->reported = now;
+          receiver_report_losses (st, "Losses: ");
+        }
+    }
+
+  s->seen = 1;
+  s->next_sequence = sequence + 1;
+  s->next_record = records_before + records;
+  s->socket_drops = socket_drops;
+  s->ring_drops = ring_drops;
+  return size - SEQUENCE_HEADER_SIZE;
+}
+
+/**
+ * @brief Set the receive buffer, past net.core.rmem_max if permitted
+ */
+static void
+receiver_set_rcvbuf (int fd, int rcvbuf)
+{
+  int actual = 0;
+  socklen_t len = sizeof (actual);
+
+  if (setsockopt (fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof (rcvbuf)) < 0)
+    setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
+
+  /* The kernel reports double the usable size */
+  if (getsockopt (fd, SOL_SOCKET, SO_RCVBUF, &actual, &len) == 0 && actual / 2 < rcvbuf)
+    fprintf (stderr, "Receive buffer is %d bytes instead of %d, raise net.core.rmem_max\n",
+             actual / 2, rcvbuf);
+}
+
+static int
+receiver_open_socket (uint16_t port, int rcvbuf)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  int fd, on = 1;
+
+  fd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+  setsockopt (fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof (on));
+  receiver_set_rcvbuf (fd, rcvbuf);
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_ANY);
+  addr.sin_port = htons (port);
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+      getsockname (fd, (struct sockaddr *) &addr, &len) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  printf ("port %u\n", ntohs (addr.sin_port));
+  fflush (stdout);
+  return fd;
+}
+
+static void
+receiver_update_drops (receiver_stats_t *st, struct msghdr *msg)
+{
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR (msg); cmsg; cmsg = CMSG_NXTHDR (msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        memcpy (&st->kernel_drops, CMSG_DATA (cmsg), sizeof (st->kernel_drops));
+    }
+}
+
+/**
+ * @brief Move datagrams from the socket to the FIFO until stopped
+ *
+ * @return 0 on a clean stop or once Wireshark closed the FIFO, -1 on errors
+ */
+static int
+receiver_run (int sock, int fifo, uint32_t sw_if_index, int pcapng, int lz4, int sequence,
+              receiver_stats_t *st)
+{
+  static uint8_t buffers[RECEIVER_BATCH_DATAGRAMS][RECEIVER_MAX_DATAGRAM_SIZE];
+  static uint8_t *plain[RECEIVER_BATCH_DATAGRAMS];  // Restored datagrams with lz4
+  static char controls[RECEIVER_BATCH_DATAGRAMS][CMSG_SPACE (sizeof (uint32_t))];
+  static struct mmsghdr msgs[RECEIVER_BATCH_DATAGRAMS];
+  static struct iovec iovs[RECEIVER_BATCH_DATAGRAMS];
+  static writer_t w;
+  struct pollfd pfd = { .fd = sock, .events = POLLIN };
+  int i, n;
+
+  w.fd = fifo;
+
+  for (i = 0; lz4 && i < RECEIVER_BATCH_DATAGRAMS; i++)
+    {
+      plain[i] = malloc (RECEIVER_MAX_DATAGRAM_SIZE);
+      if (plain[i] == NULL)
+        return -1;
+    }
+
+  if (!pcapng)
+    {
+      pcap_file_header_t fh = {
+        .magic = PCAP_MAGIC,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = PCAP_SNAPLEN,
+        .network = PCAP_NETWORK,
+      };
+
+      if (writer_add (&w, &fh, sizeof (fh)) < 0 || writer_flush (&w) < 0)
+        return errno == EPIPE ? 0 : -1;
+    }
+
+  while (!receiver_stop)
+    {
+      n = poll (&pfd, 1, RECEIVER_POLL_TIMEOUT_MS);
+      if (n <= 0)
+        {
+          if (n < 0 && errno != EINTR)
+            return -1;
+          continue;
+        }
+
+      for (i = 0; i < RECEIVER_BATCH_DATAGRAMS; i++)
+        {
+          iovs[i].iov_base = buffers[i];
+          iovs[i].iov_len = sizeof (buffers[i]);
+          memset (&msgs[i].msg_hdr, 0, sizeof (msgs[i].msg_hdr));
+          msgs[i].msg_hdr.msg_iov = &iovs[i];
+          msgs[i].msg_hdr.msg_iovlen = 1;
+          msgs[i].msg_hdr.msg_control = controls[i];
+          msgs[i].msg_hdr.msg_controllen = sizeof (controls[i]);
+        }
+
+      n = recvmmsg (sock, msgs, RECEIVER_BATCH_DATAGRAMS, MSG_DONTWAIT, NULL);
+      if (n < 0)
+        {
+          if (errno == EAGAIN || errno == EINTR)
+            continue;
+          return -1;
+        }
+
+      for (i = 0; i < n; i++)
+        {
+          const uint8_t *data = buffers[i];
+          long size = msgs[i].msg_len;
+          int rv;
+
+          st->datagrams++;
+          receiver_update_drops (st, &msgs[i].msg_hdr);
+
+          if (lz4)
+            {
+              size = receiver_decompress (buffers[i], size, plain[i], &data);
+              if (size < 0)
+                {
+                  st->malformed++;
+                  continue;
+                }
+            }
+
+          if (sequence)
+            {
+              size = receiver_check_sequence (st, &data, size);
+              if (size < 0)
+                {
+                  st->malformed++;
+                  continue;
+                }
+            }
+
+          /* pcapng datagrams are complete sections of the captured interface */
+          if (pcapng)
+            rv = writer_add (&w, data, size);
+          else
+            rv = receiver_add_datagram (&w, st, data, size, sw_if_index);
+
+          if (rv < 0)
+            return errno == EPIPE ? 0 : -1;
+        }
+
+      /* The iovecs point into the receive buffers, write before reusing them */
+      if (writer_flush (&w) < 0)
+        return errno == EPIPE ? 0 : -1;
+    }
+
+  return 0;
+}
+
+static void
+usage (const char *name)
+{
+  fprintf (stderr, "Usage: %s --fifo <path> --interface <sw_if_index> [--port <port>] "
+           "[--rcvbuf <bytes>] [--pcapng] [--lz4] [--sequence]\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const struct option options[] = {
+    { "fifo", required_argument, 0, 'f' },
+    { "interface", required_argument, 0, 'i' },
+    { "port", required_argument, 0, 'p' },
+    { "rcvbuf", required_argument, 0, 'r' },
+    { "pcapng", no_argument, 0, 'n' },
+    { "lz4", no_argument, 0, 'z' },
+    { "sequence", no_argument, 0, 's' },
+    { 0, 0, 0, 0 },
+  };
+  struct sigaction sa;
+  receiver_stats_t st;
+  const char *fifo_path = NULL;
+  long sw_if_index = -1, port = 0, rcvbuf = RECEIVER_DEFAULT_RCVBUF;
+  int pcapng = 0, lz4 = 0, sequence = 0, sock, fifo, opt, rv;
+
+  while ((opt = getopt_long (argc, argv, "f:i:p:r:nzs", options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+        case 'f':
+          fifo_path = optarg;
+          break;
+        case 'i':
+          sw_if_index = strtol (optarg, NULL, 0);
+          break;
+        case 'p':
+          port = strtol (optarg, NULL, 0);
+          break;
+        case 'r':
+          rcvbuf = strtol (optarg, NULL, 0);
+          break;
+        case 'n':
+          pcapng = 1;
+          break;
+        case 'z':
+          lz4 = 1;
+          break;
+        case 's':
+          sequence = 1;
+          break;
+        default:
+          usage (argv[0]);
+          return 1;
+        }
+    }
+
+  if (fifo_path == NULL || sw_if_index < 0 || sw_if_index > UINT32_MAX ||
+      port < 0 || port > 65535 || rcvbuf <= 0 || rcvbuf > INT_MAX)
+    {
+      usage (argv[0]);
+      return 1;
+    }
+
+#ifndef VPP_BRIDGE_RECEIVER_LZ4
+  if (lz4)
+    {
+      fprintf (stderr, "Built without LZ4, rebuild with -DVPP_BRIDGE_RECEIVER_LZ4 -llz4\n");
+      return 1;
+    }
+#endif
+
+  /* No SA_RESTART, blocked calls return to check the flag */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = receiver_signal;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGHUP, &sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+
+  /* Do not outlive the extcap that launched us */
+  prctl (PR_SET_PDEATHSIG, SIGTERM);
+
+  sock = receiver_open_socket (port, rcvbuf);
+  if (sock < 0)
+    {
+      fprintf (stderr, "Failed to bind UDP port %ld: %s\n", port, strerror (errno));
+      return 1;
+    }
+
+  /* Datagrams queue up in the socket until Wireshark opens its end */
+  fifo = open (fifo_path, O_WRONLY | O_CLOEXEC);
+  if (fifo < 0)
+    {
+      if (!receiver_stop)
+        fprintf (stderr, "Failed to open %s: %s\n", fifo_path, strerror (errno));
+      close (sock);
+      return receiver_stop ? 0 : 1;
+    }
+
+  memset (&st, 0, sizeof (st));
+  rv = receiver_run (sock, fifo, sw_if_index, pcapng, lz4, sequence, &st);
+  if (rv < 0)
+    fprintf (stderr, "Receiver failed: %s\n", strerror (errno));
+
+  fprintf (stderr, "Received %llu datagrams, wrote %llu packets (%llu bytes), "
+           "%llu of other interfaces, %llu malformed datagrams, %u dropped by the kernel\n",
+           (unsigned long long) st.datagrams, (unsigned long long) st.packets,
+           (unsigned long long) st.bytes, (unsigned long long) st.filtered,
+           (unsigned long long) st.malformed, st.kernel_drops);
+  if (sequence)
+    receiver_report_losses (&st, "");
+
+  close (fifo);
+  close (sock);
+  return rv < 0 ? 1 : 0;
+}
@@ -33,6 +33,15 @@ import datetime
 import select
 import errno
 import shlex
+import mmap
+import subprocess
+import csv
+import ipaddress
+
+try:
+    import lz4.block  # Only needed for --compress
+except ImportError:
+    lz4 = None
 
 # Constants
 PRODUCT_NAME = "VPP"
@@ -57,10 +66,67 @@ else:
 # Constants
 DIRECTION_RX = 0
 DIRECTION_TX = 1
+DIRECTION_DROP = 2  # error-drop, the record carries the drop reason
+DIRECTION_IP4 = 3   # ip4-unicast
+DIRECTION_IP6 = 4   # ip6-unicast
+DROP_REASON_SIZE = 4  # vlib error of a dropped packet, after the packet header
+DIRECTION_NAMES = {DIRECTION_RX: "RX", DIRECTION_TX: "TX", DIRECTION_DROP: "drop",
+                   DIRECTION_IP4: "ip4", DIRECTION_IP6: "ip6"}
 MAX_DATAGRAM_SIZE = 65507  # Maximum UDP datagram size
+UDP_RCVBUF_SIZE = 64 << 20  # Socket receive buffer for UDP destinations
+PACKET_HEADER_SIZE = 21  # Size of the per-packet header sent by the VPP plugin
+
+# Shared memory ring of "shm:" destinations, read by ShmRingReader (see
+# vpp_plugin/wireshark_bridge/shm.h)
+SHM_PREFIX = "shm:"
+SHM_MAGIC = 0x57425352
+SHM_VERSION = 1
+SHM_ANNOUNCE_FORMAT = "=IIQQ"  # magic, version, mapping size, ring id
+SHM_HEADER_FORMAT = "=IHHQQQI"  # magic, version, header size, data size, ring id, dropped, closed
+SHM_WRITE_POS_OFFSET = 64
+SHM_READ_POS_OFFSET = 128
+SHM_RECORD_ALIGN = 8
+
+# TCP stream destinations (see vpp_plugin/wireshark_bridge/stream.h)
+TCP_PREFIX = "tcp://"
+
+# LZ4 compressed transport (see WIRESHARK_BRIDGE_COMPRESSION_* in wireshark_bridge.h)
+COMPRESSION_HEADER_FORMAT = "!HBBII"  # magic, flags, reserved, uncompressed length, payload length
+COMPRESSION_HEADER_SIZE = 12
+COMPRESSION_MAGIC = 0x575a
+COMPRESSION_FLAG_LZ4 = 1
+
+# Datagram sequence header of a "sequence" session (see WIRESHARK_BRIDGE_SEQUENCE_* in
+# wireshark_bridge.h), inside the compression header if any
+SEQUENCE_HEADER_FORMAT = "!HBBIIIQQ"  # magic, sender thread, reserved, sequence number, records,
+                                       # VPP socket drops, records before, VPP ring drops
+SEQUENCE_HEADER_SIZE = 32
+SEQUENCE_MAGIC = 0x5753
+SO_RXQ_OVFL = getattr(socket, "SO_RXQ_OVFL", 40)  # Linux, receive buffer drops of a socket
+
+# pcapng blocks: section headers delimit the sections of a TCP stream, an
+# interface statistics block is appended to a section after a loss
+PCAPNG_SHB_TYPE = 0x0A0D0D0A
+PCAPNG_BLOCK_MIN_SIZE = 12
+PCAPNG_ISB_TYPE = 0x00000005
+PCAPNG_OPT_COMMENT = 1
+PCAPNG_OPT_ISB_IFDROP = 5
+PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D
+
+# Flow records of a "flows" session (see vpp_plugin/wireshark_bridge/flow.h)
+FLOW_RECORD_FORMAT = "!IBBBBHHHH16s16sQQQQ"  # interface, direction, IP version, protocol,
+                                              # TCP flags, ethertype, ports, reserved, addresses,
+                                              # packets, bytes, first and last seen
+FLOW_RECORD_SIZE = 80
+FLOW_CSV_FIELDS = ["last_seen", "first_seen", "sw_if_index", "direction", "ethertype", "protocol",
+                   "src_address", "src_port", "dst_address", "dst_port", "packets", "bytes",
+                   "tcp_flags"]
+
+# Native UDP receiver built from vpp_bridge_receiver.c, looked up next to this script
+NATIVE_RECEIVER_NAME = "vpp_bridge_receiver"
 
 # PCAP Constants
-PCAP_MAGIC = 0xa1b2c3d4
+PCAP_MAGIC = 0xa1b23c4d  # Nanosecond timestamps
 PCAP_VERSION_MAJOR = 2
 PCAP_VERSION_MINOR = 4
 PCAP_THISZONE = 0
@@ -226,10 +292,11 @@ class Interface:
 class Packet:
     """Class for storing packet information."""
     sw_if_index: int
-    timestamp_sec: int
-    timestamp_usec: int
+    timestamp_ns: int  # Nanoseconds since the epoch
     data: bytes
     direction: int
+    original_length: int = 0
+    drop_reason: int = 0  # vlib error of a packet of the drop capture point
 
 
 class PcapWriter:
@@ -256,28 +323,76 @@ class PcapWriter:
         file.flush()
     
     @staticmethod
-    def write_packet(file, data: bytes, timestamp: Optional[float] = None) -> None:
+    def write_packet(file, data: bytes, timestamp_ns: Optional[int] = None,
+                     original_length: Optional[int] = None) -> None:
         """Write packet data in PCAP format.
         
         Args:
             file: File object for writing
             data: Packet data
-            timestamp: Packet timestamp (seconds since epoch)
+            timestamp_ns: Packet timestamp (nanoseconds since epoch)
+            original_length: Length of the packet on the wire if it was truncated
         """
-        if timestamp is None:
-            timestamp = time.time()
+        if timestamp_ns is None:
+            timestamp_ns = time.time_ns()
+        
+        if not original_length or original_length < len(data):
+            original_length = len(data)
         
-        ts_sec = int(timestamp)
-        ts_usec = int((timestamp - ts_sec) * 1000000)
+        ts_sec, ts_nsec = divmod(timestamp_ns, 1000000000)
         
         # Create packet header
-        # Format: Timestamp seconds, microseconds, captured length, original length
-        packet_header = struct.pack('!IIII', ts_sec, ts_usec, len(data), len(data))
+        # Format: Timestamp seconds, nanoseconds, captured length, original length
+        packet_header = struct.pack('!IIII', ts_sec, ts_nsec, len(data), original_length)
         
         # Write header and data
         file.write(packet_header)
         file.write(data)
         file.flush()
+    
+    @staticmethod
+    def statistics_block(section: bytes, dropped: int, comment: str) -> bytes:
+        """Build an interface statistics block for the first interface of
+        a pcapng section, in the byte order of the section.
+        
+        Args:
+            section: Section the block is appended to
+            dropped: Packets lost so far (isb_ifdrop)
+            comment: Text of the opt_comment
+            
+        Returns:
+            The block, empty if the section has no valid header
+        """
+        if len(section) < 12:
+            return b''
+        if struct.unpack_from('<I', section, 8)[0] == PCAPNG_BYTE_ORDER_MAGIC:
+            order = '<'
+        elif struct.unpack_from('>I', section, 8)[0] == PCAPNG_BYTE_ORDER_MAGIC:
+            order = '>'
+        else:
+            return b''
+        
+        text = comment.encode()
+        options = struct.pack(order + 'HHQ', PCAPNG_OPT_ISB_IFDROP, 8, dropped)
+        options += struct.pack(order + 'HH', PCAPNG_OPT_COMMENT, len(text)) + text
+        options += b'\0' * (-len(text) % 4) + struct.pack(order + 'HH', 0, 0)
+        
+        timestamp_ns = time.time_ns()  # The section's interfaces use if_tsresol 9
+        length = 20 + len(options) + 4
+        return (struct.pack(order + 'IIIII', PCAPNG_ISB_TYPE, length, 0,
+                            timestamp_ns >> 32, timestamp_ns & 0xffffffff) +
+                options + struct.pack(order + 'I', length))
+    
+    @staticmethod
+    def write_section(file, section: bytes) -> None:
+        """Write a complete pcapng section as sent by the VPP plugin.
+        
+        Args:
+            file: File object for writing
+            section: Section header, interface descriptions and packets
+        """
+        file.write(section)
+        file.flush()
 
 
 class NetworkUtils:
@@ -354,6 +469,140 @@ class NetworkUtils:
             return 9000
 
 
+class ShmRingReader:
+    """Reads packet records from the shared memory ring of a VPP capture session.
+    
+    The consumer binds a Unix datagram socket, VPP passes the memfd of the
+    ring over it with SCM_RIGHTS and records are then read straight from the
+    mapping. The socket is only looked at while the ring is empty.
+    
+    vpp_agent/vpp_agent.py keeps a copy for its shm: proxy, change both together.
+    """
+    
+    def __init__(self, socket_path: str):
+        """Bind the announcement socket.
+        
+        Args:
+            socket_path: Path of the Unix socket given to VPP as shm:<path>
+        """
+        self.socket_path = socket_path
+        if os.path.exists(socket_path):
+            os.unlink(socket_path)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.sock.bind(socket_path)
+        os.chmod(socket_path, 0o777)  # Let VPP send to it
+        self.ring = None  # type: Optional[mmap.mmap]
+        self.ring_id = None
+        self.header_size = 0
+        self.data_size = 0
+        self.read_pos = 0
+    
+    def _attach(self, fd: int, mapping_size: int, ring_id: int) -> None:
+        """Map a newly announced ring and start reading where the last consumer stopped."""
+        try:
+            ring = mmap.mmap(fd, mapping_size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        
+        magic, version, header_size, data_size, _, _, _ = struct.unpack_from(SHM_HEADER_FORMAT, ring, 0)
+        if magic != SHM_MAGIC or version != SHM_VERSION:
+            ring.close()
+            logger.error(f"Unsupported shared ring (magic {magic:#x}, version {version})")
+            return
+        
+        if self.ring:
+            self.ring.close()
+        self.ring = ring
+        self.ring_id = ring_id
+        self.header_size = header_size
+        self.data_size = data_size
+        self.read_pos = struct.unpack_from("=Q", ring, SHM_READ_POS_OFFSET)[0]
+        logger.info(f"Attached to shared ring {ring_id:#x} ({data_size} bytes)")
+    
+    def poll_announcements(self, timeout: float) -> None:
+        """Wait up to timeout seconds for announcements and attach to new rings."""
+        fd_size = struct.calcsize("i")
+        while True:
+            readable, _, _ = select.select([self.sock], [], [], timeout)
+            if not readable:
+                return
+            timeout = 0
+            
+            msg, ancdata, _, _ = self.sock.recvmsg(64, socket.CMSG_SPACE(fd_size))
+            fds = [struct.unpack("i", data[:fd_size])[0]
+                   for level, kind, data in ancdata
+                   if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS]
+            if len(msg) < struct.calcsize(SHM_ANNOUNCE_FORMAT) or not fds:
+                for fd in fds:
+                    os.close(fd)
+                continue
+            
+            magic, version, mapping_size, ring_id = struct.unpack_from(SHM_ANNOUNCE_FORMAT, msg)
+            if magic != SHM_MAGIC or ring_id == self.ring_id:
+                os.close(fds[0])
+                continue
+            self._attach(fds[0], mapping_size, ring_id)
+    
+    def read_records(self, max_bytes: int = 1 << 20) -> List[bytes]:
+        """Read the records published since the last call.
+        
+        Every record is the usual 21-byte packet header followed by the
+        packet bytes (a drop reason in between for dropped packets), the
+        same as inside a datagram.
+        
+        Args:
+            max_bytes: Stop after about this many bytes of records
+            
+        Returns:
+            List of records, empty if there is nothing new
+        """
+        if not self.ring:
+            return []
+        
+        ring = self.ring
+        mask = self.data_size - 1
+        write_pos = struct.unpack_from("=Q", ring, SHM_WRITE_POS_OFFSET)[0]
+        read_pos = self.read_pos
+        records = []
+        n_bytes = 0
+        
+        while read_pos < write_pos and n_bytes < max_bytes:
+            offset = read_pos & mask
+            start = self.header_size + offset
+            record_len = struct.unpack_from("=I", ring, start)[0]
+            
+            # Zero length: the rest of the area is unused, continue at its start
+            if record_len == 0:
+                read_pos += self.data_size - offset
+                continue
+            
+            records.append(ring[start + 4:start + record_len])
+            n_bytes += record_len
+            read_pos += (record_len + SHM_RECORD_ALIGN - 1) & ~(SHM_RECORD_ALIGN - 1)
+        
+        # Hand the space back to VPP
+        if read_pos != self.read_pos:
+            struct.pack_into("=Q", ring, SHM_READ_POS_OFFSET, read_pos)
+            self.read_pos = read_pos
+        
+        return records
+    
+    def dropped(self) -> int:
+        """Number of records VPP dropped because the ring was full."""
+        if not self.ring:
+            return 0
+        return struct.unpack_from(SHM_HEADER_FORMAT, self.ring, 0)[5]
+    
+    def close(self) -> None:
+        """Unmap the ring and remove the socket."""
+        if self.ring:
+            self.ring.close()
+            self.ring = None
+        self.sock.close()
+        if os.path.exists(self.socket_path):
+            os.unlink(self.socket_path)
+
+
 class VppAgent:
     """Handles communication with the VPP agent."""
     
@@ -437,12 +686,25 @@ class VppAgent:
             logger.error(f"Error fetching interfaces: {e}")
             return []
     
-    def enable_bridge(self, interface: Union[str, int], bridge_address: str) -> bool:
+    def enable_bridge(self, interface: Union[str, int], bridge_address: str, snaplen: int = 0,
+                      capture_filter: Optional[str] = None, sample: int = 0,
+                      max_pps: int = 0, pcapng: bool = False, compress: bool = False,
+                      flows: bool = False, capture_points: Optional[str] = None,
+                      sequence: bool = False) -> bool:
         """Enable packet forwarding from VPP to bridge.
         
         Args:
             interface: Interface name or SW interface index
             bridge_address: Bridge address (IP:port)
+            snaplen: Maximum number of bytes captured per packet (0 - no limit)
+            capture_filter: Capture filter applied inside VPP before copying
+            sample: Capture 1 in N packets (0 or 1 - all)
+            max_pps: Capture rate limit in packets per second (0 - no limit)
+            pcapng: Have VPP send ready pcapng sections instead of packet records
+            compress: Have VPP LZ4-compress every datagram
+            flows: Have VPP send flow records instead of packets
+            capture_points: Capture points, e.g. "rx tx drop" (None - rx and tx)
+            sequence: Have VPP put a sequence header in front of every datagram
             
         Returns:
             bool: True if successful
@@ -452,6 +714,24 @@ class VppAgent:
                 "interface": interface,
                 "bridge_address": bridge_address
             }
+            if snaplen:
+                data["snaplen"] = snaplen
+            if capture_filter:
+                data["filter"] = capture_filter
+            if sample > 1:
+                data["sample"] = sample
+            if max_pps:
+                data["max_pps"] = max_pps
+            if pcapng:
+                data["format"] = "pcapng"
+            if compress:
+                data["compress"] = True
+            if flows:
+                data["flows"] = True
+            if capture_points:
+                data["direction"] = capture_points
+            if sequence:
+                data["sequence"] = True
             
             result = self._make_request("POST", "enable", data)
             success = result.get("success", False)
@@ -482,29 +762,186 @@ class VppAgent:
             return False
 
 
+class LossTracker:
+    """Accounts for the packets lost between VPP and this receiver.
+    
+    Every sender thread of a "sequence" session numbers its datagrams and
+    counts the records it put into them. A gap in the numbers is lost
+    datagrams: dropped on a full VPP socket buffer, which the header counts
+    as well, lost in the receive buffer here (SO_RXQ_OVFL on Linux) or lost
+    on the network, the rest. Packets dropped in the VPP worker rings never
+    made it into a datagram, the header carries their count too.
+    """
+    
+    def __init__(self):
+        self.senders = {}  # type: Dict[int, List[int]]  # next sequence, next record, socket drops, ring drops
+        self.lost_datagrams = 0
+        self.lost_records = 0
+        self.socket_drops = 0
+        self.ring_drops = 0
+        self.receive_drops = 0
+        self.late = 0
+    
+    def update(self, header: Tuple[int, ...]) -> int:
+        """Account for one datagram.
+        
+        Args:
+            header: Unpacked sequence header of the datagram
+            
+        Returns:
+            Records lost right before this datagram
+        """
+        _, sender, _, sequence, records, socket_drops, records_before, ring_drops = header
+        state = self.senders.get(sender)
+        
+        # Counting starts with the first datagram seen of each sender thread
+        if state is None:
+            self.senders[sender] = [(sequence + 1) & 0xffffffff, records_before + records,
+                                    socket_drops, ring_drops]
+            return 0
+        
+        gap = (sequence - state[0]) & 0xffffffff
+        if gap >= 1 << 31:
+            # Reordered on the way, it was counted as lost
+            self.late += 1
+            self.lost_datagrams = max(self.lost_datagrams - 1, 0)
+            self.lost_records = max(self.lost_records - records, 0)
+            return 0
+        
+        lost = max(records_before - state[1], 0)
+        self.lost_datagrams += gap
+        self.lost_records += lost
+        self.socket_drops += (socket_drops - state[2]) & 0xffffffff
+        self.ring_drops += max(ring_drops - state[3], 0)
+        self.senders[sender] = [(sequence + 1) & 0xffffffff, records_before + records,
+                                socket_drops, ring_drops]
+        return lost
+    
+    def summary(self) -> str:
+        """Describe where packets were lost so far."""
+        socket_drops = min(self.socket_drops, self.lost_datagrams)
+        receive_drops = min(self.receive_drops, self.lost_datagrams - socket_drops)
+        network = self.lost_datagrams - socket_drops - receive_drops
+        return (f"{self.lost_datagrams} datagrams ({self.lost_records} packets) lost after VPP: "
+                f"{socket_drops} on the VPP socket, {receive_drops} in the receive buffer, "
+                f"{network} on the network; {self.ring_drops} packets dropped in the VPP worker rings")
+
+
 class PacketProcessor:
     """Processes packets from VPP and queues them for Wireshark."""
     
-    def __init__(self, debug: bool = False, exit_on_error: bool = False):
+    def __init__(self, debug: bool = False, exit_on_error: bool = False, pcapng: bool = False,
+                 compress: bool = False, flows: bool = False, flow_csv: Optional[str] = None,
+                 sequence: bool = False):
         """Initialize the packet processor.
         
         Args:
             debug: Enable debug mode
             exit_on_error: Exit the entire process on critical errors
+            pcapng: Datagrams are pcapng sections to be passed on unchanged
+            compress: Datagrams are LZ4 compressed, each behind its own header
+            flows: Datagrams carry flow records, shown as one synthetic packet each
+            flow_csv: Optional file to append the flow records to as CSV
+            sequence: Datagrams start with a sequence header, lost ones are accounted for
         """
         self.debug = debug
+        self.pcapng = pcapng
+        self.compress = compress
+        self.flows = flows
+        self.sequence = sequence
+        self.loss = LossTracker() if sequence else None
+        self.flow_csv_file = None
+        self.flow_csv = None
+        if flow_csv:
+            new_file = not os.path.exists(flow_csv) or os.path.getsize(flow_csv) == 0
+            self.flow_csv_file = open(flow_csv, 'a', newline='')
+            self.flow_csv = csv.writer(self.flow_csv_file)
+            if new_file:
+                self.flow_csv.writerow(FLOW_CSV_FIELDS)
         self.running = False
         self.interfaces = {}  # type: Dict[int, Interface]
         self.interfaces_lock = threading.Lock()  # Add lock for thread-safe access to interfaces
         self.packets_queue = queue.Queue()
         self.server_thread = None
+        self.packet_server = None
+        self.shm_reader = None
+        self.native_receiver = None
         self.exit_on_error = exit_on_error
     
-    def start_packet_server(self, port: Optional[int] = None) -> int:
+    @staticmethod
+    def find_native_receiver() -> Optional[str]:
+        """Find the native UDP receiver next to this script.
+        
+        Returns:
+            Path to the executable, None if it is not built (Linux only)
+        """
+        if not IS_LINUX:
+            return None
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), NATIVE_RECEIVER_NAME)
+        return path if os.access(path, os.X_OK) else None
+    
+    def start_native_receiver(self, receiver_path: str, port: Optional[int],
+                              interface_index: int, fifo_path: str) -> int:
+        """Start the native receiver, it writes to the FIFO itself.
+        
+        The receiver takes datagrams in batches with recvmmsg into a large
+        socket buffer and writes them as pcap with few writev calls, instead
+        of the receive and FIFO writer threads of this process.
+        
+        Args:
+            receiver_path: Path to the native receiver
+            port: Optional specific port to use. If None, the kernel picks one.
+            interface_index: Interface index to capture
+            fifo_path: Path to the FIFO
+            
+        Returns:
+            int: Server port number, 0 on failure
+        """
+        command = [receiver_path, '--fifo', normalize_path(fifo_path),
+                   '--interface', str(interface_index), '--port', str(port or 0),
+                   '--rcvbuf', str(UDP_RCVBUF_SIZE)]
+        if self.pcapng:
+            command.append('--pcapng')
+        if self.compress:
+            command.append('--lz4')
+        if self.sequence:
+            command.append('--sequence')
+        
+        self.native_receiver = subprocess.Popen(command, stdout=subprocess.PIPE,
+                                                stderr=subprocess.PIPE, text=True)
+        
+        # The receiver reports "port <n>" once its socket is bound
+        line = self.native_receiver.stdout.readline().split()
+        if len(line) != 2 or line[0] != 'port':
+            logger.error(f"Native receiver failed: {self.native_receiver.stderr.read().strip()}")
+            self.native_receiver.wait()
+            self.native_receiver = None
+            return 0
+        
+        self.wireshark_port = int(line[1])
+        self.running = True
+        
+        if self.debug:
+            logger.debug(f"Native receiver {receiver_path} started on port {self.wireshark_port}")
+        
+        return self.wireshark_port
+    
+    def wait_native_receiver(self) -> None:
+        """Thread function logging the native receiver until it exits."""
+        receiver = self.native_receiver
+        for line in receiver.stderr:
+            logger.info(f"Native receiver: {line.rstrip()}")
+        
+        receiver.wait()
+        if receiver.returncode != 0 and self.running:
+            logger.error(f"Native receiver exited with code {receiver.returncode}")
+    
+    def start_packet_server(self, port: Optional[int] = None, tcp: bool = False) -> int:
         """Start the server for receiving packets from VPP.
         
         Args:
             port: Optional specific port to use. If None, find a free port.
+            tcp: Accept a TCP stream from VPP instead of receiving datagrams
             
         Returns:
             int: Server port number
@@ -517,7 +954,7 @@ class PacketProcessor:
         
         # Start server thread
         self.packet_server = threading.Thread(
-            target=self._receive_packets_thread,
+            target=self._receive_stream_thread if tcp else self._receive_packets_thread,
             args=(self.wireshark_port,),
             daemon=True
         )
@@ -528,6 +965,43 @@ class PacketProcessor:
         
         return self.wireshark_port
     
+    def start_shm_server(self, socket_path: str) -> None:
+        """Start receiving packets from a VPP shared memory ring.
+        
+        Args:
+            socket_path: Unix socket that VPP announces the ring on
+        """
+        self.shm_reader = ShmRingReader(socket_path)
+        self.running = True
+        
+        self.packet_server = threading.Thread(
+            target=self._receive_shm_thread,
+            daemon=True
+        )
+        self.packet_server.start()
+        
+        if self.debug:
+            logger.debug(f"Shared ring consumer started on {socket_path}")
+    
+    def _receive_shm_thread(self) -> None:
+        """Thread function for reading packets from the shared memory ring."""
+        reader = self.shm_reader
+        try:
+            while self.running:
+                records = reader.read_records()
+                if records:
+                    self._process_packet_buffer(bytearray().join(records))
+                else:
+                    # Ring is empty - wait a little, picking up new rings meanwhile
+                    reader.poll_announcements(0.001)
+        except Exception as e:
+            if self.running:
+                logger.error(f"Error reading shared ring: {e}")
+        finally:
+            reader.close()
+            if self.debug:
+                logger.debug("Shared ring consumer shut down")
+    
     def _receive_packets_thread(self, port: int) -> None:
         """Thread function for receiving packets from VPP.
         
@@ -536,9 +1010,14 @@ class PacketProcessor:
         """
         server_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
         server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        # Bursts from VPP outrun this thread, let the kernel absorb them
+        server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, UDP_RCVBUF_SIZE)
+        # Receive buffer drops tell local loss from network loss
+        receive_drops = self.sequence and IS_LINUX
+        if receive_drops:
+            server_socket.setsockopt(socket.SOL_SOCKET, SO_RXQ_OVFL, 1)
         
         try:
-            print(f"Receiving packets on port 0.0.0.0:{port}")
             server_socket.bind(('0.0.0.0', port))
             server_socket.settimeout(0.05)  # Use timeout for clean shutdown
             
@@ -549,14 +1028,33 @@ class PacketProcessor:
             
             while self.running:
                 try:
-                    data, client_address = server_socket.recvfrom(MAX_DATAGRAM_SIZE)
-                    print(f"Received {len(data)} bytes from {client_address[0]}:{client_address[1]}")
+                    if receive_drops:
+                        data, ancdata, _, client_address = server_socket.recvmsg(
+                            MAX_DATAGRAM_SIZE, socket.CMSG_SPACE(4))
+                        for level, kind, value in ancdata:
+                            if level == socket.SOL_SOCKET and kind == SO_RXQ_OVFL and len(value) >= 4:
+                                self.loss.receive_drops = struct.unpack('=I', value[:4])[0]
+                    else:
+                        data, client_address = server_socket.recvfrom(MAX_DATAGRAM_SIZE)
                     if data:
                         if self.debug:
                             logger.debug(f"Received {len(data)} bytes from {client_address[0]}:{client_address[1]}")
                         
-                        buffer.extend(data)
-                        buffer = self._process_packet_buffer(buffer)
+                        if self.compress:
+                            datagrams, _ = self._decompress(bytearray(data))
+                        else:
+                            datagrams = [data]
+                        
+                        if self.sequence:
+                            datagrams = [self._check_sequence(d) for d in datagrams]
+                        
+                        for data in datagrams:
+                            if self.pcapng:
+                                # Every datagram is a complete section, no parsing needed
+                                self.packets_queue.put(data)
+                            else:
+                                buffer.extend(data)
+                                buffer = self._process_packet_buffer(buffer)
                     
                 except socket.timeout:
                     # Expected, just retry
@@ -586,6 +1084,193 @@ class PacketProcessor:
             if self.debug:
                 logger.debug("Packet server shut down")
     
+    def _receive_stream_thread(self, port: int) -> None:
+        """Thread function for receiving a TCP stream from VPP.
+        
+        The stream carries the same records (or pcapng sections) as the
+        datagrams, records may span reads. VPP reconnects after errors and
+        always starts a new connection on a record boundary, but drops
+        what it had not written yet, so the tail of the last connection
+        may be a partial record or section: records are reassembled per
+        connection, and pcapng is only passed on in whole sections, see
+        _complete_sections.
+        
+        Args:
+            port: Server port number
+        """
+        server_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        
+        try:
+            server_socket.bind(('0.0.0.0', port))
+            server_socket.listen(1)
+            server_socket.settimeout(0.05)  # Use timeout for clean shutdown
+            
+            if self.debug:
+                logger.debug(f"Listening for VPP TCP connections on port {port}")
+            
+            while self.running:
+                try:
+                    conn, client_address = server_socket.accept()
+                except socket.timeout:
+                    continue
+                
+                if self.debug:
+                    logger.debug(f"VPP connected from {client_address[0]}:{client_address[1]}")
+                
+                conn.settimeout(0.05)
+                buffer = bytearray()
+                compressed = bytearray()
+                try:
+                    while self.running:
+                        try:
+                            data = conn.recv(MAX_DATAGRAM_SIZE)
+                        except socket.timeout:
+                            # Nothing more is coming for now, pass on the last section
+                            if self.pcapng and buffer:
+                                sections, buffer = self._complete_sections(buffer, idle=True)
+                                if sections:
+                                    self.packets_queue.put(sections)
+                            continue
+                        if not data:
+                            break
+                        
+                        # Compressed datagrams may span reads as well
+                        if self.compress:
+                            compressed.extend(data)
+                            chunks, compressed = self._decompress(compressed)
+                            data = b''.join(chunks)
+                            if not data:
+                                continue
+                        
+                        buffer.extend(data)
+                        if self.pcapng:
+                            sections, buffer = self._complete_sections(buffer)
+                            if sections:
+                                self.packets_queue.put(sections)
+                        else:
+                            buffer = self._process_packet_buffer(buffer)
+                except (OSError, ValueError) as e:
+                    if self.running:
+                        logger.error(f"Error receiving data: {e}")
+                finally:
+                    conn.close()
+                    if buffer and self.debug:
+                        logger.debug(f"Dropped {len(buffer)} bytes of an incomplete record or section")
+                    if self.debug:
+                        logger.debug("VPP disconnected, waiting for it to reconnect")
+        
+        except Exception as e:
+            logger.error(f"Error setting up packet server: {e}")
+        
+        finally:
+            server_socket.close()
+            if self.debug:
+                logger.debug("Packet server shut down")
+    
+    def _complete_sections(self, buffer: bytearray, idle: bool = False) -> Tuple[bytes, bytearray]:
+        """Split the complete pcapng sections off a TCP stream buffer.
+        
+        The buffer always starts with a section header block. A section is
+        complete once the next one starts; with idle set, when no more data
+        is coming for now, the last section is complete too if it ends on a
+        block boundary. Whatever is left is dropped with the connection.
+        
+        Args:
+            buffer: Stream data, starting with a section header block
+            idle: The stream has nothing more to read right now
+            
+        Returns:
+            The complete sections and the rest of the buffer
+        """
+        section = 0
+        end = 0
+        order = None
+        
+        while len(buffer) - end >= PCAPNG_BLOCK_MIN_SIZE:
+            # The block type of a section header reads the same in both byte orders
+            if struct.unpack_from('<I', buffer, end)[0] == PCAPNG_SHB_TYPE:
+                if struct.unpack_from('<I', buffer, end + 8)[0] == PCAPNG_BYTE_ORDER_MAGIC:
+                    order = '<'
+                elif struct.unpack_from('>I', buffer, end + 8)[0] == PCAPNG_BYTE_ORDER_MAGIC:
+                    order = '>'
+                else:
+                    raise ValueError("Invalid pcapng section header in the stream")
+                section = end
+            elif order is None:
+                raise ValueError("pcapng stream does not start with a section header")
+            
+            length = struct.unpack_from(order + 'I', buffer, end + 4)[0]
+            if length < PCAPNG_BLOCK_MIN_SIZE or length % 4:
+                raise ValueError(f"Invalid pcapng block length {length} in the stream")
+            if len(buffer) - end < length:
+                break
+            end += length
+        
+        if idle and end == len(buffer):
+            section = end
+        return bytes(buffer[:section]), buffer[section:]
+    
+    def _decompress(self, buffer: bytearray) -> Tuple[List[bytes], bytearray]:
+        """Restore the datagrams of a compressing VPP session.
+        
+        Args:
+            buffer: Compression headers, each followed by its payload
+            
+        Returns:
+            The restored datagrams and the data of an incomplete one
+        """
+        datagrams = []
+        offset = 0
+        
+        while len(buffer) - offset >= COMPRESSION_HEADER_SIZE:
+            magic, flags, _, length, payload_length = struct.unpack_from(COMPRESSION_HEADER_FORMAT,
+                                                                          buffer, offset)
+            if magic != COMPRESSION_MAGIC:
+                raise ValueError("Invalid compression header, is the VPP session compressing?")
+            
+            start = offset + COMPRESSION_HEADER_SIZE
+            if len(buffer) - start < payload_length:
+                break
+            
+            payload = bytes(buffer[start:start + payload_length])
+            if flags & COMPRESSION_FLAG_LZ4:
+                payload = lz4.block.decompress(payload, uncompressed_size=length)
+            datagrams.append(payload)
+            offset = start + payload_length
+        
+        return datagrams, buffer[offset:]
+    
+    def _check_sequence(self, datagram: bytes) -> bytes:
+        """Account for the sequence header of a datagram and strip it.
+        
+        A pcapng section that follows lost packets gets an interface
+        statistics block with the loss so far, which Wireshark shows in the
+        capture file properties.
+        
+        Args:
+            datagram: Datagram of a "sequence" session
+            
+        Returns:
+            The records or pcapng section of the datagram
+        """
+        if len(datagram) < SEQUENCE_HEADER_SIZE:
+            raise ValueError("Datagram shorter than a sequence header, is the VPP session sequenced?")
+        header = struct.unpack_from(SEQUENCE_HEADER_FORMAT, datagram)
+        if header[0] != SEQUENCE_MAGIC:
+            raise ValueError("Invalid sequence header, is the VPP session sequenced?")
+        
+        payload = bytes(datagram[SEQUENCE_HEADER_SIZE:])
+        lost = self.loss.update(header)
+        if lost:
+            summary = self.loss.summary()
+            logger.warning(f"Lost {lost} packets before datagram {header[3]} of sender {header[1]}, "
+                           f"{summary}")
+            if self.pcapng:
+                payload += PcapWriter.statistics_block(payload, self.loss.lost_records + self.loss.ring_drops,
+                                                        summary)
+        return payload
+    
     def _process_packet_buffer(self, buffer: bytearray) -> bytearray:
         """Process received packet data buffer.
         
@@ -595,39 +1280,50 @@ class PacketProcessor:
         Returns:
             Remaining unprocessed data
         """
-        # Each packet has a 17-byte header followed by packet data
+        # Each packet has a 21-byte header followed by packet data
         # Header format (big-endian):
         # - sw_if_index (4 bytes)
-        # - timestamp_sec (4 bytes)
-        # - timestamp_usec (4 bytes)
-        # - packet_length (4 bytes)
-        # - direction (1 byte)
+        # - timestamp (8 bytes) - nanoseconds since the epoch
+        # - packet_length (4 bytes) - captured length, limited by snaplen
+        # - original_length (4 bytes) - length of the packet on the wire
+        # - direction (1 byte) - capture point, DIRECTION_*
+        # Dropped packets have their vlib error (4 bytes) between the header
+        # and the packet data.
+        
+        if self.flows:
+            return self._process_flow_buffer(buffer)
         
-        HEADER_SIZE = 17
+        HEADER_SIZE = PACKET_HEADER_SIZE
         
         # Process as many complete packets as possible
         while len(buffer) >= HEADER_SIZE:
             # Parse header (big-endian as used in wireshark_bridge.c)
             sw_if_index = int.from_bytes(buffer[0:4], byteorder='big')
-            timestamp_sec = int.from_bytes(buffer[4:8], byteorder='big')
-            timestamp_usec = int.from_bytes(buffer[8:12], byteorder='big')
+            timestamp_ns = int.from_bytes(buffer[4:12], byteorder='big')
             packet_length = int.from_bytes(buffer[12:16], byteorder='big')
-            direction = buffer[16]
+            original_length = int.from_bytes(buffer[16:20], byteorder='big')
+            direction = buffer[20]
+            header_size = HEADER_SIZE + (DROP_REASON_SIZE if direction == DIRECTION_DROP else 0)
             
             # Check if we have the complete packet
-            if len(buffer) < HEADER_SIZE + packet_length:
+            if len(buffer) < header_size + packet_length:
                 break
             
+            drop_reason = 0
+            if direction == DIRECTION_DROP:
+                drop_reason = int.from_bytes(buffer[HEADER_SIZE:header_size], byteorder='big')
+            
             # Extract packet data
-            packet_data = buffer[HEADER_SIZE:HEADER_SIZE + packet_length]
+            packet_data = buffer[header_size:header_size + packet_length]
             
             # Create packet object
             packet = Packet(
                 sw_if_index=sw_if_index,
-                timestamp_sec=timestamp_sec,
-                timestamp_usec=timestamp_usec,
+                timestamp_ns=timestamp_ns,
                 data=packet_data,
-                direction=direction
+                direction=direction,
+                original_length=original_length,
+                drop_reason=drop_reason
             )
             
             # Add to queue
@@ -636,21 +1332,107 @@ class PacketProcessor:
             # Update interface statistics
             with self.interfaces_lock:
                 if sw_if_index in self.interfaces:
-                    if direction == DIRECTION_RX:
-                        self.interfaces[sw_if_index].packets_received_rx += 1
-                        self.interfaces[sw_if_index].bytes_received_rx += packet_length
-                    else:
+                    # The drop and ip capture points count as received
+                    if direction == DIRECTION_TX:
                         self.interfaces[sw_if_index].packets_received_tx += 1
                         self.interfaces[sw_if_index].bytes_received_tx += packet_length
+                    else:
+                        self.interfaces[sw_if_index].packets_received_rx += 1
+                        self.interfaces[sw_if_index].bytes_received_rx += packet_length
             
             if self.debug and self.packets_queue.qsize() % 100 == 0:
                 logger.debug(f"Queue size: {self.packets_queue.qsize()} packets")
             
             # Remove processed packet from buffer
-            buffer = buffer[HEADER_SIZE + packet_length:]
+            buffer = buffer[header_size + packet_length:]
         
         return buffer
     
+    def _process_flow_buffer(self, buffer: bytearray) -> bytearray:
+        """Process received flow records.
+        
+        Every record becomes a synthetic packet of its flow, headers made up
+        from the 5-tuple and the counters as text payload, stamped with the
+        time the flow was last seen. Records also go to the CSV side stream
+        if there is one.
+        
+        Args:
+            buffer: Flow record data
+            
+        Returns:
+            Remaining unprocessed data
+        """
+        offset = 0
+        
+        while len(buffer) - offset >= FLOW_RECORD_SIZE:
+            (sw_if_index, direction, ip_version, protocol, tcp_flags, ethertype, src_port, dst_port, _,
+             src, dst, packets, n_bytes, first_seen, last_seen) = struct.unpack_from(FLOW_RECORD_FORMAT,
+                                                                                     buffer, offset)
+            offset += FLOW_RECORD_SIZE
+            
+            if ip_version == 4:
+                src_address, dst_address = ipaddress.IPv4Address(src[:4]), ipaddress.IPv4Address(dst[:4])
+            elif ip_version == 6:
+                src_address, dst_address = ipaddress.IPv6Address(src), ipaddress.IPv6Address(dst)
+            else:
+                src_address = dst_address = ""
+            
+            if self.flow_csv:
+                self.flow_csv.writerow([last_seen, first_seen, sw_if_index,
+                                        "rx" if direction == DIRECTION_RX else "tx",
+                                        f"0x{ethertype:04x}", protocol, src_address, src_port,
+                                        dst_address, dst_port, packets, n_bytes, f"0x{tcp_flags:02x}"])
+            
+            summary = (f"flow packets={packets} bytes={n_bytes} "
+                       f"duration={(last_seen - first_seen) / 1e9:.3f}s tcp_flags=0x{tcp_flags:02x}").encode()
+            data = self._flow_packet(ip_version, protocol, tcp_flags, ethertype, src_port, dst_port,
+                                     src, dst, summary)
+            self.packets_queue.put(Packet(
+                sw_if_index=sw_if_index,
+                timestamp_ns=last_seen,
+                data=data,
+                direction=direction,
+                original_length=len(data)
+            ))
+            
+            with self.interfaces_lock:
+                if sw_if_index in self.interfaces:
+                    if direction == DIRECTION_RX:
+                        self.interfaces[sw_if_index].packets_received_rx += 1
+                        self.interfaces[sw_if_index].bytes_received_rx += len(data)
+                    else:
+                        self.interfaces[sw_if_index].packets_received_tx += 1
+                        self.interfaces[sw_if_index].bytes_received_tx += len(data)
+        
+        if self.flow_csv_file and offset:
+            self.flow_csv_file.flush()
+        
+        return buffer[offset:]
+    
+    @staticmethod
+    def _flow_packet(ip_version: int, protocol: int, tcp_flags: int, ethertype: int,
+                     src_port: int, dst_port: int, src: bytes, dst: bytes, payload: bytes) -> bytes:
+        """Build the synthetic Ethernet frame of a flow record.
+        
+        Returns:
+            Ethernet, IP and TCP or UDP headers of the flow followed by @c payload
+        """
+        l4 = b''
+        if protocol == 6:  # TCP, data offset 5 words
+            l4 = struct.pack('!HHIIBBHHH', src_port, dst_port, 0, 0, 5 << 4, tcp_flags, 65535, 0, 0)
+        elif protocol == 17:  # UDP
+            l4 = struct.pack('!HHHH', src_port, dst_port, 8 + len(payload), 0)
+        
+        if ip_version == 4:
+            ip = struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(l4) + len(payload), 0, 0, 64,
+                             protocol, 0, src[:4], dst[:4])
+        elif ip_version == 6:
+            ip = struct.pack('!IHBB16s16s', 6 << 28, len(l4) + len(payload), protocol, 64, src, dst)
+        else:
+            ip = l4 = b''
+        
+        return bytes(12) + struct.pack('!H', ethertype) + ip + l4 + payload
+    
     def capture_packets(self, interface_index: int, fifo_path: str) -> None:
         """Capture packets for the specified interface and write to pipe/FIFO.
         
@@ -694,20 +1476,21 @@ class PacketProcessor:
                     logger.error(f"Named pipe not found at {fifo_path}")
                     return
                 
-                # Write PCAP header
-                win32file.WriteFile(pipe_handle, struct.pack(
-                    '!IHHiIII',
-                    PCAP_MAGIC,
-                    PCAP_VERSION_MAJOR,
-                    PCAP_VERSION_MINOR,
-                    PCAP_THISZONE,
-                    PCAP_SIGFIGS,
-                    PCAP_SNAPLEN,
-                    PCAP_NETWORK
-                ))
-                
-                if self.debug:
-                    logger.debug(f"Wrote PCAP header to pipe {fifo_path}")
+                # Write PCAP header, pcapng sections bring their own
+                if not self.pcapng:
+                    win32file.WriteFile(pipe_handle, struct.pack(
+                        '!IHHiIII',
+                        PCAP_MAGIC,
+                        PCAP_VERSION_MAJOR,
+                        PCAP_VERSION_MINOR,
+                        PCAP_THISZONE,
+                        PCAP_SIGFIGS,
+                        PCAP_SNAPLEN,
+                        PCAP_NETWORK
+                    ))
+                    
+                    if self.debug:
+                        logger.debug(f"Wrote PCAP header to pipe {fifo_path}")
                 
                 # Process packets
                 while self.running:
@@ -719,6 +1502,11 @@ class PacketProcessor:
                         except queue.Empty:
                             continue
                         
+                        # The VPP session only captures this interface
+                        if self.pcapng:
+                            win32file.WriteFile(pipe_handle, packet)
+                            continue
+                        
                         # Check interface match
                         if packet.sw_if_index != interface_index:
                             continue
@@ -729,17 +1517,16 @@ class PacketProcessor:
                             continue
                         
                         # Write packet to pipe
-                        timestamp = packet.timestamp_sec + (packet.timestamp_usec / 1000000.0)
-                        ts_sec = int(timestamp)
-                        ts_usec = int((timestamp - ts_sec) * 1000000)
+                        ts_sec, ts_nsec = divmod(packet.timestamp_ns, 1000000000)
                         
                         # Create packet header and write
-                        packet_header = struct.pack('!IIII', ts_sec, ts_usec, len(packet.data), len(packet.data))
+                        original_length = max(packet.original_length, len(packet.data))
+                        packet_header = struct.pack('!IIII', ts_sec, ts_nsec, len(packet.data), original_length)
                         win32file.WriteFile(pipe_handle, packet_header)
                         win32file.WriteFile(pipe_handle, packet.data)
                         
                         if self.debug and packet.sw_if_index == interface_index:
-                            dir_str = "RX" if packet.direction == DIRECTION_RX else "TX"
+                            dir_str = DIRECTION_NAMES.get(packet.direction, "?")
                             logger.debug(f"Wrote {dir_str} packet to pipe, length {len(packet.data)} bytes")
                         
                     except pywintypes.error as e:
@@ -831,11 +1618,12 @@ class PacketProcessor:
             capture_rx: Whether to capture RX packets
             capture_tx: Whether to capture TX packets
         """
-        # Write PCAP header
-        PcapWriter.write_header(fifo)
-        
-        if self.debug:
-            logger.debug(f"Wrote PCAP header to FIFO")
+        # Write PCAP header, pcapng sections bring their own
+        if not self.pcapng:
+            PcapWriter.write_header(fifo)
+            
+            if self.debug:
+                logger.debug(f"Wrote PCAP header to FIFO")
         
         # Store FIFO path for macOS existence check
         fifo_path = None
@@ -865,6 +1653,11 @@ class PacketProcessor:
                             break
                     continue
                 
+                # The VPP session only captures this interface
+                if self.pcapng:
+                    PcapWriter.write_section(fifo, packet)
+                    continue
+                
                 # Check interface match
                 if packet.sw_if_index != interface_index:
                     continue
@@ -875,7 +1668,7 @@ class PacketProcessor:
                     continue
                 
                 # Write packet to FIFO
-                timestamp = packet.timestamp_sec + (packet.timestamp_usec / 1000000.0)
+                timestamp = packet.timestamp_ns
                 
                 # For macOS, use improved FIFO handling with extra error checking
                 if IS_MACOS:
@@ -894,11 +1687,11 @@ class PacketProcessor:
                             break
                             
                         # Write packet data with proper flushing
-                        PcapWriter.write_packet(fifo, packet.data, timestamp)
+                        PcapWriter.write_packet(fifo, packet.data, timestamp, packet.original_length)
                         fifo.flush()  # Ensure data is written immediately
                         
                         if self.debug and packet.sw_if_index == interface_index:
-                            dir_str = "RX" if packet.direction == DIRECTION_RX else "TX"
+                            dir_str = DIRECTION_NAMES.get(packet.direction, "?")
                             logger.debug(f"Wrote {dir_str} packet to FIFO, length {len(packet.data)} bytes")
                             
                     except BrokenPipeError:
@@ -920,10 +1713,10 @@ class PacketProcessor:
                 else:
                     # Standard handling for other platforms
                     try:
-                        PcapWriter.write_packet(fifo, packet.data, timestamp)
+                        PcapWriter.write_packet(fifo, packet.data, timestamp, packet.original_length)
                         
                         if self.debug and packet.sw_if_index == interface_index:
-                            dir_str = "RX" if packet.direction == DIRECTION_RX else "TX"
+                            dir_str = DIRECTION_NAMES.get(packet.direction, "?")
                             logger.debug(f"Wrote {dir_str} packet to FIFO, length {len(packet.data)} bytes")
                             
                     except BrokenPipeError:
@@ -935,14 +1728,30 @@ class PacketProcessor:
                     except Exception as e:
                         logger.error(f"Error in packet capture: {e}")
                 
+            except (BrokenPipeError, ValueError) as e:
+                # pcapng writes are not wrapped by the per-platform handling above
+                logger.error(f"FIFO closed, ending capture: {e}")
+                break
             except Exception as e:
                 logger.error(f"Error in packet capture processing: {e}")
     
     def stop(self) -> None:
         """Stop packet processing."""
         self.running = False
+        if self.native_receiver and self.native_receiver.poll() is None:
+            self.native_receiver.terminate()
+            try:
+                self.native_receiver.wait(timeout=2.0)
+            except subprocess.TimeoutExpired:
+                self.native_receiver.kill()
         if self.packet_server:
             self.packet_server.join(timeout=2.0)
+        if self.loss:
+            logger.info(f"Sequence accounting: {self.loss.summary()}")
+        if self.flow_csv_file:
+            self.flow_csv_file.close()
+            self.flow_csv_file = None
+            self.flow_csv = None
 
 
 class ExtcapFormatter:
@@ -980,6 +1789,44 @@ class ExtcapFormatter:
     def print_config() -> None:
         """Print configuration options for the interface."""
         print("arg {number=0}{call=--debug}{display=Debug mode}{type=boolflag}{default=false}")
+        print("arg {number=1}{call=--snaplen}{display=Snapshot length}"
+              "{tooltip=Maximum bytes captured per packet in VPP, 0 - whole packet}"
+              "{type=unsigned}{range=0,65535}{default=0}")
+        print("arg {number=2}{call=--sample}{display=Sampling rate}"
+              "{tooltip=Capture 1 in N packets in VPP, 0 - every packet}"
+              "{type=unsigned}{default=0}")
+        print("arg {number=3}{call=--max-pps}{display=Rate limit (packets/s)}"
+              "{tooltip=Maximum packets per second captured in VPP, 0 - no limit}"
+              "{type=unsigned}{default=0}")
+        print("arg {number=4}{call=--shm-socket}{display=Shared memory socket}"
+              "{tooltip=Local captures only: Unix socket path to receive the VPP shared memory ring on}"
+              "{type=string}")
+        print("arg {number=5}{call=--pcapng}{display=pcapng from VPP}"
+              "{tooltip=VPP writes pcapng itself, packets are passed to Wireshark unchanged (not with a shared memory socket)}"
+              "{type=boolflag}{default=false}")
+        print("arg {number=6}{call=--tcp}{display=TCP stream}"
+              "{tooltip=VPP connects over TCP instead of sending UDP datagrams, for remote captures over a WAN}"
+              "{type=boolflag}{default=false}")
+        print("arg {number=7}{call=--python-receiver}{display=Python receiver}"
+              f"{{tooltip=Receive UDP datagrams in Python even if {NATIVE_RECEIVER_NAME} is built}}"
+              "{type=boolflag}{default=false}")
+        print("arg {number=8}{call=--compress}{display=LZ4 compression}"
+              "{tooltip=VPP compresses every datagram, for captures over slow links (needs the lz4 Python package)}"
+              "{type=boolflag}{default=false}")
+        print("arg {number=9}{call=--flows}{display=Flow summary}"
+              "{tooltip=VPP sends a record per flow and second instead of the packets, shown as one synthetic packet each (not with a shared memory socket)}"
+              "{type=boolflag}{default=false}")
+        print("arg {number=10}{call=--flow-csv}{display=Flow CSV file}"
+              "{tooltip=With a flow summary, also append every flow record to this CSV file}"
+              "{type=fileselect}{mustexist=false}")
+        print("arg {number=11}{call=--capture-points}{display=Capture points}"
+              "{tooltip=Where VPP captures, space separated: rx, tx, drop (dropped packets, with pcapng from VPP the drop reason as packet comment), "
+              "ip4 and ip6 (IP unicast input, tunnels decapsulated)}"
+              "{type=string}{default=rx tx}")
+        print("arg {number=12}{call=--sequence}{display=Loss accounting}"
+              "{tooltip=VPP numbers its datagrams, lost packets are logged by where they were lost and, with pcapng from VPP, "
+              "recorded as interface drops (UDP only)}"
+              "{type=boolflag}{default=false}")
 
 
 class VppExtcapBridge:
@@ -1089,6 +1936,28 @@ class VppExtcapBridge:
         parser.add_argument('--vpp-port', type=int, default=8080, help='VPP port')
         parser.add_argument('--wireshark-ip', help='Wireshark IP address to use for packet capture bridge')
         parser.add_argument('--wireshark-port', type=int, help='Wireshark port to use for packet capture bridge')
+        parser.add_argument('--snaplen', type=int, default=0, help='Maximum bytes captured per packet in VPP (0 - no limit)')
+        parser.add_argument('--sample', type=int, default=0, help='Capture 1 in N packets in VPP (0 - every packet)')
+        parser.add_argument('--max-pps', type=int, default=0, help='Maximum packets per second captured in VPP (0 - no limit)')
+        parser.add_argument('--shm-socket', help='Read packets from a VPP shared memory ring announced on this Unix socket '
+                                                 '(VPP and Wireshark on the same host only)')
+        parser.add_argument('--pcapng', action='store_true', help='Have VPP encode pcapng and pass it on unchanged '
+                                                                   '(ignored with --shm-socket)')
+        parser.add_argument('--tcp', action='store_true', help='Have VPP connect over TCP instead of sending UDP '
+                                                               'datagrams (ignored with --shm-socket)')
+        parser.add_argument('--compress', action='store_true', help='Have VPP LZ4-compress every datagram '
+                                                                    '(needs the lz4 Python package, '
+                                                                    'ignored with --shm-socket)')
+        parser.add_argument('--flows', action='store_true', help='Have VPP send flow records instead of packets, '
+                                                                 'each shown as a synthetic packet of its flow')
+        parser.add_argument('--flow-csv', help='Append the flow records of --flows to this CSV file')
+        parser.add_argument('--sequence', action='store_true', help='Have VPP number its datagrams and account '
+                                                                    'for lost packets (ignored with --shm-socket '
+                                                                    'and --tcp)')
+        parser.add_argument('--capture-points', default='rx tx',
+                            help='Capture points in VPP, space separated: rx, tx, drop, ip4 and ip6')
+        parser.add_argument('--python-receiver', action='store_true',
+                            help=f'Receive UDP datagrams in Python even if {NATIVE_RECEIVER_NAME} is built')
         parser.add_argument('--debug', action='store_true', help='Enable debug mode')
         
         self.args = parser.parse_args()
@@ -1197,7 +2066,27 @@ class VppExtcapBridge:
             return 1
         
         # Initialize components
-        self.packet_processor = PacketProcessor(self.debug, exit_on_error=True)
+        # Shared rings carry packet records only
+        # Shared rings carry packet records only, flow records are never pcapng
+        flows = self.args.flows
+        if flows and self.args.shm_socket:
+            logger.error("--flows is not supported with --shm-socket")
+            return 1
+        pcapng = self.args.pcapng and not self.args.shm_socket and not flows
+        compress = self.args.compress and not self.args.shm_socket
+        # A TCP stream loses nothing once VPP handed it a datagram
+        sequence = self.args.sequence and not self.args.shm_socket and not self.args.tcp
+        if compress and lz4 is None:
+            logger.error("--compress needs the lz4 package: pip install lz4")
+            return 1
+        try:
+            self.packet_processor = PacketProcessor(self.debug, exit_on_error=True, pcapng=pcapng,
+                                                    compress=compress, flows=flows,
+                                                    flow_csv=self.args.flow_csv if flows else None,
+                                                    sequence=sequence)
+        except OSError as e:
+            logger.error(f"Failed to open {self.args.flow_csv}: {e}")
+            return 1
         self.vpp_agent = VppAgent(
             self.args.vpp_host, 
             self.args.vpp_port, 
@@ -1219,21 +2108,51 @@ class VppExtcapBridge:
         if self.debug:
             logger.debug(f"Found interface name {interface_name} for index {interface_index}")
         
-        # Start packet processor server
-        if self.args.wireshark_port:
-            wireshark_port = self.packet_processor.start_packet_server(self.args.wireshark_port)
-        else:
-            wireshark_port = self.packet_processor.start_packet_server()
-        
-        if wireshark_port == 0:
-            logger.error("Failed to start packet server")
-            return 1
-        
-        # Enable bridge in VPP using real interface name
-        wireshark_ip = self.args.wireshark_ip or NetworkUtils.get_local_ip()
-        bridge_address = f"{wireshark_ip}:{wireshark_port}"
+        native_receiver = None
+        # The native receiver only knows packet records and pcapng
+        if not (self.args.shm_socket or self.args.tcp or self.args.python_receiver or flows):
+            native_receiver = PacketProcessor.find_native_receiver()
         
-        if not self.vpp_agent.enable_bridge(interface_name, bridge_address):
+        if self.args.shm_socket:
+            # Local capture: VPP writes into a shared ring, no datagrams at all
+            self.socket_path = self.args.shm_socket
+            try:
+                self.packet_processor.start_shm_server(self.socket_path)
+            except OSError as e:
+                logger.error(f"Failed to bind {self.socket_path}: {e}")
+                return 1
+            bridge_address = SHM_PREFIX + self.socket_path
+        elif native_receiver and self.packet_processor.start_native_receiver(
+                native_receiver, self.args.wireshark_port, interface_index, fifo_path):
+            # UDP datagrams straight to the FIFO, this process only drives VPP
+            wireshark_ip = self.args.wireshark_ip or NetworkUtils.get_local_ip()
+            bridge_address = f"{wireshark_ip}:{self.packet_processor.wireshark_port}"
+        else:
+            if native_receiver:
+                logger.warning("Native receiver failed to start, using the Python receiver")
+                native_receiver = None
+            
+            # Start packet processor server
+            if self.args.wireshark_port:
+                wireshark_port = self.packet_processor.start_packet_server(self.args.wireshark_port,
+                                                                           self.args.tcp)
+            else:
+                wireshark_port = self.packet_processor.start_packet_server(tcp=self.args.tcp)
+            
+            if wireshark_port == 0:
+                logger.error("Failed to start packet server")
+                return 1
+            
+            # Enable bridge in VPP using real interface name
+            wireshark_ip = self.args.wireshark_ip or NetworkUtils.get_local_ip()
+            bridge_address = f"{wireshark_ip}:{wireshark_port}"
+            if self.args.tcp:
+                bridge_address = TCP_PREFIX + bridge_address
+        
+        if not self.vpp_agent.enable_bridge(interface_name, bridge_address, self.args.snaplen,
+                                            self.args.extcap_capture_filter,
+                                            self.args.sample, self.args.max_pps, pcapng, compress,
+                                            flows, self.args.capture_points, sequence):
             logger.error(f"Failed to enable bridge for interface {interface_name}")
             self.packet_processor.stop()
             return 1
@@ -1241,13 +2160,20 @@ class VppExtcapBridge:
         if self.debug:
             logger.debug(f"Bridge enabled for interface {interface_name} to {bridge_address}")
         
-        # Start capture thread (still using interface_index for packet filtering)
+        # Start capture thread (still using interface_index for packet filtering),
+        # the native receiver filters and writes by itself
         self.packet_processor.running = True
-        self.capture_thread = threading.Thread(
-            target=self.packet_processor.capture_packets,
-            args=(interface_index, fifo_path),
-            daemon=True
-        )
+        if native_receiver:
+            self.capture_thread = threading.Thread(
+                target=self.packet_processor.wait_native_receiver,
+                daemon=True
+            )
+        else:
+            self.capture_thread = threading.Thread(
+                target=self.packet_processor.capture_packets,
+                args=(interface_index, fifo_path),
+                daemon=True
+            )
         self.capture_thread.start()
         
         if self.debug:
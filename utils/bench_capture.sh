@@ -0,0 +1,166 @@
+#!/bin/bash
+
+# =========================================================================
+# VPP-Wireshark Bridge capture load test
+#
+# Drives a packet-generator stream through the wireshark-bridge-rx node for
+# a sweep of packet sizes and destinations and reports, per run:
+#   - clocks/packet of wireshark-bridge-rx from `show runtime`
+#   - packets/s generated and mirrored (sent by the plugin)
+#   - drop rate, the share of generated packets that were not mirrored
+# A "none" destination runs the same stream without capture, as the
+# baseline to compare against.
+#
+# Run it on the VPP host, once per VPP worker configuration to compare
+# worker counts (`cpu { workers N }` in startup.conf needs a restart).
+#
+# Usage: bench_capture.sh [-s "64 512 1500"] [-d "none udp unix"]
+#                         [-r <pps>] [-t <seconds>] [-p <port>]
+# =========================================================================
+
+VPPCTL="${VPPCTL:-vppctl}"
+SIZES="64 128 512 1500"
+DESTINATIONS="none udp unix"
+RATE="1e6"
+DURATION=5
+PORT=9500
+UNIX_SOCKET="/tmp/wireshark_bridge_bench.sock"
+SINK_PID=""
+
+while getopts "s:d:r:t:p:" opt; do
+    case "${opt}" in
+        s) SIZES="${OPTARG}" ;;
+        d) DESTINATIONS="${OPTARG}" ;;
+        r) RATE="${OPTARG}" ;;
+        t) DURATION="${OPTARG}" ;;
+        p) PORT="${OPTARG}" ;;
+        *) sed -n 's/^# Usage: //p' "$0"; exit 1 ;;
+    esac
+done
+
+# -------------------------------------------------------------------------
+# Sink discarding whatever the plugin sends
+# -------------------------------------------------------------------------
+start_sink() {
+    python3 - "$1" "${PORT}" "${UNIX_SOCKET}" <<'EOF' &
+import os, socket, sys
+kind, port, path = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+if kind == "udp":
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port))
+else:
+    if os.path.exists(path):
+        os.unlink(path)
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    sock.bind(path)
+sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 64 << 20)
+buf = bytearray(65536)
+while True:
+    sock.recv_into(buf)
+EOF
+    SINK_PID=$!
+    sleep 0.5
+}
+
+stop_sink() {
+    if [ -n "${SINK_PID}" ]; then
+        kill "${SINK_PID}" 2>/dev/null
+        wait "${SINK_PID}" 2>/dev/null
+        SINK_PID=""
+    fi
+    rm -f "${UNIX_SOCKET}"
+}
+
+cleanup() {
+    stop_sink
+    ${VPPCTL} packet-generator delete wb_bench >/dev/null 2>&1
+    ${VPPCTL} wireshark bridge disable pg0 >/dev/null 2>&1
+    exit 0
+}
+
+trap cleanup SIGINT SIGTERM
+
+# -------------------------------------------------------------------------
+# Helpers reading VPP state
+# -------------------------------------------------------------------------
+
+# Vectors and vector-weighted clocks/packet of a node over all threads
+node_runtime() {
+    ${VPPCTL} show runtime | awk -v node="$1" '
+        $1 == node { vectors += $4; clocks += $4 * $6 }
+        END { printf "%d %.1f\n", vectors, vectors ? clocks / vectors : 0 }'
+}
+
+# Packets the plugin sent for pg0
+mirrored_packets() {
+    ${VPPCTL} wireshark bridge stats pg0 | awk '$1 == "pg0" { sent += $3 } END { print sent + 0 }'
+}
+
+# -------------------------------------------------------------------------
+# Runs
+# -------------------------------------------------------------------------
+WORKERS=$(${VPPCTL} show threads | grep -c workers)
+
+${VPPCTL} create packet-generator interface pg0 >/dev/null 2>&1
+${VPPCTL} set interface state pg0 up
+
+printf "Workers: %s, rate: %s pps, %s s per run\n" "${WORKERS}" "${RATE}" "${DURATION}"
+printf "%-6s %-6s %-10s %-14s %-14s %-10s\n" "Dest" "Size" "Clk/pkt" "Generated pps" "Mirrored pps" "Drops %"
+
+for dest in ${DESTINATIONS}; do
+    for size in ${SIZES}; do
+        case "${dest}" in
+            udp)  start_sink udp;  bridge="127.0.0.1:${PORT}" ;;
+            unix) start_sink unix; bridge="${UNIX_SOCKET}" ;;
+            *)    bridge="" ;;
+        esac
+
+        ${VPPCTL} packet-generator delete wb_bench >/dev/null 2>&1
+        ${VPPCTL} exec /dev/stdin <<EOF
+packet-generator new {
+  name wb_bench
+  limit -1
+  rate ${RATE}
+  size ${size}-${size}
+  interface pg0
+  node ethernet-input
+  data {
+    IP4: 00:01:02:03:04:05 -> 00:06:07:08:09:0a
+    UDP: 192.168.0.1 -> 192.168.0.2
+    UDP: 1234 -> 5678
+    incrementing 100
+  }
+}
+EOF
+
+        # Without a session the rx node is not on the arc, baseline is ethernet-input
+        if [ -n "${bridge}" ]; then
+            ${VPPCTL} wireshark bridge enable pg0 "${bridge}" rx >/dev/null
+            node="wireshark-bridge-rx"
+        else
+            node="ethernet-input"
+        fi
+
+        ${VPPCTL} clear runtime
+        ${VPPCTL} packet-generator enable-stream wb_bench
+        sleep "${DURATION}"
+        ${VPPCTL} packet-generator disable-stream wb_bench
+        sleep 0.2
+
+        read -r vectors clocks <<< "$(node_runtime "${node}")"
+        mirrored=0
+        if [ -n "${bridge}" ]; then
+            mirrored=$(mirrored_packets)
+            ${VPPCTL} wireshark bridge disable pg0 "${bridge}" >/dev/null
+        fi
+        stop_sink
+
+        awk -v d="${dest}" -v s="${size}" -v c="${clocks}" -v v="${vectors}" -v m="${mirrored}" \
+            -v t="${DURATION}" -v b="${bridge}" 'BEGIN {
+            drops = (b != "" && v) ? 100 * (v - m) / v : 0
+            printf "%-6s %-6s %-10s %-14.0f %-14.0f %-10.2f\n", d, s, c, v / t, m / t, drops
+        }'
+    done
+done
+
+cleanup
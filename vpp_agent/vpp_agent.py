@@ -9,6 +9,9 @@ Provides a REST API interface to VPP (Vector Packet Processing) for:
 - Managing Wireshark bridge connections
 - Executing VPP commands
 - Collecting statistics
+
+Requests go through vppctl, or through a persistent binary API connection
+with --api-socket.
 """
 
 import json
@@ -23,6 +26,8 @@ import os
 import select
 import sys
 import fcntl  # For file locking
+import mmap
+import struct
 from http.server import HTTPServer, BaseHTTPRequestHandler
 from socketserver import ThreadingMixIn
 from typing import Dict, List, Any, Optional, Union, Tuple
@@ -36,16 +41,39 @@ logger = logging.getLogger('vpp_agent')
 
 # Global variables
 GLOBAL_UNIX_SOCKET = None
+GLOBAL_USE_SHM = False  # Proxy reads VPP's shared memory ring instead of datagrams
 GLOBAL_BRIDGE_ADDRESS = None
 GLOBAL_PROXY_THREAD = None
 GLOBAL_PROXY_RUNNING = False
 GLOBAL_PROXY_LOCK = threading.Lock()  # Lock for synchronizing proxy thread operations
+GLOBAL_STATS_SOCKET = None  # VPP stats segment socket, bridge stats are parsed from the CLI without it
+GLOBAL_API_SOCKET = None  # VPP binary API socket, requests go through vppctl without it
 
 # Path to store agent data (lock files, etc.)
 DATA_DIR = os.path.join(os.path.expanduser("~"), ".vpp_agent")
 
 # Maximum UDP datagram size
 MAX_DATAGRAM_SIZE = 65507
+
+# Capture point keywords of "wireshark bridge enable"
+CAPTURE_POINTS = ("rx", "tx", "both", "drop", "ip4", "ip6")
+
+# direction_mask bits and output_format values of wireshark_bridge_enable
+# (see vpp_plugin/wireshark_bridge/wireshark_bridge.api)
+CAPTURE_POINT_MASKS = {"rx": 1, "tx": 2, "both": 3, "drop": 4, "ip4": 8, "ip6": 16}
+OUTPUT_FORMATS = {"records": 0, "pcapng": 1}
+ALL_INTERFACES = 0xffffffff
+IF_STATUS_API_FLAG_ADMIN_UP = 1
+
+# Shared memory ring of "shm:" destinations (see vpp_plugin/wireshark_bridge/shm.h)
+SHM_PREFIX = "shm:"
+SHM_MAGIC = 0x57425352
+SHM_VERSION = 1
+SHM_ANNOUNCE_FORMAT = "=IIQQ"  # magic, version, mapping size, ring id
+SHM_HEADER_FORMAT = "=IHHQQQI"  # magic, version, header size, data size, ring id, dropped, closed
+SHM_WRITE_POS_OFFSET = 64
+SHM_READ_POS_OFFSET = 128
+SHM_RECORD_ALIGN = 8
 # Lock file for single instance
 LOCK_FILE = '/tmp/vpp_agent.lock'
 # Lock file descriptor
@@ -111,6 +139,163 @@ class VPPCommandExecutor:
             return {"success": False, "error": f"Command execution failed: {str(e)}"}
 
 
+class VPPBinaryAPI:
+    """
+    Persistent connection to the VPP binary API (needs vpp_papi)
+    
+    Keeps the interface metadata of VPP in a cache, filled on the first
+    request and refreshed when VPP reports an interface it does not know
+    about or the deletion of one. Calls are serialized, a vpp_papi client
+    is not meant to be shared between threads.
+    """
+    
+    _instance = None
+    _instance_lock = threading.Lock()
+    
+    @classmethod
+    def get(cls) -> Optional['VPPBinaryAPI']:
+        """
+        Get the shared connection, connecting on first use
+        
+        Returns:
+            The connection, or None without --api-socket or if VPP cannot be
+            reached, callers fall back to vppctl then
+        """
+        if not GLOBAL_API_SOCKET:
+            return None
+        with cls._instance_lock:
+            if cls._instance is None:
+                try:
+                    cls._instance = cls(GLOBAL_API_SOCKET)
+                except Exception as e:
+                    logger.warning(f"Failed to connect to the VPP binary API, falling back to vppctl: {e}")
+                    return None
+            return cls._instance
+    
+    @classmethod
+    def reset(cls) -> None:
+        """Drop the shared connection after an error, the next request reconnects"""
+        with cls._instance_lock:
+            if cls._instance is not None:
+                try:
+                    cls._instance.vpp.disconnect()
+                except Exception:
+                    pass
+                cls._instance = None
+    
+    def __init__(self, socket_path: str):
+        from vpp_papi import VPPApiClient
+        self.lock = threading.Lock()
+        self.interfaces = {}  # sw_if_index -> interface dict, see VPPInterfaceManager
+        self.interfaces_stale = True
+        self.vpp = VPPApiClient(server_address=socket_path)
+        self.vpp.connect("vpp_agent")
+        self.vpp.register_event_callback(self._on_event)
+        self.vpp.api.want_interface_events(enable_disable=True, pid=os.getpid())
+        logger.info(f"Connected to the VPP binary API on {socket_path}")
+    
+    def _on_event(self, msg_name: str, msg: Any) -> None:
+        """Keep the interface cache up to date, runs on the vpp_papi event thread"""
+        if msg_name != "sw_interface_event":
+            return
+        with self.lock:
+            interface = self.interfaces.get(msg.sw_if_index)
+            if msg.deleted:
+                self.interfaces.pop(msg.sw_if_index, None)
+            elif interface is None:
+                self.interfaces_stale = True
+            else:
+                interface["is_up"] = bool(int(msg.flags) & IF_STATUS_API_FLAG_ADMIN_UP)
+    
+    def _refresh_interfaces(self) -> None:
+        """Rebuild the interface cache, called with the lock held"""
+        self.interfaces_stale = False
+        details = {d.sw_if_index: d for d in self.vpp.api.sw_interface_dump()}
+        reply = self.vpp.api.wireshark_bridge_get_interfaces()
+        
+        interfaces = {}
+        for info in reply.interfaces:
+            d = details.get(info.sw_if_index)
+            interface = {
+                "name": info.name,
+                "description": info.name,
+                "is_up": bool(d and int(d.flags) & IF_STATUS_API_FLAG_ADMIN_UP),
+                "mac_address": str(d.l2_address) if d else "",
+                "ip_addresses": [],
+                "sw_if_index": info.sw_if_index,
+                "mtu": {},
+                "stats": {}
+            }
+            if d:
+                interface["mtu"] = dict(zip(("l3", "ip4", "ip6", "mpls"), d.mtu))
+                for is_ipv6 in (False, True):
+                    for a in self.vpp.api.ip_address_dump(sw_if_index=info.sw_if_index, is_ipv6=is_ipv6):
+                        interface["ip_addresses"].append(str(a.prefix.ip))
+            interfaces[info.sw_if_index] = interface
+        
+        self.interfaces = interfaces
+        logger.info(f"Cached {len(interfaces)} interfaces from the binary API")
+    
+    def get_interfaces(self) -> List[Dict[str, Any]]:
+        """Get the cached interfaces, in sw_if_index order"""
+        with self.lock:
+            if self.interfaces_stale:
+                self._refresh_interfaces()
+            return [dict(self.interfaces[i]) for i in sorted(self.interfaces)]
+    
+    def get_sw_if_index(self, name: str) -> Optional[int]:
+        """Look an interface name up in the cache, refreshing it once if needed"""
+        with self.lock:
+            for refresh in (self.interfaces_stale, True):
+                if refresh:
+                    self._refresh_interfaces()
+                for sw_if_index, interface in self.interfaces.items():
+                    if interface["name"] == name:
+                        return sw_if_index
+        return None
+    
+    def get_bridge_stats(self) -> Dict[str, Any]:
+        """Get the bridge counters of every captured interface, keyed by interface name"""
+        names = {i["sw_if_index"]: i["name"] for i in self.get_interfaces()}
+        with self.lock:
+            reply = self.vpp.api.wireshark_bridge_get_stats(sw_if_index=ALL_INTERFACES)
+        
+        # Counters of an interface captured by several sessions are summed up
+        stats = {}
+        for entry in reply.stats:
+            interface_name = names.get(entry.sw_if_index, str(entry.sw_if_index))
+            interface_stats = stats.setdefault(interface_name, {
+                "rx_packets": 0,
+                "rx_bytes": 0,
+                "tx_packets": 0,
+                "tx_bytes": 0,
+                "sampled_out": 0,
+                "policed": 0
+            })
+            interface_stats["rx_packets"] += entry.packets_sent_rx
+            interface_stats["rx_bytes"] += entry.bytes_sent_rx
+            interface_stats["tx_packets"] += entry.packets_sent_tx
+            interface_stats["tx_bytes"] += entry.bytes_sent_tx
+            interface_stats["sampled_out"] += entry.packets_sampled_out
+            interface_stats["policed"] += entry.packets_policed
+        
+        return {"stats": stats}
+    
+    def call(self, name: str, **kwargs: Any) -> Dict[str, Any]:
+        """
+        Send a request with an autoreply and check its retval
+        
+        Returns:
+            Dict in the form of VPPCommandExecutor.execute_command
+        """
+        logger.info(f"VPP API call: {name} {kwargs}")
+        with self.lock:
+            reply = getattr(self.vpp.api, name)(**kwargs)
+        if reply.retval != 0:
+            return {"success": False, "output": "", "error": f"{name} failed with retval {reply.retval}"}
+        return {"success": True, "output": "", "error": ""}
+
+
 class VPPInterfaceManager:
     """Manages VPP interface operations"""
     
@@ -124,6 +309,14 @@ class VPPInterfaceManager:
         Returns:
             Dict containing interfaces information or error
         """
+        api = VPPBinaryAPI.get()
+        if api:
+            try:
+                return {"interfaces": api.get_interfaces()}
+            except Exception as e:
+                logger.warning(f"Failed to get interfaces over the binary API, falling back to vppctl: {e}")
+                VPPBinaryAPI.reset()
+        
         try:
             # First get basic interface information
             output = self.executor.execute_command("show interface")
@@ -371,11 +564,94 @@ class VPPInterfaceManager:
                             logger.debug(f"Found IPv6 address {part} for interface {current_interface['name']}")
 
 
+# Stats segment counters of the plugin, see wireshark_bridge.h
+BRIDGE_STATS_PREFIX = "/wireshark-bridge/"
+BRIDGE_COMBINED_STATS = {"sent-rx": ("rx_packets", "rx_bytes"), "sent-tx": ("tx_packets", "tx_bytes"),
+                         "mirrored-rx": ("mirrored_rx_packets", "mirrored_rx_bytes"),
+                         "mirrored-tx": ("mirrored_tx_packets", "mirrored_tx_bytes")}
+BRIDGE_SIMPLE_STATS = {"sampled-out": "sampled_out", "policed": "policed",
+                       "dropped-queue-full": "dropped_queue_full", "dropped-filter": "dropped_filter",
+                       "dropped-stalled": "dropped_stalled"}
+
+
+class VPPStatsSegmentReader:
+    """Reads the plugin counters straight from the VPP stats segment (needs vpp_papi)"""
+    
+    def __init__(self, socket_path: str):
+        from vpp_papi.vpp_stats import VPPStats
+        self.stats = VPPStats(socketname=socket_path)
+        self.stats.connect()
+    
+    @staticmethod
+    def _sum_threads(counter: Any, index: int, field: Optional[int] = None) -> int:
+        """Sum up one counter index over all threads
+        
+        Args:
+            counter: Per thread vectors of the counter
+            index: Counter index (sw_if_index)
+            field: 0 for packets, 1 for bytes of a combined counter, None for a simple one
+        """
+        total = 0
+        for per_thread in counter:
+            if index >= len(per_thread):
+                continue
+            value = per_thread[index]
+            if field is not None:
+                if isinstance(value, dict):
+                    value = value["packets" if field == 0 else "bytes"]
+                else:
+                    value = value[field]
+            total += int(value)
+        return total
+    
+    def get_bridge_stats(self) -> Dict[str, Any]:
+        """Get the bridge counters of every interface, keyed by interface name"""
+        names = self.stats['/if/names']
+        counters = {name: self.stats[BRIDGE_STATS_PREFIX + name]
+                    for name in list(BRIDGE_COMBINED_STATS) + list(BRIDGE_SIMPLE_STATS)}
+        
+        stats = {}
+        for sw_if_index, interface_name in enumerate(names):
+            if not interface_name:
+                continue
+            interface_stats = {}
+            for name, (packets_key, bytes_key) in BRIDGE_COMBINED_STATS.items():
+                interface_stats[packets_key] = self._sum_threads(counters[name], sw_if_index, 0)
+                interface_stats[bytes_key] = self._sum_threads(counters[name], sw_if_index, 1)
+            for name, key in BRIDGE_SIMPLE_STATS.items():
+                interface_stats[key] = self._sum_threads(counters[name], sw_if_index)
+            # Interfaces never captured have every counter at zero
+            if any(interface_stats.values()):
+                stats[interface_name] = interface_stats
+        
+        return {"stats": stats}
+    
+    def get_interface_stats(self) -> Dict[str, Any]:
+        """Get the rx/tx counters of every interface, keyed by interface name"""
+        names = self.stats['/if/names']
+        rx = self.stats['/if/rx']
+        tx = self.stats['/if/tx']
+        
+        stats = {}
+        for sw_if_index, interface_name in enumerate(names):
+            if not interface_name:
+                continue
+            stats[interface_name] = {
+                "rx_packets": self._sum_threads(rx, sw_if_index, 0),
+                "rx_bytes": self._sum_threads(rx, sw_if_index, 1),
+                "tx_packets": self._sum_threads(tx, sw_if_index, 0),
+                "tx_bytes": self._sum_threads(tx, sw_if_index, 1)
+            }
+        
+        return stats
+
+
 class VPPStatisticsCollector:
     """Collects and processes VPP statistics"""
     
     def __init__(self, executor: VPPCommandExecutor):
         self.executor = executor
+        self.stats_reader = None
     
     def get_vpp_stats(self) -> Dict[str, Any]:
         """
@@ -385,12 +661,15 @@ class VPPStatisticsCollector:
             Dict containing interface statistics or error
         """
         try:
-            output = self.executor.execute_command("show interface")
+            stats = self._get_stats_segment_interface_stats()
+            output = {"success": True, "output": ""}
+            if stats is None:
+                stats = {}
+                output = self.executor.execute_command("show interface")
             
             if not output["success"]:
                 return {"error": "Failed to get statistics"}
             
-            stats = {}
             lines = output.get('output', '').split('\n')
             current_interface = None
             
@@ -431,6 +710,19 @@ class VPPStatisticsCollector:
             logger.error(f"Error getting VPP stats: {e}")
             return {"error": f"Failed to get statistics: {str(e)}"}
     
+    def _get_stats_segment_interface_stats(self) -> Optional[Dict[str, Any]]:
+        """Interface counters from the stats segment, None without it"""
+        if not GLOBAL_STATS_SOCKET:
+            return None
+        try:
+            if self.stats_reader is None:
+                self.stats_reader = VPPStatsSegmentReader(GLOBAL_STATS_SOCKET)
+            return self.stats_reader.get_interface_stats()
+        except Exception as e:
+            logger.warning(f"Failed to read the stats segment, falling back to the CLI: {e}")
+            self.stats_reader = None
+            return None
+    
     def _parse_interface_stats(self, line: str, stats_dict: Dict[str, int]) -> None:
         """
         Parse a line of interface statistics output
@@ -486,6 +778,24 @@ class VPPStatisticsCollector:
         Returns:
             Dict containing bridge statistics or empty dict if not available
         """
+        # The stats segment needs no CLI round trip and no text parsing
+        if GLOBAL_STATS_SOCKET:
+            try:
+                if self.stats_reader is None:
+                    self.stats_reader = VPPStatsSegmentReader(GLOBAL_STATS_SOCKET)
+                return self.stats_reader.get_bridge_stats()
+            except Exception as e:
+                logger.warning(f"Failed to read the stats segment, falling back to the CLI: {e}")
+                self.stats_reader = None
+        
+        api = VPPBinaryAPI.get()
+        if api:
+            try:
+                return api.get_bridge_stats()
+            except Exception as e:
+                logger.warning(f"Failed to get bridge stats over the binary API, falling back to the CLI: {e}")
+                VPPBinaryAPI.reset()
+        
         try:
             output = self.executor.execute_command("wireshark bridge stats")
             
@@ -495,39 +805,41 @@ class VPPStatisticsCollector:
             stats = {}
             lines = output.get('output', '').split('\n')
             
-            # Find the header line
-            header_index = -1
-            for i, line in enumerate(lines):
-                if "Interface" in line and "RX Packets" in line:
-                    header_index = i
-                    break
-            
-            if header_index == -1:
-                return {"stats": {}}
-            
-            # Parse data lines after the header
-            for j in range(header_index + 1, len(lines)):
-                line = lines[j].strip()
-                if not line:
+            # Every capture session prints its own interface table:
+            #   <interface> <Yes|No> <rx packets> <rx bytes> <tx packets> <tx bytes>
+            #   [<sampled out> <policed>]
+            # Counters of an interface captured by several sessions are summed up
+            for line in lines:
+                parts = line.split()
+                if len(parts) < 6 or parts[1] not in ("Yes", "No"):
                     continue
                 
-                parts = line.split()
-                if len(parts) >= 5:
-                    interface_name = parts[0]
-                    try:
-                        rx_packets = int(parts[1])
-                        rx_bytes = int(parts[2])
-                        tx_packets = int(parts[3])
-                        tx_bytes = int(parts[4])
-                        
-                        stats[interface_name] = {
-                            "rx_packets": rx_packets,
-                            "rx_bytes": rx_bytes,
-                            "tx_packets": tx_packets,
-                            "tx_bytes": tx_bytes
-                        }
-                    except (ValueError, IndexError):
-                        logger.warning(f"Failed to parse bridge stats line: {line}")
+                interface_name = parts[0]
+                try:
+                    rx_packets = int(parts[2])
+                    rx_bytes = int(parts[3])
+                    tx_packets = int(parts[4])
+                    tx_bytes = int(parts[5])
+                    sampled_out = int(parts[6]) if len(parts) >= 8 else 0
+                    policed = int(parts[7]) if len(parts) >= 8 else 0
+                except (ValueError, IndexError):
+                    logger.warning(f"Failed to parse bridge stats line: {line}")
+                    continue
+                
+                interface_stats = stats.setdefault(interface_name, {
+                    "rx_packets": 0,
+                    "rx_bytes": 0,
+                    "tx_packets": 0,
+                    "tx_bytes": 0,
+                    "sampled_out": 0,
+                    "policed": 0
+                })
+                interface_stats["rx_packets"] += rx_packets
+                interface_stats["rx_bytes"] += rx_bytes
+                interface_stats["tx_packets"] += tx_packets
+                interface_stats["tx_bytes"] += tx_bytes
+                interface_stats["sampled_out"] += sampled_out
+                interface_stats["policed"] += policed
             
             return {"stats": stats}
         
@@ -576,7 +888,44 @@ class VPPBridgeManager:
         
         return status
     
-    def enable_bridge(self, interface: str, bridge_address: str, unix_socket: str = None) -> Dict[str, Any]:
+    @staticmethod
+    def compile_filter(expression: str) -> Dict[str, Any]:
+        """
+        Compile a capture filter expression to classic BPF bytecode
+        
+        Uses tcpdump for the Ethernet link type, the plugin runs the program
+        on frames as they are seen by the capture nodes.
+        
+        Args:
+            expression: Capture filter in pcap-filter syntax
+            
+        Returns:
+            Dict containing success status and the bytecode in
+            "N,code jt jf k,..." form or an error message
+        """
+        try:
+            result = subprocess.run(
+                ["tcpdump", "-y", "EN10MB", "-ddd", expression],
+                capture_output=True,
+                text=True,
+                check=False
+            )
+        except Exception as e:
+            logger.error(f"Error compiling capture filter: {e}")
+            return {"success": False, "error": f"Filter compilation failed: {str(e)}"}
+        
+        if result.returncode != 0:
+            return {"success": False, "error": f"Invalid capture filter: {result.stderr.strip()}"}
+        
+        lines = [line.strip() for line in result.stdout.splitlines() if line.strip()]
+        return {"success": True, "bytecode": ",".join(lines)}
+    
+    def enable_bridge(self, interface: str, bridge_address: str, unix_socket: str = None,
+                      snaplen: int = 0, direction: str = "both",
+                      capture_filter: str = None, sample: int = 0,
+                      max_pps: int = 0, max_bps: int = 0,
+                      output_format: str = "records", compress: bool = False,
+                      flows: bool = False, sequence: bool = False) -> Dict[str, Any]:
         """
         Enable Wireshark bridge for an interface
         
@@ -584,6 +933,22 @@ class VPPBridgeManager:
             interface: Interface name
             bridge_address: Bridge address (IP:port)
             unix_socket: Optional path to Unix socket
+            snaplen: Maximum number of bytes captured per packet (0 - no limit)
+            direction: Capture points, space separated: "rx", "tx", "both",
+                       "drop" (error-drop, with the drop reason), "ip4"
+                       (ip4-unicast) and "ip6" (ip6-unicast)
+            capture_filter: Optional capture filter expression, applied in VPP
+                            before packets are copied
+            sample: Capture 1 in N packets of the interface (0 or 1 - all)
+            max_pps: Capture rate limit of the interface in packets/s (0 - none)
+            max_bps: Capture rate limit of the interface in bits/s (0 - none)
+            output_format: "records" or "pcapng" to have VPP send ready pcapng
+                           sections
+            compress: Have VPP LZ4-compress every datagram on its sender threads
+            flows: Have VPP send flow records (5-tuple, packets, bytes) instead
+                   of packets, see the extcap --flows option
+            sequence: Have VPP number its datagrams, so that the receiver can
+                      account for lost ones, see the extcap --sequence option
             
         Returns:
             Dict containing success status and error message if any
@@ -596,6 +961,26 @@ class VPPBridgeManager:
         if not unix_socket and (not bridge_address or not isinstance(bridge_address, str)):
             return {"success": False, "error": "Invalid bridge address"}
         
+        if not isinstance(snaplen, int) or snaplen < 0:
+            return {"success": False, "error": "Invalid snaplen"}
+        
+        points = direction.split() if isinstance(direction, str) else []
+        if not points or any(p not in CAPTURE_POINTS for p in points):
+            return {"success": False, "error": "Invalid direction"}
+        
+        for name, value in (("sample", sample), ("max_pps", max_pps), ("max_bps", max_bps)):
+            if not isinstance(value, int) or value < 0:
+                return {"success": False, "error": f"Invalid {name}"}
+        
+        if output_format not in ("records", "pcapng"):
+            return {"success": False, "error": "Invalid format"}
+        
+        api = VPPBinaryAPI.get()
+        if api:
+            return self._enable_bridge_api(api, interface, unix_socket or bridge_address, snaplen,
+                                           points, capture_filter, sample, max_pps, max_bps,
+                                           output_format, compress, flows, sequence)
+        
         # Construct the command
         command = ""
         if unix_socket:
@@ -603,6 +988,32 @@ class VPPBridgeManager:
         else:
             command = f"wireshark bridge enable {interface} {bridge_address}"
         
+        command += " " + " ".join(points)
+        
+        if snaplen:
+            command += f" snaplen {snaplen}"
+        
+        if sample > 1:
+            command += f" sample {sample}"
+        if max_pps:
+            command += f" max-pps {max_pps}"
+        if max_bps:
+            command += f" max-bps {max_bps}"
+        if output_format == "pcapng":
+            command += " pcapng"
+        if compress:
+            command += " compress"
+        if flows:
+            command += " flows"
+        if sequence:
+            command += " sequence"
+        
+        if capture_filter:
+            compiled = self.compile_filter(capture_filter)
+            if not compiled["success"]:
+                return compiled
+            command += f" filter {shlex.quote(compiled['bytecode'])}"
+        
         # Execute the command
         result = self.executor.execute_command(command)
         logger.info(f"Bridge enable result: {result}")
@@ -611,20 +1022,83 @@ class VPPBridgeManager:
         
         return result
     
-    def disable_bridge(self, interface: Optional[str] = None) -> Dict[str, Any]:
+    def _enable_bridge_api(self, api: VPPBinaryAPI, interface: str, bridge_address: str,
+                           snaplen: int, points: List[str], capture_filter: Optional[str],
+                           sample: int, max_pps: int, max_bps: int, output_format: str,
+                           compress: bool, flows: bool, sequence: bool) -> Dict[str, Any]:
+        """Enable the bridge with wireshark_bridge_enable, arguments as for enable_bridge"""
+        program = []
+        if capture_filter:
+            compiled = self.compile_filter(capture_filter)
+            if not compiled["success"]:
+                return compiled
+            for insn in compiled["bytecode"].split(",")[1:]:
+                code, jt, jf, k = (int(v) for v in insn.split())
+                program.append({"code": code, "jt": jt, "jf": jf, "k": k})
+        
+        direction_mask = 0
+        for point in points:
+            direction_mask |= CAPTURE_POINT_MASKS[point]
+        
+        try:
+            sw_if_index = api.get_sw_if_index(interface)
+            if sw_if_index is None:
+                return {"success": False, "error": f"Unknown interface {interface}"}
+            
+            result = api.call("wireshark_bridge_enable",
+                              sw_if_index=sw_if_index,
+                              bridge_address=bridge_address,
+                              snaplen=snaplen,
+                              direction_mask=direction_mask,
+                              sample_rate=sample,
+                              max_pps=max_pps,
+                              max_bps=max_bps,
+                              output_format=OUTPUT_FORMATS[output_format],
+                              compress=compress,
+                              flows=flows,
+                              sequence=sequence,
+                              filter_len=len(program),
+                              filter=program)
+        except Exception as e:
+            logger.error(f"Error calling the VPP binary API: {e}")
+            VPPBinaryAPI.reset()
+            return {"success": False, "error": f"API call failed: {str(e)}"}
+        
+        logger.info(f"Bridge enable result: {result}")
+        return result
+    
+    def disable_bridge(self, interface: Optional[str] = None,
+                       bridge_address: Optional[str] = None) -> Dict[str, Any]:
         """
         Disable Wireshark bridge for an interface
         
         Args:
             interface: Interface name (optional, if None will disable all bridges)
+            bridge_address: Capture session to disable (optional, if None will
+                            disable the interface in every session)
             
         Returns:
             Dict containing success status and error message if any
         """
+        api = VPPBinaryAPI.get()
+        if api:
+            try:
+                sw_if_index = api.get_sw_if_index(interface) if interface else ALL_INTERFACES
+                if sw_if_index is None:
+                    return {"success": False, "error": f"Unknown interface {interface}"}
+                return api.call("wireshark_bridge_disable", sw_if_index=sw_if_index,
+                                bridge_address=bridge_address or "")
+            except Exception as e:
+                logger.error(f"Error calling the VPP binary API: {e}")
+                VPPBinaryAPI.reset()
+                return {"success": False, "error": f"API call failed: {str(e)}"}
+        
         # Construct the command
         command = "wireshark bridge disable"
         if interface:
             command += f" {interface}"
+        if bridge_address:
+            command += f" {bridge_address}"
         
         # Execute the command
         result = self.executor.execute_command(command)
@@ -708,13 +1182,14 @@ class VPPAPIHandler(BaseHTTPRequestHandler):
         if self.path == '/interfaces':
             interfaces = self.interface_manager.get_interfaces()
             
-            # Add raw command output for debugging
-            try:
-                raw_output = self.executor.execute_command("show interface")
-                if raw_output["success"]:
-                    interfaces["raw_output"] = raw_output["output"]
-            except Exception as e:
-                interfaces["debug_error"] = str(e)
+            # Add raw command output for debugging, unless it came from the cache
+            if not VPPBinaryAPI.get():
+                try:
+                    raw_output = self.executor.execute_command("show interface")
+                    if raw_output["success"]:
+                        interfaces["raw_output"] = raw_output["output"]
+                except Exception as e:
+                    interfaces["debug_error"] = str(e)
                 
             self._send_json_response(interfaces)
             
@@ -759,7 +1234,17 @@ class VPPAPIHandler(BaseHTTPRequestHandler):
                 result = self.bridge_manager.enable_bridge(
                     data['interface'], 
                     bridge_address,
-                    GLOBAL_UNIX_SOCKET
+                    local_destination(),
+                    data.get('snaplen', 0),
+                    data.get('direction', 'both'),
+                    data.get('filter'),
+                    data.get('sample', 0),
+                    data.get('max_pps', 0),
+                    data.get('max_bps', 0),
+                    data.get('format', 'records'),
+                    bool(data.get('compress', False)),
+                    bool(data.get('flows', False)),
+                    bool(data.get('sequence', False))
                 )
                 
                 # If bridge was enabled successfully and we have unix_socket and bridge_address, manage proxy thread
@@ -774,7 +1259,7 @@ class VPPAPIHandler(BaseHTTPRequestHandler):
                     logger.info(f"Starting new proxy thread between {GLOBAL_UNIX_SOCKET} and {bridge_address}")
                     GLOBAL_PROXY_RUNNING = True
                     GLOBAL_PROXY_THREAD = threading.Thread(
-                        target=start_proxy,
+                        target=start_shm_proxy if GLOBAL_USE_SHM else start_proxy,
                         args=(GLOBAL_UNIX_SOCKET, bridge_address),
                         daemon=True
                     )
@@ -790,7 +1275,10 @@ class VPPAPIHandler(BaseHTTPRequestHandler):
             
             with GLOBAL_PROXY_LOCK:  # Lock during the bridge operation to synchronize with other requests
                 # First call the bridge_manager to disable the bridge
-                result = self.bridge_manager.disable_bridge(data['interface'])
+                result = self.bridge_manager.disable_bridge(
+                    data['interface'],
+                    local_destination() or data.get('bridge_address')
+                )
                 
                 # If bridge was disabled successfully, stop proxy thread if running
                 if result["success"]:
@@ -875,6 +1363,194 @@ class VPPAgentServer:
             self.server.server_close()
 
 
+def local_destination() -> Optional[str]:
+    """
+    Destination VPP is pointed at when the agent proxies captures itself
+    
+    Returns:
+        shm:<unix socket>, the Unix socket path, or None without a proxy
+    """
+    if not GLOBAL_UNIX_SOCKET:
+        return None
+    return SHM_PREFIX + GLOBAL_UNIX_SOCKET if GLOBAL_USE_SHM else GLOBAL_UNIX_SOCKET
+
+
+class ShmRingReader:
+    """
+    Reads packet records from the shared memory ring of a VPP capture session
+    
+    VPP passes the memfd of the ring over the Unix datagram socket bound here
+    and repeats the announcement every second. Records are read straight from
+    the mapping, the socket is only looked at while the ring is empty.
+    
+    The agent runs on its own, without the extcap, so it keeps a copy of the
+    extcap's reader; change both together.
+    """
+    
+    def __init__(self, socket_path: str):
+        self.socket_path = socket_path
+        if os.path.exists(socket_path):
+            os.unlink(socket_path)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.sock.bind(socket_path)
+        os.chmod(socket_path, 0o777)  # Set permissions to allow VPP to write to it
+        self.ring = None
+        self.ring_id = None
+        self.header_size = 0
+        self.data_size = 0
+        self.read_pos = 0
+    
+    def _attach(self, fd: int, mapping_size: int, ring_id: int) -> None:
+        """Map a newly announced ring and continue where the last consumer stopped"""
+        try:
+            ring = mmap.mmap(fd, mapping_size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        
+        magic, version, header_size, data_size, _, _, _ = struct.unpack_from(SHM_HEADER_FORMAT, ring, 0)
+        if magic != SHM_MAGIC or version != SHM_VERSION:
+            ring.close()
+            logger.error(f"Unsupported shared ring (magic {magic:#x}, version {version})")
+            return
+        
+        if self.ring:
+            self.ring.close()
+        self.ring = ring
+        self.ring_id = ring_id
+        self.header_size = header_size
+        self.data_size = data_size
+        self.read_pos = struct.unpack_from("=Q", ring, SHM_READ_POS_OFFSET)[0]
+        logger.info(f"Attached to shared ring {ring_id:#x} ({data_size} bytes)")
+    
+    def poll_announcements(self, timeout: float) -> None:
+        """Wait up to timeout seconds for announcements and attach to new rings"""
+        fd_size = struct.calcsize("i")
+        while True:
+            readable, _, _ = select.select([self.sock], [], [], timeout)
+            if not readable:
+                return
+            timeout = 0
+            
+            msg, ancdata, _, _ = self.sock.recvmsg(64, socket.CMSG_SPACE(fd_size))
+            fds = [struct.unpack("i", data[:fd_size])[0]
+                   for level, kind, data in ancdata
+                   if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS]
+            if len(msg) < struct.calcsize(SHM_ANNOUNCE_FORMAT) or not fds:
+                for fd in fds:
+                    os.close(fd)
+                continue
+            
+            magic, version, mapping_size, ring_id = struct.unpack_from(SHM_ANNOUNCE_FORMAT, msg)
+            if magic != SHM_MAGIC or ring_id == self.ring_id:
+                os.close(fds[0])
+                continue
+            self._attach(fds[0], mapping_size, ring_id)
+    
+    def read_records(self, max_bytes: int = 1 << 20) -> List[bytes]:
+        """
+        Read the records published since the last call
+        
+        Args:
+            max_bytes: Stop after about this many bytes of records
+            
+        Returns:
+            Records (21-byte packet header, the drop reason of a drop record,
+            and packet bytes), empty if none
+        """
+        if not self.ring:
+            return []
+        
+        ring = self.ring
+        mask = self.data_size - 1
+        write_pos = struct.unpack_from("=Q", ring, SHM_WRITE_POS_OFFSET)[0]
+        read_pos = self.read_pos
+        records = []
+        n_bytes = 0
+        
+        while read_pos < write_pos and n_bytes < max_bytes:
+            offset = read_pos & mask
+            start = self.header_size + offset
+            record_len = struct.unpack_from("=I", ring, start)[0]
+            
+            # Zero length: the rest of the area is unused, continue at its start
+            if record_len == 0:
+                read_pos += self.data_size - offset
+                continue
+            
+            records.append(ring[start + 4:start + record_len])
+            n_bytes += record_len
+            read_pos += (record_len + SHM_RECORD_ALIGN - 1) & ~(SHM_RECORD_ALIGN - 1)
+        
+        # Hand the space back to VPP
+        if read_pos != self.read_pos:
+            struct.pack_into("=Q", ring, SHM_READ_POS_OFFSET, read_pos)
+            self.read_pos = read_pos
+        
+        return records
+    
+    def dropped(self) -> int:
+        """Number of records VPP dropped because the ring was full"""
+        if not self.ring:
+            return 0
+        return struct.unpack_from(SHM_HEADER_FORMAT, self.ring, 0)[5]
+    
+    def close(self) -> None:
+        """Unmap the ring and remove the socket"""
+        if self.ring:
+            self.ring.close()
+            self.ring = None
+        self.sock.close()
+        if os.path.exists(self.socket_path):
+            os.unlink(self.socket_path)
+
+
+def start_shm_proxy(unix_socket_path: str, bridge_address: str) -> None:
+    """
+    Start a proxy between a VPP shared memory ring and bridge address
+    
+    Records are repacked into datagrams of the usual format, so the extcap
+    side does not need to know about the shared ring.
+    
+    Args:
+        unix_socket_path: Path to Unix socket the ring is announced on
+        bridge_address: Bridge address (IP:port)
+    """
+    global GLOBAL_PROXY_RUNNING
+    
+    logger.info(f"Starting shared ring proxy between {unix_socket_path} and {bridge_address}")
+    
+    host, port = bridge_address.split(':')
+    port = int(port)
+    
+    reader = ShmRingReader(unix_socket_path)
+    bridge_sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    
+    GLOBAL_PROXY_RUNNING = True
+    
+    try:
+        while GLOBAL_PROXY_RUNNING:
+            records = reader.read_records()
+            if not records:
+                # Ring is empty - wait a little, picking up new rings meanwhile
+                reader.poll_announcements(0.001)
+                continue
+            
+            datagram = bytearray()
+            for record in records:
+                if datagram and len(datagram) + len(record) > MAX_DATAGRAM_SIZE:
+                    bridge_sender.sendto(datagram, (host, port))
+                    datagram = bytearray()
+                datagram += record
+            bridge_sender.sendto(datagram, (host, port))
+    except Exception as e:
+        logger.error(f"Proxy error: {str(e)}")
+    finally:
+        logger.info(f"Stopping shared ring proxy and cleaning up sockets, "
+                    f"{reader.dropped()} records dropped on the full ring")
+        reader.close()
+        bridge_sender.close()
+
+
 def start_proxy(unix_socket_path: str, bridge_address: str) -> None:
     """
     Start a proxy between Unix socket and bridge address
@@ -934,7 +1610,16 @@ def main() -> None:
     parser.add_argument('--debug', action='store_true', help='Enable debug logging')
     parser.add_argument('--vppcmd', type=str, default='vppctl', help='VPP command (e.g., vppctl, or "docker exec ...", or /a/b/c/vppctl)')
     parser.add_argument('--unix-socket', type=str, help='Path to Unix socket for proxy')
+    parser.add_argument('--shm', action='store_true',
+                        help='Have VPP write into a shared memory ring announced on --unix-socket '
+                             'instead of sending datagrams to it')
     parser.add_argument('--bridge-address', type=str, help='Bridge address for proxy')
+    parser.add_argument('--stats-socket', type=str,
+                        help='Read bridge counters from the VPP stats segment on this socket '
+                             '(e.g. /run/vpp/stats.sock, needs vpp_papi) instead of the CLI')
+    parser.add_argument('--api-socket', type=str,
+                        help='Talk to VPP over the binary API on this socket (e.g. /run/vpp/api.sock, '
+                             'needs vpp_papi) instead of running --vppcmd for every request')
     args = parser.parse_args()
 
     # Configure logging
@@ -975,13 +1660,20 @@ def main() -> None:
     VPPCommandExecutor.set_vppcmd(args.vppcmd)
     
     # Store unix_socket path in global variable
-    global GLOBAL_UNIX_SOCKET
+    global GLOBAL_UNIX_SOCKET, GLOBAL_USE_SHM
     GLOBAL_UNIX_SOCKET = args.unix_socket
+    GLOBAL_USE_SHM = args.shm
+    if GLOBAL_USE_SHM and not GLOBAL_UNIX_SOCKET:
+        parser.error("--shm requires --unix-socket")
     
     # Store bridge_address in global variable
     global GLOBAL_BRIDGE_ADDRESS
     GLOBAL_BRIDGE_ADDRESS = args.bridge_address
     
+    global GLOBAL_STATS_SOCKET, GLOBAL_API_SOCKET
+    GLOBAL_STATS_SOCKET = args.stats_socket
+    GLOBAL_API_SOCKET = args.api_socket
+    
     # Note: We no longer start the proxy thread here.
     # It will be started by the enable_bridge method when needed
     
@@ -0,0 +1,327 @@
+/*
+ * bench.c - capture path microbenchmark of the VPP Wireshark bridge plugin
+ *
+ * Built with -DWIRESHARK_BRIDGE_BENCH=ON only. "wireshark bridge bench"
+ * feeds synthetic packets of a sweep of sizes through the worker copy
+ * (wireshark_bridge_send_packet) into the main thread's ring of an
+ * existing session, and times how fast its sender thread gets them out
+ * through the session's transport. Run it against a UDP and a Unix socket
+ * session to compare the two; the capture nodes themselves and worker
+ * counts are covered by utils/bench_capture.sh under packet-generator load.
+ *
+ * The command is mp-safe and suspends between bursts, the main thread's
+ * ring has no other producer while it does, as packets captured on the
+ * main thread go in from the same thread.
+ */
+
+#include <vlib/vlib.h>
+#include <vnet/vnet.h>
+#include <vppinfra/time.h>
+
+#include "wireshark_bridge.h"
+
+#define WIRESHARK_BRIDGE_BENCH_BUFFERS 256
+#define WIRESHARK_BRIDGE_BENCH_DRAIN_TIMEOUT 5.0  // Seconds to wait for the sender
+
+typedef struct {
+  u64 capture_clocks;
+  u64 captured;
+  u64 sent;
+  u64 ring_drops;
+  u64 socket_drops;
+  f64 seconds;
+} wireshark_bridge_bench_result_t;
+
+static wireshark_bridge_session_t *
+wireshark_bridge_bench_session (wireshark_bridge_main_t *wbm, u8 *bridge_address)
+{
+  wireshark_bridge_session_t **sp;
+
+  pool_foreach (sp, wbm->sessions)
+    {
+      if (strcmp ((char *) sp[0]->bridge_address, (char *) bridge_address) == 0)
+        return sp[0];
+    }
+
+  return NULL;
+}
+
+/**
+ * @brief Check that the session survived a suspend
+ */
+static int
+wireshark_bridge_bench_session_valid (wireshark_bridge_main_t *wbm, wireshark_bridge_session_t *s,
+                                      u32 session_index)
+{
+  return !pool_is_free_index (wbm->sessions, session_index) && wbm->sessions[session_index] == s;
+}
+
+static u64
+wireshark_bridge_bench_sent (wireshark_bridge_interface_t *wbi, u8 direction)
+{
+  wireshark_bridge_interface_sender_t *c;
+  u64 sent = 0;
+
+  vec_foreach (c, wbi->senders)
+    sent += direction == WIRESHARK_BRIDGE_DIRECTION_RX ? c->packets_sent_rx : c->packets_sent_tx;
+
+  return sent;
+}
+
+static u64
+wireshark_bridge_bench_socket_drops (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_sender_t *sender;
+  u64 drops = 0;
+
+  vec_foreach (sender, s->senders)
+    drops += sender->tx.backpressure_drops;
+
+  return drops;
+}
+
+/**
+ * @brief Wake the sender of the ring if the capture asked for it, as the
+ * capture nodes do at the end of a frame
+ */
+static void
+wireshark_bridge_bench_kick (wireshark_bridge_session_t *s, wireshark_bridge_ring_t *ring)
+{
+  if (ring->wakeup_pending)
+    {
+      ring->wakeup_pending = 0;
+      pthread_cond_signal (&s->senders[ring->sender_index].cond);
+    }
+}
+
+/**
+ * @brief Build a synthetic packet of @c size bytes, chained if it does not
+ * fit into one buffer
+ */
+static u32
+wireshark_bridge_bench_buffer (vlib_main_t *vm, u32 sw_if_index, u32 size)
+{
+  u8 data[1024];
+  vlib_buffer_t *first, *last;
+  u32 bi, i;
+
+  if (vlib_buffer_alloc (vm, &bi, 1) != 1)
+    return ~0;
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i;
+
+  first = last = vlib_get_buffer (vm, bi);
+  first->current_length = 0;
+  first->total_length_not_including_first_buffer = 0;
+  vnet_buffer (first)->sw_if_index[VLIB_RX] = sw_if_index;
+  vnet_buffer (first)->sw_if_index[VLIB_TX] = sw_if_index;
+
+  for (i = 0; i < size; i += sizeof (data))
+    {
+      u16 n = clib_min (size - i, sizeof (data));
+
+      if (vlib_buffer_chain_append_data_with_alloc (vm, first, &last, data, n) != n)
+        {
+          vlib_buffer_free (vm, &bi, 1);
+          return ~0;
+        }
+    }
+
+  return bi;
+}
+
+/**
+ * @brief Run one packet size through the session
+ *
+ * @return 0 on success, -1 if the session went away
+ */
+static int
+wireshark_bridge_bench_run (vlib_main_t *vm, wireshark_bridge_main_t *wbm,
+                            wireshark_bridge_session_t *s, wireshark_bridge_interface_t *wbi,
+                            u32 *buffers, u32 size, u64 n_packets, u8 direction,
+                            wireshark_bridge_bench_result_t *r)
+{
+  wireshark_bridge_ring_t *ring = &s->queue.rings[vm->thread_index];
+  u32 session_index = s->session_index, sw_if_index = wbi->sw_if_index;
+  u64 sent_before = wireshark_bridge_bench_sent (wbi, direction);
+  u64 ring_drops_before = ring->ring_full_drops;
+  u64 socket_drops_before = wireshark_bridge_bench_socket_drops (s);
+  u64 done = 0, t0, expected;
+  f64 start = vlib_time_now (vm), deadline;
+  u32 i;
+
+  clib_memset (r, 0, sizeof (*r));
+
+  while (done < n_packets)
+    {
+      u32 burst = clib_min (n_packets - done, VLIB_FRAME_SIZE);
+
+      /* Leave the ring to the sender until a whole burst fits */
+      wireshark_bridge_ring_recycle_buffers (vm, ring);
+      if (WIRESHARK_BRIDGE_RING_SIZE - (ring->head - clib_atomic_load_acq_n (&ring->tail)) < burst)
+        {
+          wireshark_bridge_bench_kick (s, ring);
+          vlib_process_suspend (vm, 1e-5);
+          if (!wireshark_bridge_bench_session_valid (wbm, s, session_index))
+            return -1;
+          continue;
+        }
+
+      u64 timestamp = unix_time_now_nsec ();
+
+      t0 = clib_cpu_time_now ();
+      for (i = 0; i < burst; i++)
+        {
+          vlib_buffer_t *b = vlib_get_buffer (vm, buffers[(done + i) % WIRESHARK_BRIDGE_BENCH_BUFFERS]);
+
+          wireshark_bridge_send_packet (vm, ring, s, sw_if_index, 0, b, size, size, timestamp,
+                                        direction);
+        }
+      r->capture_clocks += clib_cpu_time_now () - t0;
+
+      wireshark_bridge_bench_kick (s, ring);
+      done += burst;
+    }
+
+  /* Everything that went into the ring has to come out of the sender */
+  expected = n_packets - (ring->ring_full_drops - ring_drops_before);
+  deadline = vlib_time_now (vm) + WIRESHARK_BRIDGE_BENCH_DRAIN_TIMEOUT;
+  while (wireshark_bridge_bench_sent (wbi, direction) - sent_before < expected &&
+         vlib_time_now (vm) < deadline)
+    {
+      wireshark_bridge_ring_recycle_buffers (vm, ring);
+      vlib_process_suspend (vm, 1e-4);
+      if (!wireshark_bridge_bench_session_valid (wbm, s, session_index))
+        return -1;
+    }
+  wireshark_bridge_ring_recycle_buffers (vm, ring);
+
+  r->captured = expected;
+  r->sent = wireshark_bridge_bench_sent (wbi, direction) - sent_before;
+  r->ring_drops = ring->ring_full_drops - ring_drops_before;
+  r->socket_drops = wireshark_bridge_bench_socket_drops (s) - socket_drops_before;
+  r->seconds = vlib_time_now (vm) - start;
+  return 0;
+}
+
+/**
+ * @brief CLI command to benchmark the capture path of a session
+ */
+static clib_error_t *
+wireshark_bridge_bench_command_fn (vlib_main_t * vm,
+                                  unformat_input_t * input,
+                                  vlib_cli_command_t * cmd)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  wireshark_bridge_bench_result_t r;
+  wireshark_bridge_session_t *s;
+  wireshark_bridge_interface_t *wbi;
+  u32 sw_if_index = ~0, size, *sizes = 0, *size_p, buffers[WIRESHARK_BRIDGE_BENCH_BUFFERS];
+  u32 n_buffers, i;
+  u8 *bridge_address = 0, direction = WIRESHARK_BRIDGE_DIRECTION_RX;
+  u64 n_packets = 1000000;
+  clib_error_t *error = 0;
+
+  /* Parse arguments */
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "size %u", &size))
+        vec_add1 (sizes, size);
+      else if (unformat (input, "packets %llu", &n_packets))
+        ;
+      else if (unformat (input, "tx"))
+        direction = WIRESHARK_BRIDGE_DIRECTION_TX;
+      else if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+        ;
+      else if (bridge_address == 0 && unformat (input, "%s", &bridge_address))
+        ;
+      else
+        {
+          error = clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+          goto done;
+        }
+    }
+
+  if (n_packets == 0)
+    {
+      error = clib_error_return (0, "Please specify at least one packet");
+      goto done;
+    }
+
+  if (bridge_address == 0 || sw_if_index == ~0)
+    {
+      error = clib_error_return (0, "Please specify a bridge address and an interface it captures");
+      goto done;
+    }
+
+  s = wireshark_bridge_bench_session (wbm, bridge_address);
+  wbi = s ? wireshark_bridge_find_interface (s, sw_if_index) : NULL;
+  if (wbi == NULL || !wbi->is_enabled)
+    {
+      error = clib_error_return (0, "%s does not capture %U", bridge_address,
+                                 format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index);
+      goto done;
+    }
+
+  if (vec_len (sizes) == 0)
+    {
+      u32 default_sizes[] = { 64, 128, 512, 1500, 9000 };
+
+      for (i = 0; i < ARRAY_LEN (default_sizes); i++)
+        vec_add1 (sizes, default_sizes[i]);
+    }
+
+  vlib_cli_output (vm, "Session %u: %s, %u sender threads, %s",
+                   s->session_index, s->bridge_address, vec_len (s->senders),
+                   s->use_pool_buffers ? "pool buffers" : "ring slots");
+  vlib_cli_output (vm, "%-8s %-12s %-12s %-14s %-12s %-12s %-12s",
+                   "Size", "Clk/pkt", "ns/pkt", "Sent pps", "Sent Mbps", "Ring drops", "Sock drops");
+
+  vec_foreach (size_p, sizes)
+    {
+      size = clib_min (size_p[0], 65535);
+
+      for (n_buffers = 0; n_buffers < WIRESHARK_BRIDGE_BENCH_BUFFERS; n_buffers++)
+        {
+          buffers[n_buffers] = wireshark_bridge_bench_buffer (vm, sw_if_index, size);
+          if (buffers[n_buffers] == ~0)
+            break;
+        }
+
+      if (n_buffers < WIRESHARK_BRIDGE_BENCH_BUFFERS)
+        {
+          vlib_buffer_free (vm, buffers, n_buffers);
+          error = clib_error_return (0, "Out of buffers for %u byte packets", size);
+          goto done;
+        }
+
+      if (wireshark_bridge_bench_run (vm, wbm, s, wbi, buffers, size, n_packets, direction, &r) < 0)
+        {
+          vlib_buffer_free (vm, buffers, n_buffers);
+          error = clib_error_return (0, "Session went away during the benchmark");
+          goto done;
+        }
+      vlib_buffer_free (vm, buffers, n_buffers);
+
+      vlib_cli_output (vm, "%-8u %-12.1f %-12.1f %-14.0f %-12.1f %-12llu %-12llu",
+                       size,
+                       (f64) r.capture_clocks / n_packets,
+                       (f64) r.capture_clocks / n_packets * 1e9 / vm->clib_time.clocks_per_second,
+                       r.sent / r.seconds,
+                       r.sent * size * 8 / r.seconds / 1e6,
+                       r.ring_drops, r.socket_drops);
+    }
+
+done:
+  vec_free (sizes);
+  vec_free (bridge_address);
+  return error;
+}
+
+VLIB_CLI_COMMAND (wireshark_bridge_bench_command, static) = {
+  .path = "wireshark bridge bench",
+  .short_help = "wireshark bridge bench <bridge_address> <interface> [size <bytes>]... [packets <n>] [tx]",
+  .function = wireshark_bridge_bench_command_fn,
+  .is_mp_safe = 1,
+};
@@ -0,0 +1,164 @@
+/*
+ * bpf.c - classic BPF program checks and parsing for the Wireshark bridge
+ */
+
+#include <vppinfra/vec.h>
+
+#include "bpf.h"
+
+/**
+ * @brief Check that a cBPF program is safe to run in the capture nodes
+ *
+ * Same rules as the kernel socket filter checker: known opcodes only,
+ * scratch memory indices in range, no division by a constant zero and
+ * only forward jumps that stay inside the program, which ends with a
+ * return. Together these guarantee the interpreter terminates without
+ * any per-instruction bounds checks.
+ *
+ * @return 1 if the program is valid, 0 otherwise
+ */
+int
+wireshark_bridge_bpf_validate (const wireshark_bridge_bpf_insn_t *insns, u32 n_insns)
+{
+  u32 i;
+
+  if (n_insns == 0 || n_insns > WIRESHARK_BRIDGE_BPF_MAX_INSNS)
+    return 0;
+
+  for (i = 0; i < n_insns; i++)
+    {
+      const wireshark_bridge_bpf_insn_t *insn = &insns[i];
+      u32 n_left = n_insns - i - 1;
+
+      switch (insn->code)
+        {
+        case BPF_LD | BPF_W | BPF_ABS:
+        case BPF_LD | BPF_H | BPF_ABS:
+        case BPF_LD | BPF_B | BPF_ABS:
+        case BPF_LD | BPF_W | BPF_IND:
+        case BPF_LD | BPF_H | BPF_IND:
+        case BPF_LD | BPF_B | BPF_IND:
+        case BPF_LD | BPF_W | BPF_LEN:
+        case BPF_LD | BPF_IMM:
+        case BPF_LDX | BPF_W | BPF_IMM:
+        case BPF_LDX | BPF_W | BPF_LEN:
+        case BPF_LDX | BPF_B | BPF_MSH:
+        case BPF_ALU | BPF_ADD | BPF_K:
+        case BPF_ALU | BPF_ADD | BPF_X:
+        case BPF_ALU | BPF_SUB | BPF_K:
+        case BPF_ALU | BPF_SUB | BPF_X:
+        case BPF_ALU | BPF_MUL | BPF_K:
+        case BPF_ALU | BPF_MUL | BPF_X:
+        case BPF_ALU | BPF_DIV | BPF_X:
+        case BPF_ALU | BPF_MOD | BPF_X:
+        case BPF_ALU | BPF_AND | BPF_K:
+        case BPF_ALU | BPF_AND | BPF_X:
+        case BPF_ALU | BPF_OR | BPF_K:
+        case BPF_ALU | BPF_OR | BPF_X:
+        case BPF_ALU | BPF_XOR | BPF_K:
+        case BPF_ALU | BPF_XOR | BPF_X:
+        case BPF_ALU | BPF_LSH | BPF_K:
+        case BPF_ALU | BPF_LSH | BPF_X:
+        case BPF_ALU | BPF_RSH | BPF_K:
+        case BPF_ALU | BPF_RSH | BPF_X:
+        case BPF_ALU | BPF_NEG:
+        case BPF_MISC | BPF_TAX:
+        case BPF_MISC | BPF_TXA:
+        case BPF_RET | BPF_K:
+        case BPF_RET | BPF_A:
+          break;
+
+        case BPF_ALU | BPF_DIV | BPF_K:
+        case BPF_ALU | BPF_MOD | BPF_K:
+          if (insn->k == 0)
+            return 0;
+          break;
+
+        case BPF_LD | BPF_MEM:
+        case BPF_LDX | BPF_W | BPF_MEM:
+        case BPF_ST:
+        case BPF_STX:
+          if (insn->k >= BPF_MEMWORDS)
+            return 0;
+          break;
+
+        case BPF_JMP | BPF_JA:
+          if (insn->k >= n_left)
+            return 0;
+          break;
+
+        case BPF_JMP | BPF_JEQ | BPF_K:
+        case BPF_JMP | BPF_JEQ | BPF_X:
+        case BPF_JMP | BPF_JGT | BPF_K:
+        case BPF_JMP | BPF_JGT | BPF_X:
+        case BPF_JMP | BPF_JGE | BPF_K:
+        case BPF_JMP | BPF_JGE | BPF_X:
+        case BPF_JMP | BPF_JSET | BPF_K:
+        case BPF_JMP | BPF_JSET | BPF_X:
+          if (insn->jt >= n_left || insn->jf >= n_left)
+            return 0;
+          break;
+
+        default:
+          return 0;
+        }
+    }
+
+  /* Falling off the end is not allowed */
+  return BPF_CLASS (insns[n_insns - 1].code) == BPF_RET;
+}
+
+/**
+ * @brief Parse a cBPF program in `tcpdump -ddd` / iptables bpf format
+ *
+ * The format is the instruction count followed by comma separated
+ * "code jt jf k" quadruples, e.g. "4,48 0 0 9,21 0 1 6,6 0 0 1,6 0 0 0".
+ * On success a new vector of instructions is stored in the argument; the
+ * program is not validated here.
+ */
+uword
+unformat_wireshark_bridge_bpf_program (unformat_input_t * input, va_list * args)
+{
+  wireshark_bridge_bpf_insn_t **result = va_arg (*args, wireshark_bridge_bpf_insn_t **);
+  wireshark_bridge_bpf_insn_t *insns = 0, *insn;
+  u32 n_insns, code, jt, jf, k, i;
+
+  if (!unformat (input, "%u", &n_insns))
+    return 0;
+
+  if (n_insns == 0 || n_insns > WIRESHARK_BRIDGE_BPF_MAX_INSNS)
+    return 0;
+
+  for (i = 0; i < n_insns; i++)
+    {
+      if (!unformat (input, ",%u %u %u %u", &code, &jt, &jf, &k) ||
+          code > 0xffff || jt > 0xff || jf > 0xff)
+        {
+          vec_free (insns);
+          return 0;
+        }
+
+      vec_add2 (insns, insn, 1);
+      insn->code = code;
+      insn->jt = jt;
+      insn->jf = jf;
+      insn->k = k;
+    }
+
+  *result = insns;
+  return 1;
+}
+
+/**
+ * @brief Format a short summary of a cBPF program vector
+ */
+u8 *
+format_wireshark_bridge_bpf_program (u8 * s, va_list * args)
+{
+  wireshark_bridge_bpf_insn_t *insns = va_arg (*args, wireshark_bridge_bpf_insn_t *);
+
+  if (insns == 0)
+    return format (s, "none");
+
+  return format (s, "%u insns", vec_len (insns));
+}
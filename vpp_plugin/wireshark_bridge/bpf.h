@@ -0,0 +1,221 @@
+/*
+ * bpf.h - classic BPF capture filters for the Wireshark bridge plugin
+ *
+ * Programs use the Linux cBPF instruction set, i.e. what `tcpdump -ddd`
+ * prints, and are run by the capture nodes on the first buffer of every
+ * packet before anything is copied.
+ */
+
+#ifndef __included_wireshark_bridge_bpf_h__
+#define __included_wireshark_bridge_bpf_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/byte_order.h>
+#include <vppinfra/format.h>
+
+#include <linux/filter.h>
+
+typedef struct sock_filter wireshark_bridge_bpf_insn_t;
+
+/* Maximum program length, same as the kernel limit for socket filters */
+#define WIRESHARK_BRIDGE_BPF_MAX_INSNS BPF_MAXINSNS
+
+int wireshark_bridge_bpf_validate (const wireshark_bridge_bpf_insn_t *insns, u32 n_insns);
+unformat_function_t unformat_wireshark_bridge_bpf_program;
+format_function_t format_wireshark_bridge_bpf_program;
+
+/* Packet bytes a program loads from: @c prefix_len bytes of a header
+ * built for the capture, then @c len bytes of the buffer */
+typedef struct {
+  u8 *prefix;
+  u32 prefix_len;
+  u8 *data;
+  u32 len;
+} wireshark_bridge_bpf_packet_t;
+
+/**
+ * @brief Load a big-endian value of @c size bytes from the packet
+ *
+ * Returns 0 if the load is out of bounds, which ends the program with a
+ * reject like in the kernel.
+ */
+static_always_inline int
+wireshark_bridge_bpf_load (wireshark_bridge_bpf_packet_t *pkt, u64 offset, u32 size, u32 *value)
+{
+  u8 *data = pkt->data;
+  u32 i;
+
+  if (offset + size > (u64) pkt->prefix_len + pkt->len)
+    return 0;
+
+  if (PREDICT_FALSE (offset < pkt->prefix_len))
+    {
+      /* Byte by byte, a load may span the prefix and the buffer */
+      for (i = 0, *value = 0; i < size; i++)
+        *value = (*value << 8) | (offset + i < pkt->prefix_len ? pkt->prefix[offset + i] :
+                                  data[offset + i - pkt->prefix_len]);
+      return 1;
+    }
+  offset -= pkt->prefix_len;
+
+  switch (size)
+    {
+    case 4:
+      *value = clib_net_to_host_u32 (clib_mem_unaligned (data + offset, u32));
+      break;
+    case 2:
+      *value = clib_net_to_host_u16 (clib_mem_unaligned (data + offset, u16));
+      break;
+    default:
+      *value = data[offset];
+      break;
+    }
+
+  return 1;
+}
+
+/**
+ * @brief Run a validated cBPF program over a packet
+ *
+ * @param pkt    packet bytes available for loads
+ * @param wire_len  packet length reported by BPF_LEN
+ * @return number of bytes to capture, 0 to drop the packet
+ */
+static_always_inline u32
+wireshark_bridge_bpf_run (const wireshark_bridge_bpf_insn_t *insns,
+                          wireshark_bridge_bpf_packet_t *pkt, u32 wire_len)
+{
+  const wireshark_bridge_bpf_insn_t *pc = insns;
+  u32 A = 0, X = 0, k, v;
+  u32 mem[BPF_MEMWORDS] = { 0 };
+
+  for (;; pc++)
+    {
+      k = pc->k;
+
+      switch (pc->code)
+        {
+        case BPF_RET | BPF_K:
+          return k;
+        case BPF_RET | BPF_A:
+          return A;
+
+        /* Loads into A */
+        case BPF_LD | BPF_W | BPF_ABS:
+          if (!wireshark_bridge_bpf_load (pkt, k, 4, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_H | BPF_ABS:
+          if (!wireshark_bridge_bpf_load (pkt, k, 2, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_B | BPF_ABS:
+          if (!wireshark_bridge_bpf_load (pkt, k, 1, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_W | BPF_IND:
+          if (!wireshark_bridge_bpf_load (pkt, (u64) X + k, 4, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_H | BPF_IND:
+          if (!wireshark_bridge_bpf_load (pkt, (u64) X + k, 2, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_B | BPF_IND:
+          if (!wireshark_bridge_bpf_load (pkt, (u64) X + k, 1, &A))
+            return 0;
+          break;
+        case BPF_LD | BPF_W | BPF_LEN:
+          A = wire_len;
+          break;
+        case BPF_LD | BPF_IMM:
+          A = k;
+          break;
+        case BPF_LD | BPF_MEM:
+          A = mem[k];
+          break;
+
+        /* Loads into X */
+        case BPF_LDX | BPF_W | BPF_IMM:
+          X = k;
+          break;
+        case BPF_LDX | BPF_W | BPF_MEM:
+          X = mem[k];
+          break;
+        case BPF_LDX | BPF_W | BPF_LEN:
+          X = wire_len;
+          break;
+        case BPF_LDX | BPF_B | BPF_MSH:
+          if (!wireshark_bridge_bpf_load (pkt, k, 1, &v))
+            return 0;
+          X = (v & 0xf) << 2;
+          break;
+
+        /* Scratch memory stores */
+        case BPF_ST:
+          mem[k] = A;
+          break;
+        case BPF_STX:
+          mem[k] = X;
+          break;
+
+        /* Arithmetic */
+        case BPF_ALU | BPF_ADD | BPF_K: A += k; break;
+        case BPF_ALU | BPF_ADD | BPF_X: A += X; break;
+        case BPF_ALU | BPF_SUB | BPF_K: A -= k; break;
+        case BPF_ALU | BPF_SUB | BPF_X: A -= X; break;
+        case BPF_ALU | BPF_MUL | BPF_K: A *= k; break;
+        case BPF_ALU | BPF_MUL | BPF_X: A *= X; break;
+        case BPF_ALU | BPF_DIV | BPF_K: A /= k; break;
+        case BPF_ALU | BPF_DIV | BPF_X:
+          if (X == 0)
+            return 0;
+          A /= X;
+          break;
+        case BPF_ALU | BPF_MOD | BPF_K: A %= k; break;
+        case BPF_ALU | BPF_MOD | BPF_X:
+          if (X == 0)
+            return 0;
+          A %= X;
+          break;
+        case BPF_ALU | BPF_AND | BPF_K: A &= k; break;
+        case BPF_ALU | BPF_AND | BPF_X: A &= X; break;
+        case BPF_ALU | BPF_OR | BPF_K: A |= k; break;
+        case BPF_ALU | BPF_OR | BPF_X: A |= X; break;
+        case BPF_ALU | BPF_XOR | BPF_K: A ^= k; break;
+        case BPF_ALU | BPF_XOR | BPF_X: A ^= X; break;
+        case BPF_ALU | BPF_LSH | BPF_K: A = k < 32 ? A << k : 0; break;
+        case BPF_ALU | BPF_LSH | BPF_X: A = X < 32 ? A << X : 0; break;
+        case BPF_ALU | BPF_RSH | BPF_K: A = k < 32 ? A >> k : 0; break;
+        case BPF_ALU | BPF_RSH | BPF_X: A = X < 32 ? A >> X : 0; break;
+        case BPF_ALU | BPF_NEG: A = -A; break;
+
+        /* Jumps, always forward */
+        case BPF_JMP | BPF_JA:
+          pc += k;
+          break;
+        case BPF_JMP | BPF_JEQ | BPF_K: pc += (A == k) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JEQ | BPF_X: pc += (A == X) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JGT | BPF_K: pc += (A > k) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JGT | BPF_X: pc += (A > X) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JGE | BPF_K: pc += (A >= k) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JGE | BPF_X: pc += (A >= X) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JSET | BPF_K: pc += (A & k) ? pc->jt : pc->jf; break;
+        case BPF_JMP | BPF_JSET | BPF_X: pc += (A & X) ? pc->jt : pc->jf; break;
+
+        /* Register transfers */
+        case BPF_MISC | BPF_TAX:
+          X = A;
+          break;
+        case BPF_MISC | BPF_TXA:
+          A = X;
+          break;
+
+        default:
+          /* Rejected by the validator, never reached */
+          return 0;
+        }
+    }
+}
+
+#endif /* __included_wireshark_bridge_bpf_h__ */
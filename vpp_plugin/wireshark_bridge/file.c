@@ -0,0 +1,380 @@
+/*
+ * file.c - pcapng file destination with rotation
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+#include <vppinfra/format.h>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "file.h"
+
+/**
+ * @brief Set up the files of a session writing to @c path
+ *
+ * No file is opened yet, see wireshark_bridge_file_rotate ().
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int
+wireshark_bridge_file_init (wireshark_bridge_file_t *f, char *path)
+{
+  uword len = strlen (path), ext_len = strlen (WIRESHARK_BRIDGE_FILE_EXTENSION);
+  void *buffers;
+
+  clib_memset (f, 0, sizeof (*f));
+  f->fd = -1;
+
+  if (len == 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  buffers = mmap (0, WIRESHARK_BRIDGE_FILE_N_BUFFERS * WIRESHARK_BRIDGE_FILE_BUFFER_SIZE,
+                  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED)
+    return -1;
+  f->buffers = buffers;
+
+  if (len > ext_len && !strcmp (path + len - ext_len, WIRESHARK_BRIDGE_FILE_EXTENSION))
+    len -= ext_len;
+  f->base = format (0, "%.*s%c", (int) len, path, 0);
+  f->max_size = WIRESHARK_BRIDGE_FILE_DEFAULT_SIZE;
+
+#ifdef WIRESHARK_BRIDGE_IO_URING
+  /* Without io_uring in the kernel the buffers are written with pwrite */
+  f->ring_ready = io_uring_queue_init (WIRESHARK_BRIDGE_FILE_N_BUFFERS, &f->ring, 0) == 0;
+#endif
+  return 0;
+}
+
+/**
+ * @brief Write @c n_bytes of a buffer at @c offset, without io_uring
+ */
+static int
+wireshark_bridge_file_pwrite (wireshark_bridge_file_t *f, u8 *buffer, u32 n_bytes, u64 offset)
+{
+  while (n_bytes)
+    {
+      ssize_t n = pwrite (f->fd, buffer, n_bytes, offset);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        {
+          if (n == 0)
+            errno = EIO;
+          f->write_errors++;
+          return -1;
+        }
+
+      buffer += n;
+      n_bytes -= n;
+      offset += n;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Collect completed writes
+ *
+ * @param wait  block until at least one write completes, if any is in flight
+ * @return 0 if every write collected went through, -1 otherwise
+ */
+static int
+wireshark_bridge_file_complete (wireshark_bridge_file_t *f, int wait)
+{
+  int rv = 0;
+#ifdef WIRESHARK_BRIDGE_IO_URING
+  struct io_uring_cqe *cqe;
+
+  while (f->n_in_flight)
+    {
+      int ret = wait ? io_uring_wait_cqe (&f->ring, &cqe) : io_uring_peek_cqe (&f->ring, &cqe);
+      u32 i;
+
+      if (ret == -EINTR)
+        continue;
+      if (ret < 0)
+        break;
+
+      i = (uword) io_uring_cqe_get_data (cqe);
+      if (cqe->res != (int) f->lengths[i])
+        {
+          errno = cqe->res < 0 ? -cqe->res : EIO;
+          f->write_errors++;
+          rv = -1;
+        }
+      io_uring_cqe_seen (&f->ring, cqe);
+
+      f->in_flight[i] = 0;
+      f->lengths[i] = 0;
+      f->n_in_flight--;
+      wait = 0;
+    }
+#endif
+  return rv;
+}
+
+/**
+ * @brief Write the full buffer being filled and move on to the next one
+ *
+ * With io_uring the write is only queued, and the next buffer is waited
+ * for if it is still being written.
+ */
+static int
+wireshark_bridge_file_submit (wireshark_bridge_file_t *f)
+{
+  u32 i = f->current;
+  u8 *buffer = f->buffers + (uword) i * WIRESHARK_BRIDGE_FILE_BUFFER_SIZE;
+  int rv = 0;
+
+#ifdef WIRESHARK_BRIDGE_IO_URING
+  if (f->ring_ready)
+    {
+      struct io_uring_sqe *sqe = io_uring_get_sqe (&f->ring);
+
+      io_uring_prep_write (sqe, f->fd, buffer, f->lengths[i], f->write_offset);
+      io_uring_sqe_set_data (sqe, (void *) (uword) i);
+      io_uring_submit (&f->ring);
+      f->in_flight[i] = 1;
+      f->n_in_flight++;
+    }
+  else
+#endif
+    {
+      rv = wireshark_bridge_file_pwrite (f, buffer, f->lengths[i], f->write_offset);
+      f->lengths[i] = 0;
+    }
+
+  f->write_offset += WIRESHARK_BRIDGE_FILE_BUFFER_SIZE;
+  f->current = (i + 1) % WIRESHARK_BRIDGE_FILE_N_BUFFERS;
+
+  while (rv == 0 && f->in_flight[f->current])
+    rv = wireshark_bridge_file_complete (f, 1);
+
+  return rv;
+}
+
+/**
+ * @brief Finish the current file: wait for its writes, write its tail
+ * and close it
+ */
+static int
+wireshark_bridge_file_close (wireshark_bridge_file_t *f)
+{
+  u32 tail = f->lengths[f->current];
+  int rv = 0;
+
+  while (f->n_in_flight)
+    if (wireshark_bridge_file_complete (f, 1))
+      rv = -1;
+
+  /* The tail is not a whole number of blocks */
+  if (tail && f->direct)
+    fcntl (f->fd, F_SETFL, fcntl (f->fd, F_GETFL) & ~O_DIRECT);
+  if (tail && wireshark_bridge_file_pwrite (f, f->buffers + (uword) f->current *
+                                            WIRESHARK_BRIDGE_FILE_BUFFER_SIZE,
+                                            tail, f->write_offset))
+    rv = -1;
+
+  if (close (f->fd) < 0)
+    rv = -1;
+  f->fd = -1;
+  f->lengths[f->current] = 0;
+  return rv;
+}
+
+/**
+ * @brief Open the next file of the series, deleting the oldest files
+ * beyond max_files
+ */
+static int
+wireshark_bridge_file_open (wireshark_bridge_file_t *f, f64 now)
+{
+  time_t t = (time_t) now;
+  struct tm tm;
+  char stamp[32];
+  u8 *name;
+
+  localtime_r (&t, &tm);
+  strftime (stamp, sizeof (stamp), "%Y%m%d%H%M%S", &tm);
+  name = format (0, "%s_%05llu_%s%s%c", f->base, f->sequence + 1, stamp,
+                 WIRESHARK_BRIDGE_FILE_EXTENSION, 0);
+
+  f->fd = open ((char *) name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+  f->direct = f->fd >= 0;
+  if (f->fd < 0 && errno == EINVAL)
+    f->fd = open ((char *) name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (f->fd < 0)
+    {
+      vec_free (name);
+      return -1;
+    }
+
+  f->sequence++;
+  f->files_written++;
+  f->file_size = 0;
+  f->write_offset = 0;
+  f->current = 0;
+  f->opened = now;
+
+  vec_add1 (f->files, name);
+  while (f->max_files && vec_len (f->files) > f->max_files)
+    {
+      unlink ((char *) f->files[0]);
+      vec_free (f->files[0]);
+      vec_delete (f->files, 1, 0);
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Close the current file, if any, and open the next one
+ *
+ * @return 0 if the next file is open, -1 with errno set otherwise
+ */
+int
+wireshark_bridge_file_rotate (wireshark_bridge_file_t *f, f64 now)
+{
+  if (f->fd >= 0 && wireshark_bridge_file_close (f))
+    clib_warning ("Failed to complete %s: %s", wireshark_bridge_file_current (f) ?
+                  (char *) wireshark_bridge_file_current (f) : "capture file", strerror (errno));
+
+  return wireshark_bridge_file_open (f, now);
+}
+
+/**
+ * @brief Whether the current file is due for rotation before @c n_bytes
+ * more
+ */
+static_always_inline int
+wireshark_bridge_file_is_due (wireshark_bridge_file_t *f, u64 n_bytes, f64 now)
+{
+  /* A file always gets at least one section */
+  if (f->file_size == 0)
+    return 0;
+
+  return (f->max_size && f->file_size + n_bytes > f->max_size) ||
+         (f->max_duration && now - f->opened >= f->max_duration);
+}
+
+/**
+ * @brief Append one pcapng section to the current file (sender thread only)
+ *
+ * The file is rotated before the section if it is due.
+ *
+ * @return 0 on success, -1 with errno set if the file failed
+ */
+int
+wireshark_bridge_file_write (wireshark_bridge_file_t *f, struct iovec *iovs, u32 n_iovs, f64 now)
+{
+  u64 total = 0;
+  u32 i;
+
+  for (i = 0; i < n_iovs; i++)
+    total += iovs[i].iov_len;
+
+  if (wireshark_bridge_file_is_due (f, total, now) && wireshark_bridge_file_rotate (f, now))
+    return -1;
+
+  if (f->fd < 0)
+    {
+      errno = EBADF;
+      return -1;
+    }
+
+  for (i = 0; i < n_iovs; i++)
+    {
+      u8 *src = iovs[i].iov_base;
+      uword left = iovs[i].iov_len;
+
+      while (left)
+        {
+          u32 *length = &f->lengths[f->current];
+          u32 n = clib_min (left, WIRESHARK_BRIDGE_FILE_BUFFER_SIZE - *length);
+
+          clib_memcpy_fast (f->buffers + (uword) f->current * WIRESHARK_BRIDGE_FILE_BUFFER_SIZE +
+                            *length, src, n);
+          *length += n;
+          src += n;
+          left -= n;
+
+          if (*length == WIRESHARK_BRIDGE_FILE_BUFFER_SIZE && wireshark_bridge_file_submit (f))
+            return -1;
+        }
+    }
+
+  f->file_size += total;
+  f->bytes_written += total;
+  return 0;
+}
+
+/**
+ * @brief Collect completed writes and rotate a file past its duration
+ * while no packets come in (sender thread only)
+ */
+int
+wireshark_bridge_file_poll (wireshark_bridge_file_t *f, f64 now)
+{
+  if (f->fd < 0)
+    return 0;
+
+  if (wireshark_bridge_file_complete (f, 0))
+    return -1;
+
+  if (wireshark_bridge_file_is_due (f, 0, now))
+    return wireshark_bridge_file_rotate (f, now);
+
+  return 0;
+}
+
+/**
+ * @brief Give up on the current file after a failed write, open or
+ * rotation, the next one is opened from @c retry_time (sender thread only)
+ */
+void
+wireshark_bridge_file_fail (wireshark_bridge_file_t *f, f64 retry_time)
+{
+  f->failures++;
+  f->last_errno = errno;
+  f->retry_time = retry_time;
+
+  if (f->fd >= 0)
+    wireshark_bridge_file_close (f);
+}
+
+/**
+ * @brief Close the current file and release the buffers
+ */
+void
+wireshark_bridge_file_free (wireshark_bridge_file_t *f)
+{
+  u8 **name;
+
+  if (f->fd >= 0)
+    wireshark_bridge_file_close (f);
+
+#ifdef WIRESHARK_BRIDGE_IO_URING
+  if (f->ring_ready)
+    io_uring_queue_exit (&f->ring);
+#endif
+  if (f->buffers)
+    munmap (f->buffers, WIRESHARK_BRIDGE_FILE_N_BUFFERS * WIRESHARK_BRIDGE_FILE_BUFFER_SIZE);
+
+  vec_foreach (name, f->files)
+    vec_free (name[0]);
+  vec_free (f->files);
+  vec_free (f->base);
+  clib_memset (f, 0, sizeof (*f));
+  f->fd = -1;
+}
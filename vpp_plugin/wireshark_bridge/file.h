@@ -0,0 +1,104 @@
+/*
+ * file.h - pcapng file destination with rotation
+ *
+ * A session with a "file:/path" destination has its sender thread write
+ * the pcapng sections it would otherwise send as datagrams straight into
+ * a series of files, a ring buffer archive needing no process besides
+ * VPP. Sessions writing files always use the pcapng output format, each
+ * batch datagram being a section of its own, and a new file is only
+ * started between two sections, so every file is a complete pcapng file.
+ *
+ * Files are named like dumpcap names its ring buffer files: the path less
+ * a ".pcapng" extension, a sequence number and the local time the file
+ * was opened, "/data/vpp_00001_20240101120000.pcapng". A file is rotated
+ * once it holds max_size bytes or is max_duration seconds old, and only
+ * the newest max_files files are kept. A file that fails to be written,
+ * opened or rotated is given up on, and the next one of the series is
+ * only opened once retry_time has passed, the sections in between being
+ * dropped.
+ *
+ * Sections are gathered into WIRESHARK_BRIDGE_FILE_BUFFER_SIZE buffers
+ * aligned for O_DIRECT and written whole, so the page cache is not filled
+ * with capture data and the disk sees large sequential writes. Built with
+ * -DWIRESHARK_BRIDGE_IO_URING=ON the writes go through io_uring, up to
+ * WIRESHARK_BRIDGE_FILE_N_BUFFERS - 1 of them in flight while the next
+ * buffer fills up; otherwise each full buffer is written with pwrite. The
+ * tail of a file, less than a buffer, is written without O_DIRECT when
+ * the file is closed. Filesystems refusing O_DIRECT get buffered writes.
+ */
+
+#ifndef __included_wireshark_bridge_file_h__
+#define __included_wireshark_bridge_file_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+
+#include <sys/uio.h>
+
+#ifdef WIRESHARK_BRIDGE_IO_URING
+#include <liburing.h>
+#endif
+
+#define WIRESHARK_BRIDGE_FILE_PREFIX "file:"
+#define WIRESHARK_BRIDGE_FILE_EXTENSION ".pcapng"
+#define WIRESHARK_BRIDGE_FILE_BUFFER_SIZE (1 << 20)  // Bytes per write, a multiple of the alignment
+#define WIRESHARK_BRIDGE_FILE_N_BUFFERS 8
+#define WIRESHARK_BRIDGE_FILE_ALIGN 4096             // O_DIRECT offset, length and memory alignment
+#define WIRESHARK_BRIDGE_FILE_DEFAULT_SIZE (1ULL << 30)  // Bytes per file unless set on enable
+
+/* Files of a file session, owned by its sender thread once it runs */
+typedef struct {
+  u8 *base;                 // Path less the extension, NUL terminated
+  int fd;                   // Current file, -1 if none
+  u8 direct;                // fd is open with O_DIRECT
+
+  /* Rotation, changed with the session locked */
+  u64 max_size;             // Bytes per file, 0 for no limit
+  u32 max_duration;         // Seconds per file, 0 for no limit
+  u32 max_files;            // Files kept, 0 for all of them
+
+  u8 **files;               // Names of the files kept, oldest first
+  u64 sequence;             // Number of the last file opened
+  u64 file_size;            // Bytes given to the current file so far
+  f64 opened;               // unix_time_now () when the current file was opened
+
+  /* Write buffers, in one aligned mapping */
+  u8 *buffers;
+  u32 lengths[WIRESHARK_BRIDGE_FILE_N_BUFFERS];  // Bytes in each buffer
+  u8 in_flight[WIRESHARK_BRIDGE_FILE_N_BUFFERS];
+  u32 current;              // Buffer being filled
+  u64 write_offset;         // File offset of the buffer being filled
+  u32 n_in_flight;
+#ifdef WIRESHARK_BRIDGE_IO_URING
+  struct io_uring ring;
+  u8 ring_ready;
+#endif
+
+  u64 bytes_written;
+  u64 files_written;
+  u64 write_errors;
+
+  /* Failures, see wireshark_bridge_file_fail () */
+  u64 failures;             // Files given up on, or not opened
+  int last_errno;           // errno of the last failure
+  f64 retry_time;           // Earliest next open while fd is -1 after a failure
+} wireshark_bridge_file_t;
+
+int wireshark_bridge_file_init (wireshark_bridge_file_t *f, char *path);
+void wireshark_bridge_file_free (wireshark_bridge_file_t *f);
+int wireshark_bridge_file_rotate (wireshark_bridge_file_t *f, f64 now);
+int wireshark_bridge_file_write (wireshark_bridge_file_t *f, struct iovec *iovs, u32 n_iovs,
+                                 f64 now);
+int wireshark_bridge_file_poll (wireshark_bridge_file_t *f, f64 now);
+void wireshark_bridge_file_fail (wireshark_bridge_file_t *f, f64 retry_time);
+
+/**
+ * @brief Name of the file being written, NULL if none
+ */
+static_always_inline u8 *
+wireshark_bridge_file_current (wireshark_bridge_file_t *f)
+{
+  return f->fd >= 0 && vec_len (f->files) ? vec_elt (f->files, vec_len (f->files) - 1) : 0;
+}
+
+#endif /* __included_wireshark_bridge_file_h__ */
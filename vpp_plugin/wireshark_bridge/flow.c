@@ -0,0 +1,116 @@
+/*
+ * flow.c - flow summary export of a capture session
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/mem.h>
+
+#include <sys/mman.h>
+#include <string.h>
+
+#include "flow.h"
+#include "numa.h"
+
+/* Tables backed by huge pages are sized in whole 2 MB pages */
+#define WIRESHARK_BRIDGE_FLOW_HUGE_PAGE_SIZE (2 << 20)
+
+/**
+ * @brief Map the flow table of a worker
+ *
+ * Huge pages are used when available, otherwise regular memory, on the
+ * worker's NUMA node, touched once here like a recorder buffer so the
+ * capture path never takes a page fault on it.
+ *
+ * @param n_entries  flows held, rounded down to a power of two buckets
+ * @param numa_node  node of the worker, see numa.h
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int
+wireshark_bridge_flow_table_create (wireshark_bridge_flow_table_t *t, u32 n_entries,
+                                    u32 numa_node)
+{
+  u32 n_buckets = 1 << min_log2 (clib_max (n_entries / WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS, 1));
+  u64 size = (u64) n_buckets * sizeof (wireshark_bridge_flow_bucket_t);
+  u64 mapping_size = round_pow2 (size, WIRESHARK_BRIDGE_FLOW_HUGE_PAGE_SIZE);
+  void *base;
+
+  base = mmap (0, mapping_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base == MAP_FAILED)
+    {
+      mapping_size = round_pow2 (size, clib_mem_get_page_size ());
+      base = mmap (0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED)
+        return -1;
+    }
+
+  wireshark_bridge_numa_bind (base, mapping_size, numa_node);
+  clib_memset (base, 0, mapping_size);
+
+  t->buckets = base;
+  t->mapping_size = mapping_size;
+  t->n_buckets = n_buckets;
+  t->n_flows = 0;
+  t->evictions = 0;
+  return 0;
+}
+
+/**
+ * @brief Unmap the flow table of a worker
+ */
+void
+wireshark_bridge_flow_table_free (wireshark_bridge_flow_table_t *t)
+{
+  if (t->buckets)
+    munmap (t->buckets, t->mapping_size);
+  clib_memset (t, 0, sizeof (*t));
+}
+
+/**
+ * @brief Copy the flow in @c way of a bucket into @c dst
+ *
+ * @return 1 if the copy holds a flow, 0 if the way is empty or the worker
+ * reused it before or while it was copied
+ */
+int
+wireshark_bridge_flow_read (wireshark_bridge_flow_bucket_t *b, u32 way,
+                            wireshark_bridge_flow_entry_t *dst)
+{
+  wireshark_bridge_flow_entry_t *e = &b->entries[way];
+  u32 seq = clib_atomic_load_acq_n (&e->seq);
+
+  if (b->tags[way] == 0 || (seq & 1))
+    return 0;
+
+  clib_memcpy_fast (dst, e, sizeof (*dst));
+
+  /* The copy has to be complete before the sequence is looked at again */
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  return clib_atomic_load_relax_n (&e->seq) == seq;
+}
+
+/**
+ * @brief Write the big-endian export record of a flow, see flow.h
+ */
+void
+wireshark_bridge_flow_write_record (u8 *buffer, wireshark_bridge_flow_entry_t *e)
+{
+  wireshark_bridge_flow_key_t *k = &e->key;
+
+  clib_mem_unaligned (buffer + 0, u32) = clib_host_to_net_u32 (k->sw_if_index);
+  buffer[4] = k->direction;
+  buffer[5] = k->ip_version;
+  buffer[6] = k->protocol;
+  buffer[7] = e->tcp_flags;
+  clib_mem_unaligned (buffer + 8, u16) = clib_host_to_net_u16 (k->ethertype);
+  clib_mem_unaligned (buffer + 10, u16) = k->src_port;
+  clib_mem_unaligned (buffer + 12, u16) = k->dst_port;
+  clib_mem_unaligned (buffer + 14, u16) = 0;
+  clib_memcpy_fast (buffer + 16, k->src_address, 16);
+  clib_memcpy_fast (buffer + 32, k->dst_address, 16);
+  clib_mem_unaligned (buffer + 48, u64) = clib_host_to_net_u64 (e->packets);
+  clib_mem_unaligned (buffer + 56, u64) = clib_host_to_net_u64 (e->bytes);
+  clib_mem_unaligned (buffer + 64, u64) = clib_host_to_net_u64 (e->first_seen);
+  clib_mem_unaligned (buffer + 72, u64) = clib_host_to_net_u64 (e->last_seen);
+}
@@ -0,0 +1,270 @@
+/*
+ * flow.h - flow summary export of a capture session
+ *
+ * A session enabled with "flows" mirrors no packets. Its capture nodes
+ * look up the 5-tuple of every packet the session accepts in a per-worker
+ * flow table and count it there, and its sender threads export the flows
+ * of their workers as fixed size records once every flow interval.
+ *
+ * The table is set associative: a flow hashes to one bucket of
+ * WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS entries, with the hash tags of the
+ * entries together in the bucket's first cache line. A new flow takes an
+ * empty way of its bucket, otherwise it evicts the least recently seen
+ * flow of the bucket, so the table never grows and never needs a sweep.
+ *
+ * Only the worker writes its table. Rewriting the key of an entry is
+ * bracketed by a sequence number, odd meanwhile, so a sender copying an
+ * entry can tell when the worker reused it under its feet; counters of a
+ * flow only ever grow and are read as they are. Counters are cumulative
+ * from first_seen, a flow is exported in every interval it saw a packet.
+ *
+ * A record is WIRESHARK_BRIDGE_FLOW_RECORD_SIZE bytes, big-endian, back
+ * to back in the datagram: sw_if_index (4 bytes), direction (1), IP
+ * version (1, 0 for non-IP packets), IP protocol (1), TCP flags seen (1),
+ * ethertype (2), source port (2), destination port (2), reserved (2),
+ * source address (16), destination address (16), packets (8), bytes (8),
+ * first seen (8) and last seen (8), in nanoseconds since the epoch. IPv4
+ * addresses take the first 4 bytes of their address field.
+ */
+
+#ifndef __included_wireshark_bridge_flow_h__
+#define __included_wireshark_bridge_flow_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/xxhash.h>
+#include <vnet/ethernet/ethernet.h>
+#include <vnet/ip/ip4_packet.h>
+#include <vnet/ip/ip6_packet.h>
+#include <vnet/tcp/tcp_packet.h>
+#include <vnet/udp/udp_packet.h>
+
+#define WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS 4
+#define WIRESHARK_BRIDGE_FLOW_DEFAULT_ENTRIES (64 << 10)  // Flows per worker
+#define WIRESHARK_BRIDGE_FLOW_DEFAULT_INTERVAL 1.0        // Seconds between exports
+#define WIRESHARK_BRIDGE_FLOW_RECORD_SIZE 80
+
+// Flows seen this long before an export are still exported, covering a
+// frame stamped just before the export and counted just after it
+#define WIRESHARK_BRIDGE_FLOW_EXPORT_SLACK_NS 10000000ULL
+
+// Flow key, compared as a whole, so the padding is always zero
+typedef struct {
+  u8 src_address[16];
+  u8 dst_address[16];
+  u32 sw_if_index;
+  u16 src_port;             // Network byte order, like the addresses
+  u16 dst_port;
+  u16 ethertype;            // Host byte order
+  u8 protocol;
+  u8 direction;
+  u8 ip_version;            // 4 or 6, 0 for other ethertypes
+  u8 pad[3];
+} wireshark_bridge_flow_key_t;
+
+typedef struct {
+  volatile u32 seq;         // Odd while the key is being rewritten
+  u8 tcp_flags;             // Flags of every TCP segment of the flow, ORed
+  wireshark_bridge_flow_key_t key;
+  u64 packets;
+  u64 bytes;
+  u64 first_seen;           // Nanoseconds since the epoch
+  u64 last_seen;
+} wireshark_bridge_flow_entry_t;
+
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u32 tags[WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS];  // Hash tag per way, 0 for an empty way
+  wireshark_bridge_flow_entry_t entries[WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS];
+} wireshark_bridge_flow_bucket_t;
+
+// Flow table of one worker
+typedef struct {
+  wireshark_bridge_flow_bucket_t *buckets;
+  u64 mapping_size;
+  u32 n_buckets;            // A power of two
+  u64 n_flows;              // Ways in use (worker only)
+  u64 evictions;            // Flows replaced by a newer one (worker only)
+} wireshark_bridge_flow_table_t;
+
+int wireshark_bridge_flow_table_create (wireshark_bridge_flow_table_t *t, u32 n_entries,
+                                        u32 numa_node);
+void wireshark_bridge_flow_table_free (wireshark_bridge_flow_table_t *t);
+int wireshark_bridge_flow_read (wireshark_bridge_flow_bucket_t *b, u32 way,
+                                wireshark_bridge_flow_entry_t *dst);
+void wireshark_bridge_flow_write_record (u8 *buffer, wireshark_bridge_flow_entry_t *e);
+
+/**
+ * @brief Parse the flow key of a packet from its L3 header on
+ *
+ * Ports are taken from TCP and UDP headers of unfragmented or first
+ * fragment IPv4 packets and of IPv6 packets without extension headers,
+ * anything else counts under its addresses and protocol alone. @c key
+ * must be zeroed by the caller.
+ *
+ * @param offset   offset of the L3 header in @c data
+ * @param n_bytes  bytes of @c data, the first buffer of the packet
+ * @param type     ethertype of the L3 header
+ * @return TCP flags of the packet, 0 for anything else
+ */
+static_always_inline u8
+wireshark_bridge_flow_parse_l3 (u8 *data, u32 offset, u32 n_bytes, u16 type,
+                                wireshark_bridge_flow_key_t *key)
+{
+  u8 *l4 = 0;
+
+  key->ethertype = type;
+
+  if (type == ETHERNET_TYPE_IP4 && n_bytes >= offset + sizeof (ip4_header_t))
+    {
+      ip4_header_t *ip = (ip4_header_t *) (data + offset);
+      u32 header_length = (ip->ip_version_and_header_length & 0xf) * 4;
+
+      key->ip_version = 4;
+      key->protocol = ip->protocol;
+      clib_memcpy_fast (key->src_address, &ip->src_address, 4);
+      clib_memcpy_fast (key->dst_address, &ip->dst_address, 4);
+
+      /* Fragment offset 0, the first fragment carries the ports; a header
+       * length below the minimum is malformed, its ports are not looked for */
+      if (header_length >= sizeof (ip4_header_t) &&
+          !(clib_net_to_host_u16 (ip->flags_and_fragment_offset) & 0x1fff))
+        l4 = data + offset + header_length;
+    }
+  else if (type == ETHERNET_TYPE_IP6 && n_bytes >= offset + sizeof (ip6_header_t))
+    {
+      ip6_header_t *ip = (ip6_header_t *) (data + offset);
+
+      key->ip_version = 6;
+      key->protocol = ip->protocol;
+      clib_memcpy_fast (key->src_address, &ip->src_address, 16);
+      clib_memcpy_fast (key->dst_address, &ip->dst_address, 16);
+      l4 = data + offset + sizeof (ip6_header_t);
+    }
+
+  if (l4 == 0)
+    return 0;
+
+  if (key->protocol == IP_PROTOCOL_TCP && l4 + sizeof (tcp_header_t) <= data + n_bytes)
+    {
+      tcp_header_t *tcp = (tcp_header_t *) l4;
+
+      key->src_port = tcp->src_port;
+      key->dst_port = tcp->dst_port;
+      return tcp->flags;
+    }
+
+  if (key->protocol == IP_PROTOCOL_UDP && l4 + sizeof (udp_header_t) <= data + n_bytes)
+    {
+      udp_header_t *udp = (udp_header_t *) l4;
+
+      key->src_port = udp->src_port;
+      key->dst_port = udp->dst_port;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Parse the flow key of an Ethernet frame
+ *
+ * Up to two VLAN tags are skipped, see wireshark_bridge_flow_parse_l3 ()
+ * for the rest.
+ *
+ * @param n_bytes  bytes of @c data, the first buffer of the packet
+ * @return TCP flags of the packet, 0 for anything else
+ */
+static_always_inline u8
+wireshark_bridge_flow_parse (u8 *data, u32 n_bytes, wireshark_bridge_flow_key_t *key)
+{
+  u32 offset = sizeof (ethernet_header_t);
+  u16 type;
+  int i;
+
+  if (n_bytes < offset)
+    return 0;
+
+  type = clib_net_to_host_u16 (((ethernet_header_t *) data)->type);
+  for (i = 0; i < 2 && (type == ETHERNET_TYPE_VLAN || type == ETHERNET_TYPE_DOT1AD); i++)
+    {
+      if (n_bytes < offset + sizeof (ethernet_vlan_header_t))
+        return 0;
+      type = clib_net_to_host_u16 (((ethernet_vlan_header_t *) (data + offset))->type);
+      offset += sizeof (ethernet_vlan_header_t);
+    }
+
+  return wireshark_bridge_flow_parse_l3 (data, offset, n_bytes, type, key);
+}
+
+/**
+ * @brief Hash of a flow key
+ */
+static_always_inline u64
+wireshark_bridge_flow_hash (wireshark_bridge_flow_key_t *key)
+{
+  u64 *k = (u64 *) key;
+
+  STATIC_ASSERT (sizeof (*key) % sizeof (u64) == 0, "flow key must be a whole number of u64");
+
+  return clib_xxhash (k[0] ^ k[1] ^ (k[2] << 1) ^ (k[3] << 1) ^ (k[4] << 3) ^ (k[5] << 5));
+}
+
+/**
+ * @brief Count one packet in the worker's flow table of a session
+ *
+ * Runs on the worker owning @c t. A lookup reads the tag line of one
+ * bucket and the entry of a matching tag, a new flow takes an empty way
+ * or the one seen least recently.
+ */
+static_always_inline void
+wireshark_bridge_flow_update (wireshark_bridge_flow_table_t *t, wireshark_bridge_flow_key_t *key,
+                              u32 n_bytes, u8 tcp_flags, u64 now_ns)
+{
+  u64 hash = wireshark_bridge_flow_hash (key);
+  u32 tag = (u32) hash | 1;
+  wireshark_bridge_flow_bucket_t *b = &t->buckets[(hash >> 32) & (t->n_buckets - 1)];
+  wireshark_bridge_flow_entry_t *e;
+  u32 i, victim = 0;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS; i++)
+    if (b->tags[i] == tag && !memcmp (&b->entries[i].key, key, sizeof (*key)))
+      {
+        e = &b->entries[i];
+        goto found;
+      }
+
+  for (i = 0; i < WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS; i++)
+    {
+      if (b->tags[i] == 0)
+        {
+          victim = i;
+          break;
+        }
+      if (b->entries[i].last_seen < b->entries[victim].last_seen)
+        victim = i;
+    }
+
+  if (b->tags[victim])
+    t->evictions++;
+  else
+    t->n_flows++;
+
+  /* Readers see an odd sequence number until the new flow is complete */
+  e = &b->entries[victim];
+  clib_atomic_store_relax_n (&e->seq, e->seq + 1);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  e->key = *key;
+  e->tcp_flags = 0;
+  e->packets = 0;
+  e->bytes = 0;
+  e->first_seen = now_ns;
+  b->tags[victim] = tag;
+  clib_atomic_store_rel_n (&e->seq, e->seq + 1);
+
+found:
+  e->packets++;
+  e->bytes += n_bytes;
+  e->last_seen = now_ns;
+  e->tcp_flags |= tcp_flags;
+}
+
+#endif /* __included_wireshark_bridge_flow_h__ */
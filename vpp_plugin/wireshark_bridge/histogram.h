@@ -0,0 +1,86 @@
+/*
+ * histogram.h - log2 bucketed histograms of the sender threads
+ *
+ * Bucket i counts the values in [2^i, 2^(i+1)), bucket 0 also counts 0.
+ * Adding a value is a bit scan and three increments, so the histograms
+ * can stay on in production. Every histogram has a single writer, readers
+ * may see a sample half added, which is good enough for statistics.
+ */
+
+#ifndef __included_wireshark_bridge_histogram_h__
+#define __included_wireshark_bridge_histogram_h__
+
+#include <vppinfra/clib.h>
+
+#define WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS 32
+
+typedef struct {
+  u64 buckets[WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS];
+  u64 count;
+  u64 sum;
+  u64 max;
+} wireshark_bridge_histogram_t;
+
+static_always_inline void
+wireshark_bridge_histogram_add (wireshark_bridge_histogram_t *h, u64 value)
+{
+  u32 bucket = value ? min_log2 (value) : 0;
+
+  h->buckets[clib_min (bucket, WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS - 1)]++;
+  h->count++;
+  h->sum += value;
+  if (value > h->max)
+    h->max = value;
+}
+
+/**
+ * @brief Add @c n values falling into the same bucket as @c value
+ */
+static_always_inline void
+wireshark_bridge_histogram_add_n (wireshark_bridge_histogram_t *h, u64 value, u64 n)
+{
+  u32 bucket = value ? min_log2 (value) : 0;
+
+  h->buckets[clib_min (bucket, WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS - 1)] += n;
+  h->count += n;
+  h->sum += value * n;
+  if (value > h->max)
+    h->max = value;
+}
+
+/**
+ * @brief Sum up histograms, e.g. those of every sender thread of a session
+ */
+static_always_inline void
+wireshark_bridge_histogram_merge (wireshark_bridge_histogram_t *dst,
+                                  wireshark_bridge_histogram_t *src)
+{
+  u32 i;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+  dst->count += src->count;
+  dst->sum += src->sum;
+  dst->max = clib_max (dst->max, src->max);
+}
+
+/**
+ * @brief Upper bound of the bucket holding the given percentile
+ */
+static_always_inline u64
+wireshark_bridge_histogram_percentile (wireshark_bridge_histogram_t *h, u32 percent)
+{
+  u64 rank = (h->count * percent + 99) / 100, seen = 0;
+  u32 i;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += h->buckets[i];
+      if (seen >= rank && seen > 0)
+        return clib_min (2ULL << i, h->max);
+    }
+
+  return h->max;
+}
+
+#endif /* __included_wireshark_bridge_histogram_h__ */
@@ -0,0 +1,474 @@
+/*
+ * node.c - capture nodes of the VPP Wireshark bridge plugin
+ */
+
+#include <vlib/vlib.h>
+#include <vnet/vnet.h>
+#include <vnet/feature/feature.h>
+
+#include "wireshark_bridge.h"
+
+/* Packet trace structure */
+typedef struct {
+  u32 sw_if_index;
+  u32 next_index;
+  u8 direction;
+} wireshark_bridge_trace_t;
+
+/**
+ * @brief Format trace data for output
+ */
+static u8 *
+format_wireshark_bridge_trace (u8 * s, va_list * args)
+{
+  CLIB_UNUSED (vlib_main_t * vm) = va_arg (*args, vlib_main_t *);
+  CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
+  wireshark_bridge_trace_t *t = va_arg (*args, wireshark_bridge_trace_t *);
+
+  s = format (s, "wireshark-bridge: sw_if_index %d, next index %d, capture point %U",
+              t->sw_if_index, t->next_index, format_wireshark_bridge_capture_point,
+              (u32) 1 << t->direction);
+  return s;
+}
+
+/**
+ * @brief Find the Ethernet header of a packet at the drop, ip4 or ip6
+ * capture point
+ *
+ * Captures always start with an Ethernet header. Past ethernet-input the
+ * header of the frame, VLAN tags included, is still right in front of the
+ * L3 header, but a packet decapsulated from an L3 tunnel or drafted by
+ * VPP has none: it gets a synthetic one with zero addresses, built in
+ * @c eth and copied in front of the packet by the capture. The buffer
+ * itself is never written to, the packet may still be forwarded. A drop
+ * gets one only if the buffer's offsets show its current data is the L3
+ * header, any other drop is captured as it is.
+ *
+ * @return header length to step back, -1 if @c eth holds a synthetic one
+ */
+static_always_inline int
+wireshark_bridge_point_l2_header (vlib_buffer_t *b, u8 direction, ethernet_header_t *eth)
+{
+  u8 version = direction == WIRESHARK_BRIDGE_DIRECTION_IP4 ? 4 :
+               direction == WIRESHARK_BRIDGE_DIRECTION_IP6 ? 6 : 0;
+  i32 l2_length;
+
+  if (b->flags & VNET_BUFFER_F_L2_HDR_OFFSET_VALID)
+    {
+      l2_length = b->current_data - vnet_buffer (b)->l2_hdr_offset;
+      if (l2_length == 0 && version == 0)
+        return 0;
+      if (l2_length >= (i32) sizeof (ethernet_header_t) &&
+          l2_length <= (i32) (sizeof (ethernet_header_t) + 2 * sizeof (ethernet_vlan_header_t)))
+        return l2_length;
+    }
+
+  if (version == 0)
+    {
+      if (!(b->flags & VNET_BUFFER_F_L3_HDR_OFFSET_VALID) ||
+          vnet_buffer (b)->l3_hdr_offset != b->current_data || b->current_length == 0)
+        return 0;
+      version = *(u8 *) vlib_buffer_get_current (b) >> 4;
+      if (version != 4 && version != 6)
+        return 0;
+    }
+
+  clib_memset (eth->dst_address, 0, sizeof (eth->dst_address));
+  clib_memset (eth->src_address, 0, sizeof (eth->src_address));
+  eth->type = clib_host_to_net_u16 (version == 4 ? ETHERNET_TYPE_IP4 : ETHERNET_TYPE_IP6);
+  return -1;
+}
+
+/**
+ * @brief Capture a single buffer into every session interested in it
+ *
+ * A session filter runs on the first buffer before anything is copied, so
+ * packets it rejects never reach the session's ring. Sampling and rate
+ * limits of the interface apply to the packets the filter accepted. The
+ * capture covers the whole buffer chain, up to the snaplen. Recorder
+ * sessions keep the packet in the worker's recorder instead of the ring,
+ * they do not depend on their destination until a dump. Flow sessions
+ * only count the packet in the worker's flow table, its key is parsed
+ * once for all of them. Packets at the drop and ip capture points are
+ * captured from their Ethernet header on, the buffer is stepped back to
+ * it for the capture and restored afterwards, or a synthetic one is put
+ * in front of the copy.
+ */
+static_always_inline void
+wireshark_bridge_capture_buffer (vlib_main_t *vm, wireshark_bridge_main_t *wbm,
+                                 vlib_buffer_t *b, f64 now, u64 now_ns, u8 direction)
+{
+  u32 sw_if_index = vnet_buffer (b)->sw_if_index[direction == WIRESHARK_BRIDGE_DIRECTION_TX ? VLIB_TX : VLIB_RX];
+  u32 *session_indices = wireshark_bridge_interface_sessions (wbm, sw_if_index);
+  u32 *si;
+  ethernet_header_t eth;
+  u8 *l2_header = 0;
+  int l2_length = 0;
+
+  if (PREDICT_TRUE (session_indices == NULL))
+    return;
+
+  if (direction > WIRESHARK_BRIDGE_DIRECTION_TX)
+    {
+      l2_length = wireshark_bridge_point_l2_header (b, direction, &eth);
+      if (l2_length < 0)
+        {
+          l2_header = (u8 *) &eth;
+          l2_length = 0;
+        }
+      vlib_buffer_advance (b, -l2_length);
+    }
+
+  u8 *data = vlib_buffer_get_current (b);
+  u32 original_length = vlib_buffer_length_in_chain (vm, b) + (l2_header ? sizeof (eth) : 0);
+  u64 timestamp = wireshark_bridge_buffer_timestamp (wbm, b, now_ns, direction);
+  wireshark_bridge_bpf_packet_t pkt = {
+    .prefix = l2_header,
+    .prefix_len = l2_header ? sizeof (eth) : 0,
+    .data = data,
+    .len = b->current_length,
+  };
+  wireshark_bridge_flow_key_t key;
+  u8 have_key = 0, tcp_flags = 0;
+
+  vec_foreach (si, session_indices)
+    {
+      wireshark_bridge_session_t *s = wbm->sessions[si[0]];
+      wireshark_bridge_ring_t *ring = &s->queue.rings[vm->thread_index];
+      wireshark_bridge_interface_t *wbi;
+      u32 packet_length = original_length;
+
+      if (!(s->bridge_connected || s->use_recorder) || !(s->direction_mask & (1 << direction)))
+        continue;
+
+      wbi = wireshark_bridge_find_interface (s, sw_if_index);
+      if (PREDICT_FALSE (wbi == NULL) || !(wbi->direction_mask & (1 << direction)))
+        continue;
+
+      // The stream cannot take more right now, don't copy what would be dropped
+      if (PREDICT_FALSE (s->backpressure) && !(s->use_recorder || s->use_flows))
+        {
+          ring->backpressure_drops++;
+          wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_DROPPED_STALLED,
+                                            vm->thread_index, sw_if_index);
+          continue;
+        }
+
+      if (s->filter)
+        {
+          u32 accept = wireshark_bridge_bpf_run (s->filter, &pkt, original_length);
+          if (accept == 0)
+            {
+              ring->filter_rejects++;
+              wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_DROPPED_FILTER,
+                                                vm->thread_index, sw_if_index);
+              continue;
+            }
+
+          // A filter may also truncate, like a socket filter does
+          packet_length = clib_min (packet_length, accept);
+        }
+
+      // Rate limits count the bytes that will actually be captured
+      if (s->snaplen)
+        packet_length = clib_min (packet_length, s->snaplen);
+
+      if (!wireshark_bridge_interface_admit (wbi, vm->thread_index, packet_length, now))
+        continue;
+
+      if (s->use_recorder)
+        {
+          // Not mapped if the last enable ran out of memory
+          if (PREDICT_TRUE (ring->recorder.slots != 0))
+            wireshark_bridge_record_packet (vm, ring, sw_if_index, l2_header, b, packet_length,
+                                            original_length, timestamp, direction);
+        }
+      else if (s->use_flows)
+        {
+          // Not mapped if the last enable ran out of memory
+          if (PREDICT_FALSE (ring->flows.buckets == 0))
+            continue;
+
+          if (!have_key)
+            {
+              clib_memset (&key, 0, sizeof (key));
+              if (l2_header)
+                tcp_flags = wireshark_bridge_flow_parse_l3 (data, 0, b->current_length,
+                                                            clib_net_to_host_u16 (eth.type), &key);
+              else
+                tcp_flags = wireshark_bridge_flow_parse (data, b->current_length, &key);
+              key.sw_if_index = sw_if_index;
+              key.direction = direction;
+              have_key = 1;
+            }
+          wireshark_bridge_flow_update (&ring->flows, &key, original_length, tcp_flags, timestamp);
+        }
+      else
+        wireshark_bridge_send_packet (vm, ring, s, sw_if_index, l2_header, b, packet_length,
+                                      original_length, timestamp, direction);
+    }
+
+  vlib_buffer_advance (b, l2_length);
+}
+
+/**
+ * @brief Shared body of the capture nodes
+ *
+ * The session state and the clocks are checked once per frame rather than
+ * once per packet: vlib time for the rate limits, wall clock time for the
+ * packets without a hardware timestamp. Buffers are processed four at a time with the headers
+ * (and, while capturing, the packet data) of the next four prefetched,
+ * and all of them are handed to the next feature with a single
+ * vlib_buffer_enqueue_to_next call.
+ */
+static_always_inline uword
+wireshark_bridge_node_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
+                              vlib_frame_t *frame, u8 direction)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b = bufs;
+  u16 nexts[VLIB_FRAME_SIZE], *next = nexts;
+  wireshark_bridge_session_t **sp;
+  u32 n_left, *from;
+  u8 capture = 0;
+  f64 now = 0;
+  u64 now_ns = 0;
+
+  from = vlib_frame_vector_args (frame);
+  n_left = frame->n_vectors;
+  vlib_get_buffers (vm, from, bufs, n_left);
+
+  /* Return pool buffers the sender threads are done with */
+  pool_foreach (sp, wbm->sessions)
+    {
+      wireshark_bridge_ring_recycle_buffers (vm, &sp[0]->queue.rings[vm->thread_index]);
+      capture |= sp[0]->bridge_connected | sp[0]->use_recorder;
+    }
+
+  /* Nothing to capture while every session is down */
+  if (PREDICT_TRUE (capture))
+    {
+      now = vlib_time_now (vm);
+      now_ns = unix_time_now_nsec ();
+    }
+
+  while (n_left >= 4)
+    {
+      /* Prefetch the next iteration */
+      if (PREDICT_TRUE (n_left >= 8))
+        {
+          vlib_prefetch_buffer_header (b[4], LOAD);
+          vlib_prefetch_buffer_header (b[5], LOAD);
+          vlib_prefetch_buffer_header (b[6], LOAD);
+          vlib_prefetch_buffer_header (b[7], LOAD);
+
+          if (capture)
+            {
+              CLIB_PREFETCH (b[4]->data, CLIB_CACHE_LINE_BYTES, LOAD);
+              CLIB_PREFETCH (b[5]->data, CLIB_CACHE_LINE_BYTES, LOAD);
+              CLIB_PREFETCH (b[6]->data, CLIB_CACHE_LINE_BYTES, LOAD);
+              CLIB_PREFETCH (b[7]->data, CLIB_CACHE_LINE_BYTES, LOAD);
+            }
+        }
+
+      if (capture)
+        {
+          wireshark_bridge_capture_buffer (vm, wbm, b[0], now, now_ns, direction);
+          wireshark_bridge_capture_buffer (vm, wbm, b[1], now, now_ns, direction);
+          wireshark_bridge_capture_buffer (vm, wbm, b[2], now, now_ns, direction);
+          wireshark_bridge_capture_buffer (vm, wbm, b[3], now, now_ns, direction);
+        }
+
+      vnet_feature_next_u16 (&next[0], b[0]);
+      vnet_feature_next_u16 (&next[1], b[1]);
+      vnet_feature_next_u16 (&next[2], b[2]);
+      vnet_feature_next_u16 (&next[3], b[3]);
+
+      b += 4;
+      next += 4;
+      n_left -= 4;
+    }
+
+  while (n_left > 0)
+    {
+      if (capture)
+        wireshark_bridge_capture_buffer (vm, wbm, b[0], now, now_ns, direction);
+
+      vnet_feature_next_u16 (&next[0], b[0]);
+
+      b += 1;
+      next += 1;
+      n_left -= 1;
+    }
+
+  /* Wake up the sender thread of each ring once per frame, not once per packet */
+  if (capture)
+    pool_foreach (sp, wbm->sessions)
+      {
+        wireshark_bridge_ring_t *ring = &sp[0]->queue.rings[vm->thread_index];
+
+        if (ring->wakeup_pending)
+          {
+            ring->wakeup_pending = 0;
+            pthread_cond_signal (&sp[0]->senders[ring->sender_index].cond);
+          }
+      }
+
+  if (PREDICT_FALSE (node->flags & VLIB_NODE_FLAG_TRACE))
+    {
+      int rx_tx = direction == WIRESHARK_BRIDGE_DIRECTION_TX ? VLIB_TX : VLIB_RX;
+
+      n_left = frame->n_vectors;
+      b = bufs;
+      next = nexts;
+
+      while (n_left > 0)
+        {
+          if (b[0]->flags & VLIB_BUFFER_IS_TRACED)
+            {
+              wireshark_bridge_trace_t *t =
+                vlib_add_trace (vm, node, b[0], sizeof (*t));
+              t->sw_if_index = vnet_buffer (b[0])->sw_if_index[rx_tx];
+              t->next_index = next[0];
+              t->direction = direction;
+            }
+
+          b += 1;
+          next += 1;
+          n_left -= 1;
+        }
+    }
+
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+
+  return frame->n_vectors;
+}
+
+/* RX Node function */
+VLIB_NODE_FN (wireshark_bridge_rx_node) (vlib_main_t * vm,
+                                         vlib_node_runtime_t * node,
+                                         vlib_frame_t * frame)
+{
+  return wireshark_bridge_node_inline (vm, node, frame, WIRESHARK_BRIDGE_DIRECTION_RX);
+}
+
+/* TX Node function */
+VLIB_NODE_FN (wireshark_bridge_tx_node) (vlib_main_t * vm,
+                                         vlib_node_runtime_t * node,
+                                         vlib_frame_t * frame)
+{
+  return wireshark_bridge_node_inline (vm, node, frame, WIRESHARK_BRIDGE_DIRECTION_TX);
+}
+
+/* Drop point node function, the packet's vlib error is its drop reason */
+VLIB_NODE_FN (wireshark_bridge_drop_node) (vlib_main_t * vm,
+                                           vlib_node_runtime_t * node,
+                                           vlib_frame_t * frame)
+{
+  return wireshark_bridge_node_inline (vm, node, frame, WIRESHARK_BRIDGE_DIRECTION_DROP);
+}
+
+/* IPv4 point node function */
+VLIB_NODE_FN (wireshark_bridge_ip4_node) (vlib_main_t * vm,
+                                          vlib_node_runtime_t * node,
+                                          vlib_frame_t * frame)
+{
+  return wireshark_bridge_node_inline (vm, node, frame, WIRESHARK_BRIDGE_DIRECTION_IP4);
+}
+
+/* IPv6 point node function */
+VLIB_NODE_FN (wireshark_bridge_ip6_node) (vlib_main_t * vm,
+                                          vlib_node_runtime_t * node,
+                                          vlib_frame_t * frame)
+{
+  return wireshark_bridge_node_inline (vm, node, frame, WIRESHARK_BRIDGE_DIRECTION_IP6);
+}
+
+#define WIRESHARK_BRIDGE_RX_N_NEXT 1
+#define WIRESHARK_BRIDGE_RX_NEXT_DROP 0
+
+/* RX Node registration */
+VLIB_REGISTER_NODE (wireshark_bridge_rx_node) = {
+  .name = "wireshark-bridge-rx",
+  .vector_size = sizeof (u32),
+  .format_trace = format_wireshark_bridge_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = 0,
+  .n_next_nodes = WIRESHARK_BRIDGE_RX_N_NEXT,
+  .next_nodes = {
+    [WIRESHARK_BRIDGE_RX_NEXT_DROP] = "error-drop",
+  },
+};
+
+#define WIRESHARK_BRIDGE_TX_N_NEXT 1
+#define WIRESHARK_BRIDGE_TX_NEXT_DROP 0
+
+/* TX Node registration */
+VLIB_REGISTER_NODE (wireshark_bridge_tx_node) = {
+  .name = "wireshark-bridge-tx",
+  .vector_size = sizeof (u32),
+  .format_trace = format_wireshark_bridge_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = 0,
+  .n_next_nodes = WIRESHARK_BRIDGE_TX_N_NEXT,
+  .next_nodes = {
+    [WIRESHARK_BRIDGE_TX_NEXT_DROP] = "error-drop",
+  },
+};
+
+/* Drop, IPv4 and IPv6 point node registrations, their next nodes come
+ * from the feature arcs */
+VLIB_REGISTER_NODE (wireshark_bridge_drop_node) = {
+  .name = "wireshark-bridge-drop",
+  .vector_size = sizeof (u32),
+  .format_trace = format_wireshark_bridge_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = 0,
+};
+
+VLIB_REGISTER_NODE (wireshark_bridge_ip4_node) = {
+  .name = "wireshark-bridge-ip4",
+  .vector_size = sizeof (u32),
+  .format_trace = format_wireshark_bridge_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = 0,
+};
+
+VLIB_REGISTER_NODE (wireshark_bridge_ip6_node) = {
+  .name = "wireshark-bridge-ip6",
+  .vector_size = sizeof (u32),
+  .format_trace = format_wireshark_bridge_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = 0,
+};
+
+/* Feature registration structures */
+VNET_FEATURE_INIT (wireshark_bridge_rx_feature, static) = {
+  .arc_name = "device-input",
+  .node_name = "wireshark-bridge-rx",
+  .runs_before = VNET_FEATURES ("ethernet-input"),
+};
+
+VNET_FEATURE_INIT (wireshark_bridge_tx_feature, static) = {
+  .arc_name = "interface-output",
+  .node_name = "wireshark-bridge-tx",
+  .runs_before = VNET_FEATURES ("interface-output-arc-end"),
+};
+
+VNET_FEATURE_INIT (wireshark_bridge_drop_feature, static) = {
+  .arc_name = "error-drop",
+  .node_name = "wireshark-bridge-drop",
+  .runs_before = VNET_FEATURES ("drop"),
+};
+
+VNET_FEATURE_INIT (wireshark_bridge_ip4_feature, static) = {
+  .arc_name = "ip4-unicast",
+  .node_name = "wireshark-bridge-ip4",
+  .runs_before = VNET_FEATURES ("ip4-lookup"),
+};
+
+VNET_FEATURE_INIT (wireshark_bridge_ip6_feature, static) = {
+  .arc_name = "ip6-unicast",
+  .node_name = "wireshark-bridge-ip6",
+  .runs_before = VNET_FEATURES ("ip6-lookup"),
+};
@@ -0,0 +1,47 @@
+/*
+ * numa.h - NUMA placement of capture memory
+ *
+ * Everything a worker writes on the capture path, the descriptors and
+ * slots of its ring, its recorder buffer and its flow table, is mapped
+ * preferring the worker's NUMA node, the numa_node of its vlib_main_t.
+ * The preference holds whichever thread faults a page in first, and the
+ * kernel falls back to another node when that one runs out of memory.
+ * Sender threads are placed on the node of the rings they drain, see
+ * wireshark_bridge_queue_init ().
+ */
+
+#ifndef __included_wireshark_bridge_numa_h__
+#define __included_wireshark_bridge_numa_h__
+
+#include <vppinfra/clib.h>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* MPOL_PREFERRED of <numaif.h>, which comes with libnuma */
+#define WIRESHARK_BRIDGE_MPOL_PREFERRED 1
+
+/* Nodes a mapping can prefer, a single mask word */
+#define WIRESHARK_BRIDGE_NUMA_MAX_NODES 64
+
+/**
+ * @brief Prefer @c numa_node for the pages of a mapping
+ *
+ * Only pages faulted in afterwards are placed, so this goes right after
+ * the mmap. A hint only: without NUMA support in the kernel the pages
+ * simply stay where they are first touched.
+ */
+static_always_inline void
+wireshark_bridge_numa_bind (void *base, uword size, u32 numa_node)
+{
+  unsigned long nodemask;
+
+  if (numa_node >= WIRESHARK_BRIDGE_NUMA_MAX_NODES)
+    return;
+
+  nodemask = 1UL << numa_node;
+  syscall (SYS_mbind, base, size, WIRESHARK_BRIDGE_MPOL_PREFERRED, &nodemask,
+           WIRESHARK_BRIDGE_NUMA_MAX_NODES + 1, 0);
+}
+
+#endif /* __included_wireshark_bridge_numa_h__ */
@@ -0,0 +1,173 @@
+/*
+ * pcapng.h - pcapng blocks written by the sender thread
+ *
+ * With the pcapng output format every datagram is a complete pcapng
+ * section: a section header block, an interface description block for
+ * each interface with packets in the datagram and an enhanced packet
+ * block per packet, a dropped packet with its drop reason as the opt_comment
+ * of the block. Sections do not depend on each other, so a receiver
+ * can write datagrams to a file or pipe unchanged, and a lost datagram
+ * never invalidates the ones after it.
+ *
+ * Blocks are in host byte order, which the section header announces.
+ */
+
+#ifndef __included_wireshark_bridge_pcapng_h__
+#define __included_wireshark_bridge_pcapng_h__
+
+#include <vppinfra/clib.h>
+
+#define WIRESHARK_BRIDGE_PCAPNG_SHB_TYPE 0x0A0D0D0A
+#define WIRESHARK_BRIDGE_PCAPNG_IDB_TYPE 0x00000001
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_TYPE 0x00000006
+#define WIRESHARK_BRIDGE_PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define WIRESHARK_BRIDGE_PCAPNG_LINKTYPE_ETHERNET 1
+
+/* Option codes */
+#define WIRESHARK_BRIDGE_PCAPNG_OPT_ENDOFOPT 0
+#define WIRESHARK_BRIDGE_PCAPNG_OPT_COMMENT 1
+#define WIRESHARK_BRIDGE_PCAPNG_OPT_IF_NAME 2
+#define WIRESHARK_BRIDGE_PCAPNG_OPT_IF_TSRESOL 9
+#define WIRESHARK_BRIDGE_PCAPNG_OPT_EPB_FLAGS 2
+
+/* epb_flags direction bits */
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_INBOUND 1
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_OUTBOUND 2
+
+/* Interfaces a single datagram can describe */
+#define WIRESHARK_BRIDGE_PCAPNG_MAX_INTERFACES 32
+
+/* Longest packet comment */
+#define WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT 128
+
+/* Block sizes */
+#define WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE 28
+#define WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE(name_len) \
+  (32 + ((name_len) ? 4 + round_pow2 ((name_len), 4) : 0))
+#define WIRESHARK_BRIDGE_PCAPNG_COMMENT_SIZE(comment_len) \
+  ((comment_len) ? 4 + round_pow2 ((comment_len), 4) : 0)
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE(packet_length, comment_len) \
+  (44 + round_pow2 ((packet_length), 4) + WIRESHARK_BRIDGE_PCAPNG_COMMENT_SIZE (comment_len))
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_HEADER_SIZE 28
+#define WIRESHARK_BRIDGE_PCAPNG_EPB_TRAILER_SIZE(packet_length, comment_len) \
+  (16 + round_pow2 ((packet_length), 4) - (packet_length) + \
+   WIRESHARK_BRIDGE_PCAPNG_COMMENT_SIZE (comment_len))
+
+static_always_inline u8 *
+wireshark_bridge_pcapng_put_u32 (u8 *b, u32 value)
+{
+  clib_memcpy (b, &value, sizeof (value));
+  return b + sizeof (value);
+}
+
+static_always_inline u8 *
+wireshark_bridge_pcapng_put_option (u8 *b, u16 code, void *value, u16 length)
+{
+  u16 header[2] = { code, length };
+  u32 padded = round_pow2 ((u32) length, 4);
+
+  clib_memcpy (b, header, sizeof (header));
+  clib_memcpy (b + sizeof (header), value, length);
+  clib_memset (b + sizeof (header) + length, 0, padded - length);
+  return b + sizeof (header) + padded;
+}
+
+/**
+ * @brief Write a section header block with an unspecified section length
+ * @return bytes written
+ */
+static_always_inline u32
+wireshark_bridge_pcapng_write_shb (u8 *b)
+{
+  u16 version[2] = { 1, 0 };
+  u64 section_length = ~0ULL;
+
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_SHB_TYPE);
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE);
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_BYTE_ORDER_MAGIC);
+  clib_memcpy (b, version, sizeof (version));
+  clib_memcpy (b + sizeof (version), &section_length, sizeof (section_length));
+  b += sizeof (version) + sizeof (section_length);
+  wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE);
+
+  return WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE;
+}
+
+/**
+ * @brief Write an Ethernet interface description block with ns timestamps
+ * @return bytes written
+ */
+static_always_inline u32
+wireshark_bridge_pcapng_write_idb (u8 *b, u8 *name, u32 name_len, u32 snaplen)
+{
+  u32 size = WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE (name_len);
+  u16 linktype[2] = { WIRESHARK_BRIDGE_PCAPNG_LINKTYPE_ETHERNET, 0 };
+  u8 tsresol = 9;
+
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_IDB_TYPE);
+  b = wireshark_bridge_pcapng_put_u32 (b, size);
+  clib_memcpy (b, linktype, sizeof (linktype));
+  b = wireshark_bridge_pcapng_put_u32 (b + sizeof (linktype), snaplen);
+  if (name_len)
+    b = wireshark_bridge_pcapng_put_option (b, WIRESHARK_BRIDGE_PCAPNG_OPT_IF_NAME, name, name_len);
+  b = wireshark_bridge_pcapng_put_option (b, WIRESHARK_BRIDGE_PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_OPT_ENDOFOPT);
+  wireshark_bridge_pcapng_put_u32 (b, size);
+
+  return size;
+}
+
+/**
+ * @brief Write the part of an enhanced packet block before the packet data
+ *
+ * The packet data follows, then wireshark_bridge_pcapng_write_epb_trailer (),
+ * so the sender can gather the data from wherever the packet is held.
+ *
+ * @param interface_id  index of the interface's IDB in the section
+ * @param ts_ns         timestamp in nanoseconds
+ * @param comment_len   length of the comment the trailer will carry
+ * @return bytes written
+ */
+static_always_inline u32
+wireshark_bridge_pcapng_write_epb_header (u8 *b, u32 interface_id, u64 ts_ns,
+                                          u32 packet_length, u32 original_length,
+                                          u32 comment_len)
+{
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_EPB_TYPE);
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE (packet_length,
+                                                                           comment_len));
+  b = wireshark_bridge_pcapng_put_u32 (b, interface_id);
+  b = wireshark_bridge_pcapng_put_u32 (b, ts_ns >> 32);
+  b = wireshark_bridge_pcapng_put_u32 (b, ts_ns & 0xffffffff);
+  b = wireshark_bridge_pcapng_put_u32 (b, packet_length);
+  wireshark_bridge_pcapng_put_u32 (b, original_length);
+
+  return WIRESHARK_BRIDGE_PCAPNG_EPB_HEADER_SIZE;
+}
+
+/**
+ * @brief Write the padding and options closing an enhanced packet block
+ *
+ * @param inbound       1 for received packets, 0 for transmitted ones
+ * @param comment       opt_comment of the block, @c comment_len bytes, none if 0
+ * @return bytes written
+ */
+static_always_inline u32
+wireshark_bridge_pcapng_write_epb_trailer (u8 *b, u32 packet_length, int inbound,
+                                           u8 *comment, u32 comment_len)
+{
+  u32 pad = round_pow2 (packet_length, 4) - packet_length;
+  u32 flags = inbound ? WIRESHARK_BRIDGE_PCAPNG_EPB_INBOUND : WIRESHARK_BRIDGE_PCAPNG_EPB_OUTBOUND;
+
+  clib_memset (b, 0, pad);
+  b += pad;
+  if (comment_len)
+    b = wireshark_bridge_pcapng_put_option (b, WIRESHARK_BRIDGE_PCAPNG_OPT_COMMENT, comment, comment_len);
+  b = wireshark_bridge_pcapng_put_option (b, WIRESHARK_BRIDGE_PCAPNG_OPT_EPB_FLAGS, &flags, sizeof (flags));
+  b = wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_OPT_ENDOFOPT);
+  wireshark_bridge_pcapng_put_u32 (b, WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE (packet_length, comment_len));
+
+  return WIRESHARK_BRIDGE_PCAPNG_EPB_TRAILER_SIZE (packet_length, comment_len);
+}
+
+#endif /* __included_wireshark_bridge_pcapng_h__ */
@@ -0,0 +1,99 @@
+/*
+ * recorder.c - always-on flight recorder of a capture session
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/mem.h>
+
+#include <sys/mman.h>
+#include <string.h>
+
+#include "recorder.h"
+#include "numa.h"
+
+/* Buffers backed by huge pages are sized in whole 2 MB pages */
+#define WIRESHARK_BRIDGE_RECORDER_HUGE_PAGE_SIZE (2 << 20)
+
+/**
+ * @brief Map the record buffer of a worker
+ *
+ * Huge pages are used when available, otherwise regular memory, on the
+ * worker's NUMA node. The buffer is touched once here, so the capture
+ * path never takes a page fault on it.
+ *
+ * @param size       buffer size, rounded down to a power of two slots, at
+ *                   least WIRESHARK_BRIDGE_RECORDER_MIN_SLOTS
+ * @param slot_size  bytes per record, header included
+ * @param numa_node  node of the worker, see numa.h
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int
+wireshark_bridge_recorder_create (wireshark_bridge_recorder_t *r, u64 size, u32 slot_size,
+                                  u32 numa_node)
+{
+  u32 n_slots = 1 << min_log2 (clib_max (size / slot_size, WIRESHARK_BRIDGE_RECORDER_MIN_SLOTS));
+  u64 mapping_size = round_pow2 ((u64) n_slots * slot_size, WIRESHARK_BRIDGE_RECORDER_HUGE_PAGE_SIZE);
+  void *base;
+
+  base = mmap (0, mapping_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base == MAP_FAILED)
+    {
+      mapping_size = round_pow2 ((u64) n_slots * slot_size, clib_mem_get_page_size ());
+      base = mmap (0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED)
+        return -1;
+    }
+
+  wireshark_bridge_numa_bind (base, mapping_size, numa_node);
+  clib_memset (base, 0, mapping_size);
+
+  r->slots = base;
+  r->mapping_size = mapping_size;
+  r->slot_size = slot_size;
+  r->n_slots = n_slots;
+  r->head = 0;
+  return 0;
+}
+
+/**
+ * @brief Unmap the record buffer of a worker
+ */
+void
+wireshark_bridge_recorder_free (wireshark_bridge_recorder_t *r)
+{
+  if (r->slots)
+    munmap (r->slots, r->mapping_size);
+  clib_memset (r, 0, sizeof (*r));
+}
+
+/**
+ * @brief Index of the oldest record that is still intact
+ */
+u64
+wireshark_bridge_recorder_oldest (wireshark_bridge_recorder_t *r)
+{
+  u64 head = clib_atomic_load_acq_n (&r->head);
+
+  return head > r->n_slots - 2 ? head - (r->n_slots - 2) : 0;
+}
+
+/**
+ * @brief Copy record @c index into @c dst, slot_size bytes
+ *
+ * @return 1 if the copy is intact, 0 if the worker may have overwritten
+ * the record before or while it was copied
+ */
+int
+wireshark_bridge_recorder_read (wireshark_bridge_recorder_t *r, u64 index, u8 *dst)
+{
+  if (index < wireshark_bridge_recorder_oldest (r))
+    return 0;
+
+  clib_memcpy_fast (dst, wireshark_bridge_recorder_slot (r, index), r->slot_size);
+
+  /* The copy has to be complete before the head is looked at again */
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  return index >= wireshark_bridge_recorder_oldest (r);
+}
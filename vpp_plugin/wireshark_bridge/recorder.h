@@ -0,0 +1,53 @@
+/*
+ * recorder.h - always-on flight recorder of a capture session
+ *
+ * A session enabled with "recorder" sends nothing while it captures. Its
+ * capture nodes write every packet as a record, the usual 21 byte packet
+ * header followed by at most snaplen packet bytes, into the next slot of
+ * a per-worker circular buffer in huge page memory, overwriting the
+ * oldest record once the buffer is full. A dump ("wireshark bridge dump",
+ * its API or a counter trigger) then takes the records of the last
+ * seconds out of every worker's buffer, merged by time.
+ *
+ * Slots have a fixed size, so the records still in a buffer are simply
+ * the last n_slots written. The worker never waits for a reader: a reader
+ * copies a slot and then checks whether the worker may have come around
+ * to it while it did. One slot of slack covers stores of the next record
+ * becoming visible before the head store preceding them.
+ */
+
+#ifndef __included_wireshark_bridge_recorder_h__
+#define __included_wireshark_bridge_recorder_h__
+
+#include <vppinfra/clib.h>
+
+#define WIRESHARK_BRIDGE_RECORDER_DEFAULT_SIZE (16 << 20)  // Bytes per worker
+#define WIRESHARK_BRIDGE_RECORDER_DEFAULT_SNAPLEN 128      // Without a session snaplen
+#define WIRESHARK_BRIDGE_RECORDER_DEFAULT_SECONDS 10       // Dumped when not given
+#define WIRESHARK_BRIDGE_RECORDER_MIN_SLOTS 4              // Two of them are never read
+
+/* Circular record buffer of one worker */
+typedef struct {
+  u8 *slots;
+  u64 mapping_size;
+  u32 slot_size;            // Bytes per slot, record header included
+  u32 n_slots;              // A power of two
+  volatile u64 head;        // Records ever written, written by the worker only
+} wireshark_bridge_recorder_t;
+
+int wireshark_bridge_recorder_create (wireshark_bridge_recorder_t *r, u64 size, u32 slot_size,
+                                      u32 numa_node);
+void wireshark_bridge_recorder_free (wireshark_bridge_recorder_t *r);
+u64 wireshark_bridge_recorder_oldest (wireshark_bridge_recorder_t *r);
+int wireshark_bridge_recorder_read (wireshark_bridge_recorder_t *r, u64 index, u8 *dst);
+
+/**
+ * @brief Slot holding record @c index
+ */
+static_always_inline u8 *
+wireshark_bridge_recorder_slot (wireshark_bridge_recorder_t *r, u64 index)
+{
+  return r->slots + (index & (r->n_slots - 1)) * r->slot_size;
+}
+
+#endif /* __included_wireshark_bridge_recorder_h__ */
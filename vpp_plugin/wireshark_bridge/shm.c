@@ -0,0 +1,189 @@
+/*
+ * shm.c - shared memory capture ring for consumers on the VPP host
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/time.h>
+#include <vppinfra/error.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "shm.h"
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+
+/* Mappings backed by huge pages are sized in whole 2 MB pages */
+#define WIRESHARK_BRIDGE_SHM_HUGE_PAGE_SIZE (2 << 20)
+
+/**
+ * @brief Try to create and map a memfd of @c size bytes
+ */
+static int
+wireshark_bridge_shm_map (wireshark_bridge_shm_t *shm, u64 size, unsigned int flags)
+{
+  void *base;
+  int fd = memfd_create ("wireshark-bridge", MFD_CLOEXEC | flags);
+
+  if (fd < 0)
+    return -1;
+
+  if (ftruncate (fd, size) < 0)
+    goto error;
+
+  base = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+    goto error;
+
+  shm->fd = fd;
+  shm->header = base;
+  shm->mapping_size = size;
+  return 0;
+
+error:
+  close (fd);
+  return -1;
+}
+
+/**
+ * @brief Create the shared ring of a session
+ *
+ * Huge pages are used when available, otherwise regular shared memory.
+ *
+ * @param data_size size of the record area, rounded up to a power of two
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int
+wireshark_bridge_shm_create (wireshark_bridge_shm_t *shm, u64 data_size)
+{
+  wireshark_bridge_shm_header_t *h;
+  u64 size;
+
+  data_size = 1ULL << max_log2 (data_size);
+  size = sizeof (wireshark_bridge_shm_header_t) + data_size;
+
+  if (wireshark_bridge_shm_map (shm, round_pow2 (size, WIRESHARK_BRIDGE_SHM_HUGE_PAGE_SIZE),
+                                MFD_HUGETLB) < 0 &&
+      wireshark_bridge_shm_map (shm, round_pow2 (size, clib_mem_get_page_size ()), 0) < 0)
+    return -1;
+
+  h = shm->header;
+  clib_memset (h, 0, sizeof (*h));
+  h->magic = WIRESHARK_BRIDGE_SHM_MAGIC;
+  h->version = WIRESHARK_BRIDGE_SHM_VERSION;
+  h->header_size = sizeof (*h);
+  h->data_size = data_size;
+  h->ring_id = clib_cpu_time_now ();
+
+  shm->data = (u8 *) (h + 1);
+  shm->data_size = data_size;
+  shm->write_pos = 0;
+  return 0;
+}
+
+/**
+ * @brief Tell the consumer that no more records follow and unmap the ring
+ *
+ * The consumer keeps its own mapping, so records it has not read yet stay
+ * readable after this.
+ */
+void
+wireshark_bridge_shm_free (wireshark_bridge_shm_t *shm)
+{
+  if (shm->header == 0)
+    return;
+
+  wireshark_bridge_shm_publish (shm);
+  clib_atomic_store_rel_n (&shm->header->closed, 1);
+
+  munmap (shm->header, shm->mapping_size);
+  close (shm->fd);
+  clib_memset (shm, 0, sizeof (*shm));
+  shm->fd = -1;
+}
+
+/**
+ * @brief Pass the memfd to the consumer bound at @c addr
+ *
+ * Announcements carry the ring id, so a consumer that is already attached
+ * can ignore repeated ones. Failing to reach the consumer is not an error,
+ * it may simply not be running yet.
+ *
+ * @return 0 if the announcement was sent, -1 otherwise
+ */
+int
+wireshark_bridge_shm_announce (wireshark_bridge_shm_t *shm, int socket_fd,
+                               struct sockaddr_un *addr)
+{
+  wireshark_bridge_shm_announce_t announce = {
+    .magic = WIRESHARK_BRIDGE_SHM_MAGIC,
+    .version = WIRESHARK_BRIDGE_SHM_VERSION,
+    .mapping_size = shm->mapping_size,
+    .ring_id = shm->header->ring_id,
+  };
+  struct iovec iov = { .iov_base = &announce, .iov_len = sizeof (announce) };
+  union {
+    struct cmsghdr align;
+    u8 buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  struct msghdr msg = {
+    .msg_name = addr,
+    .msg_namelen = sizeof (*addr),
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = sizeof (control.buf),
+  };
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  clib_memcpy (CMSG_DATA (cmsg), &shm->fd, sizeof (int));
+
+  return sendmsg (socket_fd, &msg, MSG_DONTWAIT) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Reserve space for the next record (sender thread only)
+ *
+ * Writes the record length and returns where its @c n_bytes of packet
+ * header and data go, or NULL when the consumer has not freed enough
+ * space, in which case the record is counted as dropped. Records become
+ * visible to the consumer with wireshark_bridge_shm_publish ().
+ */
+u8 *
+wireshark_bridge_shm_reserve (wireshark_bridge_shm_t *shm, u32 n_bytes)
+{
+  u64 mask = shm->data_size - 1;
+  u32 record_len = sizeof (u32) + n_bytes;
+  u64 aligned = round_pow2 ((u64) record_len, WIRESHARK_BRIDGE_SHM_RECORD_ALIGN);
+  u64 pos = shm->write_pos;
+  u64 offset = pos & mask;
+  u64 to_end = shm->data_size - offset;
+  u64 needed = aligned > to_end ? to_end + aligned : aligned;
+  u64 read_pos = clib_atomic_load_acq_n (&shm->header->read_pos);
+
+  if (aligned > shm->data_size || pos + needed - read_pos > shm->data_size)
+    {
+      shm->header->dropped++;
+      return 0;
+    }
+
+  /* Records never wrap, skip the tail of the area instead */
+  if (aligned > to_end)
+    {
+      *(u32 *) (shm->data + offset) = 0;
+      pos += to_end;
+      offset = 0;
+    }
+
+  *(u32 *) (shm->data + offset) = record_len;
+  shm->write_pos = pos + aligned;
+
+  return shm->data + offset + sizeof (u32);
+}
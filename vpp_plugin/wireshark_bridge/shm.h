@@ -0,0 +1,94 @@
+/*
+ * shm.h - shared memory capture ring for consumers on the VPP host
+ *
+ * A session with an "shm:/path/to/socket" destination writes its records
+ * into a memfd backed byte ring instead of sending datagrams. The memfd is
+ * passed over the Unix datagram socket bound by the consumer at the path,
+ * after which the consumer reads records straight from the mapping
+ * without any system calls. The announcement is repeated every second,
+ * consumers ignore the ones for the ring they are already reading.
+ *
+ * Layout of the mapping (host byte order, fixed offsets so that consumers
+ * in other languages do not depend on the cache line size VPP was built
+ * with):
+ *
+ *   0    wireshark_bridge_shm_header_t
+ *   192  record area of data_size bytes (a power of two)
+ *
+ * Every record starts on an 8 byte boundary with a u32 record length,
+ * counting the length field itself, followed by the usual 21 byte packet
+ * header and the packet bytes. A zero length means the rest of the record
+ * area up to its end is unused and the next record is at its start.
+ */
+
+#ifndef __included_wireshark_bridge_shm_h__
+#define __included_wireshark_bridge_shm_h__
+
+#include <vppinfra/clib.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define WIRESHARK_BRIDGE_SHM_PREFIX "shm:"
+#define WIRESHARK_BRIDGE_SHM_MAGIC 0x57425352    /* "WBSR" */
+#define WIRESHARK_BRIDGE_SHM_VERSION 1
+#define WIRESHARK_BRIDGE_SHM_DEFAULT_SIZE (64 << 20)
+#define WIRESHARK_BRIDGE_SHM_RECORD_ALIGN 8
+#define WIRESHARK_BRIDGE_SHM_ANNOUNCE_INTERVAL 1.0  // Seconds between fd announcements
+
+/* Shared ring header, the first 192 bytes of the mapping */
+typedef struct {
+  /* Written once by the plugin before the fd is passed */
+  u32 magic;
+  u16 version;
+  u16 header_size;          // Offset of the record area
+  u64 data_size;            // Size of the record area
+  u64 ring_id;              // Changes whenever the ring is recreated
+  /* Written by the producer */
+  u64 dropped;              // Records dropped because the ring was full
+  volatile u32 closed;      // Set when the session is gone, no more records follow
+  u8 pad0[28];
+  /* Producer position, written by the plugin sender thread only */
+  volatile u64 write_pos;
+  u8 pad1[56];
+  /* Consumer position, written by the consumer only */
+  volatile u64 read_pos;
+  u8 pad2[56];
+} wireshark_bridge_shm_header_t;
+
+STATIC_ASSERT_SIZEOF (wireshark_bridge_shm_header_t, 192);
+
+/* Announcement sent with the memfd as SCM_RIGHTS ancillary data */
+typedef struct {
+  u32 magic;
+  u32 version;
+  u64 mapping_size;
+  u64 ring_id;
+} wireshark_bridge_shm_announce_t;
+
+/* Producer side state of a shared ring, owned by the session */
+typedef struct {
+  int fd;
+  wireshark_bridge_shm_header_t *header;
+  u8 *data;
+  u64 data_size;
+  u64 mapping_size;
+  u64 write_pos;            // Records written but not yet published
+} wireshark_bridge_shm_t;
+
+int wireshark_bridge_shm_create (wireshark_bridge_shm_t *shm, u64 data_size);
+void wireshark_bridge_shm_free (wireshark_bridge_shm_t *shm);
+int wireshark_bridge_shm_announce (wireshark_bridge_shm_t *shm, int socket_fd,
+                                   struct sockaddr_un *addr);
+u8 *wireshark_bridge_shm_reserve (wireshark_bridge_shm_t *shm, u32 n_bytes);
+
+/**
+ * @brief Make the records written since the last call visible to the consumer
+ */
+static_always_inline void
+wireshark_bridge_shm_publish (wireshark_bridge_shm_t *shm)
+{
+  clib_atomic_store_rel_n (&shm->header->write_pos, shm->write_pos);
+}
+
+#endif /* __included_wireshark_bridge_shm_h__ */
@@ -0,0 +1,270 @@
+/*
+ * stream.c - TCP stream transport for remote captures
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+#include <vppinfra/error.h>
+#include <vppinfra/time.h>
+
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "stream.h"
+
+/**
+ * @brief Set up a stream towards @c addr, the connection is made by
+ * wireshark_bridge_stream_poll ()
+ */
+void
+wireshark_bridge_stream_init (wireshark_bridge_stream_t *stream, struct sockaddr_in *addr)
+{
+  clib_memset (stream, 0, sizeof (*stream));
+  stream->fd = -1;
+  stream->addr = *addr;
+}
+
+/**
+ * @brief Drop the connection and whatever was not written yet
+ *
+ * The next connection starts on a record boundary again.
+ */
+static void
+wireshark_bridge_stream_close (wireshark_bridge_stream_t *stream, f64 now)
+{
+  if (stream->state == WIRESHARK_BRIDGE_STREAM_CONNECTED)
+    stream->disconnects++;
+
+  if (stream->fd >= 0)
+    close (stream->fd);
+
+  stream->fd = -1;
+  stream->state = WIRESHARK_BRIDGE_STREAM_DISCONNECTED;
+  stream->next_connect = now + WIRESHARK_BRIDGE_STREAM_RECONNECT_INTERVAL;
+  vec_reset_length (stream->backlog);
+  stream->backlog_offset = 0;
+}
+
+void
+wireshark_bridge_stream_free (wireshark_bridge_stream_t *stream)
+{
+  if (stream->fd >= 0)
+    close (stream->fd);
+  stream->fd = -1;
+  vec_free (stream->backlog);
+}
+
+/**
+ * @brief Start a non-blocking connect
+ */
+static void
+wireshark_bridge_stream_connect (wireshark_bridge_stream_t *stream, f64 now)
+{
+  int one = 1, sndbuf = WIRESHARK_BRIDGE_STREAM_SNDBUF;
+
+  stream->fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (stream->fd < 0)
+    {
+      stream->next_connect = now + WIRESHARK_BRIDGE_STREAM_RECONNECT_INTERVAL;
+      return;
+    }
+
+  /* Batches are written whole, Nagle would only add latency */
+  setsockopt (stream->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+  setsockopt (stream->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof (sndbuf));
+  setsockopt (stream->fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof (one));
+
+  if (connect (stream->fd, (struct sockaddr *) &stream->addr, sizeof (stream->addr)) == 0)
+    {
+      stream->state = WIRESHARK_BRIDGE_STREAM_CONNECTED;
+      stream->connects++;
+    }
+  else if (errno == EINPROGRESS)
+    stream->state = WIRESHARK_BRIDGE_STREAM_CONNECTING;
+  else
+    wireshark_bridge_stream_close (stream, now);
+}
+
+/**
+ * @brief Write as much of the backlog as the socket takes
+ *
+ * @return 0 if the socket is still usable, -1 if the connection was lost
+ */
+static int
+wireshark_bridge_stream_flush_backlog (wireshark_bridge_stream_t *stream, f64 now)
+{
+  while (stream->backlog_offset < vec_len (stream->backlog))
+    {
+      ssize_t n = send (stream->fd, stream->backlog + stream->backlog_offset,
+                        vec_len (stream->backlog) - stream->backlog_offset,
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n > 0)
+        {
+          stream->backlog_offset += n;
+          continue;
+        }
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+      wireshark_bridge_stream_close (stream, now);
+      return -1;
+    }
+
+  vec_reset_length (stream->backlog);
+  stream->backlog_offset = 0;
+  return 0;
+}
+
+/**
+ * @brief Make progress on connecting and on the backlog (sender thread only)
+ *
+ * @return 1 if the stream is ready for a new batch, 0 otherwise
+ */
+int
+wireshark_bridge_stream_poll (wireshark_bridge_stream_t *stream, f64 now)
+{
+  if (stream->state == WIRESHARK_BRIDGE_STREAM_DISCONNECTED && now >= stream->next_connect)
+    wireshark_bridge_stream_connect (stream, now);
+
+  if (stream->state == WIRESHARK_BRIDGE_STREAM_CONNECTING)
+    {
+      struct pollfd pfd = { .fd = stream->fd, .events = POLLOUT };
+      socklen_t len = sizeof (int);
+      int error = 0;
+
+      if (poll (&pfd, 1, 0) <= 0)
+        return 0;
+
+      if (getsockopt (stream->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+        {
+          wireshark_bridge_stream_close (stream, now);
+          return 0;
+        }
+
+      stream->state = WIRESHARK_BRIDGE_STREAM_CONNECTED;
+      stream->connects++;
+    }
+
+  if (stream->state != WIRESHARK_BRIDGE_STREAM_CONNECTED)
+    return 0;
+
+  if (wireshark_bridge_stream_flush_backlog (stream, now) < 0)
+    return 0;
+
+  return wireshark_bridge_stream_is_ready (stream);
+}
+
+/**
+ * @brief Wait up to @c timeout_msec for the stream to take a new batch
+ *
+ * For writers that must not lose a batch, the recorder dumps. Connects
+ * and writes the backlog as wireshark_bridge_stream_poll () does, with
+ * the sender's mutex held.
+ *
+ * @return 1 if the stream is ready for a new batch, 0 on timeout
+ */
+int
+wireshark_bridge_stream_wait (wireshark_bridge_stream_t *stream, u32 timeout_msec)
+{
+  f64 now = unix_time_now ();
+  f64 deadline = now + timeout_msec * 1e-3;
+
+  while (!wireshark_bridge_stream_poll (stream, now))
+    {
+      struct pollfd pfd = { .fd = stream->fd, .events = POLLOUT };
+      int msec;
+
+      if (now >= deadline)
+        return 0;
+
+      /* Until the next connect attempt without a socket, else until it can take more */
+      msec = (int) ((deadline - now) * 1e3) + 1;
+      if (stream->state == WIRESHARK_BRIDGE_STREAM_DISCONNECTED)
+        msec = clib_min (msec, (int) ((stream->next_connect - now) * 1e3) + 1);
+      poll (&pfd, stream->state == WIRESHARK_BRIDGE_STREAM_DISCONNECTED ? 0 : 1, clib_max (msec, 0));
+      now = unix_time_now ();
+    }
+
+  return 1;
+}
+
+/**
+ * @brief Write a batch of buffers to the stream (sender thread only)
+ *
+ * Whatever part of the batch the kernel does not take goes to the
+ * backlog. A batch is dropped whole if the stream is not connected or
+ * still has a backlog.
+ *
+ * @return number of buffers written or queued, 0 if the batch was dropped
+ */
+int
+wireshark_bridge_stream_write (wireshark_bridge_stream_t *stream, struct iovec *iovs,
+                               u32 n_iovs, f64 now)
+{
+  struct msghdr msg = { 0 };
+  size_t total = 0, written = 0;
+  ssize_t n;
+  u32 i, first = 0;
+
+  if (!wireshark_bridge_stream_poll (stream, now))
+    return 0;
+
+  for (i = 0; i < n_iovs; i++)
+    total += iovs[i].iov_len;
+
+  /* A batch of gathered payloads can hold more iovecs than one sendmsg takes */
+  while (first < n_iovs)
+    {
+      size_t chunk = 0;
+
+      msg.msg_iov = iovs + first;
+      msg.msg_iovlen = clib_min (n_iovs - first, IOV_MAX);
+      for (i = 0; i < msg.msg_iovlen; i++)
+        chunk += msg.msg_iov[i].iov_len;
+
+      do
+        n = sendmsg (stream->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+      while (n < 0 && errno == EINTR);
+
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+          clib_warning ("TCP stream lost: %s", strerror (errno));
+          wireshark_bridge_stream_close (stream, now);
+          return 0;
+        }
+
+      if (n < 0)
+        break;
+      written += n;
+      if ((size_t) n < chunk)
+        break;
+      first += msg.msg_iovlen;
+    }
+
+  if (written == total)
+    return n_iovs;
+
+  /* Keep the rest, it has to go out before the next batch */
+  for (i = 0; i < n_iovs; i++)
+    {
+      if (written >= iovs[i].iov_len)
+        {
+          written -= iovs[i].iov_len;
+          continue;
+        }
+
+      vec_add (stream->backlog, (u8 *) iovs[i].iov_base + written, iovs[i].iov_len - written);
+      written = 0;
+    }
+
+  return n_iovs;
+}
@@ -0,0 +1,70 @@
+/*
+ * stream.h - TCP stream transport for remote captures
+ *
+ * A session with a "tcp://host:port" destination writes its datagram
+ * buffers back to back into a TCP connection instead of sending them as
+ * UDP datagrams, so nothing is fragmented at the IP layer and the
+ * receiver's window pushes back when it does not keep up. The byte stream
+ * is the same sequence of records (or pcapng sections) a datagram would
+ * carry, the receiver only has to reassemble records that span reads.
+ *
+ * The socket never blocks the sender thread. Bytes the kernel did not
+ * take are kept in a backlog and written before anything else, and while
+ * there is a backlog new batches are dropped whole, so the stream always
+ * stays aligned to record boundaries. The connection is made, and remade
+ * after errors, by the sender thread. Recorder dumps, which have nothing
+ * to send again later, wait for the backlog instead.
+ */
+
+#ifndef __included_wireshark_bridge_stream_h__
+#define __included_wireshark_bridge_stream_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#define WIRESHARK_BRIDGE_STREAM_PREFIX "tcp://"
+#define WIRESHARK_BRIDGE_STREAM_RECONNECT_INTERVAL 1.0  // Seconds between connect attempts
+#define WIRESHARK_BRIDGE_STREAM_RETRY_USEC 1000  // Backlog and connect poll while stalled
+#define WIRESHARK_BRIDGE_STREAM_SNDBUF (4 << 20)
+#define WIRESHARK_BRIDGE_STREAM_WAIT_MSEC 1000  // Longest wait of a recorder dump per batch
+
+typedef enum {
+  WIRESHARK_BRIDGE_STREAM_DISCONNECTED,
+  WIRESHARK_BRIDGE_STREAM_CONNECTING,
+  WIRESHARK_BRIDGE_STREAM_CONNECTED,
+} wireshark_bridge_stream_state_t;
+
+/* Connection state of a stream session, owned by its sender thread */
+typedef struct {
+  int fd;
+  wireshark_bridge_stream_state_t state;
+  struct sockaddr_in addr;
+  u8 *backlog;              // Bytes of the last batch the kernel did not take
+  u32 backlog_offset;       // Bytes of the backlog already written
+  f64 next_connect;         // Earliest time of the next connect attempt
+  u64 connects;             // Connections established
+  u64 disconnects;          // Connections lost
+} wireshark_bridge_stream_t;
+
+void wireshark_bridge_stream_init (wireshark_bridge_stream_t *stream, struct sockaddr_in *addr);
+void wireshark_bridge_stream_free (wireshark_bridge_stream_t *stream);
+int wireshark_bridge_stream_poll (wireshark_bridge_stream_t *stream, f64 now);
+int wireshark_bridge_stream_wait (wireshark_bridge_stream_t *stream, u32 timeout_msec);
+int wireshark_bridge_stream_write (wireshark_bridge_stream_t *stream, struct iovec *iovs,
+                                   u32 n_iovs, f64 now);
+
+/**
+ * @brief Whether a new batch would be written right away
+ */
+static_always_inline int
+wireshark_bridge_stream_is_ready (wireshark_bridge_stream_t *stream)
+{
+  return stream->state == WIRESHARK_BRIDGE_STREAM_CONNECTED &&
+         stream->backlog_offset == vec_len (stream->backlog);
+}
+
+#endif /* __included_wireshark_bridge_stream_h__ */
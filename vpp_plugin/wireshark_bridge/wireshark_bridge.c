@@ -14,42 +14,29 @@
 #include <vlib/unix/unix.h>
 #include <vnet/format_fns.h>
 #include <vnet/ip/ip_types_api.h>
+#include <vppinfra/linux/sysfs.h>
 
 // Add forward declaration for vl_api_get_main
 extern void *vl_api_get_main(void);
 
-// Make sure the packet structure is defined only once at the top
-typedef struct {
-  u32 sw_if_index;
-  u8 *packet_data;
-  u32 packet_length;
-  f64 timestamp;
-  u8 direction;
-} wireshark_bridge_packet_t;
-
-// Define the queue structure correctly
-typedef struct {
-  wireshark_bridge_packet_t *packets;
-  volatile u8 should_stop;
-  u32 queue_overflows;
-} wireshark_bridge_queue_t;
-
-// Declare our global queue
-wireshark_bridge_queue_t wireshark_bridge_queue;
-
-// Protocol message format
-#define WIRESHARK_BRIDGE_VERSION 1
+#include "wireshark_bridge.h"
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/un.h>  // Added for Unix domain sockets
 
+#ifdef WIRESHARK_BRIDGE_LZ4
+#include <lz4.h>
+#endif
+
 #include "wireshark_bridge.api_enum.h"
 #include "wireshark_bridge.api_types.h"
 
@@ -58,729 +45,3156 @@ wireshark_bridge_queue_t wireshark_bridge_queue;
 #define WIRESHARK_BRIDGE_PLUGIN_VERSION_MINOR "0"
 #define WIRESHARK_BRIDGE_PLUGIN_VERSION_PATCH "0"
 
-// Packet direction constants
-#define WIRESHARK_BRIDGE_DIRECTION_RX 0
-#define WIRESHARK_BRIDGE_DIRECTION_TX 1
-
-// Configuration constants
-#define WIRESHARK_BRIDGE_MAX_QUEUE_SIZE 10000  // Maximum packets in queue
-#define WIRESHARK_BRIDGE_PACKET_HEADER_SIZE 17 // Size of packet header in bytes
-#define WIRESHARK_BRIDGE_CONNECT_TIMEOUT_SEC 5 // Socket connection timeout
-#define WIRESHARK_BRIDGE_BATCH_SIZE 32         // Number of packets to batch send
-#define WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE 65507 // Maximum UDP datagram size
-
-// Interface data structure
-typedef struct {
-  u32 sw_if_index;
-  u8 is_enabled;
-  u64 packets_sent_rx;
-  u64 bytes_sent_rx;
-  u64 packets_sent_tx;
-  u64 bytes_sent_tx;
-} wireshark_bridge_interface_t;
-
-// Main plugin context structure
-typedef struct {
-  /* API message ID base */
-  u16 msg_id_base;
-
-  /* Vector of interfaces */
-  wireshark_bridge_interface_t *interfaces;
-  
-  /* Hash table for faster interface lookup */
-  uword *interface_index_by_sw_if_index;
-
-  /* Bridge socket */
-  int bridge_socket;
-  union {
-    struct sockaddr_in inet_addr;  // For backward compatibility
-    struct sockaddr_un unix_addr;  // For Unix domain sockets
-  } bridge_addr;
-  u8 bridge_connected;
-  u8 use_unix_socket;  // Flag to indicate if we're using a Unix socket
-  char socket_path[108];  // Store Unix socket path (max path length)
-
-  /* Thread for sending packets */
-  pthread_t sender_thread;
-  u8 sender_thread_running;
-  pthread_mutex_t sender_mutex;
-  pthread_cond_t sender_cond;
-  
-  /* Convenience */
-  vlib_main_t *vlib_main;
-  vnet_main_t *vnet_main;
-  ethernet_main_t *ethernet_main;
-} wireshark_bridge_main_t;
-
 wireshark_bridge_main_t wireshark_bridge_main;
 
 /* Forward declarations */
 static void *wireshark_bridge_sender_thread_fn (void *arg);
-extern vlib_node_registration_t wireshark_bridge_rx_node;
-extern vlib_node_registration_t wireshark_bridge_tx_node;
-static void wireshark_bridge_send_packets (wireshark_bridge_main_t * wbm, wireshark_bridge_packet_t * packets, u32 n_packets);
-
-/* Feature registration structures */
-VNET_FEATURE_INIT (wireshark_bridge_rx_feature, static) = {
-  .arc_name = "device-input",
-  .node_name = "wireshark-bridge-rx",
-  .runs_before = VNET_FEATURES ("ethernet-input"),
+static void wireshark_bridge_send_packets (wireshark_bridge_sender_t * sender, wireshark_bridge_packet_t * packets, u32 n_packets);
+static void wireshark_bridge_sender_account_batch (wireshark_bridge_sender_t *sender, wireshark_bridge_packet_t *packets, u32 n_packets);
+static void wireshark_bridge_sender_export_flows (wireshark_bridge_sender_t *sender);
+
+/* Stats process, also taking the recorder dumps asked for over the API */
+static vlib_node_registration_t wireshark_bridge_stats_process_node;
+#define WIRESHARK_BRIDGE_EVENT_DUMP 1
+
+/* Interface counters of the recorder triggers, by WIRESHARK_BRIDGE_TRIGGER_* */
+static const u8 wireshark_bridge_trigger_vnet_counters[] = {
+#define _(sym, name) VNET_INTERFACE_COUNTER_##sym,
+  foreach_wireshark_bridge_trigger_counter
+#undef _
 };
 
-VNET_FEATURE_INIT (wireshark_bridge_tx_feature, static) = {
-  .arc_name = "interface-output",
-  .node_name = "wireshark-bridge-tx",
-  .runs_before = VNET_FEATURES ("interface-output-arc-end"),
+static const char *wireshark_bridge_trigger_names[] = {
+#define _(sym, name) name,
+  foreach_wireshark_bridge_trigger_counter
+#undef _
 };
 
-/* Packet trace structure */
-typedef struct {
-  u32 sw_if_index;
-  u32 next_index;
-  u8 direction;
-} wireshark_bridge_trace_t;
+/**
+ * @brief Allocate per-thread capture rings and reset the stop flag
+ *
+ * Called from the main thread before the session is published to the
+ * workers, so they never observe the rings vector being resized. The
+ * descriptors of a ring are mapped on its worker's NUMA node. Sender
+ * threads are spread over the nodes of the workers round robin, and a
+ * ring goes round robin to the senders on its node, to any sender if
+ * there are more nodes than senders.
+ *
+ * @return 0 on success, -1 if descriptors could not be mapped
+ */
+static int
+wireshark_bridge_queue_init (wireshark_bridge_queue_t *queue, wireshark_bridge_sender_t *senders)
+{
+  u32 n_threads = vlib_get_thread_main ()->n_vlib_mains;
+  u32 n_senders = vec_len (senders);
+  u32 *nodes = 0, *next_by_node = 0;
+  wireshark_bridge_sender_t *sender;
+  wireshark_bridge_ring_t *ring;
+  u32 i, n_local, k;
+  u8 *base;
+
+  if (vec_len (queue->rings) < n_threads)
+    vec_validate_aligned (queue->rings, n_threads - 1, CLIB_CACHE_LINE_BYTES);
+
+  vec_foreach_index (i, queue->rings)
+    {
+      ring = &queue->rings[i];
+      ring->numa_node = vlib_get_main_by_index (i)->numa_node;
+      if (vec_search (nodes, ring->numa_node) == ~0)
+        vec_add1 (nodes, ring->numa_node);
+
+      if (ring->packets)
+        continue;
+
+      base = mmap (0, WIRESHARK_BRIDGE_RING_DESCRIPTORS_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED)
+        {
+          vec_free (nodes);
+          return -1;
+        }
+      wireshark_bridge_numa_bind (base, WIRESHARK_BRIDGE_RING_DESCRIPTORS_SIZE, ring->numa_node);
+
+      ring->packets = (wireshark_bridge_packet_t *) base;
+      ring->free_buffers = (u32 *) (base + WIRESHARK_BRIDGE_RING_SIZE * sizeof (wireshark_bridge_packet_t));
+    }
+
+  vec_foreach (sender, senders)
+    {
+      sender->numa_node = nodes[(sender - senders) % vec_len (nodes)];
+      vec_reset_length (sender->ring_indices);
+    }
+
+  vec_foreach_index (i, queue->rings)
+    {
+      ring = &queue->rings[i];
+      vec_validate (next_by_node, ring->numa_node);
+
+      n_local = 0;
+      vec_foreach (sender, senders)
+        n_local += sender->numa_node == ring->numa_node;
+
+      /* The k-th sender of the ring's node, or of all of them */
+      k = n_local ? next_by_node[ring->numa_node]++ % n_local : i % n_senders;
+      vec_foreach (sender, senders)
+        if ((n_local == 0 || sender->numa_node == ring->numa_node) && k-- == 0)
+          break;
+
+      ring->sender_index = sender - senders;
+      vec_add1 (sender->ring_indices, i);
+    }
+
+  vec_free (nodes);
+  vec_free (next_by_node);
+  queue->should_stop = 0;
+  return 0;
+}
 
 /**
- * @brief Format trace data for output
+ * @brief Unmap the ring descriptors of a session and free its rings
  */
-static u8 *
-format_wireshark_bridge_trace (u8 * s, va_list * args)
+static void
+wireshark_bridge_queue_free (wireshark_bridge_queue_t *queue)
 {
-  CLIB_UNUSED (vlib_main_t * vm) = va_arg (*args, vlib_main_t *);
-  CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
-  wireshark_bridge_trace_t *t = va_arg (*args, wireshark_bridge_trace_t *);
+  wireshark_bridge_ring_t *ring;
 
-  s = format (s, "wireshark-bridge: sw_if_index %d, next index %d, direction %s",
-              t->sw_if_index, t->next_index, t->direction ? "TX" : "RX");
-  return s;
+  vec_foreach (ring, queue->rings)
+    if (ring->packets)
+      munmap (ring->packets, WIRESHARK_BRIDGE_RING_DESCRIPTORS_SIZE);
+  vec_free (queue->rings);
 }
 
 /**
- * @brief Find interface in the registry
+ * @brief Slot size for a snaplen
+ *
+ * Sessions without a snaplen get slots for a jumbo frame, larger (GSO)
+ * packets need a snaplen to be captured whole. Pages of a slot that no
+ * packet reaches are never touched, so the slab only costs the memory
+ * captures actually use.
  */
-static wireshark_bridge_interface_t *
-wireshark_bridge_find_interface (wireshark_bridge_main_t *wbm, u32 sw_if_index)
+static u32
+wireshark_bridge_slot_size (u32 snaplen)
 {
-  uword *p;
-  u32 index;
-  
-  p = hash_get (wbm->interface_index_by_sw_if_index, sw_if_index);
-  if (p == NULL)
-    return NULL;
-    
-  index = p[0];
-  if (index >= vec_len (wbm->interfaces))
-    return NULL;
-    
-  return &wbm->interfaces[index];
+  u32 size = snaplen ? clib_min (snaplen, WIRESHARK_BRIDGE_MAX_CAPTURE_LENGTH) :
+                       WIRESHARK_BRIDGE_DEFAULT_SLOT_SIZE;
+
+  return round_pow2 (size, CLIB_CACHE_LINE_BYTES);
 }
 
 /**
- * @brief Add interface to the registry
+ * @brief Map the capture slots of every ring of a session
+ *
+ * Called on the main thread with the worker barrier and the session lock
+ * held. Slots are only remapped while a ring is empty and nothing dequeued
+ * from it is still being sent; a ring that is busy keeps its slots, and
+ * copies are cut to their size until the next enable finds it idle.
+ *
+ * @return 0 on success, -1 if a slab could not be mapped
  */
-static wireshark_bridge_interface_t *
-wireshark_bridge_add_interface (wireshark_bridge_main_t *wbm, u32 sw_if_index)
+static int
+wireshark_bridge_queue_map_slots (wireshark_bridge_queue_t *queue, u32 slot_size)
 {
-  wireshark_bridge_interface_t *wbi;
-  u32 index;
-  
-  // Check if interface already exists
-  wbi = wireshark_bridge_find_interface (wbm, sw_if_index);
-  if (wbi)
-    return wbi;
-    
-  // Add new interface
-  wireshark_bridge_interface_t new_wbi = {0};
-  new_wbi.sw_if_index = sw_if_index;
-  index = vec_len (wbm->interfaces);
-  vec_add1 (wbm->interfaces, new_wbi);
-  hash_set (wbm->interface_index_by_sw_if_index, sw_if_index, index);
-  
-  return &wbm->interfaces[index];
+  wireshark_bridge_ring_t *ring;
+  u8 *slots;
+
+  vec_foreach (ring, queue->rings)
+    {
+      if (ring->slot_size == slot_size)
+        continue;
+
+      if (ring->slots && clib_atomic_load_acq_n (&ring->head) != ring->tail)
+        continue;
+
+      slots = mmap (0, (uword) WIRESHARK_BRIDGE_RING_SIZE * slot_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slots == MAP_FAILED)
+        return -1;
+      wireshark_bridge_numa_bind (slots, (uword) WIRESHARK_BRIDGE_RING_SIZE * slot_size,
+                                  ring->numa_node);
+
+      if (ring->slots)
+        munmap (ring->slots, (uword) WIRESHARK_BRIDGE_RING_SIZE * ring->slot_size);
+
+      ring->slots = slots;
+      ring->slot_size = slot_size;
+    }
+
+  return 0;
 }
 
 /**
- * @brief Thread function for sending packets to bridge
+ * @brief Unmap the capture slots of a session that no longer captures
  */
-static void *
-wireshark_bridge_sender_thread_fn (void *arg)
+static void
+wireshark_bridge_queue_unmap_slots (wireshark_bridge_queue_t *queue)
 {
-  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  wireshark_bridge_queue_t *queue = &wireshark_bridge_queue;
-  
-  while (!queue->should_stop)
+  wireshark_bridge_ring_t *ring;
+
+  vec_foreach (ring, queue->rings)
     {
-      // Wait for packets to process or stop signal
-      pthread_mutex_lock (&wbm->sender_mutex);
-      while (vec_len (queue->packets) == 0 && !queue->should_stop) {
-        struct timespec ts;
-        clock_gettime (CLOCK_REALTIME, &ts);
-        ts.tv_sec += 1; // 1 second timeout to recheck should_stop periodically
-        pthread_cond_timedwait (&wbm->sender_cond, &wbm->sender_mutex, &ts);
-      }
-      
-      if (queue->should_stop) {
-        pthread_mutex_unlock (&wbm->sender_mutex);
-        break;
-      }
-      
-      // Get packets to send
-      u32 n_packets = vec_len (queue->packets);
-      wireshark_bridge_packet_t *packets = queue->packets;
-      
-      // Clear queue for next batch
-      queue->packets = 0;
-      pthread_mutex_unlock (&wbm->sender_mutex);
-      
-      // Send packets
-      if (n_packets > 0 && wbm->bridge_connected) {
-        wireshark_bridge_send_packets (wbm, packets, n_packets);
-      }
-      
-      // Free packet data
-      for (u32 i = 0; i < n_packets; i++) {
-        vec_free (packets[i].packet_data);
-      }
-      vec_free (packets);
+      if (ring->slots)
+        munmap (ring->slots, (uword) WIRESHARK_BRIDGE_RING_SIZE * ring->slot_size);
+      ring->slots = 0;
+      ring->slot_size = 0;
     }
-  
-  return NULL;
 }
 
 /**
- * @brief Send packet to the bridge
+ * @brief Record slot size for a snaplen, a whole record header included,
+ * the drop reason of a drop record too
+ */
+static u32
+wireshark_bridge_recorder_slot_size (u32 snaplen)
+{
+  u32 size = clib_min (snaplen, WIRESHARK_BRIDGE_MAX_CAPTURE_LENGTH);
+
+  return round_pow2 (WIRESHARK_BRIDGE_PACKET_HEADER_SIZE + WIRESHARK_BRIDGE_DROP_REASON_SIZE + size, 8);
+}
+
+/**
+ * @brief Map the flight recorder of every ring of a recorder session
+ *
+ * Called on the main thread with the worker barrier held, which also keeps
+ * dumps out, they run on the main thread. Recorders already of the right
+ * slot size keep their records.
+ *
+ * @return 0 on success, -1 if a recorder could not be mapped
+ */
+static int
+wireshark_bridge_queue_map_recorders (wireshark_bridge_queue_t *queue, u64 size, u32 slot_size)
+{
+  wireshark_bridge_ring_t *ring;
+
+  vec_foreach (ring, queue->rings)
+    {
+      if (ring->recorder.slot_size == slot_size)
+        continue;
+
+      wireshark_bridge_recorder_free (&ring->recorder);
+      if (wireshark_bridge_recorder_create (&ring->recorder, size, slot_size, ring->numa_node) < 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Unmap the flight recorders of a session
  */
 static void
-wireshark_bridge_send_packet (u32 sw_if_index, u8 *packet_data, u32 packet_length, f64 timestamp, u8 direction)
+wireshark_bridge_queue_free_recorders (wireshark_bridge_queue_t *queue)
 {
-  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  wireshark_bridge_queue_t *queue = &wireshark_bridge_queue;
-  wireshark_bridge_interface_t *wbi = NULL;
+  wireshark_bridge_ring_t *ring;
 
-  // Quick check if bridge is connected before locking
-  if (!wbm->bridge_connected)
-    return;
+  vec_foreach (ring, queue->rings)
+    wireshark_bridge_recorder_free (&ring->recorder);
+}
 
-  // Find interface - use hash lookup
-  wbi = wireshark_bridge_find_interface (wbm, sw_if_index);
-  if (wbi == NULL || !wbi->is_enabled)
-    return;
+/**
+ * @brief Map the flow table of every ring of a flow session
+ *
+ * Called on the main thread with the worker barrier and the session lock
+ * held, sender threads only read the tables with their mutex held. Tables
+ * already of the right size keep their flows.
+ *
+ * @return 0 on success, -1 if a table could not be mapped
+ */
+static int
+wireshark_bridge_queue_map_flows (wireshark_bridge_queue_t *queue, u32 n_entries)
+{
+  wireshark_bridge_ring_t *ring;
 
-  // Lock to modify queue
-  pthread_mutex_lock (&wbm->sender_mutex);
-  
-  // Check queue size limit
-  if (vec_len (queue->packets) >= WIRESHARK_BRIDGE_MAX_QUEUE_SIZE) {
-    // Queue full - increment overflow counter and drop packet
-    queue->queue_overflows++;
-    pthread_mutex_unlock (&wbm->sender_mutex);
-    return;
-  }
-  
-  // Create a copy of the packet data
-  u8 *packet_copy = vec_new (u8, packet_length);
-  clib_memcpy (packet_copy, packet_data, packet_length);
-  
-  // Add packet to queue
-  wireshark_bridge_packet_t packet = {0};
-  packet.sw_if_index = sw_if_index;
-  packet.packet_data = packet_copy;
-  packet.packet_length = packet_length;
-  packet.timestamp = timestamp;
-  packet.direction = direction;
-  vec_add1 (queue->packets, packet);
-  
-  // Signal sender thread
-  pthread_cond_signal (&wbm->sender_cond);
-  
-  pthread_mutex_unlock (&wbm->sender_mutex);
+  vec_foreach (ring, queue->rings)
+    {
+      if (ring->flows.buckets)
+        continue;
+
+      if (wireshark_bridge_flow_table_create (&ring->flows, n_entries, ring->numa_node) < 0)
+        return -1;
+    }
+
+  return 0;
 }
 
 /**
- * @brief Send packets to bridge
+ * @brief Unmap the flow tables of a session
  */
 static void
-wireshark_bridge_send_packets (wireshark_bridge_main_t * wbm, wireshark_bridge_packet_t * packets, u32 n_packets)
+wireshark_bridge_queue_free_flows (wireshark_bridge_queue_t *queue)
 {
-  /* Removed unused variables: struct iovec *iov, u32 iov_count, u32 total_size */
-  u32 i;
-  wireshark_bridge_interface_t *wbi = NULL;
-  u8 *buffer = NULL;
-  u32 buffer_offset = 0;
+  wireshark_bridge_ring_t *ring;
+
+  vec_foreach (ring, queue->rings)
+    wireshark_bridge_flow_table_free (&ring->flows);
+}
+
+/**
+ * @brief Move all packets currently in a ring to the end of a vector
+ *
+ * Must only be called by the consumer (sender thread or, once the sender
+ * thread has stopped, the main thread). The slots stay reserved until
+ * wireshark_bridge_ring_release () hands them back to the producer.
+ */
+static u32
+wireshark_bridge_ring_dequeue (wireshark_bridge_ring_t *ring, wireshark_bridge_packet_t **packets)
+{
+  u32 tail = ring->tail_pending;
+  u32 head = clib_atomic_load_acq_n (&ring->head);
+  u32 n_packets = head - tail;
+
+  for (; tail != head; tail++)
+    vec_add1 (*packets, ring->packets[tail & WIRESHARK_BRIDGE_RING_MASK]);
+
+  ring->tail_pending = tail;
+
+  return n_packets;
+}
+
+/**
+ * @brief Release the slots of dequeued packets back to the producer
+ */
+static_always_inline void
+wireshark_bridge_ring_release (wireshark_bridge_ring_t *ring)
+{
+  if (ring->tail != ring->tail_pending)
+    clib_atomic_store_rel_n (&ring->tail, ring->tail_pending);
+}
+
+/**
+ * @brief Copy the first @c n_bytes captured of a queued packet
+ */
+static_always_inline void
+wireshark_bridge_packet_copy (wireshark_bridge_packet_t *p, u8 *dst, u32 n_bytes)
+{
+  vlib_main_t *vm = wireshark_bridge_main.vlib_main;
+
+  if (p->buffer_index == ~0)
+    clib_memcpy_fast (dst, p->packet_data, n_bytes);
+  else
+    wireshark_bridge_copy_chain (vm, dst, vlib_get_buffer (vm, p->buffer_index), n_bytes);
+}
+
+/**
+ * @brief Release packets after they have been sent (sender thread only)
+ *
+ * Slots are released by publishing the ring tail. Pool buffers are handed
+ * back to the worker that allocated them and published once per ring, so
+ * the worker sees a single release store per batch. Only the sender's own
+ * rings are touched, the packets all come from them.
+ */
+static void
+wireshark_bridge_release_packets (wireshark_bridge_sender_t *sender, wireshark_bridge_packet_t *packets, u32 n_packets)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_queue_t *queue = &s->queue;
+  wireshark_bridge_ring_t *ring;
+  u32 i, *ri;
 
-  // Allocate a buffer for the entire batch
-  vec_validate(buffer, WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE - 1);
-  
-  // Process each packet
   for (i = 0; i < n_packets; i++)
     {
       wireshark_bridge_packet_t *p = &packets[i];
-      
-      // Find interface
-      wbi = wireshark_bridge_find_interface (wbm, p->sw_if_index);
-      if (!wbi || !wbi->is_enabled)
-        continue;
-      
-      // Calculate header values
-      u32 timestamp_sec = (u32) p->timestamp;
-      u32 timestamp_usec = (u32) ((p->timestamp - timestamp_sec) * 1000000);
-      
-      // Check if this packet would exceed maximum datagram size
-      if (buffer_offset + WIRESHARK_BRIDGE_PACKET_HEADER_SIZE + p->packet_length > WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE)
-      {
-        // Send current buffer
-        if (buffer_offset > 0 && wbm->bridge_connected)
+
+      if (p->buffer_index != ~0)
         {
-          if (wbm->use_unix_socket)
-          {
-            ssize_t sent = sendto(wbm->bridge_socket, buffer, buffer_offset, 0,
-                                 (struct sockaddr *)&wbm->bridge_addr.unix_addr,
-                                 sizeof(wbm->bridge_addr.unix_addr));
-            if (sent < 0)
-            {
-              // Handle socket error
-              clib_warning ("Failed to send packets to Unix socket: %s", strerror (errno));
-              close (wbm->bridge_socket);
-              wbm->bridge_connected = 0;
-            }
-          }
-          else
-          {
-            ssize_t sent = sendto(wbm->bridge_socket, buffer, buffer_offset, 0,
-                                 (struct sockaddr *)&wbm->bridge_addr.inet_addr,
-                                 sizeof(wbm->bridge_addr.inet_addr));
-            if (sent < 0)
-            {
-              // Handle socket error
-              clib_warning ("Failed to send packets to bridge: %s", strerror (errno));
-              close (wbm->bridge_socket);
-              wbm->bridge_connected = 0;
-            }
-          }
+          ring = &queue->rings[p->thread_index];
+          ring->free_buffers[ring->free_head_pending++ & WIRESHARK_BRIDGE_RING_MASK] = p->buffer_index;
         }
-        
-        // Reset buffer
-        buffer_offset = 0;
-      }
-      
-      // Add header to buffer
-      /* Interface index (4 bytes) */
-      buffer[buffer_offset++] = (p->sw_if_index >> 24) & 0xFF;
-      buffer[buffer_offset++] = (p->sw_if_index >> 16) & 0xFF;
-      buffer[buffer_offset++] = (p->sw_if_index >> 8) & 0xFF;
-      buffer[buffer_offset++] = p->sw_if_index & 0xFF;
-      
-      /* Timestamp seconds (4 bytes) */
-      buffer[buffer_offset++] = (timestamp_sec >> 24) & 0xFF;
-      buffer[buffer_offset++] = (timestamp_sec >> 16) & 0xFF;
-      buffer[buffer_offset++] = (timestamp_sec >> 8) & 0xFF;
-      buffer[buffer_offset++] = timestamp_sec & 0xFF;
-      
-      /* Timestamp microseconds (4 bytes) */
-      buffer[buffer_offset++] = (timestamp_usec >> 24) & 0xFF;
-      buffer[buffer_offset++] = (timestamp_usec >> 16) & 0xFF;
-      buffer[buffer_offset++] = (timestamp_usec >> 8) & 0xFF;
-      buffer[buffer_offset++] = timestamp_usec & 0xFF;
-      
-      /* Packet length (4 bytes) */
-      buffer[buffer_offset++] = (p->packet_length >> 24) & 0xFF;
-      buffer[buffer_offset++] = (p->packet_length >> 16) & 0xFF;
-      buffer[buffer_offset++] = (p->packet_length >> 8) & 0xFF;
-      buffer[buffer_offset++] = p->packet_length & 0xFF;
-      
-      /* Direction (1 byte) */
-      buffer[buffer_offset++] = p->direction;
-      
-      // Add packet data to buffer
-      clib_memcpy(buffer + buffer_offset, p->packet_data, p->packet_length);
-      buffer_offset += p->packet_length;
-      
-      // Update statistics
-      if (p->direction == WIRESHARK_BRIDGE_DIRECTION_RX) {
-        wbi->packets_sent_rx++;
-        wbi->bytes_sent_rx += p->packet_length;
-      } else {
-        wbi->packets_sent_tx++;
-        wbi->bytes_sent_tx += p->packet_length;
-      }
-    }
-  
-  // Send any remaining data
-  if (buffer_offset > 0 && wbm->bridge_connected)
-  {
-    if (wbm->use_unix_socket)
-    {
-      ssize_t sent = sendto(wbm->bridge_socket, buffer, buffer_offset, 0,
-                           (struct sockaddr *)&wbm->bridge_addr.unix_addr,
-                           sizeof(wbm->bridge_addr.unix_addr));
-      if (sent < 0)
-      {
-        // Handle socket error
-        clib_warning ("Failed to send packets to Unix socket: %s", strerror (errno));
-        close (wbm->bridge_socket);
-        wbm->bridge_connected = 0;
-      }
     }
-    else
+
+  vec_foreach (ri, sender->ring_indices)
     {
-      ssize_t sent = sendto(wbm->bridge_socket, buffer, buffer_offset, 0,
-                           (struct sockaddr *)&wbm->bridge_addr.inet_addr,
-                           sizeof(wbm->bridge_addr.inet_addr));
-      if (sent < 0)
-      {
-        // Handle socket error
-        clib_warning ("Failed to send packets to bridge: %s", strerror (errno));
-        close (wbm->bridge_socket);
-        wbm->bridge_connected = 0;
-      }
+      ring = &queue->rings[ri[0]];
+      if (ring->free_head_pending != ring->free_head)
+        clib_atomic_store_rel_n (&ring->free_head, ring->free_head_pending);
+      wireshark_bridge_ring_release (ring);
     }
-  }
-  
-  vec_free(buffer);
 }
 
-/* RX Node function */
-static uword
-wireshark_bridge_rx_node_fn (vlib_main_t * vm,
-                         vlib_node_runtime_t * node,
-                         vlib_frame_t * frame)
+/**
+ * @brief Drop everything left in the rings, freeing pool buffers
+ *
+ * Must be called on the main thread after the sender threads have stopped.
+ * The worker barrier is taken so the main thread can act as the consumer
+ * of the recycle rings and free pool buffers on the workers' behalf.
+ */
+static void
+wireshark_bridge_queue_flush (vlib_main_t *vm, wireshark_bridge_queue_t *queue)
 {
-  u32 n_left_from, *from, *to_next;
-  u32 next_index;
-  u32 pkts_processed = 0;
-  CLIB_UNUSED (wireshark_bridge_main_t *wbm) = &wireshark_bridge_main;
+  wireshark_bridge_packet_t *packets = 0;
+  wireshark_bridge_ring_t *ring;
 
-  from = vlib_frame_vector_args (frame);
-  n_left_from = frame->n_vectors;
-  next_index = node->cached_next_index;
+  vlib_worker_thread_barrier_sync (vm);
 
-  while (n_left_from > 0)
+  vec_foreach (ring, queue->rings)
     {
-      u32 n_left_to_next;
+      wireshark_bridge_ring_dequeue (ring, &packets);
+      wireshark_bridge_ring_release (ring);
+      wireshark_bridge_ring_recycle_buffers (vm, ring);
+    }
 
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+  for (u32 i = 0; i < vec_len (packets); i++)
+    {
+      wireshark_bridge_packet_t *p = &packets[i];
 
-      while (n_left_from > 0 && n_left_to_next > 0)
+      if (p->buffer_index != ~0)
         {
-          u32 bi0;
-          vlib_buffer_t *b0;
-          u32 next0;
-          u32 sw_if_index0;
-          /* Removed unused variable: ethernet_header_t *eh0 */
-
-          /* speculatively enqueue b0 to the current next frame */
-          bi0 = from[0];
-          to_next[0] = bi0;
-          from += 1;
-          to_next += 1;
-          n_left_from -= 1;
-          n_left_to_next -= 1;
-
-          b0 = vlib_get_buffer (vm, bi0);
-          sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-          /* Removed: eh0 = vlib_buffer_get_current (b0); */
-
-          /* Send packet to bridge */
-          wireshark_bridge_send_packet (sw_if_index0, 
-                                       vlib_buffer_get_current (b0),
-                                       b0->current_length,
-                                       vlib_time_now(vm),
-                                       WIRESHARK_BRIDGE_DIRECTION_RX);
-
-          pkts_processed++;
-
-          /* Используем vnet_feature_next для автоматического следования по арке */
-          vnet_feature_next (&next0, b0);
-
-          if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE)
-                             && (b0->flags & VLIB_BUFFER_IS_TRACED)))
-            {
-              wireshark_bridge_trace_t *t =
-                vlib_add_trace (vm, node, b0, sizeof (*t));
-              t->sw_if_index = sw_if_index0;
-              t->next_index = next0;
-              t->direction = WIRESHARK_BRIDGE_DIRECTION_RX;
-            }
-
-          /* verify speculative enqueue, maybe switch current next frame */
-          vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
-                                           to_next, n_left_to_next,
-                                           bi0, next0);
+          vlib_buffer_free (vm, &p->buffer_index, 1);
+          queue->rings[p->thread_index].buffers_outstanding--;
         }
-
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
     }
 
-  return frame->n_vectors;
+  vlib_worker_thread_barrier_release (vm);
+
+  vec_free (packets);
 }
 
-/* TX Node function */
-static uword
-wireshark_bridge_tx_node_fn (vlib_main_t * vm,
-                         vlib_node_runtime_t * node,
-                         vlib_frame_t * frame)
+/**
+ * @brief Allocate the persistent transmit buffers of a sender thread
+ *
+ * Done before the thread starts, so a recorder dump can use them from the
+ * main thread at any time.
+ */
+static void
+wireshark_bridge_tx_init (wireshark_bridge_tx_t *tx)
 {
-  u32 n_left_from, *from, *to_next;
-  u32 next_index;
-  u32 pkts_processed = 0;
-  CLIB_UNUSED (wireshark_bridge_main_t *wbm) = &wireshark_bridge_main;
+  u32 i;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS; i++)
+    {
+      vec_validate (tx->buffers[i], WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE - 1);
+      clib_memset (&tx->msgs[i], 0, sizeof (tx->msgs[i]));
+    }
+
+  tx->n_datagrams = 0;
+  tx->n_iovs = 0;
+  tx->iov_start = 0;
+  tx->offset = 0;
+  tx->buffer_offset = 0;
+  tx->max_offset = WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE;
+}
 
-  from = vlib_frame_vector_args (frame);
-  n_left_from = frame->n_vectors;
-  next_index = node->cached_next_index;
+/**
+ * @brief Release the transmit buffers once the sender thread is gone
+ */
+static void
+wireshark_bridge_tx_free (wireshark_bridge_tx_t *tx)
+{
+  u32 i;
 
-  while (n_left_from > 0)
+  for (i = 0; i < WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS; i++)
     {
-      u32 n_left_to_next;
+      vec_free (tx->buffers[i]);
+      vec_free (tx->compressed[i]);
+    }
+  vec_free (tx->linear);
+}
 
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds
+ */
+static_always_inline u64
+wireshark_bridge_monotonic_ns (void)
+{
+  struct timespec ts;
 
-      while (n_left_from > 0 && n_left_to_next > 0)
-        {
-          u32 bi0;
-          vlib_buffer_t *b0;
-          u32 next0;
-          u32 sw_if_index0;
-          /* Removed unused variable: ethernet_header_t *eh0 */
-
-          /* speculatively enqueue b0 to the current next frame */
-          bi0 = from[0];
-          to_next[0] = bi0;
-          from += 1;
-          to_next += 1;
-          n_left_from -= 1;
-          n_left_to_next -= 1;
-
-          b0 = vlib_get_buffer (vm, bi0);
-          sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_TX];
-          /* Removed: eh0 = vlib_buffer_get_current (b0); */
-
-          /* Send packet to bridge */
-          wireshark_bridge_send_packet (sw_if_index0, 
-                                       vlib_buffer_get_current (b0),
-                                       b0->current_length,
-                                       vlib_time_now(vm),
-                                       WIRESHARK_BRIDGE_DIRECTION_TX);
-
-          pkts_processed++;
-
-          /* Используем vnet_feature_next для автоматического следования по арке */
-          vnet_feature_next (&next0, b0);
-
-          if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE)
-                             && (b0->flags & VLIB_BUFFER_IS_TRACED)))
-            {
-              wireshark_bridge_trace_t *t =
-                vlib_add_trace (vm, node, b0, sizeof (*t));
-              t->sw_if_index = sw_if_index0;
-              t->next_index = next0;
-              t->direction = WIRESHARK_BRIDGE_DIRECTION_TX;
-            }
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-          /* verify speculative enqueue, maybe switch current next frame */
-          vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
-                                           to_next, n_left_to_next,
-                                           bi0, next0);
-        }
+/**
+ * @brief Number the datagram being completed, see
+ * WIRESHARK_BRIDGE_SEQUENCE_HEADER_SIZE
+ */
+static_always_inline void
+wireshark_bridge_tx_write_sequence_header (wireshark_bridge_tx_t *tx, u8 *b)
+{
+  clib_mem_unaligned (b + 0, u16) = clib_host_to_net_u16 (WIRESHARK_BRIDGE_SEQUENCE_MAGIC);
+  b[2] = tx->sender_index;
+  b[3] = 0;
+  clib_mem_unaligned (b + 4, u32) = clib_host_to_net_u32 (tx->sequence);
+  clib_mem_unaligned (b + 8, u32) = clib_host_to_net_u32 (tx->n_records);
+  clib_mem_unaligned (b + 12, u32) = clib_host_to_net_u32 ((u32) tx->backpressure_drops);
+  clib_mem_unaligned (b + 16, u64) = clib_host_to_net_u64 (tx->records);
+  clib_mem_unaligned (b + 24, u64) = clib_host_to_net_u64 (tx->queue_drops);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
-    }
+  tx->sequence++;
+  tx->records += tx->n_records;
+}
+
+/**
+ * @brief Put the drops of one UDP destination into the sequence headers of
+ * the batch, just before it goes to that destination
+ */
+static_always_inline void
+wireshark_bridge_tx_set_destination_drops (wireshark_bridge_tx_t *tx, u32 n_datagrams, u64 drops)
+{
+  u32 i;
 
-  return frame->n_vectors;
+  for (i = 0; i < n_datagrams; i++)
+    clib_mem_unaligned (tx->buffers[i] + 12, u32) = clib_host_to_net_u32 ((u32) drops);
 }
 
-#define WIRESHARK_BRIDGE_RX_N_NEXT 1
-#define WIRESHARK_BRIDGE_RX_NEXT_DROP 0
+/**
+ * @brief Complete the datagram being filled, if it holds anything
+ */
+static_always_inline void
+wireshark_bridge_tx_close_datagram (wireshark_bridge_tx_t *tx)
+{
+  struct msghdr *hdr;
 
-/* RX Node registration */
-VLIB_REGISTER_NODE (wireshark_bridge_rx_node) = {
-  .function = wireshark_bridge_rx_node_fn,
-  .name = "wireshark-bridge-rx",
-  .vector_size = sizeof (u32),
-  .format_trace = format_wireshark_bridge_trace,
-  .type = VLIB_NODE_TYPE_INTERNAL,
-  .n_errors = 0,
-  .n_next_nodes = WIRESHARK_BRIDGE_RX_N_NEXT,
-  .next_nodes = {
-    [WIRESHARK_BRIDGE_RX_NEXT_DROP] = "error-drop",
-  },
-};
+  if (tx->offset == 0)
+    return;
 
-#define WIRESHARK_BRIDGE_TX_N_NEXT 1
-#define WIRESHARK_BRIDGE_TX_NEXT_DROP 0
-
-/* TX Node registration */
-VLIB_REGISTER_NODE (wireshark_bridge_tx_node) = {
-  .function = wireshark_bridge_tx_node_fn,
-  .name = "wireshark-bridge-tx",
-  .vector_size = sizeof (u32),
-  .format_trace = format_wireshark_bridge_trace,
-  .type = VLIB_NODE_TYPE_INTERNAL,
-  .n_errors = 0,
-  .n_next_nodes = WIRESHARK_BRIDGE_TX_N_NEXT,
-  .next_nodes = {
-    [WIRESHARK_BRIDGE_TX_NEXT_DROP] = "error-drop",
-  },
-};
+  if (tx->sequence_header_size)
+    wireshark_bridge_tx_write_sequence_header (tx, tx->buffers[tx->n_datagrams]);
+  tx->n_records = 0;
+
+  hdr = &tx->msgs[tx->n_datagrams++].msg_hdr;
+  hdr->msg_iov = &tx->iovs[tx->iov_start];
+  hdr->msg_iovlen = tx->n_iovs - tx->iov_start;
+
+  tx->iov_start = tx->n_iovs;
+  tx->offset = 0;
+  tx->buffer_offset = 0;
+}
 
 /**
- * @brief Handler for wireshark_bridge_enable API call
+ * @brief Append @c n_bytes to the buffer of the datagram being filled
+ * @return where to write them
  */
-static void
-vl_api_wireshark_bridge_enable_t_handler (vl_api_wireshark_bridge_enable_t * mp)
+static_always_inline u8 *
+wireshark_bridge_tx_put (wireshark_bridge_tx_t *tx, u32 n_bytes)
 {
-  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  vl_api_wireshark_bridge_enable_reply_t *rmp;
+  struct iovec *iov;
+  u8 *b;
+
+  // A new datagram starts with room for its sequence header, written
+  // once the datagram is complete
+  if (PREDICT_FALSE (tx->offset == 0 && tx->sequence_header_size)) {
+    iov = &tx->iovs[tx->n_iovs++];
+    iov->iov_base = tx->buffers[tx->n_datagrams];
+    iov->iov_len = tx->sequence_header_size;
+    tx->buffer_offset = tx->offset = tx->sequence_header_size;
+  }
+
+  b = tx->buffers[tx->n_datagrams] + tx->buffer_offset;
+
+  // Extend the last iovec if the buffer is where it ends
+  if (tx->n_iovs > tx->iov_start &&
+      (u8 *) tx->iovs[tx->n_iovs - 1].iov_base + tx->iovs[tx->n_iovs - 1].iov_len == b)
+    tx->iovs[tx->n_iovs - 1].iov_len += n_bytes;
+  else {
+    iov = &tx->iovs[tx->n_iovs++];
+    iov->iov_base = b;
+    iov->iov_len = n_bytes;
+  }
+
+  tx->buffer_offset += n_bytes;
+  tx->offset += n_bytes;
+  return b;
+}
+
+/**
+ * @brief Append the first @c n_bytes captured of a packet to the datagram
+ * being filled
+ *
+ * Short payloads are copied next to their header. Longer ones are not
+ * copied again but gathered segment by segment, straight from the slot or
+ * the pool buffers they were captured into, which stay valid until the
+ * batch has been sent.
+ */
+static void
+wireshark_bridge_tx_put_packet_data (wireshark_bridge_tx_t *tx, wireshark_bridge_packet_t *p, u32 n_bytes)
+{
+  vlib_main_t *vm = wireshark_bridge_main.vlib_main;
+  struct iovec *iov;
+  vlib_buffer_t *b;
+
+  if (n_bytes < WIRESHARK_BRIDGE_TX_COPY_BYTES) {
+    wireshark_bridge_packet_copy (p, wireshark_bridge_tx_put (tx, n_bytes), n_bytes);
+    return;
+  }
+
+  tx->offset += n_bytes;
+
+  if (p->buffer_index == ~0) {
+    iov = &tx->iovs[tx->n_iovs++];
+    iov->iov_base = p->packet_data;
+    iov->iov_len = n_bytes;
+    return;
+  }
+
+  b = vlib_get_buffer (vm, p->buffer_index);
+  while (n_bytes)
+    {
+      u32 n = clib_min (n_bytes, b->current_length);
+
+      iov = &tx->iovs[tx->n_iovs++];
+      iov->iov_base = vlib_buffer_get_current (b);
+      iov->iov_len = n;
+      n_bytes -= n;
+
+      if (!(b->flags & VLIB_BUFFER_NEXT_PRESENT))
+        break;
+      b = vlib_get_buffer (vm, b->next_buffer);
+    }
+}
+
+/**
+ * @brief Whether @c n_bytes for packet @c p still fit into the datagram
+ * being filled
+ */
+static_always_inline int
+wireshark_bridge_tx_fits (wireshark_bridge_tx_t *tx, wireshark_bridge_packet_t *p, u32 n_bytes)
+{
+  // The packet's segments, plus a header and a pcapng trailer at most
+  return tx->offset + n_bytes <= tx->max_offset &&
+         tx->n_iovs - tx->iov_start + p->n_segments + 2 <= WIRESHARK_BRIDGE_TX_DATAGRAM_IOVS;
+}
+
+/**
+ * @brief Replace the completed datagrams of the batch by their compressed
+ * copies
+ *
+ * Runs on the sender thread (or the main thread dumping a recorder), never
+ * on a worker. A datagram gathered from several iovecs is flattened first,
+ * as the compressor needs its input in one piece. One that does not get
+ * any smaller is sent as is behind its header.
+ */
+static void
+wireshark_bridge_tx_compress (wireshark_bridge_sender_t *sender, u32 n_datagrams)
+{
+#ifdef WIRESHARK_BRIDGE_LZ4
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  u32 i, j;
+
+  if (tx->linear == 0)
+    vec_validate (tx->linear, WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE - 1);
+
+  for (i = 0; i < n_datagrams; i++)
+    {
+      struct msghdr *hdr = &tx->msgs[i].msg_hdr;
+      u64 start = wireshark_bridge_monotonic_ns ();
+      u32 length = 0, payload_length;
+      u8 *src, *dst, flags = 0;
+      int rv;
+
+      if (tx->compressed[i] == 0)
+        vec_validate (tx->compressed[i], WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE - 1);
+      dst = tx->compressed[i];
+
+      if (hdr->msg_iovlen == 1) {
+        src = hdr->msg_iov[0].iov_base;
+        length = hdr->msg_iov[0].iov_len;
+      } else {
+        src = tx->linear;
+        for (j = 0; j < hdr->msg_iovlen; j++)
+          {
+            clib_memcpy_fast (src + length, hdr->msg_iov[j].iov_base, hdr->msg_iov[j].iov_len);
+            length += hdr->msg_iov[j].iov_len;
+          }
+      }
+
+      /* Anything larger than the input is not worth sending */
+      rv = LZ4_compress_default ((char *) src, (char *) dst + WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE,
+                                 length, length - 1);
+      if (rv > 0) {
+        payload_length = rv;
+        flags = WIRESHARK_BRIDGE_COMPRESSION_FLAG_LZ4;
+      } else {
+        payload_length = length;
+        clib_memcpy_fast (dst + WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE, src, length);
+      }
+
+      *(u16 *) dst = clib_host_to_net_u16 (WIRESHARK_BRIDGE_COMPRESSION_MAGIC);
+      dst[2] = flags;
+      dst[3] = 0;
+      *(u32 *) (dst + 4) = clib_host_to_net_u32 (length);
+      *(u32 *) (dst + 8) = clib_host_to_net_u32 (payload_length);
+
+      tx->compressed_iovs[i].iov_base = dst;
+      tx->compressed_iovs[i].iov_len = WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE + payload_length;
+      hdr->msg_iov = &tx->compressed_iovs[i];
+      hdr->msg_iovlen = 1;
+
+      tx->compress_bytes_in += length;
+      tx->compress_bytes_out += tx->compressed_iovs[i].iov_len;
+      start = wireshark_bridge_monotonic_ns () - start;
+      tx->compress_ns += start;
+      wireshark_bridge_histogram_add (&sender->compress_ns, start);
+    }
+#endif
+}
+
+/**
+ * @brief Send the completed datagrams of the batch to one address
+ *
+ * @param failed  set if sending stopped on an error other than
+ *                backpressure, with errno telling which
+ * @return datagrams sent, any others were dropped
+ */
+static u32
+wireshark_bridge_tx_send_to (wireshark_bridge_sender_t *sender, struct sockaddr *addr,
+                             socklen_t addr_len, u32 n_datagrams, int *failed)
+{
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  u32 sent = 0, i;
+
+  *failed = 0;
+
+  for (i = 0; i < n_datagrams; i++)
+    {
+      tx->msgs[i].msg_hdr.msg_name = addr;
+      tx->msgs[i].msg_hdr.msg_namelen = addr_len;
+    }
+
+  while (sent < n_datagrams)
+    {
+      u64 start = wireshark_bridge_monotonic_ns ();
+      int rv = sendmmsg (sender->session->bridge_socket, tx->msgs + sent, n_datagrams - sent,
+                         MSG_DONTWAIT);
+      tx->syscalls++;
+      wireshark_bridge_histogram_add (&sender->syscall_ns, wireshark_bridge_monotonic_ns () - start);
+
+      if (rv > 0) {
+        sent += rv;
+        continue;
+      }
+
+      if (rv < 0 && errno == EINTR)
+        continue;
+
+      // Receiver is not keeping up - drop the rest of this batch
+      if (rv < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+        *failed = 1;
+      break;
+    }
+
+  return sent;
+}
+
+/**
+ * @brief Count a failed write, open or rotation of a file session and
+ * give up on its file until the retry interval is over
+ */
+static void
+wireshark_bridge_sender_file_failed (wireshark_bridge_sender_t *sender, f64 now)
+{
+  wireshark_bridge_session_t *s = sender->session;
+
+  clib_warning ("Failed to write packets to %s: %s, next file in %.0f seconds", s->bridge_address,
+                strerror (errno), WIRESHARK_BRIDGE_DESTINATION_RETRY_INTERVAL);
+  sender->tx.send_errors++;
+  wireshark_bridge_file_fail (&s->file, now + WIRESHARK_BRIDGE_DESTINATION_RETRY_INTERVAL);
+}
+
+/**
+ * @brief Whether a file session has a file to write to, opening the next
+ * one of the series once the retry interval after a failure is over
+ */
+static int
+wireshark_bridge_sender_file_ready (wireshark_bridge_sender_t *sender, f64 now)
+{
+  wireshark_bridge_file_t *f = &sender->session->file;
+
+  if (f->fd >= 0)
+    return 1;
+  if (now < f->retry_time)
+    return 0;
+
+  if (wireshark_bridge_file_rotate (f, now)) {
+    wireshark_bridge_sender_file_failed (sender, now);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Send all pending datagrams with as few sendmmsg calls as possible
+ *
+ * A full socket buffer (EAGAIN/ENOBUFS) is backpressure from the receiver:
+ * the rest of the batch is dropped and counted, but the socket stays up.
+ * Any other error takes the bridge connection down, or for UDP the
+ * destination that failed, the session once all of them failed, until
+ * the stats process retries them. The socket itself is closed on
+ * reconnect or session teardown, as the other sender threads of the
+ * session may still be using it.
+ *
+ * Stream sessions write the datagram buffers to their TCP connection in
+ * one call instead, see stream.h, and file sessions append them to their
+ * current file, see file.h. A file that fails is counted and replaced
+ * after the retry interval, the session stays up.
+ */
+static void
+wireshark_bridge_tx_flush (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  wireshark_bridge_destination_t *d;
+  u32 n_datagrams, n_iovs, sent, n_down = 0, i;
+  int failed;
+
+  // Close the datagram being filled
+  wireshark_bridge_tx_close_datagram (tx);
+
+  n_datagrams = tx->n_datagrams;
+  n_iovs = tx->n_iovs;
+  tx->n_datagrams = 0;
+  tx->n_iovs = 0;
+  tx->iov_start = 0;
+
+  if (n_datagrams == 0)
+    return;
+
+  // The datagrams are numbered already, receivers have to see them as
+  // dropped in VPP rather than lost in the network
+  if (!s->bridge_connected) {
+    tx->backpressure_drops += n_datagrams;
+    for (i = 0; i < s->n_destinations; i++)
+      tx->destination_drops[i] += n_datagrams;
+    return;
+  }
+
+  if (s->compression)
+    wireshark_bridge_tx_compress (sender, n_datagrams);
+
+  if (s->use_file) {
+    u64 start = wireshark_bridge_monotonic_ns ();
+    f64 now = unix_time_now ();
+
+    /* Each datagram is a pcapng section of its own */
+    for (i = 0; i < n_datagrams; i++)
+      {
+        struct msghdr *hdr = &tx->msgs[i].msg_hdr;
+
+        if (!wireshark_bridge_sender_file_ready (sender, now))
+          break;
+        if (wireshark_bridge_file_write (&s->file, hdr->msg_iov, hdr->msg_iovlen, now)) {
+          wireshark_bridge_sender_file_failed (sender, now);
+          break;
+        }
+        tx->datagrams_sent++;
+      }
+    tx->backpressure_drops += n_datagrams - i;
+    tx->syscalls++;
+    wireshark_bridge_histogram_add (&sender->syscall_ns, wireshark_bridge_monotonic_ns () - start);
+    return;
+  }
+
+  if (s->use_stream) {
+    u64 start = wireshark_bridge_monotonic_ns ();
+    struct iovec *iovs = s->compression ? tx->compressed_iovs : tx->iovs;
+
+    if (s->compression)
+      n_iovs = n_datagrams;
+    if (tx->stream_wait)
+      wireshark_bridge_stream_wait (&s->stream, WIRESHARK_BRIDGE_STREAM_WAIT_MSEC);
+    if (wireshark_bridge_stream_write (&s->stream, iovs, n_iovs, unix_time_now ()))
+      tx->datagrams_sent += n_datagrams;
+    else
+      tx->backpressure_drops += n_datagrams;
+    tx->syscalls++;
+    wireshark_bridge_histogram_add (&sender->syscall_ns, wireshark_bridge_monotonic_ns () - start);
+    return;
+  }
+
+  if (s->use_unix_socket) {
+    sent = wireshark_bridge_tx_send_to (sender, (struct sockaddr *) &s->bridge_addr.unix_addr,
+                                        sizeof (s->bridge_addr.unix_addr), n_datagrams, &failed);
+    tx->datagrams_sent += sent;
+    if (failed) {
+      clib_warning ("Failed to send packets to %s: %s",
+                    s->bridge_address, strerror (errno));
+      tx->send_errors++;
+      s->bridge_connected = 0;
+    }
+    tx->backpressure_drops += n_datagrams - sent;
+    return;
+  }
+
+  // The same datagrams to every destination of the group in turn, each
+  // told its own drops. Compressed headers cannot be rewritten, enabling
+  // refuses compression with sequence headers for a group
+  for (i = 0; i < s->n_destinations; i++)
+    {
+      d = &s->destinations[i];
+      if (clib_atomic_load_relax_n (&d->down)) {
+        tx->destination_drops[i] += n_datagrams;
+        n_down++;
+        continue;
+      }
+
+      if (tx->sequence_header_size && !s->compression)
+        wireshark_bridge_tx_set_destination_drops (tx, n_datagrams, tx->destination_drops[i]);
+      sent = wireshark_bridge_tx_send_to (sender, (struct sockaddr *) &d->addr, sizeof (d->addr),
+                                          n_datagrams, &failed);
+      tx->datagrams_sent += sent;
+      tx->destination_sent[i] += sent;
+      if (failed) {
+        clib_warning ("Failed to send packets to %U:%u of %s: %s",
+                      format_ip4_address, &d->addr.sin_addr, ntohs (d->addr.sin_port),
+                      s->bridge_address, strerror (errno));
+        tx->send_errors++;
+        tx->destination_errors[i]++;
+        d->retry_time = unix_time_now () + WIRESHARK_BRIDGE_DESTINATION_RETRY_INTERVAL;
+        clib_atomic_store_rel_n (&d->down, 1);
+        n_down++;
+      }
+      tx->backpressure_drops += n_datagrams - sent;
+      tx->destination_drops[i] += n_datagrams - sent;
+    }
+
+  if (n_down == s->n_destinations)
+    s->bridge_connected = 0;
+}
+
+/**
+ * @brief Count the packets waiting in the rings of a sender thread
+ */
+static u32
+wireshark_bridge_sender_pending (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_queue_t *queue = &sender->session->queue;
+  u32 *ri, n_pending = 0;
+
+  vec_foreach (ri, sender->ring_indices)
+    {
+      wireshark_bridge_ring_t *ring = &queue->rings[ri[0]];
+      n_pending += clib_atomic_load_acq_n (&ring->head) - ring->tail;
+    }
+
+  return n_pending;
+}
+
+/**
+ * @brief Sleep until signalled by a worker or until @c deadline_ns
+ *
+ * Workers signal without taking the mutex, which may cost a wakeup that
+ * comes just before the wait; the deadline bounds the delay.
+ */
+static void
+wireshark_bridge_sender_wait (wireshark_bridge_sender_t *sender, u64 deadline_ns)
+{
+  struct timespec ts = {
+    .tv_sec = deadline_ns / 1000000000ULL,
+    .tv_nsec = deadline_ns % 1000000000ULL,
+  };
+
+  pthread_mutex_lock (&sender->mutex);
+  if (!sender->session->queue.should_stop)
+    pthread_cond_timedwait (&sender->cond, &sender->mutex, &ts);
+  pthread_mutex_unlock (&sender->mutex);
+  sender->wakeups++;
+}
+
+/**
+ * @brief Connect the stream of a session and write out its backlog
+ *
+ * Tells the workers to stop capturing while the stream cannot take a new
+ * batch, so a slow or unreachable receiver costs them a flag check per
+ * packet instead of a copy that would be dropped anyway.
+ */
+static void
+wireshark_bridge_sender_service_stream (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  int ready;
+
+  pthread_mutex_lock (&sender->mutex);
+  ready = wireshark_bridge_stream_poll (&s->stream, unix_time_now ());
+  pthread_mutex_unlock (&sender->mutex);
+
+  s->backpressure = !ready;
+}
+
+/**
+ * @brief Collect the finished writes of a file session and rotate its
+ * file once it is old enough, or open the next one after a failure,
+ * packets coming in or not
+ */
+static void
+wireshark_bridge_sender_service_file (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+
+  f64 now = unix_time_now ();
+
+  pthread_mutex_lock (&sender->mutex);
+  if (wireshark_bridge_sender_file_ready (sender, now) && wireshark_bridge_file_poll (&s->file, now))
+    wireshark_bridge_sender_file_failed (sender, now);
+  pthread_mutex_unlock (&sender->mutex);
+}
+
+/**
+ * @brief Thread function for sending the packets of a session's rings
+ * assigned to one sender thread
+ *
+ * Packets are sent once batch_size of them are waiting, or once the first
+ * of them has waited max_latency_usec. Under load a sender wakes up once
+ * per batch, an interactive capture still sees every packet within the
+ * latency bound.
+ */
+static void *
+wireshark_bridge_sender_thread_fn (void *arg)
+{
+  wireshark_bridge_sender_t *sender = arg;
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_queue_t *queue = &s->queue;
+  wireshark_bridge_packet_t *packets = 0;
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  u64 max_latency_ns = (u64) wbm->max_latency_usec * 1000;
+  u64 deadline = 0;    // When the pending packets have to go, 0 if none are pending
+  f64 next_announce = 0;
+  u32 *ri, n_pending;
+  u64 now;
+
+  while (!queue->should_stop)
+    {
+      // Keep offering the shared ring, so that a consumer started (or
+      // restarted) after the session can attach at any time. Shared ring
+      // sessions have a single sender thread.
+      if (s->use_shm && unix_time_now () >= next_announce) {
+        wireshark_bridge_shm_announce (&s->shm, s->bridge_socket, &s->bridge_addr.unix_addr);
+        next_announce = unix_time_now () + WIRESHARK_BRIDGE_SHM_ANNOUNCE_INTERVAL;
+      }
+
+      // Stream sessions have a single sender thread as well
+      if (s->use_stream)
+        wireshark_bridge_sender_service_stream (sender);
+
+      // And so do file sessions, their files are appended in order
+      if (s->use_file && s->bridge_connected)
+        wireshark_bridge_sender_service_file (sender);
+
+      // Flow sessions send their flow tables, their rings stay empty
+      if (s->use_flows && s->bridge_connected &&
+          wireshark_bridge_monotonic_ns () >= sender->next_flow_export) {
+        pthread_mutex_lock (&sender->mutex);
+        wireshark_bridge_sender_export_flows (sender);
+        pthread_mutex_unlock (&sender->mutex);
+        sender->next_flow_export = wireshark_bridge_monotonic_ns () + wbm->flow_interval * 1e9;
+      }
+
+      n_pending = wireshark_bridge_sender_pending (sender);
+      now = wireshark_bridge_monotonic_ns ();
+
+      // Nothing to do - wait for a producer signal or stop request, a
+      // stalled stream is retried sooner
+      if (n_pending == 0) {
+        deadline = 0;
+        wireshark_bridge_sender_wait (sender, now + (s->backpressure ?
+                                                     WIRESHARK_BRIDGE_STREAM_RETRY_USEC :
+                                                     WIRESHARK_BRIDGE_IDLE_TIMEOUT_USEC) * 1000ULL);
+        continue;
+      }
+
+      // Let a small batch grow until it is due
+      if (deadline == 0)
+        deadline = now + max_latency_ns;
+      if (n_pending < wbm->batch_size && now < deadline) {
+        wireshark_bridge_sender_wait (sender, deadline);
+        continue;
+      }
+      deadline = 0;
+
+      // Drain this sender's worker rings without taking any lock
+      vec_reset_length (packets);
+      vec_foreach (ri, sender->ring_indices)
+        wireshark_bridge_ring_dequeue (&queue->rings[ri[0]], &packets);
+
+      u32 n_packets = vec_len (packets);
+      sender->batches++;
+
+      // Send packets; the mutex keeps the interface table stable meanwhile
+      if (s->bridge_connected) {
+        pthread_mutex_lock (&sender->mutex);
+        wireshark_bridge_send_packets (sender, packets, n_packets);
+        pthread_mutex_unlock (&sender->mutex);
+        wireshark_bridge_sender_account_batch (sender, packets, n_packets);
+      }
+
+      // Release the slots, hand pool buffers back to their workers
+      wireshark_bridge_release_packets (sender, packets, n_packets);
+    }
+
+  vec_free (packets);
+  return NULL;
+}
+
+/**
+ * @brief Complete the datagram being filled, sending the batch once every
+ * buffer is in use
+ */
+static_always_inline void
+wireshark_bridge_tx_next_datagram (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_tx_t *tx = &sender->tx;
+
+  wireshark_bridge_tx_close_datagram (tx);
+
+  if (tx->n_datagrams == WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS)
+    wireshark_bridge_tx_flush (sender);
+}
+
+/**
+ * @brief Write the pcapng comment of a packet taken at the drop point
+ *
+ * @param comment  WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT bytes
+ * @return length of the comment, 0 for packets of the other capture points
+ */
+static u32
+wireshark_bridge_drop_comment (wireshark_bridge_session_t *s, wireshark_bridge_packet_t *p,
+                               u8 *comment)
+{
+  u8 *reason;
+  int n;
+
+  if (p->direction != WIRESHARK_BRIDGE_DIRECTION_DROP)
+    return 0;
+
+  reason = p->error < vec_len (s->drop_reasons) ? s->drop_reasons[p->error] : 0;
+  if (reason)
+    n = snprintf ((char *) comment, WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT, "drop: %.*s",
+                  vec_len (reason), reason);
+  else
+    n = snprintf ((char *) comment, WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT, "drop: error %u",
+                  p->error);
+
+  return clib_min (n, WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT - 1);
+}
+
+/**
+ * @brief Set the datagram layout of a batch from the session options
+ *
+ * Sequenced sessions also take the ring drops of the sender's workers
+ * here, for the sequence headers of the batch.
+ */
+static void
+wireshark_bridge_tx_start_batch (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  wireshark_bridge_ring_t *ring;
+  u32 *ri;
+
+  // Leave room for the compression header in every datagram
+  tx->max_offset = WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE -
+    (s->compression ? WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE : 0);
+  tx->sequence_header_size = s->sequence ? WIRESHARK_BRIDGE_SEQUENCE_HEADER_SIZE : 0;
+
+  if (!s->sequence)
+    return;
+
+  tx->queue_drops = 0;
+  vec_foreach (ri, sender->ring_indices)
+    {
+      ring = &s->queue.rings[ri[0]];
+      tx->queue_drops += ring->ring_full_drops + ring->backpressure_drops;
+    }
+}
+
+/**
+ * @brief Add a packet to the datagram being filled as a pcapng block
+ *
+ * Every datagram opens a new section, and an interface is described the
+ * first time one of its packets goes into the datagram. The datagram is
+ * completed early when the packet's interface would not fit into the
+ * interface table. Packets are truncated if even a datagram of their own
+ * could not hold them.
+ */
+static void
+wireshark_bridge_tx_add_pcapng (wireshark_bridge_sender_t *sender, wireshark_bridge_interface_t *wbi,
+                                wireshark_bridge_packet_t *p)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  u8 comment[WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT];
+  u32 comment_len = wireshark_bridge_drop_comment (s, p, comment);
+  u32 name_len = vec_len (wbi->name);
+  u32 max_length = (tx->max_offset - tx->sequence_header_size - WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE -
+                    WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE (name_len) -
+                    WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE (0, comment_len)) & ~3;
+  u32 packet_length = clib_min (p->packet_length, max_length);
+  u32 interface_id;
+
+  for (interface_id = 0; interface_id < tx->n_pcapng_interfaces; interface_id++)
+    if (tx->pcapng_interfaces[interface_id] == p->sw_if_index)
+      break;
+
+  if (tx->offset > 0)
+    {
+      u32 n_bytes = WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE (packet_length, comment_len);
+
+      if (interface_id == tx->n_pcapng_interfaces)
+        n_bytes += WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE (name_len);
+
+      if (!wireshark_bridge_tx_fits (tx, p, n_bytes) ||
+          interface_id == WIRESHARK_BRIDGE_PCAPNG_MAX_INTERFACES)
+        wireshark_bridge_tx_next_datagram (sender);
+    }
+
+  if (tx->offset == 0)
+    {
+      wireshark_bridge_pcapng_write_shb (wireshark_bridge_tx_put (tx, WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE));
+      tx->n_pcapng_interfaces = 0;
+      interface_id = 0;
+    }
+
+  if (interface_id == tx->n_pcapng_interfaces)
+    {
+      wireshark_bridge_pcapng_write_idb (wireshark_bridge_tx_put (tx, WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE (name_len)),
+                                         wbi->name, name_len, s->snaplen);
+      tx->pcapng_interfaces[tx->n_pcapng_interfaces++] = p->sw_if_index;
+    }
+
+  wireshark_bridge_pcapng_write_epb_header (wireshark_bridge_tx_put (tx, WIRESHARK_BRIDGE_PCAPNG_EPB_HEADER_SIZE),
+                                            interface_id, p->timestamp, packet_length,
+                                            p->original_length, comment_len);
+  wireshark_bridge_tx_put_packet_data (tx, p, packet_length);
+  wireshark_bridge_pcapng_write_epb_trailer (wireshark_bridge_tx_put (tx, WIRESHARK_BRIDGE_PCAPNG_EPB_TRAILER_SIZE (packet_length, comment_len)),
+                                             packet_length, p->direction != WIRESHARK_BRIDGE_DIRECTION_TX,
+                                             comment, comment_len);
+}
+
+/**
+ * @brief Add a batch that was just sent to the histograms of its sender
+ *
+ * Latency runs from the packet's timestamp to the moment the batch went
+ * to the kernel, so it covers the worker enqueue, the time in the ring
+ * and the send itself. Packets of a frame share their timestamp, so runs
+ * of equal timestamps are added at once.
+ */
+static void
+wireshark_bridge_sender_account_batch (wireshark_bridge_sender_t *sender,
+                                       wireshark_bridge_packet_t *packets, u32 n_packets)
+{
+  u64 now = unix_time_now_nsec ();
+  u32 i, run;
+
+  wireshark_bridge_histogram_add (&sender->batch_packets, n_packets);
+
+  for (i = 0; i < n_packets; i += run)
+    {
+      u64 timestamp = packets[i].timestamp;
+
+      for (run = 1; i + run < n_packets && packets[i + run].timestamp == timestamp; run++)
+        ;
+
+      /* A NIC clock slightly ahead of the system clock counts as no latency */
+      wireshark_bridge_histogram_add_n (&sender->latency_ns, now > timestamp ? now - timestamp : 0, run);
+    }
+}
+
+/**
+ * @brief Send packets of a session to its bridge
+ *
+ * Records are packed into the persistent datagram buffers, which are
+ * handed to the kernel together once all of them are full and at the
+ * end of the batch. Called by the sender thread, or by the main thread
+ * dumping a flight recorder, with the sender's mutex held either way.
+ */
+static void
+wireshark_bridge_send_packets (wireshark_bridge_sender_t * sender, wireshark_bridge_packet_t * packets, u32 n_packets)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  wireshark_bridge_interface_t *wbi = NULL;
+  wireshark_bridge_interface_sender_t *counters;
+  u32 i, header_size;
+
+  wireshark_bridge_tx_start_batch (sender);
+
+  // Process each packet
+  for (i = 0; i < n_packets; i++)
+    {
+      wireshark_bridge_packet_t *p = &packets[i];
+      
+      // Find interface
+      wbi = wireshark_bridge_find_interface (s, p->sw_if_index);
+      if (!wbi || !wbi->is_enabled)
+        continue;
+      
+      header_size = wireshark_bridge_record_header_size (p->direction);
+
+      // Shared ring: the record goes straight into the consumer's memory
+      if (s->use_shm) {
+        u8 *record = wireshark_bridge_shm_reserve (&s->shm, header_size + p->packet_length);
+        if (record == NULL)
+          continue;
+
+        wireshark_bridge_write_packet_header (record, p);
+        wireshark_bridge_packet_copy (p, record + header_size, p->packet_length);
+      } else if (s->output_format == WIRESHARK_BRIDGE_FORMAT_PCAPNG) {
+        wireshark_bridge_tx_add_pcapng (sender, wbi, p);
+      } else {
+        // Move on to the next datagram if this packet would exceed maximum datagram size
+        if (tx->offset > 0 &&
+            !wireshark_bridge_tx_fits (tx, p, header_size + p->packet_length))
+          wireshark_bridge_tx_next_datagram (sender);
+
+        // Add the header, then the packet data copied or gathered
+        wireshark_bridge_write_packet_header (wireshark_bridge_tx_put (tx, header_size), p);
+        wireshark_bridge_tx_put_packet_data (tx, p, p->packet_length);
+      }
+      tx->n_records++;
+      
+      // Update this sender's statistics, the drop and ip points count as rx
+      counters = &wbi->senders[sender->sender_index];
+      if (p->direction == WIRESHARK_BRIDGE_DIRECTION_TX) {
+        counters->packets_sent_tx++;
+        counters->bytes_sent_tx += p->packet_length;
+      } else {
+        counters->packets_sent_rx++;
+        counters->bytes_sent_rx += p->packet_length;
+      }
+    }
+  
+  // Send any remaining data, or publish the records of this batch at once
+  if (s->use_shm)
+    wireshark_bridge_shm_publish (&s->shm);
+  else
+    wireshark_bridge_tx_flush (sender);
+}
+
+/**
+ * @brief Send the flows of the worker tables of a sender thread
+ *
+ * Every flow that saw a packet since the last export goes out as a
+ * record, see flow.h, packed into datagrams like packet records. Called
+ * by the sender thread with its mutex held, which keeps the tables mapped
+ * and the interface table stable while they are read.
+ */
+static void
+wireshark_bridge_sender_export_flows (wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  wireshark_bridge_queue_t *queue = &s->queue;
+  wireshark_bridge_tx_t *tx = &sender->tx;
+  wireshark_bridge_interface_t *wbi;
+  wireshark_bridge_flow_entry_t e;
+  u64 now = unix_time_now_nsec ();
+  u64 since = 0;
+  u32 *ri, bucket, way;
+
+  if (sender->flows_exported_ns > WIRESHARK_BRIDGE_FLOW_EXPORT_SLACK_NS)
+    since = sender->flows_exported_ns - WIRESHARK_BRIDGE_FLOW_EXPORT_SLACK_NS;
+
+  wireshark_bridge_tx_start_batch (sender);
+
+  vec_foreach (ri, sender->ring_indices)
+    {
+      wireshark_bridge_flow_table_t *t = &queue->rings[ri[0]].flows;
+
+      for (bucket = 0; bucket < t->n_buckets; bucket++)
+        for (way = 0; way < WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS; way++)
+          {
+            if (!wireshark_bridge_flow_read (&t->buckets[bucket], way, &e) ||
+                e.last_seen < since)
+              continue;
+
+            wbi = wireshark_bridge_find_interface (s, e.key.sw_if_index);
+            if (!wbi || !wbi->is_enabled)
+              continue;
+
+            if (tx->offset + WIRESHARK_BRIDGE_FLOW_RECORD_SIZE > tx->max_offset)
+              wireshark_bridge_tx_next_datagram (sender);
+
+            wireshark_bridge_flow_write_record (wireshark_bridge_tx_put (tx, WIRESHARK_BRIDGE_FLOW_RECORD_SIZE), &e);
+            tx->flow_records++;
+            tx->n_records++;
+          }
+    }
+
+  wireshark_bridge_tx_flush (sender);
+  sender->flows_exported_ns = now;
+}
+
+// Capture points, indexed by direction value
+static const struct {
+  char *name;               // CLI keyword
+  char *arc_name;
+  char *node_name;
+} wireshark_bridge_capture_points[WIRESHARK_BRIDGE_N_DIRECTIONS] = {
+  [WIRESHARK_BRIDGE_DIRECTION_RX] = { "rx", "device-input", "wireshark-bridge-rx" },
+  [WIRESHARK_BRIDGE_DIRECTION_TX] = { "tx", "interface-output", "wireshark-bridge-tx" },
+  [WIRESHARK_BRIDGE_DIRECTION_DROP] = { "drop", "error-drop", "wireshark-bridge-drop" },
+  [WIRESHARK_BRIDGE_DIRECTION_IP4] = { "ip4", "ip4-unicast", "wireshark-bridge-ip4" },
+  [WIRESHARK_BRIDGE_DIRECTION_IP6] = { "ip6", "ip6-unicast", "wireshark-bridge-ip6" },
+};
+
+/**
+ * @brief Format the capture points of a direction mask, "rx tx drop"
+ */
+u8 *
+format_wireshark_bridge_capture_point (u8 * s, va_list * args)
+{
+  u32 mask = va_arg (*args, u32);
+  u32 i, n = 0;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_N_DIRECTIONS; i++)
+    if (mask & (1 << i))
+      s = format (s, "%s%s", n++ ? " " : "", wireshark_bridge_capture_points[i].name);
+
+  return n ? s : format (s, "none");
+}
+
+/**
+ * @brief Parse a capture point keyword into its direction mask bit,
+ * "both" into the rx and tx bits
+ */
+uword
+unformat_wireshark_bridge_capture_point (unformat_input_t * input, va_list * args)
+{
+  u8 *mask = va_arg (*args, u8 *);
+  u32 i;
+
+  if (unformat (input, "both"))
+    {
+      *mask = WIRESHARK_BRIDGE_DIRECTION_MASK_BOTH;
+      return 1;
+    }
+
+  for (i = 0; i < WIRESHARK_BRIDGE_N_DIRECTIONS; i++)
+    if (unformat (input, wireshark_bridge_capture_points[i].name))
+      {
+        *mask = 1 << i;
+        return 1;
+      }
+
+  return 0;
+}
+
+/**
+ * @brief Format a one-line description of a capture session
+ */
+static u8 *
+format_wireshark_bridge_session (u8 * s, va_list * args)
+{
+  wireshark_bridge_session_t *session = va_arg (*args, wireshark_bridge_session_t *);
+
+  s = format (s, "Session %u: %s, capture %U, snaplen %u, slots %u x %u bytes, pool-buffers %s, filter %U, format %s, connected %s",
+              session->session_index, session->bridge_address,
+              format_wireshark_bridge_capture_point, (u32) session->direction_mask,
+              session->snaplen, WIRESHARK_BRIDGE_RING_SIZE,
+              vec_len (session->queue.rings) ? session->queue.rings[0].slot_size : 0,
+              session->use_pool_buffers ? "yes" : "no",
+              format_wireshark_bridge_bpf_program, session->filter,
+              session->output_format == WIRESHARK_BRIDGE_FORMAT_PCAPNG ? "pcapng" : "records",
+              session->bridge_connected ? "yes" : "no");
+
+  if (session->n_destinations > 1)
+    {
+      u32 i, n_up = 0;
+
+      for (i = 0; i < session->n_destinations; i++)
+        n_up += !clib_atomic_load_relax_n (&session->destinations[i].down);
+      s = format (s, ", fan-out to %u destinations (%u up)", session->n_destinations, n_up);
+    }
+  if (session->sequence)
+    s = format (s, ", sequence headers");
+  if (session->use_file)
+    {
+      s = format (s, ", files of %U", format_memory_size, (uword) session->file.max_size);
+      if (session->file.max_duration)
+        s = format (s, " or %u seconds", session->file.max_duration);
+      if (session->file.max_files)
+        s = format (s, ", %u kept", session->file.max_files);
+    }
+  if (session->compression)
+    {
+      wireshark_bridge_sender_t *sender;
+      u64 bytes_in = 0, bytes_out = 0;
+
+      vec_foreach (sender, session->senders)
+        {
+          bytes_in += sender->tx.compress_bytes_in;
+          bytes_out += sender->tx.compress_bytes_out;
+        }
+      s = format (s, ", compression lz4 (ratio %.2f)", bytes_out ? (f64) bytes_in / bytes_out : 0.0);
+    }
+  if (session->use_recorder && vec_len (session->queue.rings))
+    s = format (s, ", recorder %u x %u bytes per worker, %llu dumps",
+                session->queue.rings[0].recorder.n_slots,
+                session->queue.rings[0].recorder.slot_size, session->dumps);
+  if (session->use_recorder && session->trigger.threshold)
+    s = format (s, ", trigger %s %llu", wireshark_bridge_trigger_names[session->trigger.counter],
+                session->trigger.threshold);
+  if (session->use_flows && vec_len (session->queue.rings))
+    {
+      wireshark_bridge_ring_t *ring;
+      u64 n_flows = 0, evictions = 0;
+
+      vec_foreach (ring, session->queue.rings)
+        {
+          n_flows += ring->flows.n_flows;
+          evictions += ring->flows.evictions;
+        }
+      s = format (s, ", flows %llu of %u per worker, %llu evicted",
+                  n_flows, session->queue.rings[0].flows.n_buckets * WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS,
+                  evictions);
+    }
+  return s;
+}
+
+/**
+ * @brief Find the session sending to a destination
+ */
+static wireshark_bridge_session_t *
+wireshark_bridge_find_session (wireshark_bridge_main_t *wbm, char *bridge_address)
+{
+  wireshark_bridge_session_t **sp;
+
+  pool_foreach (sp, wbm->sessions)
+    {
+      if (strcmp ((char *) sp[0]->bridge_address, bridge_address) == 0)
+        return sp[0];
+    }
+
+  return NULL;
+}
+
+/**
+ * @brief Parse an IP:port address
+ */
+static int
+wireshark_bridge_parse_inet_address (char *bridge_address, struct sockaddr_in *addr)
+{
+  /* Parsed from a copy */
+  char *bridge_address_copy = strdup (bridge_address);
+  if (!bridge_address_copy)
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  char *colon = strchr (bridge_address_copy, ':');
+  if (colon == NULL) {
+    free (bridge_address_copy);
+    return VNET_API_ERROR_INVALID_VALUE;
+  }
+
+  *colon = '\0';  // Safely modify our copy
+  char *ip_address = bridge_address_copy;
+  int port = atoi (colon + 1);
+
+  memset (addr, 0, sizeof (*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons (port);
+
+  if (port <= 0 || port > 65535 ||
+      inet_pton (AF_INET, ip_address, &addr->sin_addr) <= 0) {
+    free (bridge_address_copy);
+    return VNET_API_ERROR_INVALID_VALUE;
+  }
+  free (bridge_address_copy);
+
+  return 0;
+}
+
+/**
+ * @brief Parse the UDP destinations of a session, IP:port[,IP:port...]
+ *
+ * Every destination starts out up. Multicast groups need no more than
+ * their address, datagrams go out with the default TTL of 1.
+ */
+static int
+wireshark_bridge_parse_destinations (char *bridge_address, wireshark_bridge_destination_t *destinations,
+                                     u32 *n_destinations)
+{
+  char *copy = strdup (bridge_address), *token, *saveptr = 0;
+  char separator[] = { WIRESHARK_BRIDGE_DESTINATION_SEPARATOR, 0 };
+  u32 i, n = 0;
+  int rv = 0;
+
+  if (!copy)
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  for (token = strtok_r (copy, separator, &saveptr); token && rv == 0;
+       token = strtok_r (0, separator, &saveptr))
+    {
+      if (n == WIRESHARK_BRIDGE_MAX_DESTINATIONS) {
+        rv = VNET_API_ERROR_INVALID_VALUE;
+        break;
+      }
+
+      rv = wireshark_bridge_parse_inet_address (token, &destinations[n].addr);
+      destinations[n].down = 0;
+
+      /* The same destination twice would get every datagram twice */
+      for (i = 0; rv == 0 && i < n; i++)
+        if (!memcmp (&destinations[i].addr, &destinations[n].addr, sizeof (destinations[n].addr)))
+          rv = VNET_API_ERROR_INVALID_VALUE;
+      n++;
+    }
+  free (copy);
+
+  if (n == 0)
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  *n_destinations = rv ? 0 : n;
+  return rv;
+}
+
+/**
+ * @brief Open the socket of a session for its destination
+ */
+static int
+wireshark_bridge_session_connect (wireshark_bridge_session_t *s)
+{
+  char *bridge_address = (char *) s->bridge_address;
+  int rv;
+
+  // Close any existing socket
+  if (s->bridge_socket > 0) {
+    close (s->bridge_socket);
+    s->bridge_socket = -1;
+  }
+
+  /* Shared memory ring, announced over a Unix socket (shm:/path) */
+  s->use_shm = strncmp (bridge_address, WIRESHARK_BRIDGE_SHM_PREFIX,
+                        strlen (WIRESHARK_BRIDGE_SHM_PREFIX)) == 0;
+  if (s->use_shm)
+    bridge_address += strlen (WIRESHARK_BRIDGE_SHM_PREFIX);
+
+  /* TCP stream (tcp://IP:port), connected by the sender thread */
+  if (!s->use_shm && strncmp (bridge_address, WIRESHARK_BRIDGE_STREAM_PREFIX,
+                             strlen (WIRESHARK_BRIDGE_STREAM_PREFIX)) == 0) {
+    struct sockaddr_in addr;
+
+    /* A byte stream has a single peer */
+    if (strchr (bridge_address, WIRESHARK_BRIDGE_DESTINATION_SEPARATOR))
+      return VNET_API_ERROR_INVALID_VALUE;
+
+    rv = wireshark_bridge_parse_inet_address (bridge_address + strlen (WIRESHARK_BRIDGE_STREAM_PREFIX), &addr);
+    if (rv)
+      return rv;
+
+    wireshark_bridge_stream_free (&s->stream);
+    wireshark_bridge_stream_init (&s->stream, &addr);
+    s->bridge_addr.inet_addr = addr;
+    s->use_stream = 1;
+    s->use_unix_socket = 0;
+
+    /* Connection problems show up as backpressure, never as a down bridge */
+    s->backpressure = 1;
+    s->bridge_connected = 1;
+    return 0;
+  }
+
+  /* Rotated pcapng files (file:/path), written by the sender thread, which
+   * also replaces files that fail. Only the first file is opened here. */
+  if (!s->use_shm && strncmp (bridge_address, WIRESHARK_BRIDGE_FILE_PREFIX,
+                             strlen (WIRESHARK_BRIDGE_FILE_PREFIX)) == 0) {
+    char *path = bridge_address + strlen (WIRESHARK_BRIDGE_FILE_PREFIX);
+
+    if (path[0] == '\0')
+      return VNET_API_ERROR_INVALID_VALUE;
+
+    if (s->file.base == 0 && wireshark_bridge_file_init (&s->file, path))
+      return VNET_API_ERROR_SYSCALL_ERROR_6;
+    if (wireshark_bridge_file_rotate (&s->file, unix_time_now ()))
+      return VNET_API_ERROR_SYSCALL_ERROR_6;
+
+    s->use_file = 1;
+    s->use_unix_socket = 0;
+    s->bridge_connected = 1;
+    return 0;
+  }
+
+  /* Check if this is a Unix socket path (starts with /) */
+  if (bridge_address[0] == '/') {
+    /* Socket path must fit into sun_path */
+    if (strlen (bridge_address) >= sizeof (s->bridge_addr.unix_addr.sun_path))
+      return VNET_API_ERROR_INVALID_VALUE;
+
+    memset (&s->bridge_addr.unix_addr, 0, sizeof (s->bridge_addr.unix_addr));
+    s->bridge_addr.unix_addr.sun_family = AF_UNIX;
+    strncpy (s->bridge_addr.unix_addr.sun_path, bridge_address,
+             sizeof(s->bridge_addr.unix_addr.sun_path) - 1);
+
+    s->bridge_socket = socket (AF_UNIX, SOCK_DGRAM, 0);
+    if (s->bridge_socket < 0)
+      return VNET_API_ERROR_SYSCALL_ERROR_1;
+
+    s->use_unix_socket = 1;
+
+    /* The ring outlives reconnects, consumers stay attached to it. The
+     * sender thread announces it to the consumer. */
+    if (s->use_shm && s->shm.header == 0 &&
+        wireshark_bridge_shm_create (&s->shm, WIRESHARK_BRIDGE_SHM_DEFAULT_SIZE) < 0)
+      return VNET_API_ERROR_SYSCALL_ERROR_2;
+  } else if (s->use_shm) {
+    return VNET_API_ERROR_INVALID_VALUE;
+  } else {
+    /* Traditional IP:port address, or several of them separated by commas */
+    rv = wireshark_bridge_parse_destinations (bridge_address, s->destinations, &s->n_destinations);
+    if (rv)
+      return rv;
+    s->bridge_addr.inet_addr = s->destinations[0].addr;
+
+    s->bridge_socket = socket (AF_INET, SOCK_DGRAM, 0);
+    if (s->bridge_socket < 0)
+      return VNET_API_ERROR_SYSCALL_ERROR_1;
+
+    /* Set socket options */
+    int optval = 1;
+    if (setsockopt (s->bridge_socket, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval)) < 0) {
+      clib_warning ("Failed to set SO_KEEPALIVE: %s", strerror (errno));
+    }
+
+    s->use_unix_socket = 0;
+  }
+
+  // For UDP, we don't need to connect, just store the address for sending
+  s->bridge_connected = 1;
+  return 0;
+}
+
+/**
+ * @brief Keep the sender threads of a session out of the session state
+ *
+ * Sender threads hold their own mutex while sending, so with all of them
+ * locked the interface table and the options can be changed freely. The
+ * main thread is the only one taking more than one, always in index order.
+ */
+static void
+wireshark_bridge_session_lock (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_sender_t *sender;
+
+  vec_foreach (sender, s->senders)
+    pthread_mutex_lock (&sender->mutex);
+}
+
+static void
+wireshark_bridge_session_unlock (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_sender_t *sender;
+
+  vec_foreach (sender, s->senders)
+    pthread_mutex_unlock (&sender->mutex);
+}
+
+/**
+ * @brief Stop the sender threads of a session
+ */
+static void
+wireshark_bridge_session_stop (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_sender_t *sender;
+
+  wireshark_bridge_session_lock (s);
+  s->queue.should_stop = 1;
+  vec_foreach (sender, s->senders)
+    pthread_cond_signal (&sender->cond);
+  wireshark_bridge_session_unlock (s);
+
+  vec_foreach (sender, s->senders)
+    {
+      if (!sender->thread_running)
+        continue;
+
+      pthread_join (sender->thread, NULL);
+      sender->thread_running = 0;
+    }
+}
+
+/**
+ * @brief CPUs of a NUMA node, as a bitmap to be freed by the caller
+ *
+ * @return 0 if the node is not known to sysfs
+ */
+static uword *
+wireshark_bridge_numa_node_cpus (u32 numa_node)
+{
+  clib_error_t *error;
+  uword *cpus = 0;
+  char *path;
+
+  path = (char *) format (0, "/sys/devices/system/node/node%u/cpulist%c", numa_node, 0);
+  error = clib_sysfs_read (path, "%U", unformat_bitmap_list, &cpus);
+  vec_free (path);
+  if (error) {
+    clib_error_free (error);
+    return 0;
+  }
+
+  return cpus;
+}
+
+/**
+ * @brief Pin a sender thread
+ *
+ * With a sender-corelist the n-th sender of a NUMA node is pinned to the
+ * n-th CPU of the list on that node, or to the CPUs of the list round
+ * robin if the list has none there. Otherwise senders may run on any CPU
+ * of their node except the ones of the VPP workers, so capture never takes
+ * time away from forwarding, on any CPU at all if their node has no other.
+ */
+static void
+wireshark_bridge_sender_set_affinity (wireshark_bridge_main_t *wbm, wireshark_bridge_sender_t *sender)
+{
+  wireshark_bridge_session_t *s = sender->session;
+  uword *node_cpus = wireshark_bridge_numa_node_cpus (sender->numa_node);
+  cpu_set_t cpuset, local;
+  int cpu, rv;
+  u32 i, rank = 0, n_local = 0;
+
+  CPU_ZERO (&cpuset);
+
+  if (vec_len (wbm->sender_cpus)) {
+    for (i = 0; i < sender->sender_index; i++)
+      rank += s->senders[i].numa_node == sender->numa_node;
+
+    vec_foreach_index (i, wbm->sender_cpus)
+      if (node_cpus && clib_bitmap_get (node_cpus, wbm->sender_cpus[i]))
+        n_local++;
+
+    sender->cpu = wbm->sender_cpus[sender->sender_index % vec_len (wbm->sender_cpus)];
+    rank = n_local ? rank % n_local : 0;
+    vec_foreach_index (i, wbm->sender_cpus)
+      if (n_local && clib_bitmap_get (node_cpus, wbm->sender_cpus[i]) && rank-- == 0) {
+        sender->cpu = wbm->sender_cpus[i];
+        break;
+      }
+    CPU_SET (sender->cpu, &cpuset);
+
+    for (i = 1; i < vec_len (vlib_worker_threads); i++)
+      if (vlib_worker_threads[i].cpu_id == sender->cpu)
+        clib_warning ("Sender thread %u shares cpu %d with VPP worker %u",
+                      sender->sender_index, sender->cpu, i);
+  } else {
+    int n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int n_excluded = 0;
+
+    for (cpu = 0; cpu < n_cpus && cpu < CPU_SETSIZE; cpu++)
+      CPU_SET (cpu, &cpuset);
+
+    /* Thread 0 is the main thread, the rest are workers */
+    for (i = 1; i < vec_len (vlib_worker_threads); i++)
+      if (vlib_worker_threads[i].cpu_id >= 0 && vlib_worker_threads[i].cpu_id < CPU_SETSIZE) {
+        CPU_CLR (vlib_worker_threads[i].cpu_id, &cpuset);
+        n_excluded++;
+      }
+
+    /* Unpinned workers or no CPU left, leave the scheduler alone */
+    if (n_excluded == 0 || CPU_COUNT (&cpuset) == 0) {
+      clib_bitmap_free (node_cpus);
+      return;
+    }
+
+    /* Stay on the node of the rings when it has a CPU to spare */
+    CPU_ZERO (&local);
+    for (cpu = 0; cpu < n_cpus && cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET (cpu, &cpuset) && clib_bitmap_get (node_cpus, cpu))
+        CPU_SET (cpu, &local);
+    if (CPU_COUNT (&local))
+      cpuset = local;
+  }
+
+  clib_bitmap_free (node_cpus);
+
+  rv = pthread_setaffinity_np (sender->thread, sizeof (cpuset), &cpuset);
+  if (rv != 0) {
+    clib_warning ("Failed to set the affinity of sender thread %u: %s",
+                  sender->sender_index, strerror (rv));
+    sender->cpu = -1;
+  }
+}
+
+/**
+ * @brief Start the sender threads of a new session
+ *
+ * Shared ring sessions get a single sender thread, the ring has a single
+ * producer, and so do stream and file sessions, a byte stream or a file
+ * has a single writer.
+ * Already started threads are stopped by the caller on failure.
+ */
+static int
+wireshark_bridge_session_start_senders (wireshark_bridge_main_t *wbm, wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_sender_t *sender;
+  u32 n_senders = (s->use_shm || s->use_stream || s->use_file) ? 1 : wbm->n_sender_threads;
+  pthread_condattr_t cond_attr;
+  char name[16];
+
+  /* Deadlines must not move with the wall clock */
+  pthread_condattr_init (&cond_attr);
+  pthread_condattr_setclock (&cond_attr, CLOCK_MONOTONIC);
+
+  vec_validate_aligned (s->senders, n_senders - 1, CLIB_CACHE_LINE_BYTES);
+  vec_foreach (sender, s->senders)
+    {
+      sender->session = s;
+      sender->sender_index = sender - s->senders;
+      sender->cpu = -1;
+      pthread_mutex_init (&sender->mutex, NULL);
+      pthread_cond_init (&sender->cond, &cond_attr);
+      wireshark_bridge_tx_init (&sender->tx);
+      sender->tx.sender_index = sender->sender_index;
+    }
+  pthread_condattr_destroy (&cond_attr);
+
+  // Initialize per-worker rings
+  if (wireshark_bridge_queue_init (&s->queue, s->senders))
+    return VNET_API_ERROR_SYSCALL_ERROR_4;
+
+  vec_foreach (sender, s->senders)
+    {
+      if (pthread_create (&sender->thread, NULL, wireshark_bridge_sender_thread_fn, sender) != 0)
+        return VNET_API_ERROR_SYSCALL_ERROR_3;
+      sender->thread_running = 1;
+
+      snprintf (name, sizeof (name), "wb_send_%u_%u", s->session_index, sender->sender_index);
+      pthread_setname_np (sender->thread, name);
+      wireshark_bridge_sender_set_affinity (wbm, sender);
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Free the drop reason names of a session
+ */
+static void
+wireshark_bridge_session_free_drop_reasons (wireshark_bridge_session_t *s)
+{
+  u8 **name;
+
+  vec_foreach (name, s->drop_reasons)
+    vec_free (name[0]);
+  vec_free (s->drop_reasons);
+}
+
+/**
+ * @brief Name every vlib error for the drop reasons of a session
+ *
+ * A dropped packet carries its vlib error, an index into the error heap
+ * of the main thread. The heap and the node vector grow without a lock
+ * when nodes are added, so the sender threads name drop reasons from this
+ * copy taken on enable instead; errors of nodes added later go out as a
+ * number. Runs with the session locked.
+ */
+static void
+wireshark_bridge_session_update_drop_reasons (wireshark_bridge_main_t *wbm,
+                                              wireshark_bridge_session_t *s)
+{
+  vlib_main_t *vm = wbm->vlib_main;
+  vlib_error_main_t *em = &vm->error_main;
+  vlib_node_t **np;
+  u32 code, e;
+
+  wireshark_bridge_session_free_drop_reasons (s);
+  if (!(s->direction_mask & WIRESHARK_BRIDGE_DIRECTION_MASK_DROP))
+    return;
+
+  vec_foreach (np, vm->node_main.nodes)
+    for (code = 0; code < np[0]->n_errors; code++)
+      {
+        e = np[0]->error_heap_index + code;
+        if (e >= vec_len (em->counters_heap))
+          break;
+        vec_validate (s->drop_reasons, e);
+        s->drop_reasons[e] = format (0, "%v: %s", np[0]->name, em->counters_heap[e].name);
+      }
+}
+
+/**
+ * @brief Free a session that is no longer reachable by the workers
+ */
+static void
+wireshark_bridge_session_free (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_interface_t *wbi;
+  wireshark_bridge_sender_t *sender;
+
+  wireshark_bridge_session_stop (s);
+
+  /* Close socket */
+  if (s->bridge_socket > 0)
+    close (s->bridge_socket);
+
+  wireshark_bridge_shm_free (&s->shm);
+  wireshark_bridge_stream_free (&s->stream);
+  wireshark_bridge_file_free (&s->file);
+  wireshark_bridge_session_free_drop_reasons (s);
+
+  wireshark_bridge_queue_unmap_slots (&s->queue);
+  wireshark_bridge_queue_free_recorders (&s->queue);
+  wireshark_bridge_queue_free_flows (&s->queue);
+  wireshark_bridge_queue_free (&s->queue);
+  vec_foreach (wbi, s->interfaces)
+    {
+      vec_free (wbi->workers);
+      vec_free (wbi->senders);
+      vec_free (wbi->name);
+    }
+  vec_free (s->interfaces);
+  vec_free (s->interface_index_by_sw_if_index);
+  vec_free (s->bridge_address);
+  vec_free (s->filter);
+  vec_free (s->trigger.file);
+
+  /* Destroy synchronization primitives */
+  vec_foreach (sender, s->senders)
+    {
+      pthread_mutex_destroy (&sender->mutex);
+      pthread_cond_destroy (&sender->cond);
+      wireshark_bridge_tx_free (&sender->tx);
+      vec_free (sender->ring_indices);
+    }
+  vec_free (s->senders);
+
+  clib_mem_free (s);
+}
+
+/**
+ * @brief Create a session for a destination and start its sender threads
+ */
+static int
+wireshark_bridge_session_create (wireshark_bridge_main_t *wbm, char *bridge_address,
+                                 wireshark_bridge_session_t **result)
+{
+  wireshark_bridge_session_t **sp, *s;
+  int rv;
+  u32 i;
+
+  s = clib_mem_alloc_aligned (sizeof (*s), CLIB_CACHE_LINE_BYTES);
+  clib_memset (s, 0, sizeof (*s));
+  s->bridge_socket = -1;
+  s->stream.fd = -1;
+  s->file.fd = -1;
+  s->bridge_address = format (0, "%s%c", bridge_address, 0);
+  s->direction_mask = WIRESHARK_BRIDGE_DIRECTION_MASK_BOTH;
+
+  rv = wireshark_bridge_session_connect (s);
+  if (rv) {
+    wireshark_bridge_session_free (s);
+    return rv;
+  }
+
+  pool_get (wbm->sessions, sp);
+  sp[0] = s;
+  s->session_index = sp - wbm->sessions;
+
+  for (i = 0; i < WIRESHARK_BRIDGE_N_SESSION_COUNTERS; i++)
+    vlib_validate_simple_counter (&wbm->session_counters[i], s->session_index);
+
+  /* Workers only see the session once it has interfaces */
+  rv = wireshark_bridge_session_start_senders (wbm, s);
+  if (rv) {
+    pool_put_index (wbm->sessions, s->session_index);
+    wireshark_bridge_session_free (s);
+    return rv;
+  }
+
+  *result = s;
+  return 0;
+}
+
+/**
+ * @brief Add what the sender threads of a session counted since the last
+ * export to the stats segment
+ *
+ * Runs on the main thread, either from the stats process or from the
+ * control plane, so it never races with itself. Counters written by a
+ * sender thread are read once and only the difference is added.
+ */
+static void
+wireshark_bridge_session_export_counters (wireshark_bridge_main_t *wbm,
+                                          wireshark_bridge_session_t *s)
+{
+  vlib_combined_counter_main_t *cm = wbm->combined_counters;
+  vlib_simple_counter_main_t *sm = wbm->session_counters;
+  u32 thread_index = vlib_get_thread_index ();
+  wireshark_bridge_interface_sender_t *c;
+  wireshark_bridge_interface_t *wbi;
+  wireshark_bridge_sender_t *sender;
+
+  vec_foreach (wbi, s->interfaces)
+    vec_foreach (c, wbi->senders)
+      {
+        u64 packets_rx = c->packets_sent_rx, bytes_rx = c->bytes_sent_rx;
+        u64 packets_tx = c->packets_sent_tx, bytes_tx = c->bytes_sent_tx;
+
+        if (packets_rx != c->packets_exported_rx)
+          vlib_increment_combined_counter (&cm[WIRESHARK_BRIDGE_COMBINED_COUNTER_SENT_RX],
+                                           thread_index, wbi->sw_if_index,
+                                           packets_rx - c->packets_exported_rx,
+                                           bytes_rx - c->bytes_exported_rx);
+        if (packets_tx != c->packets_exported_tx)
+          vlib_increment_combined_counter (&cm[WIRESHARK_BRIDGE_COMBINED_COUNTER_SENT_TX],
+                                           thread_index, wbi->sw_if_index,
+                                           packets_tx - c->packets_exported_tx,
+                                           bytes_tx - c->bytes_exported_tx);
+
+        c->packets_exported_rx = packets_rx;
+        c->bytes_exported_rx = bytes_rx;
+        c->packets_exported_tx = packets_tx;
+        c->bytes_exported_tx = bytes_tx;
+      }
+
+  vec_foreach (sender, s->senders)
+    {
+      u64 send_errors = sender->tx.send_errors;
+      u64 backpressure_drops = sender->tx.backpressure_drops;
+      u64 compress_bytes_in = sender->tx.compress_bytes_in;
+      u64 compress_bytes_out = sender->tx.compress_bytes_out;
+      u64 compress_ns = sender->tx.compress_ns;
+      u64 flow_records = sender->tx.flow_records;
+
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_SOCKET_ERRORS],
+                                     thread_index, s->session_index,
+                                     send_errors - sender->send_errors_exported);
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_DROPPED_SOCKET_FULL],
+                                     thread_index, s->session_index,
+                                     backpressure_drops - sender->backpressure_drops_exported);
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_COMPRESS_BYTES_IN],
+                                     thread_index, s->session_index,
+                                     compress_bytes_in - sender->compress_bytes_in_exported);
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_COMPRESS_BYTES_OUT],
+                                     thread_index, s->session_index,
+                                     compress_bytes_out - sender->compress_bytes_out_exported);
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_COMPRESS_NSEC],
+                                     thread_index, s->session_index,
+                                     compress_ns - sender->compress_ns_exported);
+      vlib_increment_simple_counter (&sm[WIRESHARK_BRIDGE_SESSION_COUNTER_FLOW_RECORDS],
+                                     thread_index, s->session_index,
+                                     flow_records - sender->flow_records_exported);
+
+      sender->send_errors_exported = send_errors;
+      sender->backpressure_drops_exported = backpressure_drops;
+      sender->compress_bytes_in_exported = compress_bytes_in;
+      sender->compress_bytes_out_exported = compress_bytes_out;
+      sender->compress_ns_exported = compress_ns;
+      sender->flow_records_exported = flow_records;
+    }
+}
+
+/**
+ * @brief Tear down a session once it has no interfaces left
+ */
+static void
+wireshark_bridge_session_destroy (wireshark_bridge_main_t *wbm, wireshark_bridge_session_t *s)
+{
+  /* Stop the sender threads, then release packets they did not get to */
+  wireshark_bridge_session_stop (s);
+  wireshark_bridge_queue_flush (wbm->vlib_main, &s->queue);
+  wireshark_bridge_session_export_counters (wbm, s);
+
+  pool_put_index (wbm->sessions, s->session_index);
+  wireshark_bridge_session_free (s);
+}
+
+/**
+ * @brief Set the sampling and rate limits of an interface
+ *
+ * The interface-wide rates are split evenly between the threads running
+ * the capture nodes, and every worker starts over with full buckets.
+ */
+static void
+wireshark_bridge_interface_set_limits (wireshark_bridge_interface_t *wbi,
+                                       wireshark_bridge_enable_args_t *a)
+{
+  u32 n_workers = clib_max (vlib_num_workers (), 1);
+  wireshark_bridge_interface_worker_t *w;
+
+  vec_validate_aligned (wbi->workers, vlib_get_thread_main ()->n_vlib_mains - 1,
+                        CLIB_CACHE_LINE_BYTES);
+
+  wbi->sample_rate = a->sample_rate;
+  wbi->max_pps = a->max_pps;
+  wbi->max_bps = a->max_bps;
+  wbi->worker_pps = (f64) a->max_pps / n_workers;
+  wbi->worker_bytes_per_sec = (f64) a->max_bps / 8 / n_workers;
+
+  vec_foreach (w, wbi->workers)
+    {
+      w->sample_count = 0;
+      w->last_refill = 0;
+    }
+}
+
+/**
+ * @brief Sum up the sampling and rate limit counters of all workers
+ */
+static void
+wireshark_bridge_interface_limit_counters (wireshark_bridge_interface_t *wbi,
+                                           u64 *sampled_out, u64 *policed)
+{
+  wireshark_bridge_interface_worker_t *w;
+
+  *sampled_out = *policed = 0;
+  vec_foreach (w, wbi->workers)
+    {
+      *sampled_out += w->sampled_out;
+      *policed += w->policed;
+    }
+}
+
+/**
+ * @brief Sum up the sent packet counters of all sender threads
+ */
+static void
+wireshark_bridge_interface_sent_counters (wireshark_bridge_interface_t *wbi,
+                                          wireshark_bridge_interface_sender_t *total)
+{
+  wireshark_bridge_interface_sender_t *c;
+
+  clib_memset (total, 0, sizeof (*total));
+  vec_foreach (c, wbi->senders)
+    {
+      total->packets_sent_rx += c->packets_sent_rx;
+      total->bytes_sent_rx += c->bytes_sent_rx;
+      total->packets_sent_tx += c->packets_sent_tx;
+      total->bytes_sent_tx += c->bytes_sent_tx;
+    }
+}
+
+/**
+ * @brief Enable the capture features an interface needs and disable the
+ * ones it no longer needs
+ *
+ * The feature of a capture point runs while some session captures the
+ * interface at that point, so a one-way capture leaves the other arcs
+ * alone and the drop and ip points cost nothing until they are asked for.
+ */
+static void
+wireshark_bridge_interface_update_features (wireshark_bridge_main_t *wbm, u32 sw_if_index)
+{
+  u32 *session_indices = wireshark_bridge_interface_sessions (wbm, sw_if_index);
+  u8 wanted = 0, *enabled;
+  u32 *si, i;
+
+  vec_foreach (si, session_indices)
+    {
+      wireshark_bridge_session_t *s = wbm->sessions[si[0]];
+      wireshark_bridge_interface_t *wbi = wireshark_bridge_find_interface (s, sw_if_index);
+
+      if (wbi && wbi->is_enabled)
+        wanted |= s->direction_mask & wbi->direction_mask;
+    }
+
+  vec_validate (wbm->feature_mask_by_sw_if_index, sw_if_index);
+  enabled = &wbm->feature_mask_by_sw_if_index[sw_if_index];
+
+  for (i = 0; i < WIRESHARK_BRIDGE_N_DIRECTIONS; i++)
+    if ((wanted ^ enabled[0]) & (1 << i))
+      vnet_feature_enable_disable (wireshark_bridge_capture_points[i].arc_name,
+                                   wireshark_bridge_capture_points[i].node_name, sw_if_index,
+                                   (wanted & (1 << i)) != 0, 0, 0);
+
+  enabled[0] = wanted;
+}
+
+/**
+ * @brief Get the entry of an interface in a session, adding it if needed
+ *
+ * Must be called with the session lock held, the sender threads look
+ * interfaces up while sending.
+ */
+static wireshark_bridge_interface_t *
+wireshark_bridge_session_get_interface (wireshark_bridge_main_t *wbm,
+                                        wireshark_bridge_session_t *s, u32 sw_if_index)
+{
+  wireshark_bridge_interface_t *wbi = wireshark_bridge_find_interface (s, sw_if_index);
+  wireshark_bridge_interface_t new_wbi = {0};
+  u32 index = vec_len (s->interfaces);
+  u32 i;
+
+  if (wbi)
+    return wbi;
+
+  new_wbi.sw_if_index = sw_if_index;
+  new_wbi.direction_mask = WIRESHARK_BRIDGE_DIRECTION_MASK_ALL;
+  new_wbi.name = format (0, "%U", format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index);
+
+  /* Workers count into the stats segment as soon as they see the interface */
+  for (i = 0; i < WIRESHARK_BRIDGE_N_INTERFACE_COUNTERS; i++)
+    vlib_validate_simple_counter (&wbm->interface_counters[i], sw_if_index);
+  for (i = 0; i < WIRESHARK_BRIDGE_N_COMBINED_COUNTERS; i++)
+    vlib_validate_combined_counter (&wbm->combined_counters[i], sw_if_index);
+  vec_validate_aligned (new_wbi.senders, vec_len (s->senders) - 1, CLIB_CACHE_LINE_BYTES);
+  vec_add1 (s->interfaces, new_wbi);
+  vec_validate_init_empty (s->interface_index_by_sw_if_index, sw_if_index, ~0);
+  s->interface_index_by_sw_if_index[sw_if_index] = index;
+
+  return &s->interfaces[index];
+}
+
+/**
+ * @brief Let the capture nodes of an interface see a session, or stop
+ * them from seeing it
+ */
+static void
+wireshark_bridge_interface_attach (wireshark_bridge_main_t *wbm, wireshark_bridge_session_t *s,
+                                   u32 sw_if_index, int attach)
+{
+  u32 **session_indices;
+  u32 i;
+
+  /* The interfaces a trigger sums up change, its count starts over */
+  s->trigger.primed = 0;
+
+  vec_validate (wbm->session_indices_by_sw_if_index, sw_if_index);
+  session_indices = &wbm->session_indices_by_sw_if_index[sw_if_index];
+
+  if (attach) {
+    vec_add1 (session_indices[0], s->session_index);
+    return;
+  }
+
+  i = vec_search (session_indices[0], s->session_index);
+  if (i != ~0)
+    vec_del1 (session_indices[0], i);
+  if (vec_len (session_indices[0]) == 0)
+    vec_free (session_indices[0]);
+}
+
+/**
+ * @brief Start capturing an interface in a session
+ *
+ * Sampling and rate limits are per interface, so enabling an interface
+ * again replaces them. The capture features are updated by the caller
+ * once the session options are in place.
+ */
+static void
+wireshark_bridge_session_add_interface (wireshark_bridge_main_t *wbm,
+                                        wireshark_bridge_session_t *s, u32 sw_if_index,
+                                        wireshark_bridge_enable_args_t *a)
+{
+  wireshark_bridge_interface_t *wbi;
+  u8 was_enabled;
+
+  wireshark_bridge_session_lock (s);
+  wbi = wireshark_bridge_session_get_interface (wbm, s, sw_if_index);
+  wireshark_bridge_interface_set_limits (wbi, a);
+  wbi->direction_mask = WIRESHARK_BRIDGE_DIRECTION_MASK_ALL;
+  was_enabled = wbi->is_enabled;
+  wbi->is_enabled = 1;
+  wireshark_bridge_session_unlock (s);
+
+  if (!was_enabled)
+    wireshark_bridge_interface_attach (wbm, s, sw_if_index, 1);
+}
+
+/**
+ * @brief Stop capturing an interface in a session
+ *
+ * The capture features are disabled once no session needs them anymore.
+ * Counters of the interface are kept for the stats output.
+ */
+static int
+wireshark_bridge_session_del_interface (wireshark_bridge_main_t *wbm,
+                                        wireshark_bridge_session_t *s, u32 sw_if_index)
+{
+  wireshark_bridge_interface_t *wbi = wireshark_bridge_find_interface (s, sw_if_index);
+
+  if (wbi == NULL || !wbi->is_enabled)
+    return VNET_API_ERROR_NO_SUCH_ENTRY;
+
+  wireshark_bridge_session_lock (s);
+  wbi->is_enabled = 0;
+  wireshark_bridge_session_unlock (s);
+
+  wireshark_bridge_interface_attach (wbm, s, sw_if_index, 0);
+  wireshark_bridge_interface_update_features (wbm, sw_if_index);
+
+  return 0;
+}
+
+/**
+ * @brief Enable and disable many interfaces of a session at once
+ *
+ * Meant for automation that toggles dozens of (sub-)interfaces: the
+ * session keeps its socket, sender threads and capture options, the
+ * sender threads are locked once for the whole set and, as this runs
+ * under the worker barrier, the workers see all of it or nothing. Every
+ * entry is validated before anything changes. New interfaces get no
+ * sampling or rate limits; disabling the last interface keeps the
+ * session, wireshark_bridge_disable () tears it down.
+ *
+ * @param failed  set to the index of the entry that was rejected
+ */
+static int
+wireshark_bridge_session_set_interfaces (wireshark_bridge_main_t *wbm,
+                                         wireshark_bridge_session_t *s,
+                                         wireshark_bridge_interface_toggle_t *toggles,
+                                         u32 *failed)
+{
+  wireshark_bridge_enable_args_t no_limits = {0};
+  wireshark_bridge_interface_toggle_t *t;
+  wireshark_bridge_interface_t *wbi;
+  u8 *was_enabled = 0;
+
+  vec_foreach (t, toggles)
+    if (!vnet_sw_interface_is_valid (wbm->vnet_main, t->sw_if_index) ||
+        (t->direction_mask & ~WIRESHARK_BRIDGE_DIRECTION_MASK_ALL))
+      {
+        *failed = t - toggles;
+        return t->direction_mask & ~WIRESHARK_BRIDGE_DIRECTION_MASK_ALL ?
+               VNET_API_ERROR_INVALID_VALUE : VNET_API_ERROR_INVALID_SW_IF_INDEX;
+      }
+
+  wireshark_bridge_session_lock (s);
+  vec_foreach (t, toggles)
+    {
+      wbi = t->enable ? wireshark_bridge_session_get_interface (wbm, s, t->sw_if_index) :
+                        wireshark_bridge_find_interface (s, t->sw_if_index);
+      vec_add1 (was_enabled, wbi && wbi->is_enabled);
+      if (wbi == NULL)
+        continue;
+
+      if (t->enable)
+        {
+          if (!wbi->is_enabled)
+            wireshark_bridge_interface_set_limits (wbi, &no_limits);
+          wbi->direction_mask = t->direction_mask ? t->direction_mask :
+                                WIRESHARK_BRIDGE_DIRECTION_MASK_ALL;
+        }
+      wbi->is_enabled = t->enable;
+    }
+  wireshark_bridge_session_unlock (s);
+
+  vec_foreach (t, toggles)
+    {
+      u8 enabled = t->enable, was = was_enabled[t - toggles];
+
+      if (enabled != was)
+        wireshark_bridge_interface_attach (wbm, s, t->sw_if_index, enabled);
+      wireshark_bridge_interface_update_features (wbm, t->sw_if_index);
+    }
+
+  vec_free (was_enabled);
+  return 0;
+}
+
+/**
+ * @brief Check whether a session still captures any interface
+ */
+static int
+wireshark_bridge_session_is_idle (wireshark_bridge_session_t *s)
+{
+  wireshark_bridge_interface_t *wbi;
+
+  vec_foreach (wbi, s->interfaces)
+    if (wbi->is_enabled)
+      return 0;
+
+  return 1;
+}
+
+/**
+ * @brief Find the mbuf rx timestamp field of the DPDK drivers
+ *
+ * Drivers register it when a port is started with rx timestamp offload,
+ * which happens after the plugin is initialized, so the lookup is retried
+ * on every enable until it succeeds.
+ */
+static void
+wireshark_bridge_hw_timestamp_lookup (wireshark_bridge_main_t *wbm)
+{
+#ifdef WIRESHARK_BRIDGE_HW_TIMESTAMP
+  int offset, bit;
+
+  if (!wbm->hw_timestamps || wbm->hw_timestamp_offset >= 0)
+    return;
+
+  offset = rte_mbuf_dynfield_lookup (RTE_MBUF_DYNFIELD_TIMESTAMP_NAME, NULL);
+  bit = rte_mbuf_dynflag_lookup (RTE_MBUF_DYNFLAG_RX_TIMESTAMP_NAME, NULL);
+  if (offset < 0 || bit < 0)
+    return;
+
+  /* Workers are stopped by the barrier, both are in place before they look */
+  wbm->hw_timestamp_flag = 1ULL << bit;
+  wbm->hw_timestamp_offset = offset;
+#endif
+}
+
+/**
+ * @brief Name the option of an enable its destination cannot carry
+ *
+ * @return the conflict, for VNET_API_ERROR_UNSUPPORTED, NULL if none
+ */
+static const char *
+wireshark_bridge_enable_conflict (char *bridge_address, wireshark_bridge_enable_args_t *a)
+{
+  int shm = strncmp (bridge_address, WIRESHARK_BRIDGE_SHM_PREFIX,
+                     strlen (WIRESHARK_BRIDGE_SHM_PREFIX)) == 0;
+  int stream = strncmp (bridge_address, WIRESHARK_BRIDGE_STREAM_PREFIX,
+                        strlen (WIRESHARK_BRIDGE_STREAM_PREFIX)) == 0;
+  int file = strncmp (bridge_address, WIRESHARK_BRIDGE_FILE_PREFIX,
+                      strlen (WIRESHARK_BRIDGE_FILE_PREFIX)) == 0;
+
+  /* Shared rings carry uncompressed packet records only, and count their
+   * own drops */
+  if (shm && a->output_format == WIRESHARK_BRIDGE_FORMAT_PCAPNG)
+    return "pcapng is not supported with shm destinations";
+  if (shm && a->compression)
+    return "compress is not supported with shm destinations";
+  if (shm && a->use_flows)
+    return "flows is not supported with shm destinations";
+  if (shm && a->sequence)
+    return "sequence is not supported with shm destinations";
+
+  /* A TCP stream loses nothing past the sender, and has no datagrams to frame the headers */
+  if (stream && a->sequence)
+    return "sequence is not supported with tcp destinations";
+
+  /* Every destination of a group gets its own drops in the sequence
+   * headers, rewritten after compression is no longer possible */
+  if (a->sequence && a->compression && strchr (bridge_address, WIRESHARK_BRIDGE_DESTINATION_SEPARATOR))
+    return "sequence cannot be combined with compress for several destinations";
+
+  /* Files hold live pcapng packets only */
+  if (file && a->compression)
+    return "compress is not supported with file destinations";
+  if (file && a->use_flows)
+    return "flows is not supported with file destinations";
+  if (file && a->use_recorder)
+    return "recorder is not supported with file destinations";
+  if (file && a->sequence)
+    return "sequence is not supported with file destinations";
+
+  return 0;
+}
+
+/**
+ * @brief Enable capture of an interface towards a destination
+ *
+ * Creates the session for @c bridge_address if there is none yet. Capture
+ * options belong to the session, so enabling another interface on an
+ * existing session updates them for all of its interfaces.
+ *
+ * Like every control-plane change here, this runs from a CLI or API
+ * handler with the worker barrier held, so workers never see the session
+ * pool or the sw_if_index map half-updated.
+ *
+ * On success the session takes ownership of @c a->filter.
+ */
+static int
+wireshark_bridge_enable (wireshark_bridge_main_t *wbm, u32 sw_if_index, char *bridge_address,
+                         wireshark_bridge_enable_args_t *a)
+{
+  wireshark_bridge_interface_t *wbi;
+  wireshark_bridge_session_t *s;
+  u32 snaplen;
+  int rv;
+
+  if (!vnet_sw_interface_is_valid (wbm->vnet_main, sw_if_index))
+    return VNET_API_ERROR_INVALID_SW_IF_INDEX;
+
+  if (bridge_address == NULL || bridge_address[0] == '\0' ||
+      strlen (bridge_address) > WIRESHARK_BRIDGE_MAX_ADDRESS_LENGTH)
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  if (a->filter && !wireshark_bridge_bpf_validate (a->filter, vec_len (a->filter)))
+    return VNET_API_ERROR_INVALID_ARGUMENT;
+
+#ifndef WIRESHARK_BRIDGE_LZ4
+  if (a->compression)
+    return VNET_API_ERROR_UNIMPLEMENTED;
+#endif
+
+  /* Flow records have a format of their own and are always sent */
+  if (a->use_flows && (a->output_format == WIRESHARK_BRIDGE_FORMAT_PCAPNG || a->use_recorder))
+    return VNET_API_ERROR_INVALID_VALUE_3;
+
+  if (wireshark_bridge_enable_conflict (bridge_address, a))
+    return VNET_API_ERROR_UNSUPPORTED;
+
+  s = wireshark_bridge_find_session (wbm, bridge_address);
+  if (s == NULL) {
+    rv = wireshark_bridge_session_create (wbm, bridge_address, &s);
+    if (rv)
+      return rv;
+  } else if (!s->bridge_connected) {
+    /* Reconnect a session whose socket failed, the old socket is closed
+     * while no sender thread uses it */
+    wireshark_bridge_session_lock (s);
+    rv = wireshark_bridge_session_connect (s);
+    wireshark_bridge_session_unlock (s);
+    if (rv)
+      return rv;
+  }
+
+  /* Recorded packets are always truncated, a snaplen bounds the copy */
+  snaplen = a->snaplen;
+  if (a->use_recorder && snaplen == 0)
+    snaplen = WIRESHARK_BRIDGE_RECORDER_DEFAULT_SNAPLEN;
+
+  /* Everything that can fail comes before the options change, so a failed
+   * enable leaves a live session capturing as before. Slots already
+   * remapped are harmless, copies are cut to the size of their ring. */
+  wireshark_bridge_session_lock (s);
+  rv = wireshark_bridge_queue_map_slots (&s->queue, wireshark_bridge_slot_size (snaplen));
+  if (rv == 0 && a->use_recorder)
+    rv = wireshark_bridge_queue_map_recorders (&s->queue, wbm->recorder_size,
+                                               wireshark_bridge_recorder_slot_size (snaplen));
+  if (rv == 0 && a->use_flows)
+    rv = wireshark_bridge_queue_map_flows (&s->queue, wbm->flow_table_size);
+  if (rv) {
+    /* Only what the session goes on using is kept */
+    if (!s->use_recorder)
+      wireshark_bridge_queue_free_recorders (&s->queue);
+    if (!s->use_flows)
+      wireshark_bridge_queue_free_flows (&s->queue);
+    wireshark_bridge_session_unlock (s);
+    /* A session created just now has nothing to capture yet */
+    if (vec_len (s->interfaces) == 0)
+      wireshark_bridge_session_destroy (wbm, s);
+    return VNET_API_ERROR_SYSCALL_ERROR_4;
+  }
+  if (!a->use_recorder)
+    wireshark_bridge_queue_free_recorders (&s->queue);
+  if (!a->use_flows)
+    wireshark_bridge_queue_free_flows (&s->queue);
+
+  /* Sender threads complete their datagrams before releasing their mutex,
+   * so a new format always starts with a fresh datagram */
+  s->direction_mask = a->direction_mask ? a->direction_mask : WIRESHARK_BRIDGE_DIRECTION_MASK_BOTH;
+  s->snaplen = snaplen;
+  s->use_pool_buffers = a->use_pool_buffers;
+  s->use_recorder = a->use_recorder;
+  s->use_flows = a->use_flows;
+  s->output_format = s->use_file ? WIRESHARK_BRIDGE_FORMAT_PCAPNG : a->output_format;
+  s->compression = a->compression;
+  s->sequence = a->sequence;
+  if (s->use_file) {
+    s->file.max_size = a->file_size ? (u64) a->file_size << 20 : WIRESHARK_BRIDGE_FILE_DEFAULT_SIZE;
+    s->file.max_duration = a->file_duration;
+    s->file.max_files = a->max_files;
+  }
+  wireshark_bridge_session_update_drop_reasons (wbm, s);
+  wireshark_bridge_session_unlock (s);
+
+  /* Workers are stopped by the barrier, the old program is not in use */
+  vec_free (s->filter);
+  s->filter = a->filter;
+  a->filter = 0;
+
+  wireshark_bridge_hw_timestamp_lookup (wbm);
+  wireshark_bridge_session_add_interface (wbm, s, sw_if_index, a);
+
+  /* The direction mask may have changed for every interface of the session */
+  vec_foreach (wbi, s->interfaces)
+    if (wbi->is_enabled)
+      wireshark_bridge_interface_update_features (wbm, wbi->sw_if_index);
+  return 0;
+}
+
+/**
+ * @brief Disable capture of an interface
+ *
+ * With @c bridge_address set only that session stops capturing, otherwise
+ * every session does. ~0 as @c sw_if_index stands for all interfaces.
+ * Sessions left without interfaces are torn down.
+ */
+static int
+wireshark_bridge_disable (wireshark_bridge_main_t *wbm, u32 sw_if_index, char *bridge_address)
+{
+  wireshark_bridge_session_t **sp, **idle = 0, **s;
+  wireshark_bridge_interface_t *wbi;
+  int found = 0;
+
+  pool_foreach (sp, wbm->sessions)
+    {
+      if (bridge_address && bridge_address[0] &&
+          strcmp ((char *) sp[0]->bridge_address, bridge_address) != 0)
+        continue;
+
+      if (sw_if_index == ~0) {
+        vec_foreach (wbi, sp[0]->interfaces)
+          if (wireshark_bridge_session_del_interface (wbm, sp[0], wbi->sw_if_index) == 0)
+            found = 1;
+      } else if (wireshark_bridge_session_del_interface (wbm, sp[0], sw_if_index) == 0) {
+        found = 1;
+      }
+
+      if (wireshark_bridge_session_is_idle (sp[0]))
+        vec_add1 (idle, sp[0]);
+    }
+
+  /* Sessions are destroyed outside of pool_foreach */
+  vec_foreach (s, idle)
+    wireshark_bridge_session_destroy (wbm, s[0]);
+  vec_free (idle);
+
+  return found ? 0 : VNET_API_ERROR_NO_SUCH_ENTRY;
+}
+
+/* Records merged, then sent or written together by a dump */
+#define WIRESHARK_BRIDGE_DUMP_BATCH 256
+
+// Read position of a dump in the recorder of one worker
+typedef struct {
+  wireshark_bridge_recorder_t *recorder;
+  u64 index;                // Next record to read
+  u64 end;                  // Recorder head when the dump started
+  u8 *record;               // Copy of the current record
+  wireshark_bridge_packet_t packet;  // Its header, valid with has_packet set
+  u8 has_packet;
+} wireshark_bridge_dump_cursor_t;
+
+// Output of a dump, the session's destination or a pcapng file
+typedef struct {
+  wireshark_bridge_session_t *session;
+  int fd;                   // pcapng file, -1 for the destination
+  u8 *buffer;               // Blocks not yet written to the file
+  u32 *interface_ids;       // sw_if_index -> IDB id + 1, 0 if not described yet
+  u32 n_interfaces;
+  int failed;               // A write to the file failed
+} wireshark_bridge_dump_t;
+
+/**
+ * @brief Parse the big-endian header of a packet record, see
+ * wireshark_bridge_record_header_size()
+ */
+static void
+wireshark_bridge_read_packet_header (u8 *buffer, wireshark_bridge_packet_t *p)
+{
+  u32 i;
+
+  p->sw_if_index = ((u32) buffer[0] << 24) | ((u32) buffer[1] << 16) |
+                   ((u32) buffer[2] << 8) | buffer[3];
+
+  p->timestamp = 0;
+  for (i = 4; i < 12; i++)
+    p->timestamp = (p->timestamp << 8) | buffer[i];
+
+  p->packet_length = ((u32) buffer[12] << 24) | ((u32) buffer[13] << 16) |
+                     ((u32) buffer[14] << 8) | buffer[15];
+  p->original_length = ((u32) buffer[16] << 24) | ((u32) buffer[17] << 16) |
+                       ((u32) buffer[18] << 8) | buffer[19];
+  p->direction = buffer[20];
+  p->error = 0;
+  if (p->direction == WIRESHARK_BRIDGE_DIRECTION_DROP)
+    p->error = clib_net_to_host_u32 (clib_mem_unaligned (buffer + 21, u32));
+}
+
+/**
+ * @brief Move a dump cursor to the next intact record not older than
+ * @c since_ns
+ *
+ * Records the worker overwrites while the dump reads them are skipped,
+ * the cursor goes on with the oldest record left.
+ */
+static void
+wireshark_bridge_dump_cursor_next (wireshark_bridge_dump_cursor_t *c, u64 since_ns)
+{
+  wireshark_bridge_packet_t *p = &c->packet;
+  u32 header_size;
+
+  c->has_packet = 0;
+
+  while (c->index < c->end)
+    {
+      if (!wireshark_bridge_recorder_read (c->recorder, c->index++, c->record))
+        {
+          c->index = clib_max (c->index, wireshark_bridge_recorder_oldest (c->recorder));
+          continue;
+        }
+
+      wireshark_bridge_read_packet_header (c->record, p);
+      if (p->timestamp < since_ns)
+        continue;
+
+      header_size = wireshark_bridge_record_header_size (p->direction);
+      p->packet_length = clib_min (p->packet_length, c->recorder->slot_size - header_size);
+      p->packet_data = c->record + header_size;
+      p->buffer_index = ~0;
+      p->n_segments = 1;
+      c->has_packet = 1;
+      return;
+    }
+}
+
+/**
+ * @brief Write the blocks of a dump collected so far to its file
+ */
+static void
+wireshark_bridge_dump_flush_file (wireshark_bridge_dump_t *d)
+{
+  u8 *b = d->buffer;
+  u32 n_left = vec_len (d->buffer);
+
+  while (n_left && !d->failed)
+    {
+      ssize_t rv = write (d->fd, b, n_left);
+
+      if (rv < 0 && errno == EINTR)
+        continue;
+      if (rv <= 0)
+        {
+          d->failed = 1;
+          break;
+        }
+
+      b += rv;
+      n_left -= rv;
+    }
+
+  vec_reset_length (d->buffer);
+}
+
+/**
+ * @brief Hand a batch of dumped packets to the output of the dump
+ *
+ * The destination gets them through the first sender thread's transmit
+ * path, with its mutex held, in the session's output format. A file gets
+ * one pcapng section for the whole dump, each interface described before
+ * its first packet.
+ */
+static void
+wireshark_bridge_dump_emit (wireshark_bridge_dump_t *d, wireshark_bridge_packet_t *packets,
+                            u32 n_packets)
+{
+  wireshark_bridge_session_t *s = d->session;
+  wireshark_bridge_interface_t *wbi;
+  u8 comment[WIRESHARK_BRIDGE_PCAPNG_MAX_COMMENT];
+  u32 i, *id, comment_len;
+  u8 *b;
+
+  if (d->fd < 0)
+    {
+      wireshark_bridge_sender_t *sender = &s->senders[0];
+      u64 drops;
+
+      /* A stream drops batches while it has a backlog, the dump waits for
+       * the receiver instead and gives up once it stalls for too long */
+      pthread_mutex_lock (&sender->mutex);
+      drops = sender->tx.backpressure_drops;
+      sender->tx.stream_wait = 1;
+      wireshark_bridge_send_packets (sender, packets, n_packets);
+      sender->tx.stream_wait = 0;
+      if (s->use_stream && sender->tx.backpressure_drops != drops)
+        d->failed = 1;
+      pthread_mutex_unlock (&sender->mutex);
+      return;
+    }
+
+  for (i = 0; i < n_packets; i++)
+    {
+      wireshark_bridge_packet_t *p = &packets[i];
+      u32 len = p->packet_length;
+
+      vec_validate (d->interface_ids, p->sw_if_index);
+      id = &d->interface_ids[p->sw_if_index];
+      if (id[0] == 0)
+        {
+          wbi = wireshark_bridge_find_interface (s, p->sw_if_index);
+          u32 name_len = wbi ? vec_len (wbi->name) : 0;
+
+          vec_add2 (d->buffer, b, WIRESHARK_BRIDGE_PCAPNG_IDB_SIZE (name_len));
+          wireshark_bridge_pcapng_write_idb (b, wbi ? wbi->name : 0, name_len, s->snaplen);
+          id[0] = ++d->n_interfaces;
+        }
+
+      comment_len = wireshark_bridge_drop_comment (s, p, comment);
+      vec_add2 (d->buffer, b, WIRESHARK_BRIDGE_PCAPNG_EPB_SIZE (len, comment_len));
+      b += wireshark_bridge_pcapng_write_epb_header (b, id[0] - 1, p->timestamp, len,
+                                                     p->original_length, comment_len);
+      clib_memcpy_fast (b, p->packet_data, len);
+      wireshark_bridge_pcapng_write_epb_trailer (b + len, len,
+                                                 p->direction != WIRESHARK_BRIDGE_DIRECTION_TX,
+                                                 comment, comment_len);
+    }
+
+  wireshark_bridge_dump_flush_file (d);
+}
+
+/**
+ * @brief Dump the last @c seconds of the flight recorder of a session
+ *
+ * Runs on the main thread without the worker barrier: the workers go on
+ * recording, the records of every worker are read as described in
+ * recorder.h and merged by timestamp. Only records written before the
+ * dump started are taken. They go to the session's destination, which is
+ * reconnected first under the barrier if its socket failed, or with
+ * @c file set to a new pcapng file. A stream destination is waited for
+ * between batches, the dump fails if it stalls.
+ *
+ * @param n_packets  set to the number of packets dumped
+ */
+static int
+wireshark_bridge_recorder_dump (wireshark_bridge_main_t *wbm, wireshark_bridge_session_t *s,
+                                u32 seconds, char *file, u64 *n_packets)
+{
+  wireshark_bridge_dump_cursor_t *cursors = 0, *c, *next;
+  wireshark_bridge_packet_t packets[WIRESHARK_BRIDGE_DUMP_BATCH];
+  wireshark_bridge_dump_t d = { .session = s, .fd = -1 };
+  wireshark_bridge_ring_t *ring;
+  u8 *records = 0, *b;
+  u32 n = 0, slot_size = 0;
+  u64 since_ns;
   int rv = 0;
-  u32 sw_if_index = ntohl (mp->sw_if_index);
-  char *bridge_address = (char *) mp->bridge_address;
-  char *bridge_address_copy = NULL;
-  
-  // Create a copy of the bridge address for safe manipulation
-  bridge_address_copy = strdup(bridge_address);
-  if (!bridge_address_copy) {
-    rv = VNET_API_ERROR_INVALID_VALUE;
-    goto done;
-  }
-  
-  /* Check if this is a Unix socket path (starts with /) */
-  if (bridge_address[0] == '/') {
-    /* Unix socket path */
-    wbm->use_unix_socket = 1;
-    
-    /* Copy socket path, ensuring it's not too long */
-    if (strlen(bridge_address) >= sizeof(wbm->socket_path)) {
-      rv = VNET_API_ERROR_INVALID_VALUE;
-      goto done;
+
+  *n_packets = 0;
+
+  if (!s->use_recorder)
+    return VNET_API_ERROR_FEATURE_DISABLED;
+
+  if (seconds == 0)
+    seconds = WIRESHARK_BRIDGE_RECORDER_DEFAULT_SECONDS;
+  since_ns = unix_time_now_nsec () - (u64) seconds * 1000000000ULL;
+
+  if (file && file[0])
+    {
+      d.fd = open (file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (d.fd < 0)
+        return VNET_API_ERROR_SYSCALL_ERROR_5;
+
+      vec_add2 (d.buffer, b, WIRESHARK_BRIDGE_PCAPNG_SHB_SIZE);
+      wireshark_bridge_pcapng_write_shb (b);
     }
-    
-    strncpy(wbm->socket_path, bridge_address, sizeof(wbm->socket_path) - 1);
-    wbm->socket_path[sizeof(wbm->socket_path) - 1] = '\0';
-    
-    /* Connect to bridge if not already connected */
-    if (!wbm->bridge_connected) {
-      // Close any existing socket
-      if (wbm->bridge_socket > 0) {
-        close (wbm->bridge_socket);
-      }
-      
-      wbm->bridge_socket = socket (AF_UNIX, SOCK_DGRAM, 0);
-      if (wbm->bridge_socket < 0) {
-        rv = VNET_API_ERROR_SYSCALL_ERROR_1;
-        goto done;
-      }
-      
-      memset (&wbm->bridge_addr.unix_addr, 0, sizeof (wbm->bridge_addr.unix_addr));
-      wbm->bridge_addr.unix_addr.sun_family = AF_UNIX;
-      strncpy (wbm->bridge_addr.unix_addr.sun_path, wbm->socket_path, 
-               sizeof(wbm->bridge_addr.unix_addr.sun_path) - 1);
-      
-      // For UDP, we don't need to connect, just store the address for sending
-      wbm->bridge_connected = 1;
-      
-      /* Start sender thread if not already running */
-      if (!wbm->sender_thread_running) {
-        // Initialize packet queue
-        wireshark_bridge_queue.packets = 0; /* Initialize empty vector */
-        wireshark_bridge_queue.should_stop = 0;
-        wireshark_bridge_queue.queue_overflows = 0;
-        
-        if (pthread_create (&wbm->sender_thread, NULL, wireshark_bridge_sender_thread_fn, NULL) != 0) {
-          close (wbm->bridge_socket);
-          wbm->bridge_connected = 0;
-          rv = VNET_API_ERROR_SYSCALL_ERROR_3;
-          goto done;
+  else if (!s->bridge_connected)
+    {
+      vlib_main_t *vm = vlib_get_main ();
+
+      /* Workers check bridge_connected and the socket per packet */
+      vlib_worker_thread_barrier_sync (vm);
+      wireshark_bridge_session_lock (s);
+      rv = wireshark_bridge_session_connect (s);
+      wireshark_bridge_session_unlock (s);
+      vlib_worker_thread_barrier_release (vm);
+      if (rv)
+        return rv;
+    }
+
+  vec_foreach (ring, s->queue.rings)
+    {
+      if (ring->recorder.slots == 0)
+        continue;
+
+      vec_add2 (cursors, c, 1);
+      c->recorder = &ring->recorder;
+      c->end = clib_atomic_load_acq_n (&ring->recorder.head);
+      c->index = wireshark_bridge_recorder_oldest (c->recorder);
+      vec_validate (c->record, c->recorder->slot_size - 1);
+      slot_size = clib_max (slot_size, c->recorder->slot_size);
+      wireshark_bridge_dump_cursor_next (c, since_ns);
+    }
+  vec_validate (records, WIRESHARK_BRIDGE_DUMP_BATCH * slot_size);
+
+  while (1)
+    {
+      /* Oldest record at any of the workers */
+      next = 0;
+      vec_foreach (c, cursors)
+        if (c->has_packet && (next == 0 || c->packet.timestamp < next->packet.timestamp))
+          next = c;
+
+      if (next == 0)
+        break;
+
+      packets[n] = next->packet;
+      packets[n].packet_data = records + n * slot_size;
+      clib_memcpy_fast (packets[n].packet_data, next->packet.packet_data, next->packet.packet_length);
+      wireshark_bridge_dump_cursor_next (next, since_ns);
+
+      if (++n == WIRESHARK_BRIDGE_DUMP_BATCH)
+        {
+          wireshark_bridge_dump_emit (&d, packets, n);
+          *n_packets += n;
+          n = 0;
+          if (d.failed)
+            break;
         }
-        
-        wbm->sender_thread_running = 1;
-      }
     }
-  } else {
-    /* Traditional IP:port address */
-    wbm->use_unix_socket = 0;
-    
-    /* Parse bridge address - use the copy for safe manipulation */
-    char *colon = strchr (bridge_address_copy, ':');
-    if (colon == NULL) {
-      rv = VNET_API_ERROR_INVALID_VALUE;
-      goto done;
+
+  if (n && !d.failed)
+    {
+      wireshark_bridge_dump_emit (&d, packets, n);
+      *n_packets += n;
     }
-    
-    *colon = '\0';  // Safely modify our copy
-    char *ip_address = bridge_address_copy;
-    int port = atoi (colon + 1);
-    
-    if (port <= 0 || port > 65535) {
-      rv = VNET_API_ERROR_INVALID_VALUE;
-      goto done;
+
+  if (d.fd >= 0)
+    {
+      wireshark_bridge_dump_flush_file (&d);
+      if (close (d.fd) < 0)
+        d.failed = 1;
+      if (d.failed)
+        rv = VNET_API_ERROR_SYSCALL_ERROR_5;
     }
-    
-    /* Connect to bridge if not already connected */
-    if (!wbm->bridge_connected) {
-      // Close any existing socket
-      if (wbm->bridge_socket > 0) {
-        close (wbm->bridge_socket);
-      }
-      
-      wbm->bridge_socket = socket (AF_INET, SOCK_DGRAM, 0);
-      if (wbm->bridge_socket < 0) {
-        rv = VNET_API_ERROR_SYSCALL_ERROR_1;
-        goto done;
-      }
-      
-      /* Set socket options */
-      int optval = 1;
-      if (setsockopt (wbm->bridge_socket, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval)) < 0) {
-        clib_warning ("Failed to set SO_KEEPALIVE: %s", strerror (errno));
-      }
-      
-      // For UDP, we don't need to connect, just store the address for sending
-      wbm->bridge_connected = 1;
-      wbm->use_unix_socket = 0;
-      
-      /* Set socket address */
-      memset (&wbm->bridge_addr.inet_addr, 0, sizeof (wbm->bridge_addr.inet_addr));
-      wbm->bridge_addr.inet_addr.sin_family = AF_INET;
-      wbm->bridge_addr.inet_addr.sin_port = htons (port);
-      
-      if (inet_pton (AF_INET, ip_address, &wbm->bridge_addr.inet_addr.sin_addr) <= 0) {
-        rv = VNET_API_ERROR_INVALID_VALUE;
-        close (wbm->bridge_socket);
-        goto done;
-      }
+  else if (d.failed)
+    rv = VNET_API_ERROR_SYSCALL_ERROR_7;
+
+  s->dumps++;
+
+  vec_foreach (c, cursors)
+    vec_free (c->record);
+  vec_free (cursors);
+  vec_free (records);
+  vec_free (d.buffer);
+  vec_free (d.interface_ids);
+  return rv;
+}
+
+/**
+ * @brief Set or clear the dump trigger of a recorder session
+ *
+ * @param threshold  counter increase within a stats interval that fires
+ *                   the trigger, 0 to clear it
+ */
+static int
+wireshark_bridge_recorder_set_trigger (wireshark_bridge_session_t *s, u32 counter,
+                                       u64 threshold, u32 seconds, char *file)
+{
+  wireshark_bridge_trigger_t *t = &s->trigger;
+
+  if (!s->use_recorder)
+    return VNET_API_ERROR_FEATURE_DISABLED;
+
+  if (counter >= WIRESHARK_BRIDGE_N_TRIGGER_COUNTERS)
+    return VNET_API_ERROR_INVALID_VALUE_2;
+
+  vec_free (t->file);
+  if (file && file[0])
+    t->file = format (0, "%s%c", file, 0);
+
+  t->counter = counter;
+  t->threshold = threshold;
+  t->seconds = seconds;
+  t->primed = 0;
+  return 0;
+}
+
+/**
+ * @brief Check the trigger of a recorder session, dumping once it fires
+ *
+ * Called by the stats process once per stats interval. The counter is
+ * summed over the interfaces the session captures.
+ */
+static void
+wireshark_bridge_recorder_check_trigger (wireshark_bridge_main_t *wbm,
+                                         wireshark_bridge_session_t *s)
+{
+  vnet_interface_main_t *im = &wbm->vnet_main->interface_main;
+  wireshark_bridge_trigger_t *t = &s->trigger;
+  wireshark_bridge_interface_t *wbi;
+  u64 sum = 0, n_packets;
+  int rv;
+
+  if (!s->use_recorder || t->threshold == 0)
+    return;
+
+  vec_foreach (wbi, s->interfaces)
+    if (wbi->is_enabled)
+      sum += vlib_get_simple_counter (&im->sw_if_counters[wireshark_bridge_trigger_vnet_counters[t->counter]],
+                                      wbi->sw_if_index);
+
+  /* Counters cleared meanwhile count as no increase */
+  if (!t->primed || sum < t->last || sum - t->last < t->threshold)
+    {
+      t->last = sum;
+      t->primed = 1;
+      return;
     }
-  }
-  
-  /* Enable packet capture on the interface */
-  wireshark_bridge_interface_t *wb_if = wireshark_bridge_find_interface (wbm, sw_if_index);
-  if (wb_if == NULL) {
-    wb_if = wireshark_bridge_add_interface (wbm, sw_if_index);
-    if (wb_if == NULL) {
-      rv = VNET_API_ERROR_NO_SUCH_ENTRY;
-      goto done;
+
+  t->threshold = 0;
+  t->fired++;
+
+  rv = wireshark_bridge_recorder_dump (wbm, s, t->seconds, (char *) t->file, &n_packets);
+  if (rv)
+    clib_warning ("Trigger of %s fired on %s, dump failed with error %d",
+                  s->bridge_address, wireshark_bridge_trigger_names[t->counter], rv);
+  else
+    clib_warning ("Trigger of %s fired on %s, dumped %llu packets to %s",
+                  s->bridge_address, wireshark_bridge_trigger_names[t->counter], n_packets,
+                  t->file ? (char *) t->file : (char *) s->bridge_address);
+}
+
+/**
+ * @brief Take the dumps asked for over the API (stats process only)
+ */
+static void
+wireshark_bridge_recorder_run_requests (wireshark_bridge_main_t *wbm)
+{
+  wireshark_bridge_dump_request_t *r;
+  wireshark_bridge_session_t *s;
+  u64 n_packets;
+  int rv;
+
+  vec_foreach (r, wbm->dump_requests)
+    {
+      s = wireshark_bridge_find_session (wbm, (char *) r->bridge_address);
+      rv = s ? wireshark_bridge_recorder_dump (wbm, s, r->seconds, (char *) r->file, &n_packets) :
+               VNET_API_ERROR_NO_SUCH_ENTRY;
+      if (rv)
+        clib_warning ("Dump of %s failed with error %d", r->bridge_address, rv);
+
+      vec_free (r->bridge_address);
+      vec_free (r->file);
     }
+
+  vec_reset_length (wbm->dump_requests);
+}
+
+/**
+ * @brief Whether a fixed size string of an API message is NUL terminated
+ *
+ * An address that does not fit is refused rather than cut short, a cut
+ * destination list could still parse to the wrong port.
+ */
+static_always_inline int
+wireshark_bridge_api_string_valid (u8 *string, uword size)
+{
+  return memchr (string, 0, size) != 0;
+}
+
+/**
+ * @brief Handler for wireshark_bridge_enable API call
+ */
+static void
+vl_api_wireshark_bridge_enable_t_handler (vl_api_wireshark_bridge_enable_t * mp)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vl_api_wireshark_bridge_enable_reply_t *rmp;
+  wireshark_bridge_enable_args_t a = {
+    .direction_mask = mp->direction_mask,
+    .use_pool_buffers = mp->use_pool_buffers,
+    .snaplen = ntohl (mp->snaplen),
+    .sample_rate = ntohl (mp->sample_rate),
+    .max_pps = clib_net_to_host_u64 (mp->max_pps),
+    .max_bps = clib_net_to_host_u64 (mp->max_bps),
+    .output_format = mp->output_format,
+    .use_recorder = mp->recorder,
+    .compression = mp->compress ? WIRESHARK_BRIDGE_COMPRESSION_LZ4 : WIRESHARK_BRIDGE_COMPRESSION_NONE,
+    .use_flows = mp->flows,
+    .sequence = mp->sequence,
+    .file_size = ntohl (mp->file_size_mb),
+    .file_duration = ntohl (mp->file_duration),
+    .max_files = ntohl (mp->file_count),
+  };
+  wireshark_bridge_bpf_insn_t *insn;
+  u32 i, n_insns = ntohs (mp->filter_len);
+  int rv;
+
+  /* The program has to be inside the message before any of it is read */
+  if (n_insns > WIRESHARK_BRIDGE_BPF_MAX_INSNS ||
+      sizeof (*mp) + n_insns * sizeof (mp->filter[0]) > vl_msg_api_get_msg_length (mp)) {
+    rv = VNET_API_ERROR_INVALID_ARGUMENT;
+    goto reply;
   }
-  
-  /* Only enable features if interface is not already enabled */
-  if (!wb_if->is_enabled) {
-    /* Enable feature nodes */
-    vnet_feature_enable_disable ("device-input", "wireshark-bridge-rx", sw_if_index, 1, 0, 0);
-    vnet_feature_enable_disable ("interface-output", "wireshark-bridge-tx", sw_if_index, 1, 0, 0);
-  }
-  
-  wb_if->is_enabled = 1;
 
-done:
-  if (bridge_address_copy) {
-    free(bridge_address_copy);
+  for (i = 0; i < n_insns; i++) {
+    vec_add2 (a.filter, insn, 1);
+    insn->code = ntohs (mp->filter[i].code);
+    insn->jt = mp->filter[i].jt;
+    insn->jf = mp->filter[i].jf;
+    insn->k = ntohl (mp->filter[i].k);
   }
 
+  if (!wireshark_bridge_api_string_valid (mp->bridge_address, sizeof (mp->bridge_address)))
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  else
+    rv = wireshark_bridge_enable (wbm, ntohl (mp->sw_if_index), (char *) mp->bridge_address, &a);
+  vec_free (a.filter);
+
+reply:
+
   /* Send reply */
   rmp = vl_msg_api_alloc (sizeof (*rmp));
   rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_ENABLE_REPLY);
   rmp->context = mp->context;
   rmp->retval = htonl(rv);
-  
+
   vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
 }
 
@@ -789,59 +3203,133 @@ vl_api_wireshark_bridge_disable_t_handler (vl_api_wireshark_bridge_disable_t * m
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
   vl_api_wireshark_bridge_disable_reply_t *rmp;
+  int rv;
+
+  if (!wireshark_bridge_api_string_valid (mp->bridge_address, sizeof (mp->bridge_address)))
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  else
+    rv = wireshark_bridge_disable (wbm, ntohl (mp->sw_if_index), (char *) mp->bridge_address);
+
+  /* Send reply */
+  rmp = vl_msg_api_alloc (sizeof (*rmp));
+  rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_DISABLE_REPLY);
+  rmp->context = mp->context;
+  rmp->retval = htonl (rv);
+
+  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
+}
+
+/**
+ * @brief Handler for wireshark_bridge_interface_set API call
+ */
+static void
+vl_api_wireshark_bridge_interface_set_t_handler (vl_api_wireshark_bridge_interface_set_t * mp)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vl_api_wireshark_bridge_interface_set_reply_t *rmp;
+  wireshark_bridge_interface_toggle_t *toggles = 0, *t;
+  wireshark_bridge_session_t *s;
+  u32 i, count = ntohl (mp->count), failed = ~0;
+  int rv;
+
+  /* count comes from the client, the toggles have to be in the message */
+  if (sizeof (*mp) + (u64) count * sizeof (mp->interfaces[0]) != vl_msg_api_get_msg_length (mp)) {
+    rv = VNET_API_ERROR_INVALID_VALUE;
+    goto reply;
+  }
+
+  for (i = 0; i < count; i++) {
+    vec_add2 (toggles, t, 1);
+    t->sw_if_index = ntohl (mp->interfaces[i].sw_if_index);
+    t->enable = mp->interfaces[i].enable;
+    t->direction_mask = mp->interfaces[i].direction_mask;
+  }
+
+  if (!wireshark_bridge_api_string_valid (mp->bridge_address, sizeof (mp->bridge_address)))
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  else if ((s = wireshark_bridge_find_session (wbm, (char *) mp->bridge_address)) == NULL)
+    rv = VNET_API_ERROR_NO_SUCH_ENTRY;
+  else
+    rv = wireshark_bridge_session_set_interfaces (wbm, s, toggles, &failed);
+  vec_free (toggles);
+
+reply:
+  /* Send reply */
+  rmp = vl_msg_api_alloc (sizeof (*rmp));
+  rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_INTERFACE_SET_REPLY);
+  rmp->context = mp->context;
+  rmp->retval = htonl (rv);
+  rmp->failed_index = htonl (failed);
+
+  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
+}
+
+/**
+ * @brief Handler for wireshark_bridge_snapshot API call
+ *
+ * The dump is left to the stats process, so the workers are not held at
+ * the barrier while the recorders are read and sent.
+ */
+static void
+vl_api_wireshark_bridge_snapshot_t_handler (vl_api_wireshark_bridge_snapshot_t * mp)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vl_api_wireshark_bridge_snapshot_reply_t *rmp;
+  wireshark_bridge_dump_request_t *r;
+  wireshark_bridge_session_t *s;
   int rv = 0;
-  u32 sw_if_index = ntohl (mp->sw_if_index);
-  
-  /* Disable interface */
-  u32 i;
-  wireshark_bridge_interface_t *wbi = NULL;
-  
-  for (i = 0; i < vec_len(wbm->interfaces); i++)
-    {
-      if (wbm->interfaces[i].sw_if_index == sw_if_index)
-        {
-          wbi = &wbm->interfaces[i];
-          break;
-        }
-    }
-  
-  if (wbi != NULL)
-    {
-      wbi->is_enabled = 0;
-    }
-  
-  /* Check if all interfaces are disabled */
-  u8 all_disabled = 1;
-  for (i = 0; i < vec_len(wbm->interfaces); i++)
-    {
-      if (wbm->interfaces[i].is_enabled)
-        {
-          all_disabled = 0;
-          break;
-        }
-    }
-  
-  /* Disconnect from bridge if all interfaces are disabled */
-  if (all_disabled && wbm->bridge_connected)
-    {
-      /* Stop sender thread */
-      if (wbm->sender_thread_running)
-        {
-          wireshark_bridge_queue.should_stop = 1;
-          pthread_join(wbm->sender_thread, NULL);
-          wbm->sender_thread_running = 0;
-        }
-      
-      close(wbm->bridge_socket);
-      wbm->bridge_connected = 0;
-    }
-  
+
+  mp->file[sizeof (mp->file) - 1] = 0;
+  if (!wireshark_bridge_api_string_valid (mp->bridge_address, sizeof (mp->bridge_address)))
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  else if ((s = wireshark_bridge_find_session (wbm, (char *) mp->bridge_address)) == NULL)
+    rv = VNET_API_ERROR_NO_SUCH_ENTRY;
+  else if (!s->use_recorder)
+    rv = VNET_API_ERROR_FEATURE_DISABLED;
+  else {
+    vec_add2 (wbm->dump_requests, r, 1);
+    r->bridge_address = format (0, "%s%c", mp->bridge_address, 0);
+    r->seconds = ntohl (mp->seconds);
+    r->file = mp->file[0] ? format (0, "%s%c", mp->file, 0) : 0;
+    vlib_process_signal_event (wbm->vlib_main, wireshark_bridge_stats_process_node.index,
+                               WIRESHARK_BRIDGE_EVENT_DUMP, 0);
+  }
+
+  /* Send reply */
+  rmp = vl_msg_api_alloc (sizeof (*rmp));
+  rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_SNAPSHOT_REPLY);
+  rmp->context = mp->context;
+  rmp->retval = htonl (rv);
+
+  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
+}
+
+/**
+ * @brief Handler for wireshark_bridge_set_trigger API call
+ */
+static void
+vl_api_wireshark_bridge_set_trigger_t_handler (vl_api_wireshark_bridge_set_trigger_t * mp)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vl_api_wireshark_bridge_set_trigger_reply_t *rmp;
+  wireshark_bridge_session_t *s;
+  int rv;
+
+  mp->file[sizeof (mp->file) - 1] = 0;
+  if (!wireshark_bridge_api_string_valid (mp->bridge_address, sizeof (mp->bridge_address)))
+    rv = VNET_API_ERROR_INVALID_VALUE;
+  else if ((s = wireshark_bridge_find_session (wbm, (char *) mp->bridge_address)) == NULL)
+    rv = VNET_API_ERROR_NO_SUCH_ENTRY;
+  else
+    rv = wireshark_bridge_recorder_set_trigger (s, mp->counter, clib_net_to_host_u64 (mp->threshold),
+                                                ntohl (mp->seconds), (char *) mp->file);
+
   /* Send reply */
   rmp = vl_msg_api_alloc (sizeof (*rmp));
-  rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_DISABLE_REPLY);
+  rmp->_vl_msg_id = ntohs(VL_API_WIRESHARK_BRIDGE_SET_TRIGGER_REPLY);
   rmp->context = mp->context;
   rmp->retval = htonl (rv);
-  
+
   vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
 }
 
@@ -910,387 +3398,823 @@ vl_api_wireshark_bridge_get_interfaces_t_handler (vl_api_wireshark_bridge_get_in
   vec_free (interfaces);
 }
 
+/**
+ * @brief Fill one API stats record for an interface of a session
+ */
+static void
+wireshark_bridge_fill_stats (vl_api_interface_stats_t *stats, wireshark_bridge_session_t *s,
+                             wireshark_bridge_interface_t *wbi)
+{
+  stats->session_index = htonl (s->session_index);
+  strncpy ((char *) stats->bridge_address, (char *) s->bridge_address,
+           sizeof (stats->bridge_address) - 1);
+  stats->bridge_address[sizeof (stats->bridge_address) - 1] = '\0';
+  stats->sw_if_index = htonl (wbi->sw_if_index);
+
+  wireshark_bridge_interface_sender_t sent;
+  wireshark_bridge_interface_sent_counters (wbi, &sent);
+  stats->packets_sent_rx = clib_host_to_net_u64 (sent.packets_sent_rx);
+  stats->bytes_sent_rx = clib_host_to_net_u64 (sent.bytes_sent_rx);
+  stats->packets_sent_tx = clib_host_to_net_u64 (sent.packets_sent_tx);
+  stats->bytes_sent_tx = clib_host_to_net_u64 (sent.bytes_sent_tx);
+
+  u64 sampled_out, policed;
+  wireshark_bridge_interface_limit_counters (wbi, &sampled_out, &policed);
+  stats->packets_sampled_out = clib_host_to_net_u64 (sampled_out);
+  stats->packets_policed = clib_host_to_net_u64 (policed);
+}
+
 static void
 vl_api_wireshark_bridge_get_stats_t_handler (vl_api_wireshark_bridge_get_stats_t * mp)
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
   vl_api_wireshark_bridge_get_stats_reply_t *rmp;
+  wireshark_bridge_session_t **sp;
+  wireshark_bridge_interface_t *wbi;
+  vl_api_interface_stats_t *stats = 0;
   int rv = 0;
   u32 sw_if_index = ntohl (mp->sw_if_index);
-  
-  /* Count interfaces */
-  u32 count = 0;
+  u32 count;
+
+  /* One record per session and interface, optionally for a single interface */
+  pool_foreach (sp, wbm->sessions)
+    {
+      wireshark_bridge_session_lock (sp[0]);
+      vec_foreach (wbi, sp[0]->interfaces)
+        {
+          if (sw_if_index != ~0 && wbi->sw_if_index != sw_if_index)
+            continue;
+
+          vl_api_interface_stats_t *st;
+          vec_add2 (stats, st, 1);
+          clib_memset (st, 0, sizeof (*st));
+          wireshark_bridge_fill_stats (st, sp[0], wbi);
+        }
+      wireshark_bridge_session_unlock (sp[0]);
+    }
+  count = vec_len (stats);
+
+  /* Allocate message with space for stats data */
+  u32 msg_size = sizeof (*rmp) + count * sizeof (vl_api_interface_stats_t);
+  rmp = vl_msg_api_alloc (msg_size);
+  rmp->_vl_msg_id = ntohs (VL_API_WIRESHARK_BRIDGE_GET_STATS_REPLY);
+  rmp->context = mp->context;
+  rmp->retval = htonl (rv);
+  rmp->count = htonl (count);
+
+  /* Copy stats data to the message */
+  if (count > 0) {
+    vl_api_interface_stats_t *rmp_stats = (vl_api_interface_stats_t *) (rmp + 1);
+    memcpy(rmp_stats, stats, count * sizeof(vl_api_interface_stats_t));
+  }
+
+  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
+
+  /* Free allocated memory */
+  vec_free (stats);
+}
+
+/**
+ * @brief Sum up the histograms of every sender thread of a session
+ */
+static void
+wireshark_bridge_session_histograms (wireshark_bridge_session_t *s,
+                                     wireshark_bridge_histogram_t *latency_ns,
+                                     wireshark_bridge_histogram_t *batch_packets,
+                                     wireshark_bridge_histogram_t *syscall_ns)
+{
+  wireshark_bridge_sender_t *sender;
+
+  clib_memset (latency_ns, 0, sizeof (*latency_ns));
+  clib_memset (batch_packets, 0, sizeof (*batch_packets));
+  clib_memset (syscall_ns, 0, sizeof (*syscall_ns));
+
+  vec_foreach (sender, s->senders)
+    {
+      wireshark_bridge_histogram_merge (latency_ns, &sender->latency_ns);
+      wireshark_bridge_histogram_merge (batch_packets, &sender->batch_packets);
+      wireshark_bridge_histogram_merge (syscall_ns, &sender->syscall_ns);
+    }
+}
+
+/**
+ * @brief Convert a histogram to its API representation
+ */
+static void
+wireshark_bridge_fill_histogram (vl_api_histogram_t *dst, wireshark_bridge_histogram_t *src)
+{
   u32 i;
-  
-  if (sw_if_index != ~0)
+
+  for (i = 0; i < WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS; i++)
+    dst->buckets[i] = clib_host_to_net_u64 (src->buckets[i]);
+  dst->count = clib_host_to_net_u64 (src->count);
+  dst->sum = clib_host_to_net_u64 (src->sum);
+  dst->max = clib_host_to_net_u64 (src->max);
+}
+
+static void
+vl_api_wireshark_bridge_get_latency_t_handler (vl_api_wireshark_bridge_get_latency_t * mp)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  vl_api_wireshark_bridge_get_latency_reply_t *rmp;
+  wireshark_bridge_histogram_t latency_ns, batch_packets, syscall_ns;
+  vl_api_session_latency_t *sessions = 0, *sl;
+  wireshark_bridge_session_t **sp;
+  int rv = 0;
+  u32 count;
+
+  pool_foreach (sp, wbm->sessions)
+    {
+      wireshark_bridge_session_histograms (sp[0], &latency_ns, &batch_packets, &syscall_ns);
+
+      vec_add2 (sessions, sl, 1);
+      clib_memset (sl, 0, sizeof (*sl));
+      sl->session_index = htonl (sp[0]->session_index);
+      strncpy ((char *) sl->bridge_address, (char *) sp[0]->bridge_address,
+               sizeof (sl->bridge_address) - 1);
+      wireshark_bridge_fill_histogram (&sl->latency_ns, &latency_ns);
+      wireshark_bridge_fill_histogram (&sl->batch_packets, &batch_packets);
+      wireshark_bridge_fill_histogram (&sl->syscall_ns, &syscall_ns);
+    }
+  count = vec_len (sessions);
+
+  rmp = vl_msg_api_alloc (sizeof (*rmp) + count * sizeof (vl_api_session_latency_t));
+  rmp->_vl_msg_id = ntohs (VL_API_WIRESHARK_BRIDGE_GET_LATENCY_REPLY);
+  rmp->context = mp->context;
+  rmp->retval = htonl (rv);
+  rmp->count = htonl (count);
+
+  if (count > 0)
+    memcpy ((vl_api_session_latency_t *) (rmp + 1), sessions, count * sizeof (vl_api_session_latency_t));
+
+  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
+
+  vec_free (sessions);
+}
+
+/* CLI command functions */
+
+/**
+ * @brief Turn an enable/disable return value into a CLI error
+ */
+static clib_error_t *
+wireshark_bridge_cli_error (int rv)
+{
+  switch (rv)
+    {
+    case 0:
+      return 0;
+    case VNET_API_ERROR_INVALID_SW_IF_INDEX:
+      return clib_error_return (0, "Invalid interface");
+    case VNET_API_ERROR_INVALID_VALUE:
+      return clib_error_return (0, "Invalid bridge address, expected IP:PORT, tcp://IP:PORT, /path/to/unix/socket, shm:/path/to/unix/socket or file:/path/to/capture");
+    case VNET_API_ERROR_INVALID_ARGUMENT:
+      return clib_error_return (0, "Filter program rejected by the validator");
+    case VNET_API_ERROR_UNSUPPORTED:
+      return clib_error_return (0, "Options not supported with this destination");
+    case VNET_API_ERROR_UNIMPLEMENTED:
+      return clib_error_return (0, "Compression needs the plugin built with -DWIRESHARK_BRIDGE_LZ4=ON");
+    case VNET_API_ERROR_SYSCALL_ERROR_1:
+      return clib_error_return (0, "Failed to create socket: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_2:
+      return clib_error_return (0, "Failed to create shared memory ring: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_3:
+      return clib_error_return (0, "Failed to create sender thread: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_4:
+      return clib_error_return (0, "Failed to map capture rings, slots, recorder or flow table: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_5:
+      return clib_error_return (0, "Failed to write dump file: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_6:
+      return clib_error_return (0, "Failed to open capture file: %s", strerror (errno));
+    case VNET_API_ERROR_SYSCALL_ERROR_7:
+      return clib_error_return (0, "Dump stopped, the TCP receiver did not keep up");
+    case VNET_API_ERROR_INVALID_VALUE_2:
+      return clib_error_return (0, "Invalid trigger counter");
+    case VNET_API_ERROR_INVALID_VALUE_3:
+      return clib_error_return (0, "flows cannot be combined with pcapng or recorder");
+    case VNET_API_ERROR_FEATURE_DISABLED:
+      return clib_error_return (0, "Session is not a flight recorder, enable it with `recorder'");
+    case VNET_API_ERROR_NO_SUCH_ENTRY:
+      return clib_error_return (0, "Interface not found in bridge");
+    default:
+      return clib_error_return (0, "Wireshark bridge error %d", rv);
+    }
+}
+
+/**
+ * @brief CLI command to enable the Wireshark bridge for an interface
+ */
+static clib_error_t *
+wireshark_bridge_enable_command_fn (vlib_main_t * vm,
+                                   unformat_input_t * input,
+                                   vlib_cli_command_t * cmd)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  u32 sw_if_index = ~0;
+  u8 *bridge_address = 0;
+  wireshark_bridge_enable_args_t a = { 0 };
+  clib_error_t *error = 0;
+  const char *conflict;
+  u8 point;
+  int rv;
+
+  /* Parse arguments */
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
-      /* Single interface */
-      for (i = 0; i < vec_len(wbm->interfaces); i++)
+      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+        ;
+      else if (unformat (input, "pool-buffers"))
+        a.use_pool_buffers = 1;
+      else if (unformat (input, "pcapng"))
+        a.output_format = WIRESHARK_BRIDGE_FORMAT_PCAPNG;
+      else if (unformat (input, "recorder"))
+        a.use_recorder = 1;
+      else if (unformat (input, "compress"))
+        a.compression = WIRESHARK_BRIDGE_COMPRESSION_LZ4;
+      else if (unformat (input, "flows"))
+        a.use_flows = 1;
+      else if (unformat (input, "sequence"))
+        a.sequence = 1;
+      else if (unformat (input, "snaplen %u", &a.snaplen))
+        ;
+      else if (unformat (input, "sample %u", &a.sample_rate))
+        ;
+      else if (unformat (input, "max-pps %llu", &a.max_pps))
+        ;
+      else if (unformat (input, "max-bps %llu", &a.max_bps))
+        ;
+      else if (unformat (input, "file-size %u", &a.file_size))
+        ;
+      else if (unformat (input, "file-duration %u", &a.file_duration))
+        ;
+      else if (unformat (input, "files %u", &a.max_files))
+        ;
+      else if (unformat (input, "%U", unformat_wireshark_bridge_capture_point, &point))
+        a.direction_mask |= point;
+      else if (!a.filter &&
+               (unformat (input, "filter \"%U\"", unformat_wireshark_bridge_bpf_program, &a.filter) ||
+                unformat (input, "filter %U", unformat_wireshark_bridge_bpf_program, &a.filter)))
+        ;
+      else if (unformat (input, "filter"))
         {
-          if (wbm->interfaces[i].sw_if_index == sw_if_index)
-            {
-              count = 1;
-              break;
-            }
+          error = clib_error_return (0, "Invalid filter, expected `tcpdump -ddd` output joined with commas");
+          goto done;
+        }
+      else if (unformat (input, "%s", &bridge_address))
+        ;
+      else
+        {
+          error = clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+          goto done;
         }
     }
+
+  if (sw_if_index == ~0) {
+    error = clib_error_return (0, "Interface not specified");
+    goto done;
+  }
+
+  if (!bridge_address) {
+    error = clib_error_return (0, "Bridge address not specified");
+    goto done;
+  }
+
+  /* Name the conflicting options rather than every combination refused */
+  rv = wireshark_bridge_enable (wbm, sw_if_index, (char *) bridge_address, &a);
+  conflict = wireshark_bridge_enable_conflict ((char *) bridge_address, &a);
+  if (rv == VNET_API_ERROR_UNSUPPORTED && conflict)
+    error = clib_error_return (0, "%s", conflict);
   else
+    error = wireshark_bridge_cli_error (rv);
+
+  if (!error)
+    vlib_cli_output (vm, "Wireshark bridge enabled for interface %U to %s",
+                     format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index,
+                     bridge_address);
+
+done:
+  vec_free (a.filter);
+  vec_free (bridge_address);
+  return error;
+}
+
+/**
+ * @brief CLI command to disable the Wireshark bridge for an interface
+ */
+static clib_error_t *
+wireshark_bridge_disable_command_fn (vlib_main_t * vm,
+                                    unformat_input_t * input,
+                                    vlib_cli_command_t * cmd)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  u32 sw_if_index = ~0;
+  u8 *bridge_address = 0;
+  clib_error_t *error;
+
+  /* Parse arguments */
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+        ;
+      else if (unformat (input, "%s", &bridge_address))
+        ;
+      else
+        return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+    }
+
+  error = wireshark_bridge_cli_error (
+    wireshark_bridge_disable (wbm, sw_if_index, (char *) bridge_address));
+
+  if (!error)
     {
-      /* All interfaces */
-      count = vec_len(wbm->interfaces);
+      if (sw_if_index == ~0)
+        vlib_cli_output (vm, "Wireshark bridge disabled for all interfaces");
+      else
+        vlib_cli_output (vm, "Wireshark bridge disabled for interface %U",
+                         format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index);
     }
-  
-  /* Allocate space for stats */
-  vl_api_interface_stats_t *stats = 0;
-  vec_validate (stats, count - 1);
-  
-  /* Fill statistics */
-  if (sw_if_index != ~0)
+
+  vec_free (bridge_address);
+  return error;
+}
+
+/**
+ * @brief CLI command to enable and disable many interfaces of a session
+ *
+ * "enable", "disable" and the capture point keywords apply to the
+ * interfaces that follow them, consecutive capture points add up.
+ */
+static clib_error_t *
+wireshark_bridge_interfaces_command_fn (vlib_main_t * vm,
+                                       unformat_input_t * input,
+                                       vlib_cli_command_t * cmd)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  wireshark_bridge_interface_toggle_t *toggles = 0, *t;
+  wireshark_bridge_session_t *s;
+  u8 *bridge_address = 0;
+  u8 enable = 1, direction_mask = 0, point, new_points = 1;
+  clib_error_t *error = 0;
+  u32 sw_if_index, failed = ~0;
+  int rv;
+
+  /* Parse arguments */
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "enable"))
+        enable = 1;
+      else if (unformat (input, "disable"))
+        enable = 0;
+      else if (unformat (input, "%U", unformat_wireshark_bridge_capture_point, &point))
+        {
+          direction_mask = (new_points ? 0 : direction_mask) | point;
+          new_points = 0;
+        }
+      else if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+        {
+          vec_add2 (toggles, t, 1);
+          t->sw_if_index = sw_if_index;
+          t->enable = enable;
+          t->direction_mask = direction_mask;
+          new_points = 1;
+        }
+      else if (bridge_address == 0 && unformat (input, "%s", &bridge_address))
+        ;
+      else
+        {
+          error = clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+          goto done;
+        }
+    }
+
+  if (bridge_address == 0 || vec_len (toggles) == 0)
+    {
+      error = clib_error_return (0, "Please specify a bridge address and interfaces");
+      goto done;
+    }
+
+  s = wireshark_bridge_find_session (wbm, (char *) bridge_address);
+  if (s == NULL)
+    {
+      error = clib_error_return (0, "No session for %s, enable one interface first", bridge_address);
+      goto done;
+    }
+
+  rv = wireshark_bridge_session_set_interfaces (wbm, s, toggles, &failed);
+  if (rv)
+    {
+      vlib_cli_output (vm, "Nothing changed, entry %u was rejected", failed + 1);
+      error = wireshark_bridge_cli_error (rv);
+    }
+  else
+    vlib_cli_output (vm, "Updated %u interfaces of %s", vec_len (toggles), bridge_address);
+
+done:
+  vec_free (toggles);
+  vec_free (bridge_address);
+  return error;
+}
+
+/**
+ * @brief CLI command to show Wireshark bridge statistics
+ */
+static clib_error_t *
+wireshark_bridge_stats_command_fn (vlib_main_t * vm,
+                                  unformat_input_t * input,
+                                  vlib_cli_command_t * cmd)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  wireshark_bridge_session_t **sp, *s;
+  wireshark_bridge_interface_t *wbi;
+  wireshark_bridge_interface_sender_t sent;
+  wireshark_bridge_sender_t *sender;
+  u64 sampled_out, policed;
+  u32 sw_if_index = ~0;
+  int show_one = 0;
+  u32 i;
+
+  /* Parse arguments */
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+        show_one = 1;
+      else
+        return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+    }
+
+  if (pool_elts (wbm->sessions) == 0)
     {
-      /* Single interface */
-      for (i = 0; i < vec_len(wbm->interfaces); i++)
+      vlib_cli_output (vm, "No capture sessions");
+      return 0;
+    }
+
+  pool_foreach (sp, wbm->sessions)
+    {
+      s = sp[0];
+
+      /* With an interface given, only show the sessions capturing it */
+      if (show_one && wireshark_bridge_find_interface (s, sw_if_index) == NULL)
+        continue;
+
+      vlib_cli_output (vm, "%U", format_wireshark_bridge_session, s);
+
+      /* Print header */
+      vlib_cli_output (vm, "%-25s %-10s %-15s %-15s %-15s %-15s %-15s %-15s",
+                      "Interface", "Enabled", "RX Packets", "RX Bytes", "TX Packets", "TX Bytes",
+                      "Sampled Out", "Policed");
+      vlib_cli_output (vm, "---------------------------------------------------------------------------------------------------------------------------");
+
+      wireshark_bridge_session_lock (s);
+      vec_foreach (wbi, s->interfaces)
+        {
+          if (show_one && wbi->sw_if_index != sw_if_index)
+            continue;
+
+          wireshark_bridge_interface_limit_counters (wbi, &sampled_out, &policed);
+          wireshark_bridge_interface_sent_counters (wbi, &sent);
+          vlib_cli_output (vm, "%-25U %-10s %-15llu %-15llu %-15llu %-15llu %-15llu %-15llu",
+                          format_vnet_sw_if_index_name, wbm->vnet_main, wbi->sw_if_index,
+                          wbi->is_enabled ? "Yes" : "No",
+                          sent.packets_sent_rx,
+                          sent.bytes_sent_rx,
+                          sent.packets_sent_tx,
+                          sent.bytes_sent_tx,
+                          sampled_out,
+                          policed);
+          if (wbi->sample_rate > 1 || wbi->max_pps || wbi->max_bps)
+            vlib_cli_output (vm, "  sample 1/%u, max-pps %llu, max-bps %llu",
+                             clib_max (wbi->sample_rate, 1), wbi->max_pps, wbi->max_bps);
+        }
+      wireshark_bridge_session_unlock (s);
+
+      /* Per-worker ring drops are per session, show them only in the full listing */
+      if (!show_one)
         {
-          if (wbm->interfaces[i].sw_if_index == sw_if_index)
+          vlib_cli_output (vm, "");
+          vlib_cli_output (vm, "%-10s %-6s %-8s %-15s %-15s %-15s", "Thread", "NUMA", "Sender",
+                           "Ring Drops", "Filtered", "Backpressure");
+          for (i = 0; i < vec_len (s->queue.rings); i++)
+            vlib_cli_output (vm, "%-10u %-6u %-8u %-15llu %-15llu %-15llu", i,
+                             s->queue.rings[i].numa_node, s->queue.rings[i].sender_index,
+                             s->queue.rings[i].ring_full_drops,
+                             s->queue.rings[i].filter_rejects,
+                             s->queue.rings[i].backpressure_drops);
+
+          vlib_cli_output (vm, "");
+          if (s->use_shm)
+            vlib_cli_output (vm, "Shared ring: %U, %llu bytes written, %llu bytes read, full drops: %llu",
+                             format_memory_size, s->shm.data_size,
+                             s->shm.header->write_pos, s->shm.header->read_pos,
+                             s->shm.header->dropped);
+          else
             {
-              stats[0].sw_if_index = htonl (wbm->interfaces[i].sw_if_index);
-              stats[0].packets_sent_rx = clib_host_to_net_u64 (wbm->interfaces[i].packets_sent_rx);
-              stats[0].bytes_sent_rx = clib_host_to_net_u64 (wbm->interfaces[i].bytes_sent_rx);
-              stats[0].packets_sent_tx = clib_host_to_net_u64 (wbm->interfaces[i].packets_sent_tx);
-              stats[0].bytes_sent_tx = clib_host_to_net_u64 (wbm->interfaces[i].bytes_sent_tx);
-              break;
+              /* The sender thread changes the stream state under its mutex */
+              if (s->use_file)
+                {
+                  wireshark_bridge_session_lock (s);
+                  vlib_cli_output (vm, "File: %s, files: %llu (%u kept), bytes written: %llu, write errors: %llu, %s",
+                                   wireshark_bridge_file_current (&s->file) ?
+                                   (char *) wireshark_bridge_file_current (&s->file) : "none",
+                                   s->file.files_written, vec_len (s->file.files),
+                                   s->file.bytes_written, s->file.write_errors,
+#ifdef WIRESHARK_BRIDGE_IO_URING
+                                   s->file.ring_ready ? "io_uring" :
+#endif
+                                   s->file.direct ? "pwrite, O_DIRECT" : "pwrite");
+                  if (s->file.failures)
+                    vlib_cli_output (vm, "  File failures: %llu, last: %s%s", s->file.failures,
+                                     strerror (s->file.last_errno),
+                                     s->file.fd < 0 ? ", waiting to open the next file" : "");
+                  wireshark_bridge_session_unlock (s);
+                }
+
+              if (s->use_stream)
+                {
+                  wireshark_bridge_session_lock (s);
+                  vlib_cli_output (vm, "TCP stream: %s, connects: %llu, disconnects: %llu, backlog: %u bytes",
+                                   s->stream.state == WIRESHARK_BRIDGE_STREAM_CONNECTED ? "connected" :
+                                   s->stream.state == WIRESHARK_BRIDGE_STREAM_CONNECTING ? "connecting" :
+                                   "disconnected",
+                                   s->stream.connects, s->stream.disconnects,
+                                   vec_len (s->stream.backlog) - s->stream.backlog_offset);
+                  wireshark_bridge_session_unlock (s);
+                }
+
+              vec_foreach (sender, s->senders)
+                {
+                  u8 *cpu = sender->cpu >= 0 ? format (0, "cpu %d", sender->cpu) : format (0, "unpinned");
+
+                  if (sender->numa_node == ~0)
+                    cpu = format (cpu, ", numa ?");
+                  else
+                    cpu = format (cpu, ", numa %u", sender->numa_node);
+
+                  vlib_cli_output (vm, "Sender %u (%v): datagrams sent: %llu, %s calls: %llu, backpressure drops: %llu, batches: %llu, wakeups: %llu",
+                                   sender->sender_index, cpu, sender->tx.datagrams_sent,
+                                   s->use_stream ? "sendmsg" : s->use_file ? "write" : "sendmmsg",
+                                   sender->tx.syscalls, sender->tx.backpressure_drops,
+                                   sender->batches, sender->wakeups);
+                  vec_free (cpu);
+                }
+
+              /* Fan-out groups, the counters of all sender threads summed up */
+              for (i = 0; s->n_destinations > 1 && i < s->n_destinations; i++)
+                {
+                  wireshark_bridge_destination_t *d = &s->destinations[i];
+                  u64 sent = 0, drops = 0, errors = 0;
+
+                  vec_foreach (sender, s->senders)
+                    {
+                      sent += sender->tx.destination_sent[i];
+                      drops += sender->tx.destination_drops[i];
+                      errors += sender->tx.destination_errors[i];
+                    }
+                  vlib_cli_output (vm, "Destination %U:%u (%s): datagrams sent: %llu, backpressure drops: %llu, errors: %llu",
+                                   format_ip4_address, &d->addr.sin_addr, ntohs (d->addr.sin_port),
+                                   clib_atomic_load_relax_n (&d->down) ? "down" : "up", sent, drops, errors);
+                }
             }
         }
+
+      vlib_cli_output (vm, "");
     }
-  else
+
+  return 0;
+}
+
+/**
+ * @brief Format a value of a histogram, a duration if the histogram is in ns
+ */
+static u8 *
+format_wireshark_bridge_histogram_value (u8 * s, va_list * args)
+{
+  u64 value = va_arg (*args, u64);
+  int is_ns = va_arg (*args, int);
+
+  if (!is_ns || value < 1000)
+    return format (s, is_ns ? "%lluns" : "%llu", value);
+  if (value < 1000000)
+    return format (s, "%.1fus", value / 1e3);
+  if (value < 1000000000)
+    return format (s, "%.1fms", value / 1e6);
+  return format (s, "%.2fs", value / 1e9);
+}
+
+/**
+ * @brief Format a histogram: a summary line and a line per non-empty bucket
+ */
+static u8 *
+format_wireshark_bridge_histogram (u8 * s, va_list * args)
+{
+  wireshark_bridge_histogram_t *h = va_arg (*args, wireshark_bridge_histogram_t *);
+  char *name = va_arg (*args, char *);
+  int is_ns = va_arg (*args, int);
+  u32 i;
+
+  s = format (s, "  %s: %llu samples", name, h->count);
+  if (h->count == 0)
+    return s;
+
+  s = format (s, ", avg %U, p50 %U, p99 %U, max %U",
+              format_wireshark_bridge_histogram_value, h->sum / h->count, is_ns,
+              format_wireshark_bridge_histogram_value, wireshark_bridge_histogram_percentile (h, 50), is_ns,
+              format_wireshark_bridge_histogram_value, wireshark_bridge_histogram_percentile (h, 99), is_ns,
+              format_wireshark_bridge_histogram_value, h->max, is_ns);
+
+  for (i = 0; i < WIRESHARK_BRIDGE_HISTOGRAM_BUCKETS; i++)
     {
-      /* All interfaces */
-      for (i = 0; i < vec_len(wbm->interfaces); i++)
-        {
-          stats[i].sw_if_index = htonl (wbm->interfaces[i].sw_if_index);
-          stats[i].packets_sent_rx = clib_host_to_net_u64 (wbm->interfaces[i].packets_sent_rx);
-          stats[i].bytes_sent_rx = clib_host_to_net_u64 (wbm->interfaces[i].bytes_sent_rx);
-          stats[i].packets_sent_tx = clib_host_to_net_u64 (wbm->interfaces[i].packets_sent_tx);
-          stats[i].bytes_sent_tx = clib_host_to_net_u64 (wbm->interfaces[i].bytes_sent_tx);
-        }
+      if (h->buckets[i] == 0)
+        continue;
+
+      u8 *range = format (0, "[%U, %U)",
+                          format_wireshark_bridge_histogram_value, i ? 1ULL << i : 0ULL, is_ns,
+                          format_wireshark_bridge_histogram_value, 2ULL << i, is_ns);
+      s = format (s, "\n    %-24v %llu", range, h->buckets[i]);
+      vec_free (range);
     }
-  
-  /* Allocate message with space for stats data */
-  u32 msg_size = sizeof (*rmp) + count * sizeof (vl_api_interface_stats_t);
-  rmp = vl_msg_api_alloc (msg_size);
-  rmp->_vl_msg_id = ntohs (VL_API_WIRESHARK_BRIDGE_GET_STATS_REPLY);
-  rmp->context = mp->context;
-  rmp->retval = htonl (rv);
-  rmp->count = htonl (count);
-  
-  /* Copy stats data to the message */
-  if (count > 0) {
-    vl_api_interface_stats_t *rmp_stats = (vl_api_interface_stats_t *) (rmp + 1);
-    memcpy(rmp_stats, stats, count * sizeof(vl_api_interface_stats_t));
-  }
-  
-  vl_api_send_msg (vl_api_get_main(), (u8 *) rmp);
-  
-  /* Free allocated memory */
-  vec_free (stats);
-}
 
-/* CLI command functions */
+  return s;
+}
 
 /**
- * @brief CLI command to enable the Wireshark bridge for an interface
+ * @brief CLI command to dump the flight recorder of a session
+ *
+ * Marked mp-safe, the workers go on recording while the dump reads their
+ * recorders. Sessions only change on the main thread, and the dump runs
+ * to completion without suspending; reconnecting a failed socket takes
+ * the barrier itself.
  */
 static clib_error_t *
-wireshark_bridge_enable_command_fn (vlib_main_t * vm,
-                                   unformat_input_t * input,
-                                   vlib_cli_command_t * cmd)
+wireshark_bridge_dump_command_fn (vlib_main_t * vm,
+                                 unformat_input_t * input,
+                                 vlib_cli_command_t * cmd)
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  u32 sw_if_index = ~0;
-  char *bridge_address = 0;
-  char *bridge_address_copy = 0;  // Create a copy for safe manipulation
+  wireshark_bridge_session_t *s;
+  u8 *bridge_address = 0, *file = 0;
+  u32 seconds = 0;
+  u64 n_packets;
+  clib_error_t *error = 0;
 
   /* Parse arguments */
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
-      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+      if (unformat (input, "seconds %u", &seconds))
         ;
-      else if (unformat (input, "%s", &bridge_address))
+      else if (unformat (input, "file %s", &file))
+        ;
+      else if (bridge_address == 0 && unformat (input, "%s", &bridge_address))
         ;
       else
-        return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+        {
+          error = clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+          goto done;
+        }
     }
 
-  if (sw_if_index == ~0)
-    return clib_error_return (0, "Interface not specified");
-
-  if (!bridge_address)
-    return clib_error_return (0, "Bridge address not specified");
-
-  // Create a copy of the bridge address to safely manipulate
-  bridge_address_copy = strdup(bridge_address);
-  if (!bridge_address_copy)
-    return clib_error_return (0, "Memory allocation failed");
-
-  /* Check if this is a Unix socket path (starts with /) */
-  if (bridge_address[0] == '/') {
-    /* Unix socket path */
-    wbm->use_unix_socket = 1;
-    
-    /* Copy socket path, ensuring it's not too long */
-    if (strlen(bridge_address) >= sizeof(wbm->socket_path)) {
-      free(bridge_address_copy);
-      return clib_error_return (0, "Unix socket path too long");
-    }
-    
-    strncpy(wbm->socket_path, bridge_address, sizeof(wbm->socket_path) - 1);
-    wbm->socket_path[sizeof(wbm->socket_path) - 1] = '\0';
-    
-    /* Connect to bridge if not already connected */
-    if (wbm->bridge_socket > 0) {
-      close (wbm->bridge_socket);
-    }
-    
-    wbm->bridge_socket = socket (AF_UNIX, SOCK_DGRAM, 0);
-    if (wbm->bridge_socket < 0) {
-      free(bridge_address_copy);
-      return clib_error_return (0, "Failed to create socket: %s", strerror (errno));
-    }
-    
-    memset (&wbm->bridge_addr.unix_addr, 0, sizeof (wbm->bridge_addr.unix_addr));
-    wbm->bridge_addr.unix_addr.sun_family = AF_UNIX;
-    strncpy (wbm->bridge_addr.unix_addr.sun_path, wbm->socket_path, 
-             sizeof(wbm->bridge_addr.unix_addr.sun_path) - 1);
-    
-    // For UDP, we don't need to connect, just store the address for sending
-    wbm->bridge_connected = 1;
-    
-    /* Start sender thread if not already running */
-    if (!wbm->sender_thread_running) {
-      pthread_mutex_lock (&wbm->sender_mutex);
-      wireshark_bridge_queue.packets = 0; /* Initialize empty vector */
-      wireshark_bridge_queue.should_stop = 0;
-      wireshark_bridge_queue.queue_overflows = 0;
-      pthread_mutex_unlock (&wbm->sender_mutex);
-      
-      if (pthread_create (&wbm->sender_thread, NULL, wireshark_bridge_sender_thread_fn, NULL) != 0) {
-        close (wbm->bridge_socket);
-        wbm->bridge_connected = 0;
-        free(bridge_address_copy);
-        return clib_error_return (0, "Failed to create sender thread: %s", strerror (errno));
-      }
-      
-      wbm->sender_thread_running = 1;
-    }
-  } else {
-    /* Traditional IP:port address */
-    wbm->use_unix_socket = 0;
-    
-    /* Parse bridge address - use the copy for manipulation */
-    char *colon = strchr (bridge_address_copy, ':');
-    if (colon == NULL) {
-      free(bridge_address_copy);
-      return clib_error_return (0, "Invalid bridge address format, expected IP:PORT");
-    }
-    
-    *colon = '\0';  // Safely modify our copy
-    char *ip_address = bridge_address_copy;
-    int port = atoi (colon + 1);
-    
-    if (port <= 0 || port > 65535) {
-      free(bridge_address_copy);
-      return clib_error_return (0, "Invalid port number");
-    }
-    
-    /* Connect to bridge if not already connected */
-    // Close any existing socket
-    if (wbm->bridge_socket > 0) {
-      close (wbm->bridge_socket);
-    }
-    
-    wbm->bridge_socket = socket (AF_INET, SOCK_DGRAM, 0);
-    if (wbm->bridge_socket < 0) {
-      free(bridge_address_copy);
-      return clib_error_return (0, "Failed to create socket: %s", strerror (errno));
-    }
-    
-    /* Set socket options */
-    int optval = 1;
-    if (setsockopt (wbm->bridge_socket, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval)) < 0) {
-      clib_warning ("Failed to set SO_KEEPALIVE: %s", strerror (errno));
-    }
-    
-    // For UDP, we don't need to connect, just store the address for sending
-    wbm->bridge_connected = 1;
-    wbm->use_unix_socket = 0;
-    
-    /* Set socket address */
-    memset (&wbm->bridge_addr.inet_addr, 0, sizeof (wbm->bridge_addr.inet_addr));
-    wbm->bridge_addr.inet_addr.sin_family = AF_INET;
-    wbm->bridge_addr.inet_addr.sin_port = htons (port);
-    
-    if (inet_pton (AF_INET, ip_address, &wbm->bridge_addr.inet_addr.sin_addr) <= 0) {
-      close (wbm->bridge_socket);
-      wbm->bridge_connected = 0;
-      free(bridge_address_copy);
-      return clib_error_return (0, "Invalid IP address");
-    }
+  if (!bridge_address) {
+    error = clib_error_return (0, "Bridge address not specified");
+    goto done;
   }
 
-  /* Start sender thread if not already running */
-  if (!wbm->sender_thread_running) {
-    pthread_mutex_lock (&wbm->sender_mutex);
-    wireshark_bridge_queue.packets = 0; /* Initialize empty vector */
-    wireshark_bridge_queue.should_stop = 0;
-    wireshark_bridge_queue.queue_overflows = 0;
-    pthread_mutex_unlock (&wbm->sender_mutex);
-    
-    if (pthread_create (&wbm->sender_thread, NULL, wireshark_bridge_sender_thread_fn, NULL) != 0) {
-      close (wbm->bridge_socket);
-      wbm->bridge_connected = 0;
-      free(bridge_address_copy);
-      return clib_error_return (0, "Failed to create sender thread: %s", strerror (errno));
-    }
-    
-    wbm->sender_thread_running = 1;
+  s = wireshark_bridge_find_session (wbm, (char *) bridge_address);
+  if (s == NULL) {
+    error = clib_error_return (0, "No capture session for %s", bridge_address);
+    goto done;
   }
 
-  /* Free our copy now that we're done with it */
-  free(bridge_address_copy);
+  error = wireshark_bridge_cli_error (
+    wireshark_bridge_recorder_dump (wbm, s, seconds, (char *) file, &n_packets));
 
-  /* Enable packet capture on the interface */
-  wireshark_bridge_interface_t *wb_if = wireshark_bridge_find_interface (wbm, sw_if_index);
-  if (wb_if == NULL) {
-    wb_if = wireshark_bridge_add_interface (wbm, sw_if_index);
-    if (wb_if == NULL) {
-      return clib_error_return (0, "Failed to add interface");
-    }
-  }
-  
-  /* Only enable features if interface is not already enabled */
-  if (!wb_if->is_enabled) {
-    /* Enable feature nodes */
-    vnet_feature_enable_disable ("device-input", "wireshark-bridge-rx", sw_if_index, 1, 0, 0);
-    vnet_feature_enable_disable ("interface-output", "wireshark-bridge-tx", sw_if_index, 1, 0, 0);
-  }
-  
-  wb_if->is_enabled = 1;
+  if (!error)
+    vlib_cli_output (vm, "Dumped %llu packets of the last %u seconds to %s", n_packets,
+                     seconds ? seconds : WIRESHARK_BRIDGE_RECORDER_DEFAULT_SECONDS,
+                     file ? file : bridge_address);
 
-  return clib_error_return (0, "Wireshark bridge enabled for interface %U",
-                           format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index);
+done:
+  vec_free (bridge_address);
+  vec_free (file);
+  return error;
 }
 
 /**
- * @brief CLI command to disable the Wireshark bridge for an interface
+ * @brief CLI command to set or clear the dump trigger of a session
  */
 static clib_error_t *
-wireshark_bridge_disable_command_fn (vlib_main_t * vm,
+wireshark_bridge_trigger_command_fn (vlib_main_t * vm,
                                     unformat_input_t * input,
                                     vlib_cli_command_t * cmd)
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  u32 sw_if_index = ~0;
-  int found = 0;
-  u32 i;
+  wireshark_bridge_session_t *s;
+  u8 *bridge_address = 0, *file = 0;
+  u32 counter = ~0, seconds = 0;
+  u64 threshold = 0;
+  clib_error_t *error = 0;
 
   /* Parse arguments */
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
-      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
+      if (unformat (input, "seconds %u", &seconds))
+        ;
+      else if (unformat (input, "file %s", &file))
+        ;
+      else if (unformat (input, "off"))
+        {
+          counter = 0;
+          threshold = 0;
+        }
+#define _(sym, name)                                                    \
+      else if (unformat (input, name " %llu", &threshold))              \
+        counter = WIRESHARK_BRIDGE_TRIGGER_##sym;
+      foreach_wireshark_bridge_trigger_counter
+#undef _
+      else if (bridge_address == 0 && unformat (input, "%s", &bridge_address))
         ;
       else
-        return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
-    }
-
-  if (sw_if_index == ~0)
-    return clib_error_return (0, "Interface not specified");
-
-  /* Find interface in the vector */
-  pthread_mutex_lock (&wbm->sender_mutex);
-  for (i = 0; i < vec_len (wbm->interfaces); i++)
-    {
-      if (wbm->interfaces[i].sw_if_index == sw_if_index)
         {
-          found = 1;
-          wbm->interfaces[i].is_enabled = 0;
-          break;
+          error = clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+          goto done;
         }
     }
-  pthread_mutex_unlock (&wbm->sender_mutex);
 
-  if (!found)
-    return clib_error_return (0, "Interface not found in bridge");
+  if (!bridge_address) {
+    error = clib_error_return (0, "Bridge address not specified");
+    goto done;
+  }
+
+  if (counter == ~0) {
+    error = clib_error_return (0, "Specify a counter and its threshold, or off");
+    goto done;
+  }
+
+  s = wireshark_bridge_find_session (wbm, (char *) bridge_address);
+  if (s == NULL) {
+    error = clib_error_return (0, "No capture session for %s", bridge_address);
+    goto done;
+  }
 
-  /* Disable feature nodes */
-  vnet_feature_enable_disable ("device-input", "wireshark-bridge-rx", sw_if_index, 0, 0, 0);
-  vnet_feature_enable_disable ("interface-output", "wireshark-bridge-tx", sw_if_index, 0, 0, 0);
+  error = wireshark_bridge_cli_error (
+    wireshark_bridge_recorder_set_trigger (s, counter, threshold, seconds, (char *) file));
 
-  vlib_cli_output (vm, "Wireshark bridge disabled for interface %U",
-                  format_vnet_sw_if_index_name, wbm->vnet_main, sw_if_index);
+  if (!error && threshold)
+    vlib_cli_output (vm, "%s dumps the last %u seconds to %s once %s grows by %llu in %.0f seconds",
+                     bridge_address, seconds ? seconds : WIRESHARK_BRIDGE_RECORDER_DEFAULT_SECONDS,
+                     file ? file : bridge_address, wireshark_bridge_trigger_names[counter],
+                     threshold, WIRESHARK_BRIDGE_STATS_INTERVAL);
+  else if (!error)
+    vlib_cli_output (vm, "Trigger of %s cleared", bridge_address);
 
-  return 0;
+done:
+  vec_free (bridge_address);
+  vec_free (file);
+  return error;
 }
 
 /**
- * @brief CLI command to show Wireshark bridge statistics
+ * @brief CLI command to show the pipeline histograms of the sessions
  */
 static clib_error_t *
-wireshark_bridge_stats_command_fn (vlib_main_t * vm,
-                                  unformat_input_t * input,
-                                  vlib_cli_command_t * cmd)
+wireshark_bridge_show_latency_command_fn (vlib_main_t * vm,
+                                          unformat_input_t * input,
+                                          vlib_cli_command_t * cmd)
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  u32 sw_if_index = ~0;
-  int show_one = 0;
-  u32 i;
+  wireshark_bridge_histogram_t latency_ns, batch_packets, syscall_ns;
+  wireshark_bridge_session_t **sp;
 
-  /* Parse arguments */
-  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
-    {
-      if (unformat (input, "%U", unformat_vnet_sw_interface, wbm->vnet_main, &sw_if_index))
-        show_one = 1;
-      else
-        return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
-    }
+  if (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
 
-  /* Print header */
-  vlib_cli_output (vm, "%-25s %-10s %-15s %-15s %-15s %-15s",
-                  "Interface", "Enabled", "RX Packets", "RX Bytes", "TX Packets", "TX Bytes");
-  vlib_cli_output (vm, "-------------------------------------------------------------------------");
-
-  pthread_mutex_lock (&wbm->sender_mutex);
-  if (show_one)
+  if (pool_elts (wbm->sessions) == 0)
     {
-      /* Show stats for specific interface */
-      for (i = 0; i < vec_len (wbm->interfaces); i++)
-        {
-          if (wbm->interfaces[i].sw_if_index == sw_if_index)
-            {
-              vlib_cli_output (vm, "%-25U %-10s %-15llu %-15llu %-15llu %-15llu",
-                              format_vnet_sw_if_index_name, wbm->vnet_main, wbm->interfaces[i].sw_if_index,
-                              wbm->interfaces[i].is_enabled ? "Yes" : "No",
-                              wbm->interfaces[i].packets_sent_rx,
-                              wbm->interfaces[i].bytes_sent_rx,
-                              wbm->interfaces[i].packets_sent_tx,
-                              wbm->interfaces[i].bytes_sent_tx);
-              break;
-            }
-        }
+      vlib_cli_output (vm, "No capture sessions");
+      return 0;
     }
-  else
+
+  pool_foreach (sp, wbm->sessions)
     {
-      /* Show stats for all interfaces */
-      for (i = 0; i < vec_len (wbm->interfaces); i++)
+      wireshark_bridge_session_histograms (sp[0], &latency_ns, &batch_packets, &syscall_ns);
+
+      vlib_cli_output (vm, "Session %u: %s", sp[0]->session_index, sp[0]->bridge_address);
+      vlib_cli_output (vm, "%U", format_wireshark_bridge_histogram, &latency_ns,
+                       "capture to send", 1);
+      vlib_cli_output (vm, "%U", format_wireshark_bridge_histogram, &batch_packets,
+                       "packets per batch", 0);
+      vlib_cli_output (vm, "%U", format_wireshark_bridge_histogram, &syscall_ns,
+                       sp[0]->use_shm ? "send system call (unused with shm)" : "send system call", 1);
+      if (sp[0]->compression)
         {
-          vlib_cli_output (vm, "%-25U %-10s %-15llu %-15llu %-15llu %-15llu",
-                          format_vnet_sw_if_index_name, wbm->vnet_main, wbm->interfaces[i].sw_if_index,
-                          wbm->interfaces[i].is_enabled ? "Yes" : "No",
-                          wbm->interfaces[i].packets_sent_rx,
-                          wbm->interfaces[i].bytes_sent_rx,
-                          wbm->interfaces[i].packets_sent_tx,
-                          wbm->interfaces[i].bytes_sent_tx);
+          wireshark_bridge_histogram_t compress_ns = { 0 };
+          wireshark_bridge_sender_t *sender;
+
+          vec_foreach (sender, sp[0]->senders)
+            wireshark_bridge_histogram_merge (&compress_ns, &sender->compress_ns);
+          vlib_cli_output (vm, "%U", format_wireshark_bridge_histogram, &compress_ns,
+                           "lz4 per datagram", 1);
         }
+      vlib_cli_output (vm, "");
     }
-  pthread_mutex_unlock (&wbm->sender_mutex);
 
   return 0;
 }
@@ -1298,22 +4222,47 @@ wireshark_bridge_stats_command_fn (vlib_main_t * vm,
 /* CLI command definitions */
 VLIB_CLI_COMMAND (wireshark_bridge_enable_command, static) = {
   .path = "wireshark bridge enable",
-  .short_help = "wireshark bridge enable <interface> <bridge_address> - where bridge_address can be IP:port or /path/to/unix/socket",
+  .short_help = "wireshark bridge enable <interface> <bridge_address> [rx|tx|both] [drop] [ip4] [ip6] [snaplen <bytes>] [pool-buffers] [pcapng] [recorder] [compress] [flows] [sequence] [filter <bpf_bytecode>] [sample <N>] [max-pps <pps>] [max-bps <bps>] [file-size <MB>] [file-duration <seconds>] [files <N>] - where bridge_address can be IP:port, IP:port,IP:port,... (fan-out), tcp://IP:port, /path/to/unix/socket, shm:/path/to/unix/socket or file:/path/to/capture (rotated pcapng files) and bpf_bytecode is `tcpdump -ddd` output joined with commas",
   .function = wireshark_bridge_enable_command_fn,
 };
 
+VLIB_CLI_COMMAND (wireshark_bridge_interfaces_command, static) = {
+  .path = "wireshark bridge interfaces",
+  .short_help = "wireshark bridge interfaces <bridge_address> [enable|disable] [rx|tx|both|drop|ip4|ip6] <interface> ... - change many interfaces of an existing session at once",
+  .function = wireshark_bridge_interfaces_command_fn,
+};
+
 VLIB_CLI_COMMAND (wireshark_bridge_disable_command, static) = {
   .path = "wireshark bridge disable",
-  .short_help = "wireshark bridge disable <interface>",
+  .short_help = "wireshark bridge disable [<interface>] [<bridge_address>]",
   .function = wireshark_bridge_disable_command_fn,
 };
 
+VLIB_CLI_COMMAND (wireshark_bridge_dump_command, static) = {
+  .path = "wireshark bridge dump",
+  .short_help = "wireshark bridge dump <bridge_address> [seconds <n>] [file <path.pcapng>] - send or save the last seconds of a recorder session",
+  .function = wireshark_bridge_dump_command_fn,
+  .is_mp_safe = 1,
+};
+
+VLIB_CLI_COMMAND (wireshark_bridge_trigger_command, static) = {
+  .path = "wireshark bridge trigger",
+  .short_help = "wireshark bridge trigger <bridge_address> drops|rx-miss|rx-error|tx-error <n> [seconds <n>] [file <path.pcapng>] | off - dump a recorder session once an interface counter grows by n within a second",
+  .function = wireshark_bridge_trigger_command_fn,
+};
+
 VLIB_CLI_COMMAND (wireshark_bridge_stats_command, static) = {
   .path = "wireshark bridge stats",
   .short_help = "wireshark bridge stats [<interface>]",
   .function = wireshark_bridge_stats_command_fn,
 };
 
+VLIB_CLI_COMMAND (wireshark_bridge_show_latency_command, static) = {
+  .path = "wireshark bridge show latency",
+  .short_help = "wireshark bridge show latency",
+  .function = wireshark_bridge_show_latency_command_fn,
+};
+
 /* API definitions */
 #include <wireshark_bridge/wireshark_bridge.api.c>
 
@@ -1329,33 +4278,162 @@ wireshark_bridge_init (vlib_main_t * vm)
   wbm->vlib_main = vm;
   wbm->vnet_main = vnet_get_main();
   wbm->ethernet_main = ethernet_get_main(vm);
-  
+
   /* Initialize API */
   wbm->msg_id_base = setup_message_id_table ();
-  
-  /* Initialize interfaces vector and hash table */
-  wbm->interfaces = 0; /* Initialize empty vector */
-  wbm->interface_index_by_sw_if_index = hash_create (0, sizeof (uword));
-  
-  /* Initialize bridge socket and sender thread */
-  wbm->bridge_socket = -1;
-  wbm->bridge_connected = 0;
-  wbm->use_unix_socket = 0;  /* Default to TCP socket */
-  memset(wbm->socket_path, 0, sizeof(wbm->socket_path));
-  
-  /* Initialize mutex and condition variable */
-  pthread_mutex_init (&wbm->sender_mutex, NULL);
-  pthread_cond_init (&wbm->sender_cond, NULL);
-  wbm->sender_thread_running = 0;
-  
-  /* Initialize packet queue */
-  wireshark_bridge_queue.packets = 0; /* Initialize empty vector */
-  wireshark_bridge_queue.should_stop = 0;
-  wireshark_bridge_queue.queue_overflows = 0;
-  
+
+  /* Sessions are created on enable, once the thread count is final */
+  wbm->sessions = 0;
+  wbm->session_indices_by_sw_if_index = 0;
+  wbm->feature_mask_by_sw_if_index = 0;
+
+  /* Unless the startup config has set them already */
+  if (wbm->n_sender_threads == 0)
+    wbm->n_sender_threads = WIRESHARK_BRIDGE_DEFAULT_SENDER_THREADS;
+  if (wbm->batch_size == 0)
+    wbm->batch_size = WIRESHARK_BRIDGE_BATCH_SIZE;
+  if (wbm->recorder_size == 0)
+    wbm->recorder_size = WIRESHARK_BRIDGE_RECORDER_DEFAULT_SIZE;
+  if (wbm->flow_table_size == 0)
+    wbm->flow_table_size = WIRESHARK_BRIDGE_FLOW_DEFAULT_ENTRIES;
+  if (wbm->flow_interval == 0)
+    wbm->flow_interval = WIRESHARK_BRIDGE_FLOW_DEFAULT_INTERVAL;
+
+  /* Looked up on enable, once the drivers have registered it */
+  wbm->hw_timestamp_offset = -1;
+
+  /* Stats segment counters */
+#define _(sym, str)                                                                          \
+  wbm->interface_counters[WIRESHARK_BRIDGE_INTERFACE_COUNTER_##sym].name = str;              \
+  wbm->interface_counters[WIRESHARK_BRIDGE_INTERFACE_COUNTER_##sym].stat_segment_name =      \
+    "/wireshark-bridge/" str;
+  foreach_wireshark_bridge_interface_counter
+#undef _
+#define _(sym, str)                                                                          \
+  wbm->combined_counters[WIRESHARK_BRIDGE_COMBINED_COUNTER_##sym].name = str;                \
+  wbm->combined_counters[WIRESHARK_BRIDGE_COMBINED_COUNTER_##sym].stat_segment_name =        \
+    "/wireshark-bridge/" str;
+  foreach_wireshark_bridge_combined_counter
+#undef _
+#define _(sym, str)                                                                          \
+  wbm->session_counters[WIRESHARK_BRIDGE_SESSION_COUNTER_##sym].name = str;                  \
+  wbm->session_counters[WIRESHARK_BRIDGE_SESSION_COUNTER_##sym].stat_segment_name =          \
+    "/wireshark-bridge/session/" str;
+  foreach_wireshark_bridge_session_counter
+#undef _
+
   return error;
 }
 
+/**
+ * @brief Parse the wireshark-bridge section of the startup config
+ *
+ * wireshark-bridge {
+ *   sender-threads <n>        sender threads per session
+ *   sender-corelist <list>    CPUs to pin them to, e.g. 2-3,6
+ *   batch-size <n>            packets sent at once without waiting (32)
+ *   max-latency <usec>        longest wait for a batch to fill up (1000)
+ *   hw-timestamps             use NIC rx timestamps where DPDK provides them
+ *   recorder-size <MB>        flight recorder memory per worker (16)
+ *   flow-table-size <n>       flows per worker of a flow session (65536)
+ *   flow-interval <seconds>   time between two flow exports (1)
+ * }
+ *
+ * With only a corelist there is one sender thread per listed CPU.
+ */
+static clib_error_t *
+wireshark_bridge_config (vlib_main_t * vm, unformat_input_t * input)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  uword *corelist = 0;
+  u32 n_sender_threads = ~0;
+  u32 batch_size = WIRESHARK_BRIDGE_BATCH_SIZE;
+  u32 recorder_size_mb = WIRESHARK_BRIDGE_RECORDER_DEFAULT_SIZE >> 20;
+  u32 flow_table_size = WIRESHARK_BRIDGE_FLOW_DEFAULT_ENTRIES;
+  f64 flow_interval = WIRESHARK_BRIDGE_FLOW_DEFAULT_INTERVAL;
+  uword cpu;
+
+  wbm->max_latency_usec = WIRESHARK_BRIDGE_MAX_LATENCY_USEC;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "sender-threads %u", &n_sender_threads))
+        ;
+      else if (unformat (input, "batch-size %u", &batch_size))
+        ;
+      else if (unformat (input, "max-latency %u", &wbm->max_latency_usec))
+        ;
+      else if (unformat (input, "sender-corelist %U", unformat_bitmap_list, &corelist))
+        ;
+      else if (unformat (input, "hw-timestamps"))
+        wbm->hw_timestamps = 1;
+      else if (unformat (input, "recorder-size %u", &recorder_size_mb))
+        ;
+      else if (unformat (input, "flow-table-size %u", &flow_table_size))
+        ;
+      else if (unformat (input, "flow-interval %f", &flow_interval))
+        ;
+      else
+        {
+          clib_bitmap_free (corelist);
+          return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
+        }
+    }
+
+  if (n_sender_threads == 0)
+    {
+      clib_bitmap_free (corelist);
+      return clib_error_return (0, "sender-threads must be at least 1");
+    }
+
+  if (batch_size == 0 || batch_size > WIRESHARK_BRIDGE_RING_SIZE)
+    {
+      clib_bitmap_free (corelist);
+      return clib_error_return (0, "batch-size must be between 1 and %u", WIRESHARK_BRIDGE_RING_SIZE);
+    }
+  wbm->batch_size = batch_size;
+
+  if (recorder_size_mb == 0)
+    {
+      clib_bitmap_free (corelist);
+      return clib_error_return (0, "recorder-size must be at least 1 MB");
+    }
+  wbm->recorder_size = (u64) recorder_size_mb << 20;
+
+  if (flow_table_size < WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS || flow_interval <= 0)
+    {
+      clib_bitmap_free (corelist);
+      return clib_error_return (0, "flow-table-size must be at least %u and flow-interval positive",
+                                WIRESHARK_BRIDGE_FLOW_BUCKET_WAYS);
+    }
+  wbm->flow_table_size = flow_table_size;
+  wbm->flow_interval = flow_interval;
+
+  vec_reset_length (wbm->sender_cpus);
+  clib_bitmap_foreach (cpu, corelist)
+    {
+      if (cpu >= CPU_SETSIZE)
+        {
+          clib_bitmap_free (corelist);
+          return clib_error_return (0, "sender-corelist cpu %u out of range", (u32) cpu);
+        }
+      vec_add1 (wbm->sender_cpus, cpu);
+    }
+  clib_bitmap_free (corelist);
+
+#ifndef WIRESHARK_BRIDGE_HW_TIMESTAMP
+  if (wbm->hw_timestamps)
+    clib_warning ("hw-timestamps ignored, the plugin is built without WIRESHARK_BRIDGE_HW_TIMESTAMP");
+#endif
+
+  if (n_sender_threads != ~0)
+    wbm->n_sender_threads = n_sender_threads;
+  else if (vec_len (wbm->sender_cpus))
+    wbm->n_sender_threads = vec_len (wbm->sender_cpus);
+
+  return 0;
+}
+
 /**
  * @brief Clean up resources when plugin is unloaded
  */
@@ -1363,37 +4441,104 @@ static clib_error_t *
 wireshark_bridge_exit (vlib_main_t * vm)
 {
   wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
-  
-  /* Stop sender thread */
-  if (wbm->sender_thread_running) {
-    pthread_mutex_lock (&wbm->sender_mutex);
-    wireshark_bridge_queue.should_stop = 1;
-    pthread_cond_signal (&wbm->sender_cond);
-    pthread_mutex_unlock (&wbm->sender_mutex);
-    
-    pthread_join (wbm->sender_thread, NULL);
-    wbm->sender_thread_running = 0;
-  }
-  
-  /* Close socket */
-  if (wbm->bridge_socket > 0) {
-    close (wbm->bridge_socket);
-    wbm->bridge_socket = -1;
-    wbm->bridge_connected = 0;
-  }
-  
-  /* Free resources */
-  vec_free (wbm->interfaces);
-  hash_free (wbm->interface_index_by_sw_if_index);
-  
-  /* Destroy synchronization primitives */
-  pthread_mutex_destroy (&wbm->sender_mutex);
-  pthread_cond_destroy (&wbm->sender_cond);
-  
+  wireshark_bridge_session_t **sp;
+  u32 **session_indices;
+
+  /* Stop sender threads and close sockets; anything left in the rings
+     goes away with the process */
+  pool_foreach (sp, wbm->sessions)
+    {
+      wireshark_bridge_session_free (sp[0]);
+    }
+  pool_free (wbm->sessions);
+
+  vec_foreach (session_indices, wbm->session_indices_by_sw_if_index)
+    vec_free (session_indices[0]);
+  vec_free (wbm->session_indices_by_sw_if_index);
+  vec_free (wbm->feature_mask_by_sw_if_index);
+  vec_free (wbm->sender_cpus);
+  vec_free (wbm->dump_requests);
+
+  return 0;
+}
+
+/**
+ * @brief Bring the failed UDP destinations of a session back once their
+ * retry time has come
+ *
+ * A send error such as a missing route is often brief, and the socket
+ * stays usable, so the destination is simply tried again with the next
+ * batch; a session down because all its destinations failed comes back
+ * up with them. It goes down again on the next error.
+ */
+static void
+wireshark_bridge_session_retry_destinations (wireshark_bridge_session_t *s)
+{
+  f64 now = unix_time_now ();
+  u32 i, n_down = 0, n_retried = 0;
+
+  for (i = 0; i < s->n_destinations; i++)
+    {
+      wireshark_bridge_destination_t *d = &s->destinations[i];
+
+      if (!clib_atomic_load_acq_n (&d->down))
+        continue;
+      n_down++;
+      if (now < d->retry_time)
+        continue;
+
+      clib_atomic_store_relax_n (&d->down, 0);
+      n_retried++;
+    }
+
+  if (n_retried && n_down == s->n_destinations && !s->bridge_connected && s->bridge_socket >= 0)
+    s->bridge_connected = 1;
+}
+
+/**
+ * @brief Keep the stats segment up to date with the sender threads
+ *
+ * Once per stats interval, which is also when recorder triggers are
+ * checked and failed destinations retried. Dumps asked for over the API
+ * are taken as soon as they come.
+ */
+static uword
+wireshark_bridge_stats_process (vlib_main_t * vm, vlib_node_runtime_t * rt, vlib_frame_t * f)
+{
+  wireshark_bridge_main_t *wbm = &wireshark_bridge_main;
+  wireshark_bridge_session_t **sp;
+  f64 next_export = vlib_time_now (vm) + WIRESHARK_BRIDGE_STATS_INTERVAL;
+
+  while (1)
+    {
+      vlib_process_wait_for_event_or_clock (vm, clib_max (next_export - vlib_time_now (vm), 0.0));
+      vlib_process_get_events (vm, 0);
+
+      wireshark_bridge_recorder_run_requests (wbm);
+
+      if (vlib_time_now (vm) < next_export)
+        continue;
+      next_export = vlib_time_now (vm) + WIRESHARK_BRIDGE_STATS_INTERVAL;
+
+      pool_foreach (sp, wbm->sessions)
+        {
+          wireshark_bridge_session_export_counters (wbm, sp[0]);
+          wireshark_bridge_recorder_check_trigger (wbm, sp[0]);
+          wireshark_bridge_session_retry_destinations (sp[0]);
+        }
+    }
+
   return 0;
 }
 
+VLIB_REGISTER_NODE (wireshark_bridge_stats_process_node, static) = {
+  .function = wireshark_bridge_stats_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "wireshark-bridge-stats-process",
+};
+
 VLIB_INIT_FUNCTION (wireshark_bridge_init);
+VLIB_CONFIG_FUNCTION (wireshark_bridge_config, "wireshark-bridge");
 VLIB_MAIN_LOOP_EXIT_FUNCTION (wireshark_bridge_exit);
 
 /* Plugin definition */
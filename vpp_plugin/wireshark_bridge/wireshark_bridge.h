@@ -0,0 +1,1030 @@
+/*
+ * wireshark_bridge.h - VPP plugin for bridging traffic to Wireshark
+ *
+ * Shared definitions for the control plane (wireshark_bridge.c) and the
+ * capture nodes (node.c).
+ */
+
+#ifndef __included_wireshark_bridge_h__
+#define __included_wireshark_bridge_h__
+
+#include <vnet/vnet.h>
+#include <vnet/ip/ip.h>
+#include <vnet/ethernet/ethernet.h>
+#include <vnet/interface.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/un.h>  // Added for Unix domain sockets
+#include <sys/uio.h>
+
+#include "bpf.h"
+#include "shm.h"
+#include "pcapng.h"
+#include "stream.h"
+#include "file.h"
+#include "histogram.h"
+#include "recorder.h"
+#include "flow.h"
+#include "numa.h"
+
+#ifdef WIRESHARK_BRIDGE_HW_TIMESTAMP
+#include <rte_config.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#endif
+
+// Make sure the packet structure is defined only once at the top
+typedef struct {
+  u32 sw_if_index;
+  u8 *packet_data;      // Copy in the ring's slot, NULL when buffer_index is used
+  u32 buffer_index;     // Pool buffer holding the packet, ~0 for heap copies
+  u32 thread_index;     // Worker that captured the packet
+  u32 packet_length;    // Captured length, at most the interface snaplen
+  u32 original_length;  // Length of the packet on the wire
+  u64 timestamp;        // Nanoseconds since the epoch
+  u8 direction;
+  u16 n_segments;       // Buffers in the chain holding the copy, 1 for a slot
+  u32 error;            // vlib error of a packet taken at the drop point
+} wireshark_bridge_packet_t;
+
+// Per-worker capture ring size (must be a power of two)
+#define WIRESHARK_BRIDGE_RING_SIZE 4096
+#define WIRESHARK_BRIDGE_RING_MASK (WIRESHARK_BRIDGE_RING_SIZE - 1)
+
+// Single-producer/single-consumer ring owned by one vlib_main_t.
+// Only the owning worker writes head, only the sender thread writes tail,
+// so neither side needs a lock. Producer and consumer indices live on
+// separate cache lines to avoid false sharing.
+//
+// Packets are copied into a slab of fixed-size slots mapped when the
+// session is enabled, slot i belonging to ring position i. The sender
+// publishes tail only once a batch has been sent, so a slot is never
+// rewritten while its copy is still in use, and the capture path does not
+// allocate at all. The slab lives outside the main heap, and so do the
+// packet descriptors and free_buffers, all of them on the worker's NUMA
+// node, see numa.h.
+//
+// Recorder sessions write their records into the worker's recorder buffer
+// instead, and the ring itself stays empty, see recorder.h. So do flow
+// sessions, which count packets in the worker's flow table, see flow.h.
+//
+// Pool buffers used by the pool-buffers capture mode travel back the other
+// way through free_buffers: the sender thread publishes them with free_head
+// and the worker frees them in batches on its next node dispatch, since
+// only a vlib thread may return buffers to its buffer cache.
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  volatile u32 head;
+  wireshark_bridge_packet_t *packets;  // WIRESHARK_BRIDGE_RING_SIZE descriptors, mapped
+  u32 *free_buffers;         // WIRESHARK_BRIDGE_RING_SIZE recycled buffers, after packets
+  u8 *slots;                 // WIRESHARK_BRIDGE_RING_SIZE slots of slot_size bytes
+  u32 slot_size;             // Bytes per slot, a multiple of the cache line size
+  u32 free_tail;             // Next recycled buffer to free (worker only)
+  u32 buffers_outstanding;   // Pool buffer chains allocated and not yet freed (worker only)
+  u64 ring_full_drops;  // Packets dropped by this worker because the ring was full
+  u8 wakeup_pending;         // Sender needs a signal at the end of the frame (worker only)
+  u64 filter_rejects;        // Packets not matching the session filter (worker only)
+  u32 sender_index;          // Sender thread draining this ring
+  u32 numa_node;             // NUMA node of the worker owning the ring
+  u64 backpressure_drops;    // Packets not captured while the stream was stalled
+  wireshark_bridge_recorder_t recorder;  // Records of a recorder session (worker writes)
+  wireshark_bridge_flow_table_t flows;   // Flows of a flow session (worker writes)
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+  volatile u32 tail;
+  u32 tail_pending;          // Dequeued slots not yet released (sender only)
+  volatile u32 free_head;    // Recycled buffers published to the worker
+  u32 free_head_pending;     // Recycled buffers not yet published (sender only)
+} wireshark_bridge_ring_t;
+
+// Mapping holding the packet descriptors and free_buffers of a ring
+#define WIRESHARK_BRIDGE_RING_DESCRIPTORS_SIZE \
+  (WIRESHARK_BRIDGE_RING_SIZE * (sizeof (wireshark_bridge_packet_t) + sizeof (u32)))
+
+// Sender queue of one capture session
+typedef struct {
+  wireshark_bridge_ring_t *rings;  // One ring per vlib thread, indexed by thread_index
+  volatile u8 should_stop;
+} wireshark_bridge_queue_t;
+
+// Protocol message format
+#define WIRESHARK_BRIDGE_VERSION 3
+
+// Packet direction constants, the capture point a packet was taken at.
+// Drop, ip4 and ip6 packets count as received on their rx interface.
+#define WIRESHARK_BRIDGE_DIRECTION_RX 0    // device-input
+#define WIRESHARK_BRIDGE_DIRECTION_TX 1    // interface-output
+#define WIRESHARK_BRIDGE_DIRECTION_DROP 2  // error-drop, with the drop reason
+#define WIRESHARK_BRIDGE_DIRECTION_IP4 3   // ip4-unicast, after any decapsulation
+#define WIRESHARK_BRIDGE_DIRECTION_IP6 4   // ip6-unicast
+#define WIRESHARK_BRIDGE_N_DIRECTIONS 5
+
+// Session direction mask bits
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_RX (1 << WIRESHARK_BRIDGE_DIRECTION_RX)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_TX (1 << WIRESHARK_BRIDGE_DIRECTION_TX)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_DROP (1 << WIRESHARK_BRIDGE_DIRECTION_DROP)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_IP4 (1 << WIRESHARK_BRIDGE_DIRECTION_IP4)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_IP6 (1 << WIRESHARK_BRIDGE_DIRECTION_IP6)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_BOTH \
+  (WIRESHARK_BRIDGE_DIRECTION_MASK_RX | WIRESHARK_BRIDGE_DIRECTION_MASK_TX)
+#define WIRESHARK_BRIDGE_DIRECTION_MASK_ALL ((1 << WIRESHARK_BRIDGE_N_DIRECTIONS) - 1)
+
+// Session output formats
+#define WIRESHARK_BRIDGE_FORMAT_RECORDS 0  // 21 byte header records, see the extcap
+#define WIRESHARK_BRIDGE_FORMAT_PCAPNG 1   // One pcapng section per datagram
+
+// Session transport compression. Every datagram of a compressing session
+// starts with a header (big-endian): magic (2 bytes), flags (1), reserved
+// (1), uncompressed length (4) and payload length (4). The payload is an
+// LZ4 block with WIRESHARK_BRIDGE_COMPRESSION_FLAG_LZ4 set, and the
+// datagram as is when it did not get any smaller.
+#define WIRESHARK_BRIDGE_COMPRESSION_NONE 0
+#define WIRESHARK_BRIDGE_COMPRESSION_LZ4 1
+#define WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE 12
+#define WIRESHARK_BRIDGE_COMPRESSION_MAGIC 0x575a  // "WZ"
+#define WIRESHARK_BRIDGE_COMPRESSION_FLAG_LZ4 1
+
+// Datagram sequence header of sessions enabled with "sequence", in front
+// of the records or the pcapng section of every datagram and inside the
+// compression header if any (big-endian): magic (2 bytes), sender thread
+// (1), reserved (1), sequence number (4), records in the datagram (4),
+// datagrams dropped in VPP past the rings so far (4, per destination of
+// a fan-out group), records in the datagrams
+// before this one (8) and packets dropped in the worker rings so far (8).
+// All of them count per sender thread, from the start of the session; a
+// receiver tells network and receive buffer loss, a sequence gap, from
+// the loss in VPP the drop counters account for.
+#define WIRESHARK_BRIDGE_SEQUENCE_HEADER_SIZE 32
+#define WIRESHARK_BRIDGE_SEQUENCE_MAGIC 0x5753  // "WS"
+
+// Configuration constants
+#define WIRESHARK_BRIDGE_PACKET_HEADER_SIZE 21 // Size of packet header in bytes
+#define WIRESHARK_BRIDGE_DROP_REASON_SIZE 4    // vlib error after the header of a drop record
+#define WIRESHARK_BRIDGE_CONNECT_TIMEOUT_SEC 5 // Socket connection timeout
+#define WIRESHARK_BRIDGE_BATCH_SIZE 32         // Default packets per sender batch
+#define WIRESHARK_BRIDGE_MAX_LATENCY_USEC 1000  // Default time a packet may wait for its batch
+#define WIRESHARK_BRIDGE_IDLE_TIMEOUT_USEC 100000 // Idle sender recheck, bounds a missed wakeup
+#define WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE 65507 // Maximum UDP datagram size
+#define WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS 32  // Datagrams flushed by one sendmmsg call
+#define WIRESHARK_BRIDGE_TX_DATAGRAM_IOVS 64    // iovecs gathered into one datagram
+#define WIRESHARK_BRIDGE_TX_COPY_BYTES 512      // Shorter payloads are copied, longer ones gathered
+#define WIRESHARK_BRIDGE_DEFAULT_SLOT_SIZE 9216 // Slot size without a snaplen, a jumbo frame
+// Longest capture, a record of it still has to fit into one datagram, with
+// a compression and a sequence header in front of it
+#define WIRESHARK_BRIDGE_MAX_CAPTURE_LENGTH \
+  (WIRESHARK_BRIDGE_MAX_DATAGRAM_SIZE - WIRESHARK_BRIDGE_COMPRESSION_HEADER_SIZE - \
+   WIRESHARK_BRIDGE_SEQUENCE_HEADER_SIZE - WIRESHARK_BRIDGE_PACKET_HEADER_SIZE - \
+   WIRESHARK_BRIDGE_DROP_REASON_SIZE)
+
+// Default number of sender threads per session
+#define WIRESHARK_BRIDGE_DEFAULT_SENDER_THREADS 1
+
+// UDP destinations of a fan-out session, "IP:port,IP:port,..."
+#define WIRESHARK_BRIDGE_MAX_DESTINATIONS 8
+#define WIRESHARK_BRIDGE_DESTINATION_SEPARATOR ','
+#define WIRESHARK_BRIDGE_DESTINATION_RETRY_INTERVAL 5.0  // Seconds a failed destination is skipped
+
+// Longest destination string, the size of the API's bridge_address less
+// its NUL: room for 8 "255.255.255.255:65535" and their separators
+#define WIRESHARK_BRIDGE_MAX_ADDRESS_LENGTH 191
+
+// Sender thread transmit state. The datagram buffers are allocated once
+// when the sender thread starts and reused for every batch. Headers and
+// short payloads are copied into the buffer of their datagram, longer
+// payloads are gathered straight from their slot or pool buffers, so a
+// datagram is a list of iovecs alternating between the two. The iovecs of
+// all datagrams of a batch are kept back to back. A compressing session
+// flattens each datagram and sends its compressed copy instead.
+typedef struct {
+  u8 *buffers[WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS];
+  struct iovec iovs[WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS * WIRESHARK_BRIDGE_TX_DATAGRAM_IOVS];
+  struct mmsghdr msgs[WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS];
+  u32 n_datagrams;          // Completed datagrams waiting to be sent
+  u32 n_iovs;               // iovecs in use by the batch
+  u32 iov_start;            // First iovec of the datagram being filled
+  u32 offset;               // Bytes in the datagram being filled
+  u32 buffer_offset;        // Bytes of it copied into its buffer
+  u32 max_offset;           // Datagram size limit, less the compression header if any
+  u32 n_records;            // Records in the datagram being filled
+  u32 sequence_header_size; // Reserved at the start of every datagram, 0 if none
+  u32 n_pcapng_interfaces;  // Interfaces described in the datagram being filled
+  u32 pcapng_interfaces[WIRESHARK_BRIDGE_PCAPNG_MAX_INTERFACES];  // sw_if_index by IDB id
+  u64 datagrams_sent;
+  u64 syscalls;
+  u64 backpressure_drops;   // Datagrams dropped on EAGAIN/ENOBUFS, send errors or a down bridge
+  u8 stream_wait;           // Wait for a stalled stream instead of dropping, set by dumps
+  u64 send_errors;          // Sends that failed for any other reason
+
+  /* The same, per UDP destination of the session */
+  u64 destination_sent[WIRESHARK_BRIDGE_MAX_DESTINATIONS];
+  u64 destination_drops[WIRESHARK_BRIDGE_MAX_DESTINATIONS];
+  u64 destination_errors[WIRESHARK_BRIDGE_MAX_DESTINATIONS];
+
+  /* Compression, buffers allocated on first use */
+  u8 *linear;               // Gathered datagram flattened for the compressor
+  u8 *compressed[WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS];  // Header and payload per datagram
+  struct iovec compressed_iovs[WIRESHARK_BRIDGE_TX_BATCH_DATAGRAMS];
+  u64 compress_bytes_in;    // Datagram bytes given to the compressor
+  u64 compress_bytes_out;   // Bytes sent for them, headers included
+  u64 compress_ns;          // Time spent compressing
+  u64 flow_records;         // Flow records sent
+
+  /* Sequence headers, see WIRESHARK_BRIDGE_SEQUENCE_HEADER_SIZE */
+  u8 sender_index;
+  u32 sequence;             // Next datagram number
+  u64 records;              // Records in the datagrams numbered so far
+  u64 queue_drops;          // Ring drops of the sender's workers, taken per batch
+} wireshark_bridge_tx_t;
+
+// Token bucket depth of the capture rate limits, in seconds of traffic
+#define WIRESHARK_BRIDGE_POLICER_BURST_SEC 0.1
+
+// Per-worker sampling and rate limiting state of an interface. Each worker
+// enforces its own share of the limits, so nothing here is shared.
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u32 sample_count;         // Packets seen since the last sampled one
+  f64 pps_tokens;
+  f64 byte_tokens;
+  f64 last_refill;          // 0 until the buckets are filled the first time
+  u64 sampled_out;          // Packets skipped by 1-in-N sampling
+  u64 policed;              // Packets over the rate limit
+} wireshark_bridge_interface_worker_t;
+
+// Per-sender thread counters of an interface. Every sender thread counts
+// the packets it sent itself, so nothing here is shared either.
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u64 packets_sent_rx;
+  u64 bytes_sent_rx;
+  u64 packets_sent_tx;
+  u64 bytes_sent_tx;
+
+  /* Part of the above already in the stats segment (stats process only) */
+  u64 packets_exported_rx;
+  u64 bytes_exported_rx;
+  u64 packets_exported_tx;
+  u64 bytes_exported_tx;
+} wireshark_bridge_interface_sender_t;
+
+// Interface captured by a session, with the session's counters for it
+typedef struct {
+  u32 sw_if_index;
+  u8 is_enabled;
+  u8 direction_mask;        // Capture points here, within those of the session
+  u8 *name;                 // Interface name for pcapng interface descriptions
+  wireshark_bridge_interface_sender_t *senders;  // Indexed by sender_index
+
+  /* Sampling and rate limiting, applied by the workers */
+  u32 sample_rate;          // Capture 1 in sample_rate packets, 0 or 1 for all
+  u64 max_pps;              // Interface-wide packet rate limit, 0 for none
+  u64 max_bps;              // Interface-wide bit rate limit, 0 for none
+  f64 worker_pps;           // Share of max_pps of one worker
+  f64 worker_bytes_per_sec; // Share of max_bps of one worker, in bytes
+  wireshark_bridge_interface_worker_t *workers;  // Indexed by thread_index
+} wireshark_bridge_interface_t;
+
+// Interface counters a recorder trigger can watch, named as in VPP
+#define foreach_wireshark_bridge_trigger_counter  \
+  _ (DROP, "drops")                               \
+  _ (RX_MISS, "rx-miss")                          \
+  _ (RX_ERROR, "rx-error")                        \
+  _ (TX_ERROR, "tx-error")
+
+typedef enum {
+#define _(sym, name) WIRESHARK_BRIDGE_TRIGGER_##sym,
+  foreach_wireshark_bridge_trigger_counter
+#undef _
+  WIRESHARK_BRIDGE_N_TRIGGER_COUNTERS,
+} wireshark_bridge_trigger_counter_t;
+
+// Dump of a recorder session taken by the stats process once a counter of
+// its interfaces grows by threshold within one stats interval. A trigger
+// fires once and has to be set again afterwards.
+typedef struct {
+  u64 threshold;            // 0 while no trigger is set
+  u8 counter;               // WIRESHARK_BRIDGE_TRIGGER_*
+  u32 seconds;              // Seconds of records to dump
+  u8 *file;                 // pcapng file to dump to (NUL terminated), NULL for the destination
+  u64 last;                 // Counter sum over the session's interfaces at the last check
+  u8 primed;                // last has been read at least once
+  u64 fired;                // Times a trigger of the session fired
+} wireshark_bridge_trigger_t;
+
+// Dump asked for over the API, taken by the stats process rather than
+// with the worker barrier held
+typedef struct {
+  u8 *bridge_address;       // NUL terminated
+  u32 seconds;
+  u8 *file;                 // NUL terminated, NULL for the destination
+} wireshark_bridge_dump_request_t;
+
+struct wireshark_bridge_session_t_;
+
+// Sender thread of a session. Each one drains its own share of the worker
+// rings, those of workers on its NUMA node where it has one, see
+// wireshark_bridge_queue_init (), and has its own transmit state, so
+// sender threads of a session never contend with each other.
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  struct wireshark_bridge_session_t_ *session;
+  u32 sender_index;
+  u32 *ring_indices;        // Rings drained, by thread_index, set before the thread starts
+  u32 numa_node;            // Node of its rings, ~0 if unknown
+  int cpu;                  // CPU the thread is pinned to, -1 if not pinned to one
+  pthread_t thread;
+  u8 thread_running;
+  pthread_mutex_t mutex;    // Held while sending, see wireshark_bridge_session_lock ()
+  pthread_cond_t cond;      // Waits use CLOCK_MONOTONIC
+  u64 wakeups;              // Times the thread woke up to look at its rings
+  u64 batches;              // Batches sent
+
+  /* Pipeline histograms, shown by "wireshark bridge show latency" */
+  wireshark_bridge_histogram_t latency_ns;     // Packet timestamp to send, per packet
+  wireshark_bridge_histogram_t batch_packets;  // Packets per batch
+  wireshark_bridge_histogram_t syscall_ns;     // Duration of a send system call
+  wireshark_bridge_histogram_t compress_ns;    // Compression of a datagram
+
+  /* Part of the tx counters already in the stats segment (stats process only) */
+  u64 send_errors_exported;
+  u64 backpressure_drops_exported;
+  u64 compress_bytes_in_exported;
+  u64 compress_bytes_out_exported;
+  u64 compress_ns_exported;
+  u64 flow_records_exported;
+
+  /* Flow export of a flow session, see flow.h */
+  u64 next_flow_export;     // Monotonic time of the next export
+  u64 flows_exported_ns;    // Wall clock time of the last export, 0 before the first
+
+  /* Transmit batching, owned by the sender thread */
+  wireshark_bridge_tx_t tx;
+} wireshark_bridge_sender_t;
+
+// One UDP destination of a session. A session given several addresses
+// (a fan-out group, unicast or multicast) builds and compresses every
+// batch once and sends it to each destination with sendmmsg calls of its
+// own, so a destination that is slow or fails loses its own datagrams
+// only. A failed destination is skipped until the stats process retries
+// it, WIRESHARK_BRIDGE_DESTINATION_RETRY_INTERVAL later.
+//
+// Every sender thread of the session and the stats process share down and
+// retry_time without a lock. A sender stores retry_time and then down with
+// release, the stats process loads down with acquire before retry_time.
+// Senders failing the same destination at once store the same down and
+// nearly the same retry_time, and a destination failing again while it is
+// retried just goes down again: the worst case is a duplicate retry.
+typedef struct {
+  struct sockaddr_in addr;
+  u8 down;                  // Send failed with an error other than backpressure
+  f64 retry_time;           // unix_time_now () to retry a down destination at
+} wireshark_bridge_destination_t;
+
+// Capture session: one destination, or a fan-out group of UDP
+// destinations, with its own interfaces, options, sender queue and sender
+// threads. Sessions are allocated individually, so a session pointer
+// stays valid for the sender threads and the workers while the session
+// pool grows.
+typedef struct wireshark_bridge_session_t_ {
+  u32 session_index;
+
+  /* Destination exactly as given on enable (NUL terminated) */
+  u8 *bridge_address;
+
+  /* Bridge socket */
+  int bridge_socket;
+  union {
+    struct sockaddr_in inet_addr;  // For backward compatibility
+    struct sockaddr_un unix_addr;  // For Unix domain sockets
+  } bridge_addr;
+  u8 bridge_connected;
+  u8 use_unix_socket;  // Flag to indicate if we're using a Unix socket
+  wireshark_bridge_destination_t destinations[WIRESHARK_BRIDGE_MAX_DESTINATIONS];
+  u32 n_destinations;  // UDP destinations, 0 for other kinds
+  u8 use_shm;          // Records go to the shared ring, the socket only passes its fd
+  wireshark_bridge_shm_t shm;
+  u8 use_stream;       // Datagram buffers are written to a TCP stream
+  wireshark_bridge_stream_t stream;
+  volatile u8 backpressure;  // Stream stalled, workers stop capturing (set by the sender)
+  u8 use_file;         // pcapng sections are written to rotated files, see file.h
+  wireshark_bridge_file_t file;
+
+  /* Capture options */
+  u8 direction_mask;    // WIRESHARK_BRIDGE_DIRECTION_MASK_* bits to capture
+  u8 use_pool_buffers;  // Capture into vlib pool buffers instead of ring slots
+  u32 snaplen;          // Maximum bytes captured per packet, 0 for no limit
+  wireshark_bridge_bpf_insn_t *filter;  // Validated cBPF program, NULL to capture everything
+  u8 output_format;     // WIRESHARK_BRIDGE_FORMAT_*, changed with the session locked
+  u8 compression;       // WIRESHARK_BRIDGE_COMPRESSION_*, changed with the session locked
+  u8 sequence;          // Datagrams start with a sequence header, changed with the session locked
+  u8 **drop_reasons;    // "node: reason" per vlib error with the drop point captured,
+                        // changed with the session locked
+
+  /* Flight recorder, see recorder.h */
+  u8 use_recorder;      // Record into the worker recorders, send only what is dumped
+  wireshark_bridge_trigger_t trigger;
+  u64 dumps;            // Dumps taken
+
+  /* Flow summary export, see flow.h */
+  u8 use_flows;         // Count flows in the worker tables, send flow records only
+
+  /* Interfaces of this session, changed with the session locked */
+  wireshark_bridge_interface_t *interfaces;
+  u32 *interface_index_by_sw_if_index;  // Flat map into interfaces[], ~0 if none
+
+  /* Per-worker capture rings */
+  wireshark_bridge_queue_t queue;
+
+  /* Threads sending the packets, allocated once with the session */
+  wireshark_bridge_sender_t *senders;
+} wireshark_bridge_session_t;
+
+// Stats segment counters, /wireshark-bridge/<name>. Counters indexed by
+// sw_if_index sum up every session capturing the interface. Workers count
+// in their own thread slot; the sender threads, which are not vlib
+// threads, are folded into the main thread's slot by the stats process.
+#define foreach_wireshark_bridge_interface_counter                                \
+  _ (DROPPED_QUEUE_FULL, "dropped-queue-full")  /* Ring or buffers full */        \
+  _ (DROPPED_FILTER, "dropped-filter")          /* Rejected by the filter */      \
+  _ (DROPPED_STALLED, "dropped-stalled")        /* Stream backpressure */         \
+  _ (SAMPLED_OUT, "sampled-out")                /* Skipped by 1-in-N sampling */  \
+  _ (POLICED, "policed")                        /* Over the rate limit */
+
+#define foreach_wireshark_bridge_combined_counter                                 \
+  _ (MIRRORED_RX, "mirrored-rx")  /* Copied into a ring or recorder */            \
+  _ (MIRRORED_TX, "mirrored-tx")                                                  \
+  _ (SENT_RX, "sent-rx")          /* Handed to the socket, sender threads */      \
+  _ (SENT_TX, "sent-tx")
+
+// Indexed by session_index, counted by the sender threads
+#define foreach_wireshark_bridge_session_counter                                  \
+  _ (SOCKET_ERRORS, "socket-errors")              /* Failed sends */              \
+  _ (DROPPED_SOCKET_FULL, "dropped-socket-full")  /* Datagrams, EAGAIN/ENOBUFS */ \
+  _ (COMPRESS_BYTES_IN, "compress-bytes-in")      /* Before compression */        \
+  _ (COMPRESS_BYTES_OUT, "compress-bytes-out")    /* Sent for them */             \
+  _ (COMPRESS_NSEC, "compress-nsec")              /* Compressor CPU time */       \
+  _ (FLOW_RECORDS, "flow-records")                /* Flow records sent */
+
+typedef enum {
+#define _(sym, name) WIRESHARK_BRIDGE_INTERFACE_COUNTER_##sym,
+  foreach_wireshark_bridge_interface_counter
+#undef _
+  WIRESHARK_BRIDGE_N_INTERFACE_COUNTERS,
+} wireshark_bridge_interface_counter_t;
+
+typedef enum {
+#define _(sym, name) WIRESHARK_BRIDGE_COMBINED_COUNTER_##sym,
+  foreach_wireshark_bridge_combined_counter
+#undef _
+  WIRESHARK_BRIDGE_N_COMBINED_COUNTERS,
+} wireshark_bridge_combined_counter_t;
+
+typedef enum {
+#define _(sym, name) WIRESHARK_BRIDGE_SESSION_COUNTER_##sym,
+  foreach_wireshark_bridge_session_counter
+#undef _
+  WIRESHARK_BRIDGE_N_SESSION_COUNTERS,
+} wireshark_bridge_session_counter_t;
+
+// Seconds between two exports of the sender thread counters
+#define WIRESHARK_BRIDGE_STATS_INTERVAL 1.0
+
+// Capture options given on enable
+typedef struct {
+  u8 direction_mask;
+  u8 use_pool_buffers;
+  u32 snaplen;
+  wireshark_bridge_bpf_insn_t *filter;  // Vector, ownership passes to the session
+  u8 output_format;
+  u8 compression;
+  u8 use_recorder;
+  u8 use_flows;
+  u8 sequence;
+  u32 file_size;        // Megabytes per file of a file destination, 0 for the default
+  u32 file_duration;    // Seconds per file, 0 for no limit
+  u32 max_files;        // Files kept, 0 for all of them
+
+  /* Options of the enabled interface only */
+  u32 sample_rate;
+  u64 max_pps;
+  u64 max_bps;
+} wireshark_bridge_enable_args_t;
+
+// One entry of a bulk interface change of a session
+typedef struct {
+  u32 sw_if_index;
+  u8 enable;
+  u8 direction_mask;        // Capture points, WIRESHARK_BRIDGE_DIRECTION_MASK_*, 0 for rx and tx
+} wireshark_bridge_interface_toggle_t;
+
+// Main plugin context structure
+typedef struct {
+  /* API message ID base */
+  u16 msg_id_base;
+
+  /* Pool of capture sessions */
+  wireshark_bridge_session_t **sessions;
+
+  /* sw_if_index -> vector of indices of the sessions capturing it */
+  u32 **session_indices_by_sw_if_index;
+
+  /* sw_if_index -> capture features enabled, direction mask bits */
+  u8 *feature_mask_by_sw_if_index;
+
+  /* Sender threads, from the wireshark-bridge startup config section */
+  u32 n_sender_threads;     // Sender threads per session
+  u32 *sender_cpus;         // CPUs to pin sender threads to, round robin; empty for
+                            // any CPU not running a VPP worker
+  u32 batch_size;           // Packets that make a sender send right away
+  u32 max_latency_usec;     // Longest a sender holds back a smaller batch
+  u64 recorder_size;        // Flight recorder bytes per worker
+  u32 flow_table_size;      // Flows per worker table of a flow session
+  f64 flow_interval;        // Seconds between two flow exports
+
+  /* Dumps asked for over the API, see wireshark_bridge_dump_request_t */
+  wireshark_bridge_dump_request_t *dump_requests;
+
+  /* Stats segment counters */
+  vlib_simple_counter_main_t interface_counters[WIRESHARK_BRIDGE_N_INTERFACE_COUNTERS];
+  vlib_combined_counter_main_t combined_counters[WIRESHARK_BRIDGE_N_COMBINED_COUNTERS];
+  vlib_simple_counter_main_t session_counters[WIRESHARK_BRIDGE_N_SESSION_COUNTERS];
+
+  /* Hardware rx timestamps, see wireshark_bridge_buffer_timestamp () */
+  u8 hw_timestamps;         // Enabled in the startup config
+  int hw_timestamp_offset;  // mbuf dynamic field offset, -1 if not registered
+  u64 hw_timestamp_flag;    // mbuf ol_flags bit marking a valid timestamp
+
+  /* Convenience */
+  vlib_main_t *vlib_main;
+  vnet_main_t *vnet_main;
+  ethernet_main_t *ethernet_main;
+} wireshark_bridge_main_t;
+
+extern wireshark_bridge_main_t wireshark_bridge_main;
+
+extern vlib_node_registration_t wireshark_bridge_rx_node;
+extern vlib_node_registration_t wireshark_bridge_tx_node;
+extern vlib_node_registration_t wireshark_bridge_drop_node;
+extern vlib_node_registration_t wireshark_bridge_ip4_node;
+extern vlib_node_registration_t wireshark_bridge_ip6_node;
+
+format_function_t format_wireshark_bridge_capture_point;
+unformat_function_t unformat_wireshark_bridge_capture_point;
+
+/**
+ * @brief Get the sessions capturing an interface
+ *
+ * Returns a vector of session indices, or NULL if no session captures
+ * the interface. A plain vector index, cheap enough to be done for every
+ * packet.
+ */
+static_always_inline u32 *
+wireshark_bridge_interface_sessions (wireshark_bridge_main_t *wbm, u32 sw_if_index)
+{
+  if (sw_if_index >= vec_len (wbm->session_indices_by_sw_if_index))
+    return NULL;
+
+  return wbm->session_indices_by_sw_if_index[sw_if_index];
+}
+
+/**
+ * @brief Find interface in a session's registry
+ */
+static_always_inline wireshark_bridge_interface_t *
+wireshark_bridge_find_interface (wireshark_bridge_session_t *s, u32 sw_if_index)
+{
+  u32 index;
+
+  if (sw_if_index >= vec_len (s->interface_index_by_sw_if_index))
+    return NULL;
+
+  index = s->interface_index_by_sw_if_index[sw_if_index];
+  if (index >= vec_len (s->interfaces))
+    return NULL;
+
+  return &s->interfaces[index];
+}
+
+/**
+ * @brief Count a capture event of an interface on a worker
+ */
+static_always_inline void
+wireshark_bridge_interface_count (wireshark_bridge_interface_counter_t counter,
+                                  u32 thread_index, u32 sw_if_index)
+{
+  vlib_increment_simple_counter (&wireshark_bridge_main.interface_counters[counter],
+                                 thread_index, sw_if_index, 1);
+}
+
+/**
+ * @brief Apply the sampling and rate limits of an interface to a packet
+ *
+ * Runs on the worker @c thread_index and only touches that worker's
+ * state. Sampling is deterministic, the first of every sample_rate
+ * packets is kept. The rate limits are token buckets refilled at the
+ * worker's share of the configured rate; with traffic spread unevenly
+ * over the workers the total can stay below the limit, never above it.
+ *
+ * @param n_bytes  number of bytes that will be captured
+ * @return 1 if the packet should be captured, 0 otherwise
+ */
+static_always_inline int
+wireshark_bridge_interface_admit (wireshark_bridge_interface_t *wbi, u32 thread_index,
+                                  u32 n_bytes, f64 now)
+{
+  wireshark_bridge_interface_worker_t *w;
+
+  if (PREDICT_TRUE (wbi->sample_rate <= 1 && wbi->max_pps == 0 && wbi->max_bps == 0))
+    return 1;
+
+  w = &wbi->workers[thread_index];
+
+  if (wbi->sample_rate > 1)
+    {
+      u32 n = w->sample_count++;
+
+      if (w->sample_count >= wbi->sample_rate)
+        w->sample_count = 0;
+
+      if (n != 0)
+        {
+          w->sampled_out++;
+          wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_SAMPLED_OUT,
+                                            thread_index, wbi->sw_if_index);
+          return 0;
+        }
+    }
+
+  if (wbi->max_pps == 0 && wbi->max_bps == 0)
+    return 1;
+
+  /* Refill with the time elapsed since the last packet, start full */
+  f64 pps_depth = clib_max (wbi->worker_pps * WIRESHARK_BRIDGE_POLICER_BURST_SEC, 1.0);
+  f64 byte_depth = wbi->worker_bytes_per_sec * WIRESHARK_BRIDGE_POLICER_BURST_SEC;
+
+  if (w->last_refill == 0)
+    {
+      w->pps_tokens = pps_depth;
+      w->byte_tokens = byte_depth;
+    }
+  else
+    {
+      f64 dt = now - w->last_refill;
+      w->pps_tokens = clib_min (w->pps_tokens + dt * wbi->worker_pps, pps_depth);
+      w->byte_tokens = clib_min (w->byte_tokens + dt * wbi->worker_bytes_per_sec, byte_depth);
+    }
+  w->last_refill = now;
+
+  /* Byte tokens may go negative so that packets larger than the bucket
+   * still pass, the debt is paid back before the next one */
+  if ((wbi->max_pps && w->pps_tokens < 1.0) ||
+      (wbi->max_bps && w->byte_tokens <= 0))
+    {
+      w->policed++;
+      wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_POLICED,
+                                        thread_index, wbi->sw_if_index);
+      return 0;
+    }
+
+  w->pps_tokens -= 1.0;
+  w->byte_tokens -= n_bytes;
+  return 1;
+}
+
+/**
+ * @brief Timestamp of a captured buffer in nanoseconds since the epoch
+ *
+ * Received packets carry the NIC's rx timestamp when the plugin is built
+ * with WIRESHARK_BRIDGE_HW_TIMESTAMP, hw-timestamps is enabled and the
+ * DPDK driver stored a timestamp in the buffer's mbuf. The NIC clock has
+ * to run in real time (e.g. PTP synchronized, or mlx5 real time
+ * timestamps), it is used as is. Everything else gets @c frame_ns, the
+ * wall clock read once for the whole frame.
+ */
+static_always_inline u64
+wireshark_bridge_buffer_timestamp (wireshark_bridge_main_t *wbm, vlib_buffer_t *b,
+                                   u64 frame_ns, u8 direction)
+{
+#ifdef WIRESHARK_BRIDGE_HW_TIMESTAMP
+  if (direction == WIRESHARK_BRIDGE_DIRECTION_RX && wbm->hw_timestamp_offset >= 0 &&
+      (b->flags & VLIB_BUFFER_EXT_HDR_VALID))
+    {
+      /* The mbuf header sits right in front of the vlib buffer */
+      struct rte_mbuf *mb = ((struct rte_mbuf *) b) - 1;
+
+      if (mb->ol_flags & wbm->hw_timestamp_flag)
+        return *RTE_MBUF_DYNFIELD (mb, wbm->hw_timestamp_offset, rte_mbuf_timestamp_t *);
+    }
+#endif
+
+  return frame_ns;
+}
+
+/**
+ * @brief Free pool buffers the sender thread has finished with
+ *
+ * Runs on the worker owning the ring (or on the main thread with the
+ * worker barrier held), i.e. on the only consumer of free_buffers.
+ * Buffers are returned to the buffer pool in contiguous batches.
+ */
+static_always_inline void
+wireshark_bridge_ring_recycle_buffers (vlib_main_t *vm, wireshark_bridge_ring_t *ring)
+{
+  u32 tail = ring->free_tail;
+  u32 head = clib_atomic_load_acq_n (&ring->free_head);
+
+  while (tail != head)
+    {
+      u32 start = tail & WIRESHARK_BRIDGE_RING_MASK;
+      u32 n_buffers = clib_min (head - tail, WIRESHARK_BRIDGE_RING_SIZE - start);
+
+      vlib_buffer_free (vm, &ring->free_buffers[start], n_buffers);
+      ring->buffers_outstanding -= n_buffers;
+      tail += n_buffers;
+    }
+
+  ring->free_tail = tail;
+}
+
+/**
+ * @brief Copy the first @c n_bytes of a buffer chain
+ */
+static_always_inline void
+wireshark_bridge_copy_chain (vlib_main_t *vm, u8 *dst, vlib_buffer_t *b, u32 n_bytes)
+{
+  while (n_bytes)
+    {
+      u32 n = clib_min (n_bytes, b->current_length);
+
+      clib_memcpy_fast (dst, vlib_buffer_get_current (b), n);
+      dst += n;
+      n_bytes -= n;
+
+      if (!(b->flags & VLIB_BUFFER_NEXT_PRESENT))
+        break;
+      b = vlib_get_buffer (vm, b->next_buffer);
+    }
+}
+
+/**
+ * @brief Copy the first @c n_bytes of a packet, its synthetic Ethernet
+ * header first if it has one (see wireshark_bridge_point_l2_header ())
+ */
+static_always_inline void
+wireshark_bridge_copy_packet (vlib_main_t *vm, u8 *dst, u8 *l2_header, vlib_buffer_t *b,
+                              u32 n_bytes)
+{
+  if (PREDICT_FALSE (l2_header != 0))
+    {
+      u32 n = clib_min (n_bytes, sizeof (ethernet_header_t));
+
+      clib_memcpy_fast (dst, l2_header, n);
+      dst += n;
+      n_bytes -= n;
+    }
+
+  wireshark_bridge_copy_chain (vm, dst, b, n_bytes);
+}
+
+/**
+ * @brief Copy the first @c n_bytes of a packet into a new chain of pool
+ * buffers, its synthetic Ethernet header first if it has one
+ *
+ * @return buffer index of the new chain, ~0 if the worker's buffer cache
+ * ran dry
+ */
+static_always_inline u32
+wireshark_bridge_clone_chain (vlib_main_t *vm, u8 *l2_header, vlib_buffer_t *b, u32 n_bytes,
+                              u16 *n_segments)
+{
+  vlib_buffer_t *first, *last;
+  u32 bi;
+
+  if (vlib_buffer_alloc (vm, &bi, 1) != 1)
+    return ~0;
+
+  first = last = vlib_get_buffer (vm, bi);
+  first->current_length = 0;
+  first->total_length_not_including_first_buffer = 0;
+  *n_segments = 1;
+
+  /* Fits the first, empty buffer */
+  if (PREDICT_FALSE (l2_header != 0))
+    {
+      u32 n = clib_min (n_bytes, sizeof (ethernet_header_t));
+
+      vlib_buffer_chain_append_data_with_alloc (vm, first, &last, l2_header, n);
+      n_bytes -= n;
+    }
+
+  while (n_bytes)
+    {
+      u32 n = clib_min (n_bytes, b->current_length);
+      vlib_buffer_t *prev = last;
+
+      if (vlib_buffer_chain_append_data_with_alloc (vm, first, &last,
+                                                    vlib_buffer_get_current (b), n) != n)
+        {
+          vlib_buffer_free (vm, &bi, 1);
+          return ~0;
+        }
+      *n_segments += last != prev;
+      n_bytes -= n;
+
+      if (!(b->flags & VLIB_BUFFER_NEXT_PRESENT))
+        break;
+      b = vlib_get_buffer (vm, b->next_buffer);
+    }
+
+  return bi;
+}
+
+/**
+ * @brief Size of the header of a packet record taken at a capture point
+ *
+ * Records of the drop point carry the vlib error of the packet, 4 bytes
+ * big-endian, between the 21 byte header and the packet data.
+ */
+static_always_inline u32
+wireshark_bridge_record_header_size (u8 direction)
+{
+  return WIRESHARK_BRIDGE_PACKET_HEADER_SIZE +
+         (direction == WIRESHARK_BRIDGE_DIRECTION_DROP ? WIRESHARK_BRIDGE_DROP_REASON_SIZE : 0);
+}
+
+/**
+ * @brief Write the big-endian header of a packet record, see
+ * wireshark_bridge_record_header_size()
+ */
+static_always_inline void
+wireshark_bridge_write_packet_header (u8 *buffer, wireshark_bridge_packet_t *p)
+{
+  /* Interface index (4 bytes) */
+  buffer[0] = (p->sw_if_index >> 24) & 0xFF;
+  buffer[1] = (p->sw_if_index >> 16) & 0xFF;
+  buffer[2] = (p->sw_if_index >> 8) & 0xFF;
+  buffer[3] = p->sw_if_index & 0xFF;
+
+  /* Timestamp, nanoseconds since the epoch (8 bytes) */
+  buffer[4] = (p->timestamp >> 56) & 0xFF;
+  buffer[5] = (p->timestamp >> 48) & 0xFF;
+  buffer[6] = (p->timestamp >> 40) & 0xFF;
+  buffer[7] = (p->timestamp >> 32) & 0xFF;
+  buffer[8] = (p->timestamp >> 24) & 0xFF;
+  buffer[9] = (p->timestamp >> 16) & 0xFF;
+  buffer[10] = (p->timestamp >> 8) & 0xFF;
+  buffer[11] = p->timestamp & 0xFF;
+
+  /* Captured length (4 bytes) */
+  buffer[12] = (p->packet_length >> 24) & 0xFF;
+  buffer[13] = (p->packet_length >> 16) & 0xFF;
+  buffer[14] = (p->packet_length >> 8) & 0xFF;
+  buffer[15] = p->packet_length & 0xFF;
+
+  /* Original length (4 bytes) */
+  buffer[16] = (p->original_length >> 24) & 0xFF;
+  buffer[17] = (p->original_length >> 16) & 0xFF;
+  buffer[18] = (p->original_length >> 8) & 0xFF;
+  buffer[19] = p->original_length & 0xFF;
+
+  /* Direction (1 byte) */
+  buffer[20] = p->direction;
+
+  /* Drop reason (4 bytes) */
+  if (p->direction == WIRESHARK_BRIDGE_DIRECTION_DROP)
+    clib_mem_unaligned (buffer + 21, u32) = clib_host_to_net_u32 (p->error);
+}
+
+/**
+ * @brief Capture one packet into the worker's ring of a session
+ *
+ * Runs on the worker owning @c ring and only touches that ring, so no
+ * lock is taken on the forwarding path. The packet is copied into the
+ * ring's slot, or with pool-buffers enabled into buffers from the
+ * worker's own buffer cache, nothing is allocated from the heap. Chained
+ * buffers are walked up to @c packet_length. A synthetic @c l2_header,
+ * if any, is copied in front of the buffer's bytes and counts towards
+ * @c packet_length.
+ */
+static_always_inline void
+wireshark_bridge_send_packet (vlib_main_t *vm, wireshark_bridge_ring_t *ring,
+                              wireshark_bridge_session_t *s, u32 sw_if_index,
+                              u8 *l2_header, vlib_buffer_t *b, u32 packet_length,
+                              u32 original_length, u64 timestamp, u8 direction)
+{
+  // Truncate to the configured snaplen before anything is copied
+  if (s->snaplen && packet_length > s->snaplen)
+    packet_length = s->snaplen;
+  packet_length = clib_min (packet_length, WIRESHARK_BRIDGE_MAX_CAPTURE_LENGTH);
+
+  // Check ring space; only this worker writes head
+  u32 head = ring->head;
+  u32 tail = clib_atomic_load_acq_n (&ring->tail);
+  if (head - tail >= WIRESHARK_BRIDGE_RING_SIZE) {
+    // Ring full - count the drop against this worker
+    ring->ring_full_drops++;
+    wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_DROPPED_QUEUE_FULL,
+                                      vm->thread_index, sw_if_index);
+    return;
+  }
+
+  wireshark_bridge_packet_t *packet = &ring->packets[head & WIRESHARK_BRIDGE_RING_MASK];
+
+  if (s->use_pool_buffers) {
+    u32 bi;
+
+    // The sender gathers every buffer of a chain into the same datagram
+    packet_length = clib_min (packet_length, (WIRESHARK_BRIDGE_TX_DATAGRAM_IOVS - 2) *
+                                             vlib_buffer_get_default_data_size (vm));
+
+    // Bounding outstanding chains by the ring size guarantees the
+    // recycle ring can never overflow
+    if (ring->buffers_outstanding >= WIRESHARK_BRIDGE_RING_SIZE ||
+        (bi = wireshark_bridge_clone_chain (vm, l2_header, b, packet_length,
+                                           &packet->n_segments)) == ~0) {
+      ring->ring_full_drops++;
+      wireshark_bridge_interface_count (WIRESHARK_BRIDGE_INTERFACE_COUNTER_DROPPED_QUEUE_FULL,
+                                        vm->thread_index, sw_if_index);
+      return;
+    }
+    ring->buffers_outstanding++;
+
+    packet->packet_data = NULL;
+    packet->buffer_index = bi;
+  } else {
+    // Copy into the slot of this ring position
+    u8 *slot = ring->slots + (head & WIRESHARK_BRIDGE_RING_MASK) * ring->slot_size;
+
+    packet_length = clib_min (packet_length, ring->slot_size);
+    wireshark_bridge_copy_packet (vm, slot, l2_header, b, packet_length);
+
+    packet->packet_data = slot;
+    packet->buffer_index = ~0;
+    packet->n_segments = 1;
+  }
+
+  // Fill in the rest of the ring slot
+  packet->sw_if_index = sw_if_index;
+  packet->thread_index = vm->thread_index;
+  packet->packet_length = packet_length;
+  packet->original_length = original_length;
+  packet->timestamp = timestamp;
+  packet->direction = direction;
+  packet->error = direction == WIRESHARK_BRIDGE_DIRECTION_DROP ? b->error : 0;
+
+  // Publish the slot to the sender thread
+  clib_atomic_store_rel_n (&ring->head, head + 1);
+
+  vlib_increment_combined_counter (&wireshark_bridge_main.combined_counters[
+                                     direction == WIRESHARK_BRIDGE_DIRECTION_TX ?
+                                     WIRESHARK_BRIDGE_COMBINED_COUNTER_MIRRORED_TX :
+                                     WIRESHARK_BRIDGE_COMBINED_COUNTER_MIRRORED_RX],
+                                   vm->thread_index, sw_if_index, 1, packet_length);
+
+  // The sender sleeps while its rings are empty and otherwise until its
+  // batch fills up or times out, so only those two events need a signal
+  if (head == tail || head + 1 - tail == wireshark_bridge_main.batch_size)
+    ring->wakeup_pending = 1;
+}
+
+/**
+ * @brief Record one packet in the worker's flight recorder of a session
+ *
+ * Runs on the worker owning @c ring. The record overwrites the oldest slot
+ * of the recorder, so the cost is a header and a copy of at most the
+ * slot's share of the snaplen, and nothing waits for a reader.
+ */
+static_always_inline void
+wireshark_bridge_record_packet (vlib_main_t *vm, wireshark_bridge_ring_t *ring,
+                                u32 sw_if_index, u8 *l2_header, vlib_buffer_t *b,
+                                u32 packet_length,
+                                u32 original_length, u64 timestamp, u8 direction)
+{
+  wireshark_bridge_recorder_t *r = &ring->recorder;
+  u64 head = r->head;
+  u8 *slot = wireshark_bridge_recorder_slot (r, head);
+  u32 header_size = wireshark_bridge_record_header_size (direction);
+  wireshark_bridge_packet_t p = {
+    .sw_if_index = sw_if_index,
+    .packet_length = clib_min (packet_length, r->slot_size - header_size),
+    .original_length = original_length,
+    .timestamp = timestamp,
+    .direction = direction,
+    .error = direction == WIRESHARK_BRIDGE_DIRECTION_DROP ? b->error : 0,
+  };
+
+  wireshark_bridge_write_packet_header (slot, &p);
+  wireshark_bridge_copy_packet (vm, slot + header_size, l2_header, b, p.packet_length);
+
+  // Publish the record to readers taking a dump
+  clib_atomic_store_rel_n (&r->head, head + 1);
+
+  vlib_increment_combined_counter (&wireshark_bridge_main.combined_counters[
+                                     direction == WIRESHARK_BRIDGE_DIRECTION_TX ?
+                                     WIRESHARK_BRIDGE_COMBINED_COUNTER_MIRRORED_TX :
+                                     WIRESHARK_BRIDGE_COMBINED_COUNTER_MIRRORED_RX],
+                                   vm->thread_index, sw_if_index, 1, p.packet_length);
+}
+
+#endif /* __included_wireshark_bridge_h__ */